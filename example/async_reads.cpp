@@ -0,0 +1,102 @@
+//
+// Created by arnoldm on 19.10.26.
+//
+// A tree in a page file read with direct I/O, so that every miss of the buffer
+// pool goes to the device: lookups one by one against bt::btree::find_batch(),
+// which keeps many reads in flight, and scans with and without read-ahead.
+//
+#include <chrono>
+#include <cstdint>
+#include <format>
+#include <iostream>
+#include <print>
+#include <random>
+#include <span>
+#include <vector>
+#include "btree.h"
+
+using key_type = std::uint64_t;
+using value_type = std::uint64_t;
+using index_type = std::uint32_t;
+
+static constexpr std::size_t PAGE_SIZE = 4096;
+static constexpr std::size_t FRAMES = 1024;
+static constexpr auto internal_order = bt::page_storage_order<bt::btree_internal_node, key_type, value_type, index_type, PAGE_SIZE>();
+static constexpr auto leaf_order = bt::page_storage_order<bt::btree_leaf_node, key_type, value_type, index_type, PAGE_SIZE>();
+
+template<std::size_t Read_ahead>
+using btree_type = bt::btree<key_type, value_type, index_type, internal_order, leaf_order, bt::midpoint_split,
+    bt::rebalance_policy<>, bt::paged_storage<FRAMES, PAGE_SIZE, Read_ahead, true>>;
+
+volatile std::uint64_t sink = 0;
+
+template<typename Action>
+auto measure(Action const &action) -> double {
+    auto t1 = std::chrono::high_resolution_clock::now();
+    action();
+    auto t2 = std::chrono::high_resolution_clock::now();
+    return std::chrono::duration<double>(t2 - t1).count();
+}
+
+static constexpr std::size_t N = 8'000'000;
+static constexpr std::size_t LOOKUPS = 200'000;
+
+template<std::size_t Read_ahead>
+auto scan(std::vector<std::pair<key_type, value_type>> const &entries) -> void {
+    btree_type<Read_ahead> tree;
+    tree.bulk_load(entries);
+    auto const &pool = std::as_const(tree).node_storage();
+    pool.reset_stats();
+    auto seconds = measure([&tree] {
+        std::uint64_t sum = 0;
+        for (auto const &[key, value]: std::as_const(tree))
+            sum += value;
+        sink = sum;
+    });
+    std::println(std::cout, "{:>22} | {:7.3f}s | {:8.2f}M entries/s | {:>7} misses | {:>7} read ahead",
+                 std::format("scan, read-ahead {}", Read_ahead), seconds, double(N) / seconds / 1e6,
+                 pool.stats().misses, pool.stats().prefetches);
+}
+
+int main() {
+    std::mt19937_64 rng{123};
+    std::vector<std::pair<key_type, value_type>> entries(N);
+    for (auto &[key, value]: entries) {
+        key = rng();
+        value = key;
+    }
+    std::vector<key_type> keys(LOOKUPS);
+    for (auto &key: keys)
+        key = entries[rng() % N].first;
+
+    btree_type<16> tree;
+    tree.bulk_load(entries);
+    auto const &pool = std::as_const(tree).node_storage();
+    std::println(std::cout, "btree<uint64_t, uint64_t, uint32_t, {}, {}>, {} nodes of {} bytes, {} frames, direct I/O, {} random entries",
+                 internal_order, leaf_order, tree.node_count(), PAGE_SIZE, FRAMES, N);
+    pool.reset_stats();
+    auto one_by_one = measure([&tree, &keys] {
+        std::uint64_t sum = 0;
+        for (auto key: keys)
+            sum += (*std::as_const(tree).find(key)).second;
+        sink = sum;
+    });
+    std::println(std::cout, "{:>22} | {:7.3f}s | {:8.2f}M lookups/s | {:>7} misses | {:>7} read ahead", "find", one_by_one,
+                 double(LOOKUPS) / one_by_one / 1e6, pool.stats().misses, pool.stats().prefetches);
+    pool.reset_stats();
+    auto batched = measure([&tree, &keys] {
+        // batches of FRAMES / 4 keys, each used while its leaves are in the pool
+        std::uint64_t sum = 0;
+        for (std::size_t first = 0; first < keys.size(); first += FRAMES / 4) {
+            auto batch = std::span(keys).subspan(first, std::min(FRAMES / 4, keys.size() - first));
+            for (auto it: tree.find_batch(batch))
+                sum += (*it).second;
+        }
+        sink = sum;
+    });
+    std::println(std::cout, "{:>22} | {:7.3f}s | {:8.2f}M lookups/s | {:>7} misses | {:>7} read ahead", "find_batch", batched,
+                 double(LOOKUPS) / batched / 1e6, pool.stats().misses, pool.stats().prefetches);
+    scan<1>(entries);
+    scan<16>(entries);
+    scan<64>(entries);
+}
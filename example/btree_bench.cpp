@@ -0,0 +1,617 @@
+//
+// Created by arnoldm on 19.10.26.
+//
+// Benchmark suite: standard workloads on bt::btree against std::map,
+// std::multimap, a sorted std::vector and std::flat_map (where the standard
+// library has it), for a key/value type chosen at configure time and sizes
+// chosen on the command line. Prints a table, or writes CSV or JSON for
+// tracking results over time.
+//
+#include <algorithm>
+#include <array>
+#include <chrono>
+#include <cstdint>
+#include <format>
+#include <fstream>
+#include <functional>
+#include <iostream>
+#include <limits>
+#include <map>
+#include <numeric>
+#include <optional>
+#include <print>
+#include <random>
+#include <ranges>
+#include <string>
+#include <string_view>
+#include <utility>
+#include <vector>
+#if __has_include(<flat_map>)
+#include <flat_map>
+#endif
+#include "btree.h"
+#include "key_distributions.h"
+#include "perf_counters.h"
+
+#ifndef BTREE_BENCH_KEY
+#define BTREE_BENCH_KEY std::uint64_t
+#endif
+#ifndef BTREE_BENCH_VALUE
+#define BTREE_BENCH_VALUE std::uint64_t
+#endif
+#ifndef BTREE_BENCH_INDEX
+#define BTREE_BENCH_INDEX std::uint32_t
+#endif
+#define BTREE_BENCH_STR2(x) #x
+#define BTREE_BENCH_STR(x) BTREE_BENCH_STR2(x)
+
+using key_type = BTREE_BENCH_KEY;
+using value_type = BTREE_BENCH_VALUE;
+using index_type = BTREE_BENCH_INDEX;
+using entry_type = std::pair<key_type, value_type>;
+
+template<typename T>
+auto make(std::uint64_t x) -> T {
+    if constexpr (std::is_arithmetic_v<T>)
+        return static_cast<T>(x);
+    else if constexpr (std::is_constructible_v<T, std::string>)
+        return T(std::format("{:020d}", x));
+    else
+        return T(x);
+}
+
+volatile std::size_t sink = 0;
+
+// The containers behind one interface. Inserts of keys present replace the value (upsert) where a workload
+// repeats keys, otherwise keys are unique and insert() is used as is.
+
+template<typename Btree>
+struct btree_container {
+    Btree tree;
+
+    auto insert(key_type const &key, value_type const &value) -> void { tree.insert(key, value); }
+
+    auto upsert(key_type const &key, value_type const &value) -> void {
+        if (auto it = tree.find(key); it != tree.end())
+            (*it).second = value;
+        else
+            tree.insert(key, value);
+    }
+
+    auto contains(key_type const &key) const -> bool { return tree.find(key) != tree.end(); }
+
+    auto erase(key_type const &key) -> void {
+        if (auto it = tree.find(key); it != tree.end())
+            tree.erase(it);
+    }
+
+    auto scan(key_type const &from, std::size_t count) const -> std::size_t {
+        std::size_t n = 0;
+        for (auto it = tree.lower_bound(from); n < count && it != tree.end(); ++it)
+            ++n;
+        return n;
+    }
+};
+
+template<typename Map>
+struct map_container {
+    Map map;
+
+    auto insert(key_type const &key, value_type const &value) -> void { map.emplace(key, value); }
+
+    auto upsert(key_type const &key, value_type const &value) -> void {
+        if (auto it = map.find(key); it != map.end())
+            it->second = value;
+        else
+            map.emplace(key, value);
+    }
+
+    auto contains(key_type const &key) const -> bool { return map.find(key) != map.end(); }
+
+    auto erase(key_type const &key) -> void {
+        if (auto it = map.find(key); it != map.end())
+            map.erase(it);
+    }
+
+    auto scan(key_type const &from, std::size_t count) const -> std::size_t {
+        std::size_t n = 0;
+        for (auto it = map.lower_bound(from); n < count && it != map.end(); ++it)
+            ++n;
+        return n;
+    }
+};
+
+struct sorted_vector_container {
+    std::vector<entry_type> entries;
+
+    auto assign_sorted(std::vector<entry_type> sorted) -> void { entries = std::move(sorted); }
+
+    auto position(key_type const &key) const {
+        return std::ranges::lower_bound(entries, key, {}, &entry_type::first);
+    }
+
+    auto insert(key_type const &key, value_type const &value) -> void {
+        entries.emplace(position(key), key, value);
+    }
+
+    auto upsert(key_type const &key, value_type const &value) -> void {
+        auto it = position(key);
+        if (it != entries.end() && it->first == key)
+            entries[std::size_t(it - entries.begin())].second = value;
+        else
+            entries.emplace(it, key, value);
+    }
+
+    auto contains(key_type const &key) const -> bool {
+        auto it = position(key);
+        return it != entries.end() && it->first == key;
+    }
+
+    auto erase(key_type const &key) -> void {
+        auto it = position(key);
+        if (it != entries.end() && it->first == key)
+            entries.erase(it);
+    }
+
+    auto scan(key_type const &from, std::size_t count) const -> std::size_t {
+        std::size_t n = 0;
+        for (auto it = position(from); n < count && it != entries.end(); ++it)
+            ++n;
+        return n;
+    }
+};
+
+#ifdef __cpp_lib_flat_map
+struct flat_map_container : map_container<std::flat_map<key_type, value_type>> {
+    auto assign_sorted(std::vector<entry_type> const &sorted) -> void {
+        std::vector<key_type> keys;
+        std::vector<value_type> values;
+        for (auto const &[key, value]: sorted) {
+            keys.push_back(key);
+            values.push_back(value);
+        }
+        map.replace(std::move(keys), std::move(values));
+    }
+};
+#endif
+
+static constexpr std::size_t PAGE_SIZE = 4096;
+static constexpr auto page_internal_order = bt::best_order<bt::btree_internal_node, key_type, value_type, index_type, PAGE_SIZE>();
+static constexpr auto page_leaf_order = bt::best_order<bt::btree_leaf_node, key_type, value_type, index_type, PAGE_SIZE>();
+static constexpr auto line_internal_order = bt::best_cache_line_order<bt::btree_internal_node, key_type, value_type, index_type, 8>();
+static constexpr auto line_leaf_order = bt::best_cache_line_order<bt::btree_leaf_node, key_type, value_type, index_type, 8>();
+
+enum class workload {
+    insert_sequential, insert_reverse, insert_random, insert_zipfian, lookup_hit, lookup_miss, scan, erase_random, mixed
+};
+
+struct workload_info {
+    workload w;
+    std::string_view name;
+    // inserting into or erasing from the middle of a sorted vector moves half of it
+    bool quadratic_on_flat;
+};
+
+static constexpr std::array WORKLOADS{
+    workload_info{workload::insert_sequential, "insert_sequential", false},
+    workload_info{workload::insert_reverse, "insert_reverse", true},
+    workload_info{workload::insert_random, "insert_random", true},
+    workload_info{workload::insert_zipfian, "insert_zipfian", true},
+    workload_info{workload::lookup_hit, "lookup_hit", false},
+    workload_info{workload::lookup_miss, "lookup_miss", false},
+    workload_info{workload::scan, "scan", false},
+    workload_info{workload::erase_random, "erase_random", true},
+    workload_info{workload::mixed, "mixed", true},
+};
+
+// keys of range scans
+static constexpr std::size_t SCAN_LENGTH = 100;
+// mixed: 70% lookups, 20% inserts of new keys, 10% erases
+static constexpr unsigned MIXED_LOOKUPS = 70;
+static constexpr unsigned MIXED_INSERTS = 20;
+
+/**
+ * The keys of one size: the present keys are the even numbers below 2n, so the odd ones miss
+ */
+struct key_set {
+    std::vector<key_type> sorted;
+    std::vector<key_type> shuffled;
+    std::vector<key_type> zipfian;
+    std::vector<key_type> misses;
+    std::vector<entry_type> entries;
+
+    key_set(std::size_t n, std::mt19937_64 &rng) {
+        for (std::size_t i = 0; i < n; ++i) {
+            sorted.push_back(make<key_type>(2 * i));
+            misses.push_back(make<key_type>(2 * i + 1));
+        }
+        shuffled = sorted;
+        std::ranges::shuffle(shuffled, rng);
+        std::ranges::shuffle(misses, rng);
+        // the hot keys are spread over the key space
+        zipfian_distribution zipf(n);
+        for (std::size_t i = 0; i < n; ++i)
+            zipfian.push_back(shuffled[zipf(rng)]);
+        for (std::size_t i = 0; i < n; ++i)
+            entries.emplace_back(shuffled[i], make<value_type>(i));
+    }
+};
+
+struct result {
+    std::string container;
+    std::string_view workload_name;
+    std::size_t n;
+    std::size_t operations;
+    double seconds;
+    perf_values counts;
+};
+
+using clock_type = std::chrono::high_resolution_clock;
+
+// the hardware counters with --counters, else null
+perf_counters *counters = nullptr;
+
+struct measurement {
+    double seconds;
+    perf_values counts;
+};
+
+template<typename Action>
+auto measure(Action const &action) -> measurement {
+    measurement m{};
+    {
+        perf_scope scope(counters, m.counts);
+        auto t1 = clock_type::now();
+        action();
+        auto t2 = clock_type::now();
+        m.seconds = std::chrono::duration<double>(t2 - t1).count();
+    }
+    return m;
+}
+
+/**
+ * @brief A container filled with the keys of set in random order; flat containers get them sorted at once
+ */
+template<typename Container>
+auto filled(key_set const &set) -> Container {
+    Container c;
+    if constexpr (requires { c.assign_sorted(set.entries); }) {
+        auto sorted = set.entries;
+        std::ranges::sort(sorted, {}, &entry_type::first);
+        c.assign_sorted(std::move(sorted));
+    } else {
+        for (auto const &[key, value]: set.entries)
+            c.insert(key, value);
+    }
+    return c;
+}
+
+/**
+ * @brief Run workload w on a new Container
+ * @return the number of operations and the seconds and counts they took
+ */
+template<typename Container>
+auto run(workload w, key_set const &set, std::mt19937_64 &rng) -> std::pair<std::size_t, measurement> {
+    auto const n = set.sorted.size();
+    std::size_t found = 0;
+    auto insert_all = [](auto const &keys) {
+        Container c;
+        return std::pair{keys.size(), measure([&c, &keys] {
+            for (std::size_t i = 0; i < keys.size(); ++i)
+                c.insert(keys[i], make<value_type>(i));
+        })};
+    };
+    switch (w) {
+        case workload::insert_sequential:
+            return insert_all(set.sorted);
+        case workload::insert_reverse:
+            return insert_all(std::vector<key_type>(set.sorted.rbegin(), set.sorted.rend()));
+        case workload::insert_random:
+            return insert_all(set.shuffled);
+        case workload::insert_zipfian: {
+            Container c;
+            return {n, measure([&c, &set] {
+                for (std::size_t i = 0; i < set.zipfian.size(); ++i)
+                    c.upsert(set.zipfian[i], make<value_type>(i));
+            })};
+        }
+        case workload::lookup_hit:
+        case workload::lookup_miss: {
+            auto const c = filled<Container>(set);
+            auto const &probes = w == workload::lookup_hit ? set.shuffled : set.misses;
+            auto seconds = measure([&c, &probes, &found] {
+                for (auto const &key: probes)
+                    found += c.contains(key);
+            });
+            sink = sink + found;
+            return {n, seconds};
+        }
+        case workload::scan: {
+            auto const c = filled<Container>(set);
+            auto const scans = std::max<std::size_t>(1, n / SCAN_LENGTH);
+            auto seconds = measure([&c, &set, &found, scans] {
+                for (std::size_t i = 0; i < scans; ++i)
+                    found += c.scan(set.shuffled[i], SCAN_LENGTH);
+            });
+            sink = sink + found;
+            return {scans, seconds};
+        }
+        case workload::erase_random: {
+            auto c = filled<Container>(set);
+            return {n, measure([&c, &set] {
+                for (auto const &key: set.shuffled)
+                    c.erase(key);
+            })};
+        }
+        case workload::mixed: {
+            auto c = filled<Container>(set);
+            // operations drawn beforehand: lookups of present keys, inserts of the missing keys, erases
+            std::vector<std::pair<unsigned, std::size_t>> operations(n);
+            std::uniform_int_distribution<unsigned> percent(0, 99);
+            std::uniform_int_distribution<std::size_t> pick(0, n - 1);
+            for (auto &[kind, index]: operations) {
+                kind = percent(rng);
+                index = pick(rng);
+            }
+            auto seconds = measure([&c, &set, &operations, &found] {
+                std::size_t inserted = 0;
+                for (auto const &[kind, index]: operations) {
+                    if (kind < MIXED_LOOKUPS)
+                        found += c.contains(set.shuffled[index]);
+                    else if (kind < MIXED_LOOKUPS + MIXED_INSERTS)
+                        c.insert(set.misses[inserted++], make<value_type>(index));
+                    else
+                        c.erase(set.shuffled[index]);
+                }
+            });
+            sink = sink + found;
+            return {n, seconds};
+        }
+    }
+    return {0, {}};
+}
+
+struct options {
+    std::vector<std::size_t> sizes{100'000, 1'000'000};
+    unsigned repetitions = 3;
+    std::size_t flat_limit = 100'000;
+    std::string format = "table";
+    std::string output;
+    std::vector<std::string> workloads;
+    std::vector<std::string> containers;
+    // indexes into PERF_EVENT_NAMES of the counters to report
+    std::vector<std::size_t> events;
+};
+
+auto split(std::string_view list) -> std::vector<std::string> {
+    std::vector<std::string> items;
+    for (auto part: std::views::split(list, ','))
+        items.emplace_back(part.begin(), part.end());
+    return items;
+}
+
+auto selected(std::vector<std::string> const &names, std::string_view name) -> bool {
+    return names.empty() || std::ranges::find(names, name) != names.end();
+}
+
+template<typename Container>
+auto bench(std::string_view name, bool flat, options const &opts, std::vector<key_set> const &sets,
+           std::vector<result> &results) -> void {
+    if (!selected(opts.containers, name))
+        return;
+    std::mt19937_64 rng{4711};
+    for (auto const &set: sets) {
+        auto const n = set.sorted.size();
+        for (auto const &info: WORKLOADS) {
+            if (!selected(opts.workloads, info.name) || (flat && info.quadratic_on_flat && n > opts.flat_limit))
+                continue;
+            result r{std::string(name), info.name, n, 0, std::numeric_limits<double>::max(), {}};
+            for (unsigned rep = 0; rep < opts.repetitions; ++rep) {
+                auto const [operations, m] = run<Container>(info.w, set, rng);
+                r.operations = operations;
+                if (m.seconds < r.seconds) {
+                    r.seconds = m.seconds;
+                    r.counts = m.counts;
+                }
+            }
+            if (opts.format == "table")
+                std::println(std::cerr, "{:>18} | {:>17} | {:>9} | {:9.1f} ns/op", r.container, r.workload_name, r.n,
+                             r.seconds * 1e9 / double(r.operations));
+            results.push_back(std::move(r));
+        }
+    }
+}
+
+/**
+ * @return the count of event per operation of r, if it was counted
+ */
+auto per_operation(result const &r, std::size_t event) -> std::optional<double> {
+    if (!r.counts[event])
+        return std::nullopt;
+    return *r.counts[event] / double(r.operations);
+}
+
+auto write_csv(std::ostream &out, std::vector<result> const &results, std::vector<std::size_t> const &events) -> void {
+    std::print(out, "container,workload,n,key,value,operations,seconds,ns_per_op,ops_per_second");
+    for (auto event: events)
+        std::print(out, ",{}_per_op", PERF_EVENT_NAMES[event]);
+    std::println(out, "");
+    for (auto const &r: results) {
+        std::print(out, "{},{},{},{},{},{},{:.6f},{:.2f},{:.0f}", r.container, r.workload_name, r.n,
+                   BTREE_BENCH_STR(BTREE_BENCH_KEY), BTREE_BENCH_STR(BTREE_BENCH_VALUE), r.operations, r.seconds,
+                   r.seconds * 1e9 / double(r.operations), double(r.operations) / r.seconds);
+        // empty where the counter is not available
+        for (auto event: events)
+            if (auto count = per_operation(r, event))
+                std::print(out, ",{:.3f}", *count);
+            else
+                std::print(out, ",");
+        std::println(out, "");
+    }
+}
+
+auto write_json(std::ostream &out, std::vector<result> const &results, std::vector<std::size_t> const &events) -> void {
+    std::println(out, "{{\"key\": \"{}\", \"value\": \"{}\", \"results\": [", BTREE_BENCH_STR(BTREE_BENCH_KEY),
+                 BTREE_BENCH_STR(BTREE_BENCH_VALUE));
+    for (std::size_t i = 0; i < results.size(); ++i) {
+        auto const &r = results[i];
+        std::print(out, "  {{\"container\": \"{}\", \"workload\": \"{}\", \"n\": {}, \"operations\": {}, "
+                        "\"seconds\": {:.6f}, \"ns_per_op\": {:.2f}, \"ops_per_second\": {:.0f}",
+                   r.container, r.workload_name, r.n, r.operations, r.seconds, r.seconds * 1e9 / double(r.operations),
+                   double(r.operations) / r.seconds);
+        // null where the counter is not available
+        for (auto event: events)
+            if (auto count = per_operation(r, event))
+                std::print(out, ", \"{}_per_op\": {:.3f}", PERF_EVENT_NAMES[event], *count);
+            else
+                std::print(out, ", \"{}_per_op\": null", PERF_EVENT_NAMES[event]);
+        std::println(out, "}}{}", i + 1 < results.size() ? "," : "");
+    }
+    std::println(out, "]}}");
+}
+
+/**
+ * @brief A row per workload and size, a column of ns per operation per container
+ */
+auto write_table(std::ostream &out, std::vector<result> const &results) -> void {
+    std::vector<std::string> containers;
+    for (auto const &r: results)
+        if (std::ranges::find(containers, r.container) == containers.end())
+            containers.push_back(r.container);
+    std::print(out, "{:>17} | {:>9}", "ns/op", "n");
+    for (auto const &c: containers)
+        std::print(out, " | {:>18}", c);
+    std::println(out, "");
+    for (auto const &info: WORKLOADS) {
+        std::vector<std::size_t> sizes;
+        for (auto const &r: results)
+            if (r.workload_name == info.name && std::ranges::find(sizes, r.n) == sizes.end())
+                sizes.push_back(r.n);
+        for (auto n: sizes) {
+            std::print(out, "{:>17} | {:>9}", info.name, n);
+            for (auto const &c: containers) {
+                auto it = std::ranges::find_if(results, [&](result const &r) {
+                    return r.container == c && r.workload_name == info.name && r.n == n;
+                });
+                if (it == results.end())
+                    std::print(out, " | {:>18}", "-");
+                else
+                    std::print(out, " | {:18.1f}", it->seconds * 1e9 / double(it->operations));
+            }
+            std::println(out, "");
+        }
+    }
+}
+
+/**
+ * @brief A row per container, workload and size, a column of counts per operation per event
+ */
+auto write_counter_table(std::ostream &out, std::vector<result> const &results,
+                         std::vector<std::size_t> const &events) -> void {
+    std::print(out, "{:>18} | {:>17} | {:>9}", "per op", "workload", "n");
+    for (auto event: events)
+        std::print(out, " | {:>13}", PERF_EVENT_NAMES[event]);
+    std::println(out, "");
+    for (auto const &r: results) {
+        std::print(out, "{:>18} | {:>17} | {:>9}", r.container, r.workload_name, r.n);
+        for (auto event: events)
+            if (auto count = per_operation(r, event))
+                std::print(out, " | {:13.2f}", *count);
+            else
+                std::print(out, " | {:>13}", "-");
+        std::println(out, "");
+    }
+}
+
+int main(int argc, char *argv[]) {
+    options opts;
+    for (int i = 1; i + 1 < argc; i += 2) {
+        std::string_view option = argv[i];
+        std::string_view arg = argv[i + 1];
+        if (option == "--n") {
+            opts.sizes.clear();
+            for (auto const &size: split(arg))
+                opts.sizes.push_back(std::stoull(size));
+        } else if (option == "--repeat") {
+            opts.repetitions = static_cast<unsigned>(std::stoul(std::string(arg)));
+        } else if (option == "--flat-limit") {
+            opts.flat_limit = std::stoull(std::string(arg));
+        } else if (option == "--format" && (arg == "table" || arg == "csv" || arg == "json")) {
+            opts.format = arg;
+        } else if (option == "--output") {
+            opts.output = arg;
+        } else if (option == "--workloads") {
+            opts.workloads = split(arg);
+        } else if (option == "--containers") {
+            opts.containers = split(arg);
+        } else if (option == "--counters") {
+            for (auto const &name: arg == "all" ? std::vector<std::string>(PERF_EVENT_NAMES.begin(), PERF_EVENT_NAMES.end())
+                                                : split(arg)) {
+                auto it = std::ranges::find(PERF_EVENT_NAMES, name);
+                if (it == PERF_EVENT_NAMES.end()) {
+                    argc = -1;
+                    break;
+                }
+                opts.events.push_back(static_cast<std::size_t>(it - PERF_EVENT_NAMES.begin()));
+            }
+            if (argc < 0)
+                break;
+        } else {
+            argc = -1;
+            break;
+        }
+    }
+    if (argc < 0 || argc % 2 == 0) {
+        std::println(std::cerr, "usage: {} [--n N,...] [--repeat R] [--flat-limit N] [--format table|csv|json] "
+                                "[--output file] [--workloads w,...] [--containers c,...] [--counters all|event,...]",
+                     argv[0]);
+        return 1;
+    }
+
+    std::optional<perf_counters> hardware_counters;
+    if (!opts.events.empty()) {
+        hardware_counters.emplace();
+        if (hardware_counters->available())
+            counters = &*hardware_counters;
+        if (!hardware_counters->unavailable_reason().empty())
+            std::println(std::cerr, "{} ({}), reporting {}", counters ? "some counters unavailable" : "no counters",
+                         hardware_counters->unavailable_reason(), counters ? "the others" : "time only");
+    }
+
+    std::mt19937_64 rng{123};
+    std::vector<key_set> sets;
+    for (auto n: opts.sizes)
+        sets.emplace_back(std::max<std::size_t>(n, 1), rng);
+    if (opts.format == "table")
+        std::println(std::cerr, "key {}, value {}, best of {} runs; sorted vector and flat_map insert and erase "
+                                "workloads up to n = {}", BTREE_BENCH_STR(BTREE_BENCH_KEY),
+                     BTREE_BENCH_STR(BTREE_BENCH_VALUE), opts.repetitions, opts.flat_limit);
+
+    std::vector<result> results;
+    bench<btree_container<bt::btree<key_type, value_type, index_type, line_internal_order, line_leaf_order>>>(
+        std::format("btree<{},{}>", line_internal_order, line_leaf_order), false, opts, sets, results);
+    bench<btree_container<bt::btree<key_type, value_type, index_type, page_internal_order, page_leaf_order>>>(
+        std::format("btree<{},{}>", page_internal_order, page_leaf_order), false, opts, sets, results);
+    bench<map_container<std::map<key_type, value_type>>>("std::map", false, opts, sets, results);
+    bench<map_container<std::multimap<key_type, value_type>>>("std::multimap", false, opts, sets, results);
+    bench<sorted_vector_container>("sorted_vector", true, opts, sets, results);
+#ifdef __cpp_lib_flat_map
+    bench<flat_map_container>("std::flat_map", true, opts, sets, results);
+#endif
+
+    std::ofstream file;
+    if (!opts.output.empty())
+        file.open(opts.output);
+    auto &out = opts.output.empty() ? std::cout : file;
+    if (opts.format == "csv")
+        write_csv(out, results, opts.events);
+    else if (opts.format == "json")
+        write_json(out, results, opts.events);
+    else {
+        write_table(out, results);
+        if (counters) {
+            std::println(out, "");
+            write_counter_table(out, results, opts.events);
+        }
+    }
+}
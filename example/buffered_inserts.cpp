@@ -0,0 +1,74 @@
+//
+// Created by arnoldm on 19.10.26.
+//
+// Random inserts into a tree of 10 times the size of the last level cache: bt::btree::insert
+// against bt::buffered_btree with message buffers of 4 and 16 times the internal order, and
+// the cost of lookups which consult the buffers. The number of entries can be given as argument.
+//
+#include <chrono>
+#include <cstdint>
+#include <cstdlib>
+#include <iostream>
+#include <print>
+#include <random>
+#include <string>
+#include <unistd.h>
+#include <vector>
+#include "btree.h"
+#include "buffered_btree.h"
+
+using key_type = std::uint64_t;
+using value_type = std::uint64_t;
+using index_type = std::uint32_t;
+
+static constexpr std::size_t PAGE_SIZE = 4096;
+static constexpr auto internal_order = bt::best_order<bt::btree_internal_node, key_type, value_type, index_type, PAGE_SIZE>();
+static constexpr auto leaf_order = bt::best_order<bt::btree_leaf_node, key_type, value_type, index_type, PAGE_SIZE>();
+using btree_type = bt::btree<key_type, value_type, index_type, internal_order, leaf_order>;
+template<std::size_t Buffer_size>
+using buffered_btree_type = bt::buffered_btree<key_type, value_type, index_type, internal_order, leaf_order, Buffer_size>;
+
+volatile std::size_t sink = 0;
+
+auto seconds_since(auto start) {
+    return std::chrono::duration<double>(std::chrono::high_resolution_clock::now() - start).count();
+}
+
+template<typename Tree>
+auto run(std::string const &name, std::vector<key_type> const &keys, std::vector<key_type> const &probes) -> void {
+    Tree tree;
+    auto start = std::chrono::high_resolution_clock::now();
+    for (auto key: keys)
+        tree.insert(key, key);
+    auto insert_seconds = seconds_since(start);
+    start = std::chrono::high_resolution_clock::now();
+    std::size_t found = 0;
+    for (auto key: probes)
+        found += tree.contains(key);
+    auto lookup_seconds = seconds_since(start);
+    sink = sink + found;
+    std::println(std::cout, "{:>28} | {:9.2f} | {:9.2f}", name, static_cast<double>(keys.size()) / insert_seconds / 1e6,
+                 static_cast<double>(probes.size()) / lookup_seconds / 1e6);
+}
+
+int main(int argc, char *argv[]) {
+    static constexpr std::size_t LOOKUPS = 1'000'000;
+    auto llc_size = sysconf(_SC_LEVEL3_CACHE_SIZE);
+    auto cache_size = static_cast<std::size_t>(llc_size > 0 ? llc_size : 32L << 20);
+    auto n = argc > 1 ? std::strtoull(argv[1], nullptr, 10) : 10 * cache_size / (sizeof(key_type) + sizeof(value_type));
+
+    std::mt19937_64 rng{123};
+    std::vector<key_type> keys(n);
+    for (auto &key: keys)
+        key = rng();
+    std::vector<key_type> probes(LOOKUPS);
+    for (auto &probe: probes)
+        probe = keys[rng() % n];
+
+    std::println(std::cout, "btree<uint64_t, uint64_t, uint32_t, {}, {}>, {} random inserts, last level cache {} MB",
+                 internal_order, leaf_order, n, cache_size >> 20);
+    std::println(std::cout, "{:>28} | {:>9} | {:>9}", "million", "inserts/s", "lookups/s");
+    run<btree_type>("btree", keys, probes);
+    run<buffered_btree_type<4 * internal_order>>("buffered_btree, 4 x order", keys, probes);
+    run<buffered_btree_type<16 * internal_order>>("buffered_btree, 16 x order", keys, probes);
+}
@@ -0,0 +1,70 @@
+//
+// Created by arnoldm on 19.10.26.
+//
+// Building a btree from unsorted entries: inserting one by one, bulk_load()
+// and bulk_load() on a bt::thread_pool of 1 to N threads.
+//
+#include <chrono>
+#include <cstdint>
+#include <format>
+#include <iostream>
+#include <print>
+#include <random>
+#include <thread>
+#include <utility>
+#include <vector>
+#include "btree.h"
+
+using key_type = std::uint64_t;
+using value_type = std::uint64_t;
+using index_type = std::uint32_t;
+
+static constexpr std::size_t PAGE_SIZE = 4096;
+static constexpr auto internal_order = bt::best_order<bt::btree_internal_node, key_type, value_type, index_type, PAGE_SIZE>();
+static constexpr auto leaf_order = bt::best_order<bt::btree_leaf_node, key_type, value_type, index_type, PAGE_SIZE>();
+using btree_type = bt::btree<key_type, value_type, index_type, internal_order, leaf_order>;
+
+volatile std::size_t sink = 0;
+
+template<typename Build>
+auto measure(Build const &build) -> double {
+    auto t1 = std::chrono::high_resolution_clock::now();
+    btree_type tree = build();
+    auto t2 = std::chrono::high_resolution_clock::now();
+    sink = sink + tree.node_count();
+    return std::chrono::duration<double>(t2 - t1).count();
+}
+
+int main() {
+    static constexpr std::size_t N = 20'000'000;
+    std::mt19937_64 rng{123};
+    std::vector<std::pair<key_type, value_type>> entries(N);
+    for (auto &[key, value]: entries) {
+        key = rng();
+        value = key;
+    }
+
+    std::println(std::cout, "btree<uint64_t, uint64_t, uint32_t, {}, {}>, {} random entries", internal_order, leaf_order, N);
+    auto inserts = measure([&entries] {
+        btree_type tree;
+        for (auto const &[key, value]: entries)
+            tree.insert(key, value);
+        return tree;
+    });
+    std::println(std::cout, "{:>24} | {:8.3f}s", "insert one by one", inserts);
+    auto serial = measure([&entries] {
+        btree_type tree;
+        tree.bulk_load(entries);
+        return tree;
+    });
+    std::println(std::cout, "{:>24} | {:8.3f}s | {:8.2f}x", "bulk_load", serial, inserts / serial);
+    for (unsigned threads = 1; threads <= std::max(1U, std::thread::hardware_concurrency()); threads *= 2) {
+        bt::thread_pool pool(threads);
+        auto parallel = measure([&entries, &pool] {
+            btree_type tree;
+            tree.bulk_load(entries, pool);
+            return tree;
+        });
+        std::println(std::cout, "{:>24} | {:8.3f}s | {:8.2f}x", std::format("bulk_load, {} threads", threads), parallel, inserts / parallel);
+    }
+}
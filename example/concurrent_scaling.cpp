@@ -0,0 +1,147 @@
+//
+// Created by arnoldm on 19.10.26.
+//
+// Throughput of bt::concurrent_btree, bt::olc_btree and bt::sharded_btree
+// from 1 to N threads for mixed read/write workloads, compared to a
+// bt::btree behind one global std::shared_mutex.
+//
+#include <algorithm>
+#include <atomic>
+#include <barrier>
+#include <chrono>
+#include <cstdint>
+#include <format>
+#include <iostream>
+#include <mutex>
+#include <print>
+#include <random>
+#include <shared_mutex>
+#include <string_view>
+#include <thread>
+#include <vector>
+#include "concurrent_btree.h"
+#include "olc_btree.h"
+#include "sharded_btree.h"
+
+using key_type = std::uint64_t;
+using value_type = std::uint64_t;
+using index_type = std::uint32_t;
+
+static constexpr std::size_t PAGE_SIZE = 4096;
+static constexpr auto internal_order = bt::best_order<bt::btree_internal_node, key_type, value_type, index_type, PAGE_SIZE>();
+static constexpr auto leaf_order = bt::best_order<bt::btree_leaf_node, key_type, value_type, index_type, PAGE_SIZE>();
+using btree_type = bt::btree<key_type, value_type, index_type, internal_order, leaf_order>;
+using concurrent_btree_type = bt::concurrent_btree<key_type, value_type, index_type, internal_order, leaf_order>;
+using olc_btree_type = bt::olc_btree<key_type, value_type, index_type, internal_order, leaf_order>;
+
+static constexpr std::size_t PRELOAD = 1'000'000;
+static constexpr std::size_t OPERATIONS = 4'000'000;
+
+// keys go up to about 2 * PRELOAD, split into 64 equal ranges
+class sharded_btree_type : public bt::sharded_btree<key_type, value_type, index_type, internal_order, leaf_order> {
+public:
+    sharded_btree_type() : sharded_btree(boundaries()) {}
+
+private:
+    static auto boundaries() -> std::vector<key_type> {
+        std::vector<key_type> result;
+        for (key_type i = 1; i < 64; ++i)
+            result.push_back(i * 2 * PRELOAD / 64);
+        return result;
+    }
+};
+
+// the btree behind one global latch, as used before concurrent_btree existed
+class global_latch_btree {
+public:
+    auto insert(key_type key, value_type value) -> bool {
+        std::unique_lock lock(latch_);
+        return tree_.insert(key, value);
+    }
+    auto erase(key_type key) -> std::size_t {
+        std::unique_lock lock(latch_);
+        auto it = tree_.find(key);
+        if (it == tree_.end())
+            return 0;
+        return tree_.erase(it);
+    }
+    auto contains(key_type key) const -> bool {
+        std::shared_lock lock(latch_);
+        return tree_.contains(key);
+    }
+
+private:
+    mutable std::shared_mutex latch_;
+    btree_type tree_;
+};
+
+struct workload {
+    std::string_view name;
+    unsigned read_percent;
+};
+
+volatile std::size_t sink = 0;
+
+template<typename Tree>
+auto run(unsigned thread_count, workload const &w, std::size_t preload, std::size_t operations) -> double {
+    Tree tree;
+    for (std::size_t i = 0; i < preload; ++i)
+        tree.insert(2 * i, i);
+    std::barrier start(thread_count + 1);
+    std::vector<std::thread> threads;
+    std::atomic<std::size_t> found = 0;
+    for (unsigned t = 0; t < thread_count; ++t) {
+        threads.emplace_back([&, t] {
+            std::mt19937_64 rng{t};
+            std::size_t local_found = 0;
+            // writers insert odd keys of their own and erase them again, readers look up random even keys
+            key_type next_key = 2 * t + 1;
+            std::vector<key_type> inserted;
+            start.arrive_and_wait();
+            for (std::size_t i = 0; i < operations / thread_count; ++i) {
+                if (rng() % 100 < w.read_percent) {
+                    local_found += tree.contains(2 * (rng() % preload));
+                } else if (inserted.size() < 1024 || rng() % 2 == 0) {
+                    tree.insert(next_key, next_key);
+                    inserted.push_back(next_key);
+                    next_key += 2 * thread_count;
+                } else {
+                    auto j = rng() % inserted.size();
+                    tree.erase(inserted[j]);
+                    inserted[j] = inserted.back();
+                    inserted.pop_back();
+                }
+            }
+            found += local_found;
+        });
+    }
+    start.arrive_and_wait();
+    auto t1 = std::chrono::high_resolution_clock::now();
+    for (auto &thread: threads)
+        thread.join();
+    auto t2 = std::chrono::high_resolution_clock::now();
+    sink = sink + found;
+    return static_cast<double>(operations) / std::chrono::duration<double>(t2 - t1).count() / 1e6;
+}
+
+int main() {
+    std::vector<unsigned> thread_counts{1};
+    for (unsigned n = 2; n <= std::max(1U, std::thread::hardware_concurrency()); n *= 2)
+        thread_counts.push_back(n);
+    std::vector<workload> workloads{{"read 95%", 95}, {"read 50%", 50}, {"read 5%", 5}};
+
+    std::println(std::cout, "btree<uint64_t, uint64_t, uint32_t, {}, {}>, {} key/values, {} operations, Mops/s",
+                 internal_order, leaf_order, PRELOAD, OPERATIONS);
+    std::println(std::cout, "{:>10} | {:>7} | {:>14} | {:>16} | {:>9} | {:>13}", "workload", "threads", "global latch", "concurrent_btree",
+                 "olc_btree", "sharded_btree");
+    for (auto const &w: workloads) {
+        for (auto thread_count: thread_counts) {
+            auto global = run<global_latch_btree>(thread_count, w, PRELOAD, OPERATIONS);
+            auto concurrent = run<concurrent_btree_type>(thread_count, w, PRELOAD, OPERATIONS);
+            auto olc = run<olc_btree_type>(thread_count, w, PRELOAD, OPERATIONS);
+            auto sharded = run<sharded_btree_type>(thread_count, w, PRELOAD, OPERATIONS);
+            std::println(std::cout, "{:>10} | {:7} | {:14.2f} | {:16.2f} | {:9.2f} | {:13.2f}", w.name, thread_count, global, concurrent, olc,
+                         sharded);
+        }
+    }
+}
@@ -0,0 +1,78 @@
+//
+// Created by arnoldm on 19.10.26.
+//
+// Tail latency of erases: rebalancing in the erasing call against deferred rebalancing
+// (rebalance_policy Deferred), where bt::btree::maintain() runs with a time budget
+// between batches of requests.
+//
+#include <algorithm>
+#include <chrono>
+#include <cstdint>
+#include <iostream>
+#include <print>
+#include <random>
+#include <string>
+#include <vector>
+#include "btree.h"
+
+using key_type = std::uint64_t;
+using value_type = std::uint64_t;
+using index_type = std::uint32_t;
+
+static constexpr std::size_t PAGE_SIZE = 4096;
+static constexpr auto internal_order = bt::best_order<bt::btree_internal_node, key_type, value_type, index_type, PAGE_SIZE>();
+static constexpr auto leaf_order = bt::best_order<bt::btree_leaf_node, key_type, value_type, index_type, PAGE_SIZE>();
+using btree_type = bt::btree<key_type, value_type, index_type, internal_order, leaf_order>;
+using deferred_btree_type = bt::btree<key_type, value_type, index_type, internal_order, leaf_order, bt::midpoint_split,
+    bt::rebalance_policy<50, 50, false, true>>;
+
+static constexpr std::size_t BATCH = 1'000;
+static constexpr auto BUDGET = std::chrono::microseconds(200);
+
+template<typename Tree>
+auto run(std::string const &name, std::vector<key_type> const &keys, std::vector<key_type> const &erased, bool maintain) -> void {
+    Tree tree;
+    for (auto key: keys)
+        tree.insert(key, key);
+    std::vector<double> latencies;
+    latencies.reserve(erased.size());
+    double maintenance = 0;
+    auto start = std::chrono::steady_clock::now();
+    for (std::size_t i = 0; i < erased.size(); ++i) {
+        auto t1 = std::chrono::steady_clock::now();
+        tree.erase(tree.find(erased[i]));
+        auto t2 = std::chrono::steady_clock::now();
+        latencies.push_back(std::chrono::duration<double, std::micro>(t2 - t1).count());
+        if (maintain && (i + 1) % BATCH == 0) {
+            tree.maintain(BUDGET);
+            maintenance += std::chrono::duration<double>(std::chrono::steady_clock::now() - t2).count();
+        }
+    }
+    auto total = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+    std::ranges::sort(latencies);
+    auto percentile = [&latencies](double p) {
+        return latencies[std::min(latencies.size() - 1, static_cast<std::size_t>(p * static_cast<double>(latencies.size())))];
+    };
+    std::println(std::cout, "{:>22} | {:7.2f} | {:7.2f} | {:7.2f} | {:8.1f} | {:7.3f}s | {:7.3f}s | {:9}", name,
+                 percentile(0.5), percentile(0.99), percentile(0.999), latencies.back(), total, maintenance,
+                 tree.deferred_count());
+}
+
+int main() {
+    static constexpr std::size_t N = 4'000'000;
+    std::mt19937_64 rng{123};
+    std::vector<key_type> keys(N);
+    for (auto &key: keys)
+        key = rng();
+    // erase 3 of 4 keys in random order, so that leaves underflow all the time
+    std::vector<key_type> erased(keys.begin(), keys.begin() + 3 * N / 4);
+    std::ranges::shuffle(erased, rng);
+
+    std::println(std::cout, "btree<uint64_t, uint64_t, uint32_t, {}, {}>, {} random keys, erase {} of them",
+                 internal_order, leaf_order, N, erased.size());
+    std::println(std::cout, "{:>22} | {:>7} | {:>7} | {:>7} | {:>8} | {:>8} | {:>8} | {:>9}", "erase latency (us)",
+                 "p50", "p99", "p99.9", "max", "total", "maintain", "deferred");
+    run<btree_type>("rebalance in erase", keys, erased, false);
+    run<deferred_btree_type>("deferred, maintain()", keys, erased, true);
+    run<deferred_btree_type>("deferred, no maintain", keys, erased, false);
+}
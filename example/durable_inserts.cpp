@@ -0,0 +1,94 @@
+//
+// Created by arnoldm on 19.10.26.
+//
+// Inserts into a bt::durable_btree: every insert durable with group commit
+// from 1, 4 and 16 threads, against deferred commits with one sync at the end
+// and the plain in-memory tree. Writes to a directory in the temp directory.
+//
+#include <algorithm>
+#include <chrono>
+#include <cstdint>
+#include <filesystem>
+#include <format>
+#include <iostream>
+#include <print>
+#include <random>
+#include <string>
+#include <thread>
+#include <vector>
+#include "btree.h"
+#include "durable_btree.h"
+
+using key_type = std::uint64_t;
+using value_type = std::uint64_t;
+using btree_type = bt::btree<key_type, value_type, std::uint32_t, 64, 64>;
+using durable_type = bt::durable_btree<btree_type>;
+
+template<typename Action>
+auto measure(Action const &action) -> double {
+    auto t1 = std::chrono::high_resolution_clock::now();
+    action();
+    auto t2 = std::chrono::high_resolution_clock::now();
+    return std::chrono::duration<double>(t2 - t1).count();
+}
+
+static constexpr std::size_t GROUP_INSERTS = 20'000;
+static constexpr std::size_t DEFERRED_INSERTS = 2'000'000;
+
+auto directory() -> std::filesystem::path {
+    auto path = std::filesystem::temp_directory_path() / "durable_inserts";
+    std::filesystem::remove_all(path);
+    return path;
+}
+
+auto report(std::string const &name, std::size_t inserts, double seconds, durable_type const &tree) -> void {
+    auto const syncs = tree.log().sync_count();
+    std::println(std::cout, "{:>22} | {:8} inserts | {:7.3f}s | {:10.0f} inserts/s | {:>7} syncs | {:7.1f} inserts/sync",
+                 name, inserts, seconds, double(inserts) / seconds, syncs, double(inserts) / double(std::max<std::uint64_t>(syncs, 1)));
+}
+
+auto group_commit(std::vector<key_type> const &keys, unsigned thread_count) -> void {
+    durable_type tree(directory());
+    auto seconds = measure([&tree, &keys, thread_count] {
+        std::vector<std::jthread> threads;
+        for (unsigned t = 0; t < thread_count; ++t)
+            threads.emplace_back([&tree, &keys, thread_count, t] {
+                for (std::size_t i = t; i < GROUP_INSERTS; i += thread_count)
+                    tree.insert(keys[i], i);
+            });
+    });
+    report(std::format("group, {} threads", thread_count), GROUP_INSERTS, seconds, tree);
+}
+
+int main() {
+    std::mt19937_64 rng{123};
+    std::vector<key_type> keys(DEFERRED_INSERTS);
+    for (auto &key: keys)
+        key = rng();
+
+    btree_type memory;
+    auto seconds = measure([&memory, &keys] {
+        for (std::size_t i = 0; i < keys.size(); ++i)
+            memory.insert(keys[i], i);
+    });
+    std::println(std::cout, "{:>22} | {:8} inserts | {:7.3f}s | {:10.0f} inserts/s", "in memory", keys.size(), seconds,
+                 double(keys.size()) / seconds);
+
+    for (auto thread_count: {1U, 4U, 16U})
+        group_commit(keys, thread_count);
+
+    {
+        durable_type tree(directory(), durable_type::commit_mode::deferred);
+        seconds = measure([&tree, &keys] {
+            for (std::size_t i = 0; i < keys.size(); ++i)
+                tree.insert(keys[i], i);
+            tree.sync();
+        });
+        report("deferred, 1 thread", keys.size(), seconds, tree);
+        seconds = measure([&tree] { tree.checkpoint(); });
+        std::println(std::cout, "{:>22} | {:7.3f}s, log {} bytes", "checkpoint", seconds, tree.log().size());
+    }
+    seconds = measure([] { durable_type tree(std::filesystem::temp_directory_path() / "durable_inserts"); });
+    std::println(std::cout, "{:>22} | {:7.3f}s", "open snapshot", seconds);
+    std::filesystem::remove_all(std::filesystem::temp_directory_path() / "durable_inserts");
+}
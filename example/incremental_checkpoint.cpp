@@ -0,0 +1,80 @@
+//
+// Created by arnoldm on 19.10.26.
+//
+// Keeping an image of a big tree up to date: save_image() of the whole tree
+// against bt::btree::checkpoint(), which writes only the nodes changed since
+// the last checkpoint, after rounds of more and more random inserts.
+//
+#include <chrono>
+#include <cstdint>
+#include <filesystem>
+#include <iostream>
+#include <print>
+#include <random>
+#include <vector>
+#include <fcntl.h>
+#include <unistd.h>
+#include "btree.h"
+#include "mapped_btree.h"
+
+using key_type = std::uint64_t;
+using value_type = std::uint64_t;
+using index_type = std::uint32_t;
+
+static constexpr std::size_t PAGE_SIZE = 4096;
+static constexpr auto internal_order = bt::page_storage_order<bt::btree_internal_node, key_type, value_type, index_type, PAGE_SIZE>();
+static constexpr auto leaf_order = bt::page_storage_order<bt::btree_leaf_node, key_type, value_type, index_type, PAGE_SIZE>();
+using btree_type = bt::btree<key_type, value_type, index_type, internal_order, leaf_order>;
+
+template<typename Action>
+auto measure(Action const &action) -> double {
+    auto t1 = std::chrono::high_resolution_clock::now();
+    action();
+    auto t2 = std::chrono::high_resolution_clock::now();
+    return std::chrono::duration<double>(t2 - t1).count();
+}
+
+static constexpr std::size_t N = 10'000'000;
+
+int main() {
+    std::mt19937_64 rng{123};
+    std::vector<std::pair<key_type, value_type>> entries(N);
+    for (auto &[key, value]: entries) {
+        key = rng();
+        value = key;
+    }
+    btree_type tree;
+    tree.bulk_load(entries);
+    auto const path = std::filesystem::temp_directory_path() / "incremental_checkpoint.image";
+    auto const fd = ::open(path.c_str(), O_RDWR | O_CREAT | O_TRUNC, 0644);
+    if (fd < 0)
+        return 1;
+
+    std::println(std::cout, "btree<uint64_t, uint64_t, uint32_t, {}, {}>, {} nodes of {} bytes, {} random entries",
+                 internal_order, leaf_order, tree.node_count(), sizeof(btree_type::common_node_type), N);
+    std::println(std::cout, "{:>8} | {:>22} | {:>22}", "inserts", "save_image", "checkpoint");
+    std::size_t nodes = 0;
+    auto first = measure([&tree, &nodes, fd] {
+        nodes = tree.checkpoint(fd);
+    });
+    std::println(std::cout, "{:>8} | {:>22} | {:7.3f}s {:>7} nodes", 0, "", first, nodes);
+    for (std::size_t inserts : {100, 1'000, 10'000, 100'000}) {
+        for (std::size_t i = 0; i < inserts; ++i)
+            tree.insert(rng(), i);
+        auto whole = measure([&tree, &path] {
+            auto const full_fd = ::open((path.string() + ".full").c_str(), O_WRONLY | O_CREAT | O_TRUNC, 0644);
+            tree.save_image(full_fd);
+            ::fdatasync(full_fd);
+            ::close(full_fd);
+        });
+        auto incremental = measure([&tree, &nodes, fd] {
+            nodes = tree.checkpoint(fd);
+        });
+        std::println(std::cout, "{:>8} | {:7.3f}s {:>7} nodes | {:7.3f}s {:>7} nodes", inserts, whole, tree.node_count(),
+                     incremental, nodes);
+    }
+    ::close(fd);
+    std::println(std::cout, "image verified: {}", bt::mapped_btree<btree_type>(path).verify());
+    std::filesystem::remove(path);
+    std::filesystem::remove(path.string() + ".full");
+}
@@ -0,0 +1,56 @@
+//
+// Created by arnoldm on 19.10.26.
+//
+
+#ifndef KEY_DISTRIBUTIONS_H
+#define KEY_DISTRIBUTIONS_H
+
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+#include <random>
+
+/**
+ * Ranks 0..n-1 with probability proportional to 1 / (rank + 1)^theta, by the method of Gray et al., "Quickly
+ * Generating Billion-Record Synthetic Databases" (as in YCSB). grow() extends the ranks as records are inserted,
+ * adding to zeta(n) incrementally instead of recomputing it.
+ */
+class zipfian_distribution {
+public:
+    explicit zipfian_distribution(std::uint64_t n, double theta = 0.99)
+        : theta_(theta), zeta_2_(1.0 + 1.0 / std::pow(2.0, theta)), alpha_(1.0 / (1.0 - theta)) {
+        grow(n);
+    }
+
+    auto grow(std::uint64_t n) -> void {
+        if (n <= n_)
+            return;
+        for (auto i = n_ + 1; i <= n; ++i)
+            zeta_n_ += 1.0 / std::pow(double(i), theta_);
+        n_ = n;
+        eta_ = (1.0 - std::pow(2.0 / double(n_), 1.0 - theta_)) / (1.0 - zeta_2_ / zeta_n_);
+    }
+
+    [[nodiscard]] auto size() const -> std::uint64_t { return n_; }
+
+    template<typename Rng>
+    auto operator()(Rng &rng) -> std::uint64_t {
+        auto const u = std::uniform_real_distribution<double>(0.0, 1.0)(rng);
+        auto const uz = u * zeta_n_;
+        if (uz < 1.0)
+            return 0;
+        if (uz < 1.0 + std::pow(0.5, theta_))
+            return 1;
+        return std::min(n_ - 1, static_cast<std::uint64_t>(double(n_) * std::pow(eta_ * u - eta_ + 1.0, alpha_)));
+    }
+
+private:
+    std::uint64_t n_ = 0;
+    double theta_;
+    double zeta_2_;
+    double zeta_n_ = 0;
+    double alpha_;
+    double eta_ = 0;
+};
+
+#endif //KEY_DISTRIBUTIONS_H
@@ -0,0 +1,106 @@
+//
+// Created by arnoldm on 19.10.26.
+//
+// Sustained random inserts into bt::lsm_btree against a single bt::btree
+// holding everything, then lookups of present and missing keys and a scan
+// of all entries. Writes its runs to the temp directory.
+//
+#include <chrono>
+#include <cstdint>
+#include <filesystem>
+#include <iostream>
+#include <print>
+#include <random>
+#include <string>
+#include <vector>
+#include "btree.h"
+#include "lsm_btree.h"
+
+using key_type = std::uint64_t;
+using value_type = std::uint64_t;
+using index_type = std::uint32_t;
+
+static constexpr std::size_t PAGE_SIZE = 4096;
+static constexpr auto internal_order = bt::page_storage_order<bt::btree_internal_node, key_type, value_type, index_type, PAGE_SIZE>();
+static constexpr auto leaf_order = bt::page_storage_order<bt::btree_leaf_node, key_type, bt::lsm_entry<value_type>, index_type, PAGE_SIZE>();
+using btree_type = bt::btree<key_type, value_type, index_type, internal_order, leaf_order>;
+using lsm_type = bt::lsm_btree<key_type, value_type, index_type, internal_order, leaf_order>;
+
+template<typename Action>
+auto measure(Action const &action) -> double {
+    auto t1 = std::chrono::high_resolution_clock::now();
+    action();
+    auto t2 = std::chrono::high_resolution_clock::now();
+    return std::chrono::duration<double>(t2 - t1).count();
+}
+
+static constexpr std::size_t N = 20'000'000;
+static constexpr std::size_t LOOKUPS = 1'000'000;
+
+auto report(std::string const &name, std::size_t count, double seconds) -> void {
+    std::println(std::cout, "{:>28} | {:9} | {:7.3f}s | {:10.0f} /s", name, count, seconds, double(count) / seconds);
+}
+
+int main() {
+    std::mt19937_64 rng{123};
+    std::vector<key_type> keys(N);
+    for (auto &key: keys)
+        key = rng();
+    std::vector<key_type> missing(LOOKUPS);
+    for (auto &key: missing)
+        key = rng();
+    std::uniform_int_distribution<std::size_t> pick(0, N - 1);
+    std::vector<key_type> present(LOOKUPS);
+    for (auto &key: present)
+        key = keys[pick(rng)];
+
+    std::size_t found = 0;
+    {
+        btree_type tree;
+        report("btree, inserts", N, measure([&tree, &keys] {
+            for (std::size_t i = 0; i < keys.size(); ++i)
+                tree.insert(keys[i], i);
+        }));
+        report("btree, present keys", LOOKUPS, measure([&tree, &present, &found] {
+            for (auto key: present)
+                found += tree.find(key) != tree.end();
+        }));
+    }
+
+    auto const directory = std::filesystem::temp_directory_path() / "lsm_ingest";
+    std::filesystem::create_directories(directory);
+    lsm_type tree(lsm_type::DEFAULT_MEMTABLE_CAPACITY, 4, directory);
+    report("lsm_btree, inserts", N, measure([&tree, &keys] {
+        for (std::size_t i = 0; i < keys.size(); ++i)
+            tree.insert(keys[i], i);
+    }));
+    std::println(std::cout, "{:>28} | {:9} | {:7.3f}s", "lsm_btree, flush", "", measure([&tree] { tree.flush(); }));
+    auto const stats = tree.stats();
+    std::println(std::cout, "{} runs written, {} merges, {} runs left", stats.runs_written, stats.compactions,
+                 tree.run_count());
+    report("lsm_btree, present keys", LOOKUPS, measure([&tree, &present, &found] {
+        for (auto key: present)
+            found += tree.contains(key);
+    }));
+    auto before = tree.stats();
+    report("lsm_btree, missing keys", LOOKUPS, measure([&tree, &missing, &found] {
+        for (auto key: missing)
+            found += tree.contains(key);
+    }));
+    auto after = tree.stats();
+    std::println(std::cout, "missing keys: {} runs searched, {} skipped by Bloom filters",
+                 after.run_lookups - before.run_lookups, after.filtered_lookups - before.filtered_lookups);
+    std::size_t entries = 0;
+    auto seconds = measure([&tree, &entries] {
+        for ([[maybe_unused]] auto entry: tree.entries())
+            ++entries;
+    });
+    report("lsm_btree, scan", entries, seconds);
+    report("lsm_btree, compact", N, measure([&tree] { tree.compact(); }));
+    report("lsm_btree, present keys", LOOKUPS, measure([&tree, &present, &found] {
+        for (auto key: present)
+            found += tree.contains(key);
+    }));
+    std::println(std::cout, "found {} of {} present keys", found, 3 * LOOKUPS);
+    std::filesystem::remove_all(directory);
+}
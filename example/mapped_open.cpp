@@ -0,0 +1,90 @@
+//
+// Created by arnoldm on 19.10.26.
+//
+// Opening a saved tree: bt::btree::load() of a file written by save() against
+// bt::mapped_btree on an image written by save_image(), and lookups on both.
+//
+#include <chrono>
+#include <cstdint>
+#include <filesystem>
+#include <fstream>
+#include <iostream>
+#include <optional>
+#include <print>
+#include <random>
+#include <vector>
+#include "btree.h"
+#include "mapped_btree.h"
+
+using key_type = std::uint64_t;
+using value_type = std::uint64_t;
+using index_type = std::uint32_t;
+
+static constexpr std::size_t PAGE_SIZE = 4096;
+static constexpr auto internal_order = bt::best_order<bt::btree_internal_node, key_type, value_type, index_type, PAGE_SIZE>();
+static constexpr auto leaf_order = bt::best_order<bt::btree_leaf_node, key_type, value_type, index_type, PAGE_SIZE>();
+using btree_type = bt::btree<key_type, value_type, index_type, internal_order, leaf_order>;
+
+volatile std::uint64_t sink = 0;
+
+template<typename Action>
+auto measure(Action const &action) -> double {
+    auto t1 = std::chrono::high_resolution_clock::now();
+    action();
+    auto t2 = std::chrono::high_resolution_clock::now();
+    return std::chrono::duration<double>(t2 - t1).count();
+}
+
+template<typename Tree>
+auto lookups(Tree const &tree, std::vector<key_type> const &keys) -> double {
+    return measure([&tree, &keys] {
+        std::uint64_t sum = 0;
+        for (auto key: keys)
+            sum += (*tree.find(key)).second;
+        sink = sum;
+    });
+}
+
+int main() {
+    static constexpr std::size_t N = 10'000'000;
+    static constexpr std::size_t LOOKUPS = 1'000'000;
+    std::mt19937_64 rng{123};
+    std::vector<std::pair<key_type, value_type>> entries(N);
+    for (auto &[key, value]: entries) {
+        key = rng();
+        value = key;
+    }
+    std::vector<key_type> keys(LOOKUPS);
+    for (auto &key: keys)
+        key = entries[rng() % N].first;
+    btree_type tree;
+    tree.bulk_load(entries);
+    auto const directory = std::filesystem::temp_directory_path();
+    auto const saved = directory / "mapped_open.btree";
+    auto const image = directory / "mapped_open.image";
+    {
+        std::ofstream out(saved, std::ios::binary);
+        tree.save(out);
+        std::ofstream image_out(image, std::ios::binary);
+        tree.save_image(image_out);
+    }
+
+    std::println(std::cout, "btree<uint64_t, uint64_t, uint32_t, {}, {}>, {} random entries, {} lookups", internal_order, leaf_order, N, LOOKUPS);
+    std::println(std::cout, "{:>12} | {:>10} | {:>10}", "", "open", "lookups/s");
+    btree_type loaded;
+    auto load = measure([&loaded, &saved] {
+        std::ifstream in(saved, std::ios::binary);
+        loaded.load(in);
+    });
+    std::println(std::cout, "{:>12} | {:8.3f}ms | {:8.2f}M", "load", load * 1e3, double(LOOKUPS) / lookups(loaded, keys) / 1e6);
+    std::optional<bt::mapped_btree<btree_type>> mapped;
+    auto open = measure([&mapped, &image] { mapped.emplace(image); });
+    // the first lookups read the pages of the image, the second ones find them mapped
+    auto cold = lookups(*mapped, keys);
+    auto warm = lookups(*mapped, keys);
+    std::println(std::cout, "{:>12} | {:8.3f}ms | {:8.2f}M first, {:.2f}M again", "mapped_btree", open * 1e3,
+                 double(LOOKUPS) / cold / 1e6, double(LOOKUPS) / warm / 1e6);
+    mapped.reset();
+    std::filesystem::remove(saved);
+    std::filesystem::remove(image);
+}
@@ -0,0 +1,135 @@
+//
+// Created by arnoldm on 19.10.26.
+//
+// Compares the storage policies of bt::btree: random point lookups on a big
+// tree with default, cache line aligned, page aligned and huge page backed
+// node storage. Reports lookup latency and dTLB load misses per lookup
+// (perf_event_open, Linux only).
+//
+#include <chrono>
+#include <cstdint>
+#include <cstring>
+#include <format>
+#include <iostream>
+#include <optional>
+#include <print>
+#include <random>
+#include <string_view>
+#include <vector>
+#include "btree.h"
+
+#if defined(__linux__)
+#include <linux/perf_event.h>
+#include <sys/ioctl.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+#endif
+
+using key_type = std::uint64_t;
+using value_type = std::uint64_t;
+using index_type = std::uint32_t;
+
+static constexpr std::size_t PAGE_SIZE = 4096;
+
+// counts dTLB load misses of this thread, if the kernel lets us
+class dtlb_miss_counter {
+public:
+    dtlb_miss_counter() {
+#if defined(__linux__)
+        perf_event_attr attr;
+        std::memset(&attr, 0, sizeof(attr));
+        attr.type = PERF_TYPE_HW_CACHE;
+        attr.size = sizeof(attr);
+        attr.config = PERF_COUNT_HW_CACHE_DTLB | (PERF_COUNT_HW_CACHE_OP_READ << 8) | (PERF_COUNT_HW_CACHE_RESULT_MISS << 16);
+        attr.disabled = 1;
+        attr.exclude_kernel = 1;
+        attr.exclude_hv = 1;
+        fd_ = static_cast<int>(syscall(SYS_perf_event_open, &attr, 0, -1, -1, 0));
+#endif
+    }
+
+    ~dtlb_miss_counter() {
+#if defined(__linux__)
+        if (fd_ >= 0)
+            close(fd_);
+#endif
+    }
+
+    dtlb_miss_counter(dtlb_miss_counter const &) = delete;
+    dtlb_miss_counter &operator=(dtlb_miss_counter const &) = delete;
+
+    void start() {
+#if defined(__linux__)
+        if (fd_ >= 0) {
+            ioctl(fd_, PERF_EVENT_IOC_RESET, 0);
+            ioctl(fd_, PERF_EVENT_IOC_ENABLE, 0);
+        }
+#endif
+    }
+
+    auto stop() -> std::optional<std::uint64_t> {
+#if defined(__linux__)
+        std::uint64_t count = 0;
+        if (fd_ >= 0) {
+            ioctl(fd_, PERF_EVENT_IOC_DISABLE, 0);
+            if (read(fd_, &count, sizeof(count)) == sizeof(count))
+                return count;
+        }
+#endif
+        return std::nullopt;
+    }
+
+private:
+    int fd_ = -1;
+};
+
+volatile std::size_t sink = 0;
+
+template<std::size_t Internal_order, std::size_t Leaf_order, typename Storage_policy>
+void measure(std::string_view name, std::vector<key_type> const &keys, std::vector<key_type> const &probes) {
+    using btree_type = bt::btree<key_type, value_type, index_type, Internal_order, Leaf_order,
+        bt::midpoint_split, bt::rebalance_policy<>, Storage_policy>;
+    btree_type tree;
+    for (auto key: keys)
+        tree.insert(key, key);
+
+    dtlb_miss_counter counter;
+    std::size_t found = 0;
+    counter.start();
+    auto t1 = std::chrono::high_resolution_clock::now();
+    for (auto key: probes)
+        found += tree.contains(key);
+    auto t2 = std::chrono::high_resolution_clock::now();
+    auto misses = counter.stop();
+    sink = sink + found;
+
+    auto const lookups = static_cast<double>(probes.size());
+    std::string miss_text = misses ? std::format("{:12.3f}", static_cast<double>(*misses) / lookups) : std::format("{:>12}", "n/a");
+    std::println(std::cout, "{:>26} | {:10} | {:12.1f} | {}",
+                 name, sizeof(typename btree_type::common_node_type),
+                 std::chrono::duration<double, std::nano>(t2 - t1).count() / lookups, miss_text);
+}
+
+int main() {
+    static constexpr std::size_t N = 16'000'000;
+    static constexpr std::size_t LOOKUPS = 4'000'000;
+    static constexpr auto internal_order = bt::best_order<bt::btree_internal_node, key_type, value_type, index_type, PAGE_SIZE>();
+    static constexpr auto leaf_order = bt::best_order<bt::btree_leaf_node, key_type, value_type, index_type, PAGE_SIZE>();
+    static constexpr auto page_internal_order = bt::page_storage_order<bt::btree_internal_node, key_type, value_type, index_type, PAGE_SIZE>();
+    static constexpr auto page_leaf_order = bt::page_storage_order<bt::btree_leaf_node, key_type, value_type, index_type, PAGE_SIZE>();
+
+    std::mt19937_64 rng{123};
+    std::vector<key_type> keys(N);
+    for (auto &key: keys)
+        key = rng();
+    std::vector<key_type> probes(LOOKUPS);
+    for (auto &probe: probes)
+        probe = keys[rng() % N];
+
+    std::println(std::cout, "btree<uint64_t, uint64_t, uint32_t>, {} key/values, {} random lookups", N, LOOKUPS);
+    std::println(std::cout, "{:>26} | {:>10} | {:>12} | {:>12}", "storage", "node bytes", "ns/lookup", "dTLB/lookup");
+    measure<internal_order, leaf_order, bt::vector_storage>("vector_storage", keys, probes);
+    measure<internal_order, leaf_order, bt::aligned_node_storage<>>("aligned_node_storage<64>", keys, probes);
+    measure<page_internal_order, page_leaf_order, bt::aligned_node_storage<PAGE_SIZE>>("aligned_node_storage<4096>", keys, probes);
+    measure<page_internal_order, page_leaf_order, bt::aligned_node_storage<PAGE_SIZE, true>>("  + huge pages", keys, probes);
+}
@@ -0,0 +1,199 @@
+//
+// Created by arnoldm on 19.10.26.
+//
+// Sweeps Internal_order/Leaf_order of bt::btree for a key/value type, measures
+// insertion, point lookup and scan for every combination and writes the
+// fastest combination as an alias into a generated header.
+//
+#include <algorithm>
+#include <array>
+#include <chrono>
+#include <filesystem>
+#include <format>
+#include <fstream>
+#include <iostream>
+#include <print>
+#include <random>
+#include <string>
+#include <string_view>
+#include <utility>
+#include <vector>
+#include "btree.h"
+
+#ifndef BTREE_TUNE_KEY
+#define BTREE_TUNE_KEY unsigned
+#endif
+#ifndef BTREE_TUNE_VALUE
+#define BTREE_TUNE_VALUE unsigned
+#endif
+#ifndef BTREE_TUNE_INDEX
+#define BTREE_TUNE_INDEX uint32_t
+#endif
+#define BTREE_TUNE_STR2(x) #x
+#define BTREE_TUNE_STR(x) BTREE_TUNE_STR2(x)
+
+using key_type = BTREE_TUNE_KEY;
+using value_type = BTREE_TUNE_VALUE;
+using index_type = BTREE_TUNE_INDEX;
+
+// node sizes (in cache lines) which are tried for internal and for leaf nodes
+static constexpr std::array<std::size_t, 6> CACHE_LINES{2, 4, 8, 16, 32, 64};
+
+enum class workload { insert, lookup, scan, all };
+
+struct result {
+    std::size_t internal_lines;
+    std::size_t leaf_lines;
+    std::size_t internal_order;
+    std::size_t leaf_order;
+    std::size_t internal_size;
+    std::size_t leaf_size;
+    double insert;
+    double lookup;
+    double scan;
+
+    [[nodiscard]] double score(workload w) const {
+        switch (w) {
+            case workload::insert: return insert;
+            case workload::lookup: return lookup;
+            case workload::scan: return scan;
+            case workload::all: break;
+        }
+        return insert + lookup + scan;
+    }
+};
+
+template<typename T>
+auto make(std::uint64_t x) -> T {
+    if constexpr (std::is_arithmetic_v<T>)
+        return static_cast<T>(x);
+    else if constexpr (std::is_constructible_v<T, std::string>)
+        return T(std::format("{:020d}", x));
+    else
+        return T(x);
+}
+
+volatile std::size_t sink = 0;
+
+template<std::size_t Internal_lines, std::size_t Leaf_lines>
+auto measure(std::vector<key_type> const &keys, std::vector<key_type> const &probes, unsigned repetitions) -> result {
+    static constexpr auto internal_order = bt::best_cache_line_order<bt::btree_internal_node, key_type, value_type, index_type, Internal_lines>();
+    static constexpr auto leaf_order = bt::best_cache_line_order<bt::btree_leaf_node, key_type, value_type, index_type, Leaf_lines>();
+    using btree_type = bt::btree<key_type, value_type, index_type, internal_order, leaf_order>;
+
+    using clock = std::chrono::high_resolution_clock;
+    auto seconds = [](auto d) { return std::chrono::duration<double>(d).count(); };
+    result r{Internal_lines, Leaf_lines, internal_order, leaf_order,
+             bt::cache_line_aligned_size<typename btree_type::internal_node_type>(),
+             bt::cache_line_aligned_size<typename btree_type::leaf_node_type>(),
+             std::numeric_limits<double>::max(), std::numeric_limits<double>::max(), std::numeric_limits<double>::max()};
+    for (unsigned rep = 0; rep < repetitions; ++rep) {
+        btree_type tree;
+        auto t1 = clock::now();
+        for (auto const &key: keys)
+            tree.insert(key, make<value_type>(0));
+        auto t2 = clock::now();
+        std::size_t found = 0;
+        for (auto const &key: probes)
+            found += tree.contains(key);
+        auto t3 = clock::now();
+        std::size_t scanned = 0;
+        for (auto const &[key, value]: std::as_const(tree)) {
+            (void) key;
+            (void) value;
+            ++scanned;
+        }
+        auto t4 = clock::now();
+        sink = sink + found + scanned;
+        r.insert = std::min(r.insert, seconds(t2 - t1));
+        r.lookup = std::min(r.lookup, seconds(t3 - t2));
+        r.scan = std::min(r.scan, seconds(t4 - t3));
+    }
+    std::println(std::cout, "internal {:2} lines (order {:4}) | leaf {:2} lines (order {:4}) | insert {:8.4f}s | lookup {:8.4f}s | scan {:8.4f}s",
+                 Internal_lines, internal_order, Leaf_lines, leaf_order, r.insert, r.lookup, r.scan);
+    return r;
+}
+
+template<std::size_t I, std::size_t... L>
+void sweep_leaf(std::vector<result> &results, auto const &keys, auto const &probes, unsigned repetitions, std::index_sequence<L...>) {
+    (results.push_back(measure<CACHE_LINES[I], CACHE_LINES[L]>(keys, probes, repetitions)), ...);
+}
+
+template<std::size_t... I>
+void sweep(std::vector<result> &results, auto const &keys, auto const &probes, unsigned repetitions, std::index_sequence<I...>) {
+    (sweep_leaf<I>(results, keys, probes, repetitions, std::make_index_sequence<CACHE_LINES.size()>{}), ...);
+}
+
+void write_header(std::filesystem::path const &path, result const &best, std::string_view workload_name, std::size_t n) {
+    if (path.has_parent_path())
+        std::filesystem::create_directories(path.parent_path());
+    std::ofstream out(path);
+    std::println(out, "// Generated by order_tuning - do not edit.");
+    std::println(out, "// workload: {}, {} key/values", workload_name, n);
+    std::println(out, "// internal nodes: {} cache lines ({} bytes), leaf nodes: {} cache lines ({} bytes)",
+                 best.internal_lines, best.internal_size, best.leaf_lines, best.leaf_size);
+    std::println(out, "#ifndef BTREE_TUNED_H");
+    std::println(out, "#define BTREE_TUNED_H");
+    std::println(out, "");
+    std::println(out, "#include \"btree.h\"");
+    std::println(out, "");
+    std::println(out, "namespace bt {{");
+    std::println(out, "    using tuned_btree = btree<{}, {}, {}, {}, {}>;",
+                 BTREE_TUNE_STR(BTREE_TUNE_KEY), BTREE_TUNE_STR(BTREE_TUNE_VALUE), BTREE_TUNE_STR(BTREE_TUNE_INDEX),
+                 best.internal_order, best.leaf_order);
+    std::println(out, "}}");
+    std::println(out, "");
+    std::println(out, "#endif //BTREE_TUNED_H");
+}
+
+int main(int argc, char *argv[]) {
+    std::size_t n = 1'000'000;
+    unsigned repetitions = 3;
+    workload w = workload::all;
+    std::string_view workload_name = "all";
+    std::filesystem::path output = "btree_tuned.h";
+    for (int i = 1; i + 1 < argc; i += 2) {
+        std::string_view option = argv[i];
+        std::string_view arg = argv[i + 1];
+        if (option == "--workload") {
+            workload_name = arg;
+            if (arg == "insert") w = workload::insert;
+            else if (arg == "lookup") w = workload::lookup;
+            else if (arg == "scan") w = workload::scan;
+            else if (arg == "all") w = workload::all;
+            else {
+                std::println(std::cerr, "unknown workload {} (insert, lookup, scan, all)", arg);
+                return 1;
+            }
+        } else if (option == "--n") {
+            n = std::stoull(std::string(arg));
+        } else if (option == "--repeat") {
+            repetitions = static_cast<unsigned>(std::stoul(std::string(arg)));
+        } else if (option == "--output") {
+            output = arg;
+        } else {
+            std::println(std::cerr, "usage: {} [--workload insert|lookup|scan|all] [--n N] [--repeat R] [--output header]", argv[0]);
+            return 1;
+        }
+    }
+
+    std::mt19937_64 rng{123};
+    std::uniform_int_distribution<std::uint64_t> dist(1U, 4 * n);
+    std::vector<key_type> keys;
+    keys.reserve(n);
+    for (std::size_t i = 0; i < n; ++i)
+        keys.push_back(make<key_type>(dist(rng)));
+    std::vector<key_type> probes = keys;
+    std::ranges::shuffle(probes, rng);
+
+    std::println(std::cout, "Tuning btree<{}, {}, {}> for workload {} with {} key/values",
+                 BTREE_TUNE_STR(BTREE_TUNE_KEY), BTREE_TUNE_STR(BTREE_TUNE_VALUE), BTREE_TUNE_STR(BTREE_TUNE_INDEX), workload_name, n);
+    std::vector<result> results;
+    sweep(results, keys, probes, repetitions, std::make_index_sequence<CACHE_LINES.size()>{});
+
+    auto best = std::ranges::min(results, {}, [w](result const &r) { return r.score(w); });
+    std::println(std::cout, "Best for {}: internal order {} ({} cache lines), leaf order {} ({} cache lines)",
+                 workload_name, best.internal_order, best.internal_lines, best.leaf_order, best.leaf_lines);
+    write_header(output, best, workload_name, n);
+    std::println(std::cout, "Written {}", output.string());
+}
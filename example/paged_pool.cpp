@@ -0,0 +1,92 @@
+//
+// Created by arnoldm on 19.10.26.
+//
+// A tree in a page file: bt::paged_storage keeps at most Frames nodes in
+// memory, lookups with a hot set against pools of different sizes and against
+// the tree in memory.
+//
+#include <chrono>
+#include <cstdint>
+#include <iostream>
+#include <print>
+#include <random>
+#include <vector>
+#include "btree.h"
+
+using key_type = std::uint64_t;
+using value_type = std::uint64_t;
+using index_type = std::uint32_t;
+
+static constexpr std::size_t PAGE_SIZE = 4096;
+static constexpr auto internal_order = bt::page_storage_order<bt::btree_internal_node, key_type, value_type, index_type, PAGE_SIZE>();
+static constexpr auto leaf_order = bt::page_storage_order<bt::btree_leaf_node, key_type, value_type, index_type, PAGE_SIZE>();
+
+template<typename Storage_policy>
+using btree_type = bt::btree<key_type, value_type, index_type, internal_order, leaf_order, bt::midpoint_split,
+    bt::rebalance_policy<>, Storage_policy>;
+
+volatile std::uint64_t sink = 0;
+
+template<typename Action>
+auto measure(Action const &action) -> double {
+    auto t1 = std::chrono::high_resolution_clock::now();
+    action();
+    auto t2 = std::chrono::high_resolution_clock::now();
+    return std::chrono::duration<double>(t2 - t1).count();
+}
+
+template<typename Tree>
+auto lookups(Tree const &tree, std::vector<key_type> const &keys) -> double {
+    return measure([&tree, &keys] {
+        std::uint64_t sum = 0;
+        for (auto key: keys)
+            sum += (*tree.find(key)).second;
+        sink = sum;
+    });
+}
+
+static constexpr std::size_t N = 8'000'000;
+static constexpr std::size_t LOOKUPS = 2'000'000;
+
+template<std::size_t Frames>
+auto run(std::vector<std::pair<key_type, value_type>> const &entries, std::vector<key_type> const &keys) -> void {
+    btree_type<bt::paged_storage<Frames, PAGE_SIZE>> tree;
+    auto build = measure([&tree, &entries] { tree.bulk_load(entries); });
+    auto const &pool = tree.node_storage();
+    // the first round fills the pool
+    lookups(tree, keys);
+    pool.reset_stats();
+    auto seconds = lookups(tree, keys);
+    std::println(std::cout, "{:>6} | {:>7.1f}MB | {:7.3f}s | {:8.2f}M | {:7.2f}% | {:>9}", Frames,
+                 double(Frames * PAGE_SIZE) / 1e6, build, double(LOOKUPS) / seconds / 1e6,
+                 100.0 * pool.stats().hit_rate(), pool.stats().evictions);
+}
+
+int main() {
+    std::mt19937_64 rng{123};
+    std::vector<std::pair<key_type, value_type>> entries(N);
+    for (auto &[key, value]: entries) {
+        key = rng();
+        value = key;
+    }
+    // 90% of the lookups go to the 10% of the keys in the first tenth of the key range
+    std::vector<key_type> keys(LOOKUPS);
+    auto const hot_limit = ~key_type(0) / 10;
+    std::vector<key_type> hot;
+    for (auto const &entry: entries)
+        if (entry.first < hot_limit)
+            hot.push_back(entry.first);
+    for (auto &key: keys)
+        key = rng() % 10 < 9 ? hot[rng() % hot.size()] : entries[rng() % N].first;
+
+    btree_type<bt::vector_storage> in_memory;
+    in_memory.bulk_load(entries);
+    std::println(std::cout, "btree<uint64_t, uint64_t, uint32_t, {}, {}>, {} nodes of {} bytes, {} random entries, {} lookups (90% hot)",
+                 internal_order, leaf_order, in_memory.node_count(), PAGE_SIZE, N, LOOKUPS);
+    std::println(std::cout, "{:>6} | {:>9} | {:>8} | {:>9} | {:>8} | {:>9}", "frames", "pool", "build", "lookups/s", "hit rate", "evictions");
+    run<1024>(entries, keys);
+    run<4096>(entries, keys);
+    run<16384>(entries, keys);
+    run<65536>(entries, keys);
+    std::println(std::cout, "{:>6} | {:>9} | {:>8} | {:8.2f}M |", "memory", "", "", double(LOOKUPS) / lookups(in_memory, keys) / 1e6);
+}
@@ -0,0 +1,89 @@
+//
+// Created by arnoldm on 19.10.26.
+//
+// Full scans of a bulk loaded tree: iterating entry by entry, bt::btree::for_each()
+// over per-leaf spans and bt::btree::parallel_for_each() on 1 to N threads.
+//
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <format>
+#include <iostream>
+#include <limits>
+#include <numeric>
+#include <print>
+#include <random>
+#include <span>
+#include <thread>
+#include <utility>
+#include <vector>
+#include "btree.h"
+
+using key_type = std::uint64_t;
+using value_type = std::uint64_t;
+using index_type = std::uint32_t;
+
+static constexpr std::size_t PAGE_SIZE = 4096;
+static constexpr auto internal_order = bt::best_order<bt::btree_internal_node, key_type, value_type, index_type, PAGE_SIZE>();
+static constexpr auto leaf_order = bt::best_order<bt::btree_leaf_node, key_type, value_type, index_type, PAGE_SIZE>();
+using btree_type = bt::btree<key_type, value_type, index_type, internal_order, leaf_order>;
+
+volatile std::uint64_t sink = 0;
+
+template<typename Scan>
+auto measure(Scan const &scan) -> double {
+    static constexpr int REPETITIONS = 5;
+    auto best = std::numeric_limits<double>::max();
+    for (int i = 0; i < REPETITIONS; ++i) {
+        auto t1 = std::chrono::high_resolution_clock::now();
+        sink = sink + scan();
+        auto t2 = std::chrono::high_resolution_clock::now();
+        best = std::min(best, std::chrono::duration<double>(t2 - t1).count());
+    }
+    return best;
+}
+
+int main() {
+    static constexpr std::size_t N = 20'000'000;
+    std::mt19937_64 rng{123};
+    std::vector<std::pair<key_type, value_type>> entries(N);
+    for (auto &[key, value]: entries) {
+        key = rng();
+        value = key;
+    }
+    btree_type tree;
+    tree.bulk_load(entries);
+    auto const bytes = static_cast<double>(N * (sizeof(key_type) + sizeof(value_type)));
+
+    std::println(std::cout, "btree<uint64_t, uint64_t, uint32_t, {}, {}>, sum of {} values", internal_order, leaf_order, N);
+    auto print = [bytes](std::string const &name, double seconds, double baseline) {
+        std::println(std::cout, "{:>28} | {:8.3f}s | {:7.2f} GB/s | {:6.2f}x", name, seconds, bytes / seconds / 1e9, baseline / seconds);
+    };
+    auto iterate = measure([&tree] {
+        std::uint64_t sum = 0;
+        for (auto const &[key, value]: tree)
+            sum += value;
+        return sum;
+    });
+    print("iterator", iterate, iterate);
+    auto for_each = measure([&tree] {
+        std::uint64_t sum = 0;
+        tree.for_each([&sum](std::span<key_type const>, std::span<value_type const> values) {
+            sum = std::accumulate(values.begin(), values.end(), sum);
+        });
+        return sum;
+    });
+    print("for_each", for_each, iterate);
+    for (unsigned threads = 1; threads <= std::max(1U, std::thread::hardware_concurrency()); threads *= 2) {
+        bt::thread_pool pool(threads);
+        auto parallel = measure([&tree, &pool] {
+            std::atomic<std::uint64_t> sum = 0;
+            tree.parallel_for_each([&sum](std::span<key_type const>, std::span<value_type const> values) {
+                sum.fetch_add(std::accumulate(values.begin(), values.end(), std::uint64_t{0}), std::memory_order_relaxed);
+            }, pool);
+            return sum.load();
+        });
+        print(std::format("parallel_for_each, {} threads", threads), parallel, iterate);
+    }
+}
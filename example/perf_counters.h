@@ -0,0 +1,167 @@
+//
+// Created by arnoldm on 19.10.26.
+//
+
+#ifndef PERF_COUNTERS_H
+#define PERF_COUNTERS_H
+
+#include <array>
+#include <cerrno>
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <optional>
+#include <string>
+#include <string_view>
+#include <utility>
+
+#if defined(__linux__) && __has_include(<linux/perf_event.h>)
+#define PERF_COUNTERS_LINUX 1
+#include <linux/perf_event.h>
+#include <sys/ioctl.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+#endif
+
+static constexpr std::size_t PERF_EVENTS = 6;
+
+static constexpr std::array<std::string_view, PERF_EVENTS> PERF_EVENT_NAMES{
+    "cycles", "instructions", "l1d_misses", "llc_misses", "dtlb_misses", "branch_misses"
+};
+
+#ifdef PERF_COUNTERS_LINUX
+// read misses of a cache, as PERF_TYPE_HW_CACHE encodes them
+static constexpr auto perf_cache_misses(std::uint64_t cache) -> std::uint64_t {
+    return cache | PERF_COUNT_HW_CACHE_OP_READ << 8 | PERF_COUNT_HW_CACHE_RESULT_MISS << 16;
+}
+
+// the type and config of the events of PERF_EVENT_NAMES
+static constexpr std::array<std::pair<std::uint32_t, std::uint64_t>, PERF_EVENTS> PERF_EVENT_CONFIGS{{
+    {PERF_TYPE_HARDWARE, PERF_COUNT_HW_CPU_CYCLES},
+    {PERF_TYPE_HARDWARE, PERF_COUNT_HW_INSTRUCTIONS},
+    {PERF_TYPE_HW_CACHE, perf_cache_misses(PERF_COUNT_HW_CACHE_L1D)},
+    {PERF_TYPE_HW_CACHE, perf_cache_misses(PERF_COUNT_HW_CACHE_LL)},
+    {PERF_TYPE_HW_CACHE, perf_cache_misses(PERF_COUNT_HW_CACHE_DTLB)},
+    {PERF_TYPE_HARDWARE, PERF_COUNT_HW_BRANCH_MISSES},
+}};
+#endif
+
+/**
+ * The counts of one measurement, std::nullopt for the events that could not be counted
+ */
+using perf_values = std::array<std::optional<double>, PERF_EVENTS>;
+
+/**
+ * Hardware performance counters of the calling thread, user space only, by perf_event_open(2). Each event is
+ * opened on its own, so a machine without, say, a dTLB miss event still counts the others, and the counts are
+ * scaled up when the kernel multiplexes the counters. Where no counter can be opened (other systems, containers,
+ * perf_event_paranoid > 2) available() is false and every measurement is std::nullopt, so callers report time
+ * only.
+ */
+class perf_counters {
+public:
+    perf_counters() {
+        fds_.fill(-1);
+#ifdef PERF_COUNTERS_LINUX
+        for (std::size_t i = 0; i < PERF_EVENTS; ++i) {
+            perf_event_attr attr{};
+            attr.size = sizeof(attr);
+            attr.type = PERF_EVENT_CONFIGS[i].first;
+            attr.config = PERF_EVENT_CONFIGS[i].second;
+            attr.disabled = 1;
+            attr.exclude_kernel = 1;
+            attr.exclude_hv = 1;
+            attr.read_format = PERF_FORMAT_TOTAL_TIME_ENABLED | PERF_FORMAT_TOTAL_TIME_RUNNING;
+            fds_[i] = static_cast<int>(syscall(SYS_perf_event_open, &attr, 0, -1, -1, 0));
+            if (fds_[i] < 0 && reason_.empty())
+                reason_ = std::string("perf_event_open: ") + std::strerror(errno);
+        }
+#else
+        reason_ = "no perf_event_open on this system";
+#endif
+    }
+
+    perf_counters(perf_counters const &) = delete;
+
+    auto operator=(perf_counters const &) -> perf_counters & = delete;
+
+    ~perf_counters() {
+#ifdef PERF_COUNTERS_LINUX
+        for (auto fd: fds_)
+            if (fd >= 0)
+                close(fd);
+#endif
+    }
+
+    /**
+     * @return whether at least one event is counted
+     */
+    [[nodiscard]] auto available() const -> bool {
+        for (auto fd: fds_)
+            if (fd >= 0)
+                return true;
+        return false;
+    }
+
+    /**
+     * @return why the first event that is not counted could not be opened, empty if all are counted
+     */
+    [[nodiscard]] auto unavailable_reason() const -> std::string const & { return reason_; }
+
+    auto start() -> void {
+#ifdef PERF_COUNTERS_LINUX
+        for (auto fd: fds_)
+            if (fd >= 0) {
+                ioctl(fd, PERF_EVENT_IOC_RESET, 0);
+                ioctl(fd, PERF_EVENT_IOC_ENABLE, 0);
+            }
+#endif
+    }
+
+    auto stop() -> perf_values {
+        perf_values values;
+#ifdef PERF_COUNTERS_LINUX
+        for (auto fd: fds_)
+            if (fd >= 0)
+                ioctl(fd, PERF_EVENT_IOC_DISABLE, 0);
+        for (std::size_t i = 0; i < PERF_EVENTS; ++i) {
+            // value, time enabled, time running
+            std::array<std::uint64_t, 3> data{};
+            if (fds_[i] < 0 || read(fds_[i], data.data(), sizeof(data)) != sizeof(data) || data[2] == 0)
+                continue;
+            values[i] = static_cast<double>(data[0]) * static_cast<double>(data[1]) / static_cast<double>(data[2]);
+        }
+#endif
+        return values;
+    }
+
+private:
+    std::array<int, PERF_EVENTS> fds_;
+    std::string reason_;
+};
+
+/**
+ * Counts from its construction to its destruction into values, if counters is not null
+ */
+class perf_scope {
+public:
+    perf_scope(perf_counters *counters, perf_values &values) : counters_(counters), values_(values) {
+        if (counters_)
+            counters_->start();
+    }
+
+    perf_scope(perf_scope const &) = delete;
+
+    auto operator=(perf_scope const &) -> perf_scope & = delete;
+
+    ~perf_scope() {
+        if (counters_)
+            values_ = counters_->stop();
+    }
+
+private:
+    perf_counters *counters_;
+    perf_values &values_;
+};
+
+#endif //PERF_COUNTERS_H
@@ -0,0 +1,107 @@
+//
+// Created by arnoldm on 19.10.26.
+//
+// Compares the rebalance policies of bt::btree under an erase-heavy load:
+// leaf rebalances per erase and erase throughput.
+//
+// The (untimed) counting run uses bt::tree_stats, the timed run the default
+// bt::no_stats.
+//
+#include <chrono>
+#include <cstdint>
+#include <format>
+#include <iostream>
+#include <print>
+#include <random>
+#include <string_view>
+#include <vector>
+#include "btree.h"
+
+using key_type = std::uint64_t;
+using value_type = std::uint64_t;
+using index_type = std::uint32_t;
+
+static constexpr std::size_t ORDER = 64;
+
+enum class operation { insert, erase };
+
+// erase-heavy workload: 3 out of 4 operations erase a random key until a quarter of the keys is left
+auto make_workload(std::size_t n, std::vector<key_type> &initial) -> std::vector<std::pair<operation, key_type>> {
+    std::mt19937_64 rng{123};
+    initial.resize(n);
+    for (auto &key: initial)
+        key = rng();
+    std::vector<key_type> present = initial;
+    std::vector<std::pair<operation, key_type>> ops;
+    while (present.size() > n / 4) {
+        if (rng() % 4 == 0) {
+            present.push_back(rng());
+            ops.emplace_back(operation::insert, present.back());
+        } else {
+            auto i = rng() % present.size();
+            ops.emplace_back(operation::erase, present[i]);
+            present[i] = present.back();
+            present.pop_back();
+        }
+    }
+    return ops;
+}
+
+template<typename Rebalance_policy>
+void measure(std::string_view policy_name, std::vector<key_type> const &initial,
+             std::vector<std::pair<operation, key_type>> const &ops) {
+    using btree_type = bt::btree<key_type, value_type, index_type, ORDER, ORDER, bt::midpoint_split, Rebalance_policy>;
+    using counted_type = bt::btree<key_type, value_type, index_type, ORDER, ORDER, bt::midpoint_split, Rebalance_policy,
+        bt::vector_storage, bt::tree_stats>;
+
+    // counting run
+    std::size_t erases = 0;
+    std::size_t rebalances = 0;
+    {
+        counted_type tree;
+        for (auto key: initial)
+            tree.insert(key, key);
+        tree.reset_stats();
+        for (auto [op, key]: ops) {
+            if (op == operation::insert) {
+                tree.insert(key, key);
+            } else {
+                ++erases;
+                tree.erase(tree.find(key));
+            }
+        }
+        rebalances = tree.stats()[bt::btree_event::leaf_rebalance];
+    }
+
+    // timed run
+    btree_type tree;
+    for (auto key: initial)
+        tree.insert(key, key);
+    auto t1 = std::chrono::high_resolution_clock::now();
+    for (auto [op, key]: ops) {
+        if (op == operation::insert)
+            tree.insert(key, key);
+        else
+            tree.erase(tree.find(key));
+    }
+    auto t2 = std::chrono::high_resolution_clock::now();
+    double seconds = std::chrono::duration<double>(t2 - t1).count();
+    std::println(std::cout, "{:>26} | {:>8} | {:>8} | {:10} | {:13.4f} | {:12.2f}",
+                 policy_name, btree_type::traits::min_leaf_order, btree_type::traits::merge_leaf_order,
+                 rebalances, static_cast<double>(rebalances) / static_cast<double>(erases),
+                 static_cast<double>(ops.size()) / seconds / 1e6);
+}
+
+int main() {
+    static constexpr std::size_t N = 1'000'000;
+    std::vector<key_type> initial;
+    auto ops = make_workload(N, initial);
+    std::println(std::cout, "btree<uint64_t, uint64_t, uint32_t, {}, {}>, {} key/values, {} operations (75% erase)",
+                 ORDER, ORDER, N, ops.size());
+    std::println(std::cout, "{:>26} | {:>8} | {:>8} | {:>10} | {:>13} | {:>12}",
+                 "policy", "min", "merge", "rebalances", "rebal./erase", "Mops/s");
+    measure<bt::rebalance_policy<>>("rebalance_policy<>", initial, ops);
+    measure<bt::rebalance_policy<50, 50, true>>("rebalance_policy<50,50,1>", initial, ops);
+    measure<bt::rebalance_policy<25, 50, true>>("rebalance_policy<25,50,1>", initial, ops);
+    measure<bt::rebalance_policy<25, 75, true>>("rebalance_policy<25,75,1>", initial, ops);
+}
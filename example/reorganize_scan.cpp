@@ -0,0 +1,69 @@
+//
+// Created by arnoldm on 19.10.26.
+//
+// Full scans and range queries over a btree filled with random inserts,
+// before and after bt::btree::reorganize() laid out the nodes in locality order.
+//
+#include <chrono>
+#include <cstdint>
+#include <format>
+#include <iostream>
+#include <print>
+#include <random>
+#include <string_view>
+#include <vector>
+#include "btree.h"
+
+using key_type = std::uint64_t;
+using value_type = std::uint64_t;
+using index_type = std::uint32_t;
+
+static constexpr std::size_t PAGE_SIZE = 4096;
+static constexpr auto internal_order = bt::best_order<bt::btree_internal_node, key_type, value_type, index_type, PAGE_SIZE>();
+static constexpr auto leaf_order = bt::best_order<bt::btree_leaf_node, key_type, value_type, index_type, PAGE_SIZE>();
+using btree_type = bt::btree<key_type, value_type, index_type, internal_order, leaf_order>;
+
+volatile std::uint64_t sink = 0;
+
+void measure(std::string_view name, btree_type const &tree, std::vector<key_type> const &range_starts, std::size_t range_length) {
+    auto t1 = std::chrono::high_resolution_clock::now();
+    std::uint64_t sum = 0;
+    for (auto const &[key, value]: tree)
+        sum += value;
+    auto t2 = std::chrono::high_resolution_clock::now();
+    for (auto start: range_starts) {
+        auto it = tree.find(start);
+        for (std::size_t i = 0; i < range_length && it != tree.end(); ++i, ++it)
+            sum += (*it).second;
+    }
+    auto t3 = std::chrono::high_resolution_clock::now();
+    sink = sink + sum;
+    std::println(std::cout, "{:>12} | {:10.4f}s | {:10.4f}s", name,
+                 std::chrono::duration<double>(t2 - t1).count(), std::chrono::duration<double>(t3 - t2).count());
+}
+
+int main() {
+    static constexpr std::size_t N = 8'000'000;
+    static constexpr std::size_t RANGES = 100'000;
+    static constexpr std::size_t RANGE_LENGTH = 1'000;
+    std::mt19937_64 rng{123};
+    std::vector<key_type> keys(N);
+    for (auto &key: keys)
+        key = rng();
+    btree_type tree;
+    for (auto key: keys)
+        tree.insert(key, key);
+    std::vector<key_type> range_starts(RANGES);
+    for (auto &start: range_starts)
+        start = keys[rng() % N];
+
+    std::println(std::cout, "btree<uint64_t, uint64_t, uint32_t, {}, {}>, {} random inserts, {} range queries of {} entries",
+                 internal_order, leaf_order, N, RANGES, RANGE_LENGTH);
+    std::println(std::cout, "{:>12} | {:>11} | {:>11}", "layout", "full scan", "ranges");
+    measure("insertion", tree, range_starts, RANGE_LENGTH);
+    auto t1 = std::chrono::high_resolution_clock::now();
+    tree.reorganize();
+    auto t2 = std::chrono::high_resolution_clock::now();
+    measure("reorganized", tree, range_starts, RANGE_LENGTH);
+    std::println(std::cout, "reorganize() took {:.4f}s", std::chrono::duration<double>(t2 - t1).count());
+}
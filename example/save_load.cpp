@@ -0,0 +1,63 @@
+//
+// Created by arnoldm on 19.10.26.
+//
+// Restarting with a tree: building it again by inserting every entry against
+// bt::btree::save() to a file and bt::btree::load() from it.
+//
+#include <chrono>
+#include <cstdint>
+#include <filesystem>
+#include <fstream>
+#include <iostream>
+#include <print>
+#include <random>
+#include <vector>
+#include "btree.h"
+
+using key_type = std::uint64_t;
+using value_type = std::uint64_t;
+using index_type = std::uint32_t;
+
+static constexpr std::size_t PAGE_SIZE = 4096;
+static constexpr auto internal_order = bt::best_order<bt::btree_internal_node, key_type, value_type, index_type, PAGE_SIZE>();
+static constexpr auto leaf_order = bt::best_order<bt::btree_leaf_node, key_type, value_type, index_type, PAGE_SIZE>();
+using btree_type = bt::btree<key_type, value_type, index_type, internal_order, leaf_order>;
+
+template<typename Action>
+auto measure(Action const &action) -> double {
+    auto t1 = std::chrono::high_resolution_clock::now();
+    action();
+    auto t2 = std::chrono::high_resolution_clock::now();
+    return std::chrono::duration<double>(t2 - t1).count();
+}
+
+int main() {
+    static constexpr std::size_t N = 10'000'000;
+    std::mt19937_64 rng{123};
+    std::vector<key_type> keys(N);
+    for (auto &key: keys)
+        key = rng();
+    auto const path = std::filesystem::temp_directory_path() / "save_load.btree";
+
+    std::println(std::cout, "btree<uint64_t, uint64_t, uint32_t, {}, {}>, {} random entries", internal_order, leaf_order, N);
+    btree_type tree;
+    auto inserts = measure([&keys, &tree] {
+        for (auto key: keys)
+            tree.insert(key, key);
+    });
+    std::println(std::cout, "{:>18} | {:8.3f}s", "insert one by one", inserts);
+    auto save = measure([&tree, &path] {
+        std::ofstream out(path, std::ios::binary);
+        tree.save(out);
+    });
+    auto const size = std::filesystem::file_size(path);
+    std::println(std::cout, "{:>18} | {:8.3f}s | {:8.2f} MB | {:8.2f} GB/s", "save", save, double(size) / 1e6, double(size) / save / 1e9);
+    btree_type loaded;
+    auto load = measure([&loaded, &path] {
+        std::ifstream in(path, std::ios::binary);
+        loaded.load(in);
+    });
+    std::println(std::cout, "{:>18} | {:8.3f}s | {:8.2f}x faster than inserting", "load", load, inserts / load);
+    std::filesystem::remove(path);
+    return loaded == tree ? 0 : 1;
+}
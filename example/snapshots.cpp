@@ -0,0 +1,85 @@
+//
+// Created by arnoldm on 19.10.26.
+//
+// Cost of a consistent copy of a big tree: deep copy of a btree with
+// vector_storage against bt::btree::snapshot() with cow_storage, and the
+// insert throughput of a cow_storage tree while a background thread scans
+// a snapshot.
+//
+#include <chrono>
+#include <cstdint>
+#include <format>
+#include <iostream>
+#include <print>
+#include <random>
+#include <thread>
+#include <utility>
+#include <vector>
+#include "btree.h"
+
+using key_type = std::uint64_t;
+using value_type = std::uint64_t;
+using index_type = std::uint32_t;
+
+static constexpr std::size_t PAGE_SIZE = 4096;
+static constexpr auto internal_order = bt::best_order<bt::btree_internal_node, key_type, value_type, index_type, PAGE_SIZE>();
+static constexpr auto leaf_order = bt::best_order<bt::btree_leaf_node, key_type, value_type, index_type, PAGE_SIZE>();
+using btree_type = bt::btree<key_type, value_type, index_type, internal_order, leaf_order>;
+using cow_btree_type = bt::btree<key_type, value_type, index_type, internal_order, leaf_order, bt::midpoint_split,
+    bt::rebalance_policy<>, bt::cow_storage<>>;
+
+volatile std::uint64_t sink = 0;
+
+auto seconds_since(auto start) {
+    return std::chrono::duration<double>(std::chrono::high_resolution_clock::now() - start).count();
+}
+
+template<typename Tree>
+auto insert_all(Tree &tree, std::vector<key_type> const &keys) -> double {
+    auto start = std::chrono::high_resolution_clock::now();
+    for (auto key: keys)
+        tree.insert(key, key);
+    return static_cast<double>(keys.size()) / seconds_since(start) / 1e6;
+}
+
+int main() {
+    static constexpr std::size_t N = 4'000'000;
+    static constexpr std::size_t INSERTS = 1'000'000;
+    std::mt19937_64 rng{123};
+    std::vector<key_type> keys(N);
+    for (auto &key: keys)
+        key = rng();
+    std::vector<key_type> more_keys(INSERTS);
+    for (auto &key: more_keys)
+        key = rng();
+
+    std::println(std::cout, "btree<uint64_t, uint64_t, uint32_t, {}, {}>, {} random inserts", internal_order, leaf_order, N);
+    btree_type tree;
+    insert_all(tree, keys);
+    cow_btree_type cow_tree;
+    insert_all(cow_tree, keys);
+    std::vector<key_type> first_half(more_keys.begin(), more_keys.begin() + INSERTS / 2);
+    std::vector<key_type> second_half(more_keys.begin() + INSERTS / 2, more_keys.end());
+    auto cow_mops = insert_all(cow_tree, first_half);
+
+    auto start = std::chrono::high_resolution_clock::now();
+    btree_type copy = tree;
+    auto copy_seconds = seconds_since(start);
+    start = std::chrono::high_resolution_clock::now();
+    auto snapshot = cow_tree.snapshot();
+    auto snapshot_seconds = seconds_since(start);
+    std::println(std::cout, "deep copy (vector_storage): {:.6f}s, snapshot() (cow_storage): {:.6f}s", copy_seconds, snapshot_seconds);
+
+    // the first changes after a snapshot copy the chunks on their path, later ones find them unshared
+    std::uint64_t scanned = 0;
+    std::thread scanner([&snapshot, &scanned] {
+        for (auto const &[key, value]: *snapshot)
+            scanned += value;
+    });
+    auto with_snapshot_mops = insert_all(cow_tree, second_half);
+    scanner.join();
+    sink = sink + scanned + copy.node_count();
+    std::println(std::cout, "cow_storage inserts/s: {:.2f} M before the snapshot, {:.2f} M after it while a thread scans it",
+                 cow_mops, with_snapshot_mops);
+    std::println(std::cout, "snapshot still has {} nodes, the tree {}", snapshot->node_count(), std::as_const(cow_tree).node_count());
+}
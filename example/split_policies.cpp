@@ -0,0 +1,67 @@
+//
+// Created by arnoldm on 19.10.26.
+//
+// Compares the split policies of bt::btree: bytes per entry and insert
+// throughput for random, ascending and descending inserts.
+//
+#include <chrono>
+#include <cstdint>
+#include <format>
+#include <iostream>
+#include <print>
+#include <random>
+#include <string_view>
+#include <vector>
+#include "btree.h"
+
+using key_type = std::uint64_t;
+using value_type = std::uint64_t;
+using index_type = std::uint32_t;
+
+static constexpr std::size_t PAGE_SIZE = 4096;
+static constexpr auto internal_order = bt::best_order<bt::btree_internal_node, key_type, value_type, index_type, PAGE_SIZE>();
+static constexpr auto leaf_order = bt::best_order<bt::btree_leaf_node, key_type, value_type, index_type, PAGE_SIZE>();
+
+template<typename Split_policy>
+void measure(std::string_view policy_name, std::string_view workload_name, std::vector<key_type> const &keys) {
+    using btree_type = bt::btree<key_type, value_type, index_type, internal_order, leaf_order, Split_policy>;
+    btree_type tree;
+    auto t1 = std::chrono::high_resolution_clock::now();
+    for (auto key: keys)
+        tree.insert(key, key);
+    auto t2 = std::chrono::high_resolution_clock::now();
+    double seconds = std::chrono::duration<double>(t2 - t1).count();
+    double bytes = static_cast<double>(tree.node_count() * sizeof(typename btree_type::common_node_type));
+    std::println(std::cout, "{:>14} | {:>10} | {:10} | {:12.1f} | {:12.2f}",
+                 policy_name, workload_name, tree.node_count(),
+                 bytes / static_cast<double>(keys.size()),
+                 static_cast<double>(keys.size()) / seconds / 1e6);
+}
+
+void measure_all(std::string_view workload_name, std::vector<key_type> const &keys) {
+    measure<bt::midpoint_split>("midpoint_split", workload_name, keys);
+    measure<bt::bstar_split>("bstar_split", workload_name, keys);
+}
+
+int main() {
+    static constexpr std::size_t N = 2'000'000;
+    std::println(std::cout, "btree<uint64_t, uint64_t, uint32_t, {}, {}>, {} inserts, {} bytes per node (raw entry: {} bytes)",
+                 internal_order, leaf_order, N,
+                 sizeof(bt::btree<key_type, value_type, index_type, internal_order, leaf_order>::common_node_type),
+                 sizeof(key_type) + sizeof(value_type));
+    std::println(std::cout, "{:>14} | {:>10} | {:>10} | {:>12} | {:>12}", "policy", "workload", "nodes", "bytes/entry", "Minserts/s");
+
+    std::mt19937_64 rng{123};
+    std::vector<key_type> keys(N);
+    for (auto &key: keys)
+        key = rng();
+    measure_all("random", keys);
+
+    for (std::size_t i = 0; i < N; ++i)
+        keys[i] = i;
+    measure_all("ascending", keys);
+
+    for (std::size_t i = 0; i < N; ++i)
+        keys[i] = N - i;
+    measure_all("descending", keys);
+}
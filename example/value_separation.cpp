@@ -0,0 +1,102 @@
+//
+// Created by arnoldm on 19.10.26.
+//
+// Values of 4 KB: inline in the leaves of a bt::btree against a
+// bt::separated_btree, whose tree holds 16 byte handles into a value log.
+// Random inserts, lookups, replacing half of the values and collecting the
+// garbage they leave in the log. Writes the log to the temp directory.
+//
+#include <array>
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <filesystem>
+#include <iostream>
+#include <print>
+#include <random>
+#include <string>
+#include <vector>
+#include "btree.h"
+#include "separated_btree.h"
+
+using key_type = std::uint64_t;
+using index_type = std::uint32_t;
+static constexpr std::size_t VALUE_SIZE = 4096;
+using blob_type = std::array<std::byte, VALUE_SIZE>;
+
+using inline_type = bt::btree<key_type, blob_type, index_type, 64, 16>;
+using separated_type = bt::separated_btree<bt::btree<key_type, bt::value_handle, index_type, 64, 64>>;
+
+template<typename Action>
+auto measure(Action const &action) -> double {
+    auto t1 = std::chrono::high_resolution_clock::now();
+    action();
+    auto t2 = std::chrono::high_resolution_clock::now();
+    return std::chrono::duration<double>(t2 - t1).count();
+}
+
+static constexpr std::size_t N = 200'000;
+
+auto report(std::string const &name, std::size_t count, double seconds) -> void {
+    std::println(std::cout, "{:>30} | {:7} | {:7.3f}s | {:10.0f} /s", name, count, seconds, double(count) / seconds);
+}
+
+int main() {
+    std::mt19937_64 rng{123};
+    std::vector<key_type> keys(N);
+    for (auto &key: keys)
+        key = rng();
+    blob_type blob;
+    for (std::size_t i = 0; i < blob.size(); ++i)
+        blob[i] = static_cast<std::byte>(i);
+    std::size_t found = 0;
+
+    {
+        inline_type tree;
+        report("inline, inserts", N, measure([&tree, &keys, &blob] {
+            for (auto key: keys)
+                tree.insert(key, blob);
+        }));
+        report("inline, lookups", N, measure([&tree, &keys, &found] {
+            for (auto key: keys)
+                found += std::to_integer<std::size_t>((*tree.find(key)).second[1]);
+        }));
+        std::println(std::cout, "{:>30} | {} nodes of {} bytes", "inline, tree", tree.node_count(),
+                     sizeof(inline_type::common_node_type));
+    }
+
+    auto const directory = std::filesystem::temp_directory_path() / "value_separation";
+    std::filesystem::remove_all(directory);
+    {
+        separated_type tree(directory);
+        report("separated, inserts", N, measure([&tree, &keys, &blob] {
+            for (auto key: keys)
+                tree.insert(key, blob);
+            tree.sync();
+        }));
+        report("separated, lookups", N, measure([&tree, &keys, &found] {
+            for (auto key: keys)
+                found += std::to_integer<std::size_t>((*tree.find(key))[1]);
+        }));
+        report("separated, handle lookups", N, measure([&tree, &keys, &found] {
+            for (auto key: keys)
+                found += tree.find_handle(key)->length / VALUE_SIZE;
+        }));
+        std::println(std::cout, "{:>30} | {} nodes of {} bytes", "separated, tree", tree.unsynchronized().node_count(),
+                     sizeof(separated_type::btree_type::common_node_type));
+        report("separated, replace half", N / 2, measure([&tree, &keys, &blob] {
+            for (std::size_t i = 0; i < keys.size(); i += 2)
+                tree.insert(keys[i], blob);
+            tree.sync();
+        }));
+        auto const size = tree.log().size();
+        auto const live = tree.log().live_size();
+        std::uint64_t freed = 0;
+        auto seconds = measure([&tree, &freed] { freed = tree.collect_garbage(0.25); });
+        std::println(std::cout, "{:>30} | {:7.3f}s | log of {} MB, {} MB live, {} MB freed", "separated, collect garbage",
+                     seconds, size >> 20, live >> 20, freed >> 20);
+    }
+    report("separated, reopen", N, measure([&directory] { separated_type tree(directory); }));
+    std::filesystem::remove_all(directory);
+    std::println(std::cout, "checksum {}", found);
+}
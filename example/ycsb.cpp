@@ -0,0 +1,348 @@
+//
+// Created by arnoldm on 19.10.26.
+//
+// YCSB style workload driver: loads a bt::btree and replays the core
+// workloads A-F, or a custom mix of reads, updates, inserts, scans and
+// read-modify-writes, with uniform, Zipfian or latest keys. Every operation
+// is timed into a bt::latency_histogram, and the throughput of a workload is
+// reported next to the p50/p99/p99.9/max latency of each kind of operation:
+// the tail is where splits and rebalances show.
+//
+#include <algorithm>
+#include <array>
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <fstream>
+#include <iostream>
+#include <optional>
+#include <print>
+#include <random>
+#include <string>
+#include <string_view>
+#include <utility>
+#include <vector>
+#include "btree.h"
+#include "latency_histogram.h"
+#include "key_distributions.h"
+
+using key_type = std::uint64_t;
+using index_type = std::uint32_t;
+// YCSB records have 10 fields of 100 bytes; 8 byte fields keep the cost in the tree rather than in copying values
+static constexpr std::size_t FIELDS = 10;
+using record_type = std::array<std::uint64_t, FIELDS>;
+
+static constexpr std::size_t PAGE_SIZE = 4096;
+using tree_type = bt::btree<key_type, record_type, index_type,
+    bt::best_order<bt::btree_internal_node, key_type, record_type, index_type, PAGE_SIZE>(),
+    bt::best_order<bt::btree_leaf_node, key_type, record_type, index_type, PAGE_SIZE>()>;
+using histogram_type = bt::latency_histogram<>;
+using clock_type = std::chrono::steady_clock;
+
+volatile std::uint64_t sink = 0;
+
+enum class operation { read, update, insert, scan, read_modify_write };
+
+static constexpr std::size_t OPERATIONS = 5;
+
+static constexpr std::array<std::string_view, OPERATIONS> OPERATION_NAMES{
+    "read", "update", "insert", "scan", "rmw"
+};
+
+enum class distribution { uniform, zipfian, latest };
+
+static constexpr std::array<std::string_view, 3> DISTRIBUTION_NAMES{"uniform", "zipfian", "latest"};
+
+struct workload {
+    std::string name;
+    std::array<double, OPERATIONS> proportions;
+    distribution keys;
+};
+
+static const std::array<workload, 6> CORE_WORKLOADS{
+    workload{"a", {0.5, 0.5, 0, 0, 0}, distribution::zipfian},
+    workload{"b", {0.95, 0.05, 0, 0, 0}, distribution::zipfian},
+    workload{"c", {1, 0, 0, 0, 0}, distribution::zipfian},
+    workload{"d", {0.95, 0, 0.05, 0, 0}, distribution::latest},
+    workload{"e", {0, 0, 0.05, 0.95, 0}, distribution::zipfian},
+    workload{"f", {0.5, 0, 0, 0, 0.5}, distribution::zipfian},
+};
+
+/**
+ * @brief The key of the keynum-th record: a bijection, so records are inserted in random key order as with
+ * YCSB's hashed insert order
+ */
+auto key_of(std::uint64_t keynum) -> key_type {
+    keynum ^= keynum >> 33;
+    keynum *= 0xff51afd7ed558ccdULL;
+    keynum ^= keynum >> 33;
+    keynum *= 0xc4ceb9fe1a85ec53ULL;
+    keynum ^= keynum >> 33;
+    return keynum;
+}
+
+auto record_of(std::uint64_t keynum) -> record_type {
+    record_type record;
+    for (std::size_t i = 0; i < FIELDS; ++i)
+        record[i] = keynum + i;
+    return record;
+}
+
+/**
+ * @brief Picks the keynums of requests among the records inserted so far
+ */
+class key_chooser {
+public:
+    key_chooser(distribution keys, std::uint64_t records) : keys_(keys), zipf_(records) {}
+
+    auto operator()(std::mt19937_64 &rng, std::uint64_t records) -> std::uint64_t {
+        switch (keys_) {
+            case distribution::uniform:
+                return std::uniform_int_distribution<std::uint64_t>(0, records - 1)(rng);
+            case distribution::zipfian:
+                zipf_.grow(records);
+                return zipf_(rng);
+            case distribution::latest:
+                zipf_.grow(records);
+                return records - 1 - zipf_(rng);
+        }
+        return 0;
+    }
+
+private:
+    distribution keys_;
+    zipfian_distribution zipf_;
+};
+
+struct options {
+    std::uint64_t records = 1'000'000;
+    std::uint64_t operations = 1'000'000;
+    std::size_t max_scan = 100;
+    std::optional<distribution> keys;
+    std::vector<workload> workloads;
+    std::string format = "table";
+    std::string output;
+};
+
+struct result {
+    std::string workload_name;
+    std::uint64_t operations = 0;
+    double seconds = 0;
+    std::array<histogram_type, OPERATIONS> latencies;
+};
+
+template<typename Operation>
+auto timed(histogram_type &histogram, Operation const &op) -> void {
+    auto const t1 = clock_type::now();
+    op();
+    auto const t2 = clock_type::now();
+    histogram.record(static_cast<std::uint64_t>(std::chrono::duration_cast<std::chrono::nanoseconds>(t2 - t1).count()));
+}
+
+auto load(tree_type &tree, std::uint64_t records) -> result {
+    result r{.workload_name = "load", .operations = records, .seconds = 0, .latencies = {}};
+    auto const t1 = clock_type::now();
+    for (std::uint64_t keynum = 0; keynum < records; ++keynum)
+        timed(r.latencies[std::to_underlying(operation::insert)], [&tree, keynum] { tree.insert(key_of(keynum), record_of(keynum)); });
+    r.seconds = std::chrono::duration<double>(clock_type::now() - t1).count();
+    return r;
+}
+
+auto run(workload const &w, options const &opts, std::mt19937_64 &rng, std::optional<result> &loaded) -> result {
+    tree_type tree;
+    auto load_result = load(tree, opts.records);
+    if (!loaded)
+        loaded = std::move(load_result);
+
+    auto records = opts.records;
+    key_chooser choose(opts.keys.value_or(w.keys), records);
+    std::discrete_distribution<std::size_t> operations(w.proportions.begin(), w.proportions.end());
+    std::uniform_int_distribution<std::size_t> fields(0, FIELDS - 1);
+    std::uniform_int_distribution<std::size_t> scan_lengths(1, opts.max_scan);
+
+    result r{.workload_name = w.name, .operations = opts.operations, .seconds = 0, .latencies = {}};
+    auto const t1 = clock_type::now();
+    for (std::uint64_t i = 0; i < opts.operations; ++i) {
+        auto const op = operations(rng);
+        auto &histogram = r.latencies[op];
+        switch (static_cast<operation>(op)) {
+            case operation::read: {
+                auto const key = key_of(choose(rng, records));
+                timed(histogram, [&tree, key] {
+                    if (auto it = tree.find(key); it != tree.end())
+                        for (auto field: (*it).second)
+                            sink = sink + field;
+                });
+                break;
+            }
+            case operation::update: {
+                auto const key = key_of(choose(rng, records));
+                auto const field = fields(rng);
+                timed(histogram, [&tree, key, field, i] {
+                    if (auto it = tree.find(key); it != tree.end())
+                        (*it).second[field] = i;
+                });
+                break;
+            }
+            case operation::insert: {
+                auto const keynum = records++;
+                timed(histogram, [&tree, keynum] { tree.insert(key_of(keynum), record_of(keynum)); });
+                break;
+            }
+            case operation::scan: {
+                auto const key = key_of(choose(rng, records));
+                auto const length = scan_lengths(rng);
+                timed(histogram, [&tree, key, length] {
+                    std::size_t n = 0;
+                    for (auto it = tree.lower_bound(key); n < length && it != tree.end(); ++it, ++n)
+                        sink = sink + (*it).second[0];
+                });
+                break;
+            }
+            case operation::read_modify_write: {
+                auto const key = key_of(choose(rng, records));
+                auto const field = fields(rng);
+                timed(histogram, [&tree, key, field] {
+                    if (auto it = tree.find(key); it != tree.end()) {
+                        auto record = (*it).second;
+                        ++record[field];
+                        (*it).second = record;
+                    }
+                });
+                break;
+            }
+        }
+    }
+    r.seconds = std::chrono::duration<double>(clock_type::now() - t1).count();
+    return r;
+}
+
+/**
+ * @brief The latencies of each kind of operation of a workload, and of all of them together
+ */
+auto rows(result const &r) -> std::vector<std::pair<std::string_view, histogram_type>> {
+    std::vector<std::pair<std::string_view, histogram_type>> rows;
+    histogram_type all;
+    for (std::size_t op = 0; op < OPERATIONS; ++op)
+        if (r.latencies[op].count() != 0) {
+            rows.emplace_back(OPERATION_NAMES[op], r.latencies[op]);
+            all.merge(r.latencies[op]);
+        }
+    if (rows.size() > 1)
+        rows.emplace_back("all", all);
+    return rows;
+}
+
+auto write_table(std::ostream &out, std::vector<result> const &results) -> void {
+    std::println(out, "{:>8} | {:>9} | {:>9} | {:>10} | {:>8} | {:>8} | {:>8} | {:>8} | {:>10}", "workload",
+                 "operation", "count", "ops/s", "mean ns", "p50 ns", "p99 ns", "p99.9 ns", "max ns");
+    for (auto const &r: results)
+        for (auto const &[name, h]: rows(r))
+            std::println(out, "{:>8} | {:>9} | {:>9} | {:>10.0f} | {:>8.0f} | {:>8} | {:>8} | {:>8} | {:>10}",
+                         r.workload_name, name, h.count(), double(r.operations) / r.seconds, h.mean(),
+                         h.percentile(50), h.percentile(99), h.percentile(99.9), h.max());
+}
+
+auto write_csv(std::ostream &out, std::vector<result> const &results) -> void {
+    std::println(out, "workload,operation,count,seconds,ops_per_second,mean_ns,p50_ns,p99_ns,p999_ns,max_ns");
+    for (auto const &r: results)
+        for (auto const &[name, h]: rows(r))
+            std::println(out, "{},{},{},{:.6f},{:.0f},{:.1f},{},{},{},{}", r.workload_name, name, h.count(), r.seconds,
+                         double(r.operations) / r.seconds, h.mean(), h.percentile(50), h.percentile(99),
+                         h.percentile(99.9), h.max());
+}
+
+auto split(std::string_view list) -> std::vector<std::string> {
+    std::vector<std::string> parts;
+    while (!list.empty()) {
+        auto const comma = list.find(',');
+        parts.emplace_back(list.substr(0, comma));
+        list = comma == std::string_view::npos ? std::string_view{} : list.substr(comma + 1);
+    }
+    return parts;
+}
+
+/**
+ * @brief A custom workload from "read:0.9,scan:0.1", the operations left out have proportion 0
+ */
+auto parse_mix(std::string_view mix) -> std::optional<workload> {
+    workload w{"custom", {}, distribution::zipfian};
+    for (auto const &part: split(mix)) {
+        auto const colon = part.find(':');
+        if (colon == std::string::npos)
+            return std::nullopt;
+        auto const name = std::string_view(part).substr(0, colon);
+        std::size_t op = 0;
+        while (op < OPERATIONS && OPERATION_NAMES[op] != name)
+            ++op;
+        if (op == OPERATIONS)
+            return std::nullopt;
+        w.proportions[op] = std::stod(part.substr(colon + 1));
+    }
+    return w;
+}
+
+int main(int argc, char *argv[]) {
+    options opts;
+    for (int i = 1; i + 1 < argc; i += 2) {
+        std::string_view option = argv[i];
+        std::string_view arg = argv[i + 1];
+        if (option == "--records") {
+            opts.records = std::max<std::uint64_t>(std::stoull(std::string(arg)), 1);
+        } else if (option == "--operations") {
+            opts.operations = std::stoull(std::string(arg));
+        } else if (option == "--max-scan") {
+            opts.max_scan = std::max<std::size_t>(std::stoull(std::string(arg)), 1);
+        } else if (option == "--distribution" && std::ranges::find(DISTRIBUTION_NAMES, arg) != DISTRIBUTION_NAMES.end()) {
+            opts.keys = static_cast<distribution>(std::ranges::find(DISTRIBUTION_NAMES, arg) - DISTRIBUTION_NAMES.begin());
+        } else if (option == "--workloads") {
+            for (auto const &name: split(arg)) {
+                auto it = std::ranges::find(CORE_WORKLOADS, name, &workload::name);
+                if (it == CORE_WORKLOADS.end()) {
+                    argc = -1;
+                    break;
+                }
+                opts.workloads.push_back(*it);
+            }
+        } else if (auto mix = option == "--mix" ? parse_mix(arg) : std::nullopt) {
+            opts.workloads.push_back(*mix);
+        } else if (option == "--format" && (arg == "table" || arg == "csv")) {
+            opts.format = arg;
+        } else if (option == "--output") {
+            opts.output = arg;
+        } else {
+            argc = -1;
+        }
+        if (argc < 0)
+            break;
+    }
+    if (argc < 0 || argc % 2 == 0) {
+        std::println(std::cerr, "usage: {} [--records N] [--operations N] [--workloads a,...,f] "
+                                "[--mix read:P,update:P,insert:P,scan:P,rmw:P] "
+                                "[--distribution uniform|zipfian|latest] [--max-scan N] [--format table|csv] "
+                                "[--output file]", argv[0]);
+        return 1;
+    }
+    if (opts.workloads.empty())
+        opts.workloads.assign(CORE_WORKLOADS.begin(), CORE_WORKLOADS.end());
+
+    std::mt19937_64 rng{123};
+    std::optional<result> loaded;
+    std::vector<result> results;
+    for (auto const &w: opts.workloads) {
+        if (opts.format == "table")
+            std::println(std::cerr, "workload {}: {} records, {} operations, {} keys", w.name, opts.records,
+                         opts.operations, DISTRIBUTION_NAMES[static_cast<std::size_t>(opts.keys.value_or(w.keys))]);
+        results.push_back(run(w, opts, rng, loaded));
+    }
+    results.insert(results.begin(), std::move(*loaded));
+
+    std::ofstream file;
+    if (!opts.output.empty())
+        file.open(opts.output);
+    auto &out = opts.output.empty() ? std::cout : file;
+    if (opts.format == "csv")
+        write_csv(out, results);
+    else
+        write_table(out, results);
+}
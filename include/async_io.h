@@ -0,0 +1,277 @@
+//
+// Created by arnoldm on 19.10.26.
+//
+
+#ifndef ASYNC_IO_H
+#define ASYNC_IO_H
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cerrno>
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <future>
+#include <memory>
+#include <stdexcept>
+#include <system_error>
+#include <utility>
+#include <vector>
+#include <unistd.h>
+#include "thread_pool.h"
+
+#if __has_include(<linux/io_uring.h>) && __has_include(<sys/syscall.h>)
+#include <linux/io_uring.h>
+#include <sys/mman.h>
+#include <sys/syscall.h>
+#if defined(__NR_io_uring_setup) && defined(__NR_io_uring_enter)
+#define BT_HAS_IO_URING 1
+#endif
+#endif
+
+namespace bt {
+    enum class io_backend {
+        io_uring,
+        threads
+    };
+
+    /**
+     * A finished read of async_reader: the tag passed to read() and the number of bytes read or -errno.
+     */
+    struct read_completion {
+        std::uint64_t tag;
+        std::int64_t result;
+    };
+
+    /**
+     * Reads of file descriptors which run while the caller goes on, at most queue_depth() at a time, so that a
+     * device works on many requests at once instead of one pread() after the other.
+     *
+     * On Linux the reads go to an io_uring: read() only fills a submission queue entry, reap() submits all queued
+     * entries and waits for completions in one system call. Where io_uring is missing or not permitted (old
+     * kernels, seccomp filters) the reads run as pread() on a pool of threads instead. Not thread safe.
+     */
+    class async_reader {
+    public:
+        static constexpr unsigned DEFAULT_QUEUE_DEPTH = 64;
+
+        /**
+         * @brief Use backend if it is available, else the threads
+         */
+        explicit async_reader(unsigned queue_depth = DEFAULT_QUEUE_DEPTH, io_backend backend = io_backend::io_uring)
+            : queue_depth_(std::max(queue_depth, 1U)) {
+#ifdef BT_HAS_IO_URING
+            if (backend == io_backend::io_uring && setup_ring())
+                return;
+#endif
+            (void) backend;
+            backend_ = io_backend::threads;
+            pool_ = std::make_unique<thread_pool>(std::min(queue_depth_, MAX_THREADS));
+        }
+
+        ~async_reader() {
+            // the buffers of reads in flight belong to the caller, which may free them after this
+            std::vector<read_completion> ignored;
+            try {
+                while (in_flight_ > 0)
+                    reap(ignored, in_flight_);
+            } catch (...) {
+                // a destructor must not throw, e.g. while paged_vector unwinds: if the ring cannot be entered any
+                // more, closing it below cancels what is left
+            }
+#ifdef BT_HAS_IO_URING
+            unmap_ring();
+#endif
+        }
+
+        async_reader(async_reader const &) = delete;
+
+        async_reader & operator=(async_reader const &) = delete;
+
+        [[nodiscard]] auto backend() const noexcept -> io_backend { return backend_; }
+
+        [[nodiscard]] auto queue_depth() const noexcept -> unsigned { return queue_depth_; }
+
+        /**
+         * @return the number of reads passed to read() whose completion was not reaped yet
+         */
+        [[nodiscard]] auto in_flight() const noexcept -> unsigned { return in_flight_; }
+
+        /**
+         * @brief Start reading size bytes at offset of fd into buffer, which has to stay valid until the completion
+         * with tag is reaped. At most queue_depth() reads may be in flight: reap() one first if there are.
+         */
+        auto read(int fd, void *buffer, std::size_t size, std::uint64_t offset, std::uint64_t tag) -> void {
+            if (in_flight_ == queue_depth_)
+                throw std::length_error("async_reader: queue_depth reads in flight, reap first");
+            ++in_flight_;
+#ifdef BT_HAS_IO_URING
+            if (backend_ == io_backend::io_uring) {
+                auto const tail = *sq_tail_;
+                auto const entry = tail & *sq_mask_;
+                auto &sqe = sqes_[entry];
+                std::memset(&sqe, 0, sizeof(sqe));
+                sqe.opcode = IORING_OP_READ;
+                sqe.fd = fd;
+                sqe.addr = reinterpret_cast<std::uint64_t>(buffer);
+                sqe.len = static_cast<std::uint32_t>(size);
+                sqe.off = offset;
+                sqe.user_data = tag;
+                sq_array_[entry] = entry;
+                // the kernel reads the entry after it sees the new tail
+                std::atomic_ref(*sq_tail_).store(tail + 1, std::memory_order_release);
+                ++unsubmitted_;
+                return;
+            }
+#endif
+            futures_.emplace_back(tag, pool_->submit([fd, buffer, size, offset]() -> std::int64_t {
+                auto *p = static_cast<std::byte *>(buffer);
+                std::size_t done = 0;
+                while (done < size) {
+                    auto const n = ::pread(fd, p + done, size - done, static_cast<off_t>(offset + done));
+                    if (n < 0 && errno == EINTR)
+                        continue;
+                    if (n < 0)
+                        return -std::int64_t(errno);
+                    if (n == 0)
+                        break;
+                    done += static_cast<std::size_t>(n);
+                }
+                return std::int64_t(done);
+            }));
+        }
+
+        /**
+         * @brief Submit the reads not submitted yet and wait until at least min_count of the reads in flight have
+         * finished (all of them if there are less); appends the finished ones to completions
+         */
+        auto reap(std::vector<read_completion> &completions, std::size_t min_count = 1) -> void {
+            min_count = std::min<std::size_t>(min_count, in_flight_);
+#ifdef BT_HAS_IO_URING
+            if (backend_ == io_backend::io_uring) {
+                auto reaped = collect_completions(completions);
+                while (unsubmitted_ > 0 || reaped < min_count) {
+                    auto const wait = reaped < min_count ? unsigned(min_count - reaped) : 0U;
+                    auto const result = ::syscall(__NR_io_uring_enter, ring_fd_, unsubmitted_, wait,
+                                                  wait > 0 ? IORING_ENTER_GETEVENTS : 0U, nullptr, 0);
+                    if (result < 0) {
+                        if (errno == EINTR)
+                            continue;
+                        throw std::system_error(errno, std::generic_category(), "async_reader: io_uring_enter");
+                    }
+                    unsubmitted_ -= unsigned(result);
+                    reaped += collect_completions(completions);
+                }
+                return;
+            }
+#endif
+            std::size_t reaped = 0;
+            auto collect = [this, &completions, &reaped](auto it) {
+                completions.push_back({it->first, it->second.get()});
+                --in_flight_;
+                ++reaped;
+                return futures_.erase(it);
+            };
+            for (auto it = futures_.begin(); it != futures_.end();)
+                it = it->second.wait_for(std::chrono::seconds(0)) == std::future_status::ready ? collect(it) : it + 1;
+            while (reaped < min_count)
+                collect(futures_.begin());
+        }
+
+    private:
+        static constexpr unsigned MAX_THREADS = 16;
+
+#ifdef BT_HAS_IO_URING
+        auto setup_ring() -> bool {
+            io_uring_params params{};
+            auto const fd = ::syscall(__NR_io_uring_setup, queue_depth_, &params);
+            if (fd < 0)
+                return false;
+            ring_fd_ = int(fd);
+            sq_ring_size_ = params.sq_off.array + params.sq_entries * sizeof(unsigned);
+            cq_ring_size_ = params.cq_off.cqes + params.cq_entries * sizeof(io_uring_cqe);
+            bool const single_mmap = (params.features & IORING_FEAT_SINGLE_MMAP) != 0;
+            if (single_mmap)
+                sq_ring_size_ = cq_ring_size_ = std::max(sq_ring_size_, cq_ring_size_);
+            sqes_size_ = params.sq_entries * sizeof(io_uring_sqe);
+            auto map = [this](std::size_t size, off_t offset) {
+                auto *p = ::mmap(nullptr, size, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, ring_fd_, offset);
+                return p == MAP_FAILED ? nullptr : p;
+            };
+            p_sq_ring_ = map(sq_ring_size_, IORING_OFF_SQ_RING);
+            p_cq_ring_ = single_mmap ? p_sq_ring_ : map(cq_ring_size_, IORING_OFF_CQ_RING);
+            sqes_ = static_cast<io_uring_sqe *>(map(sqes_size_, IORING_OFF_SQES));
+            if (p_sq_ring_ == nullptr || p_cq_ring_ == nullptr || sqes_ == nullptr) {
+                unmap_ring();
+                return false;
+            }
+            auto at = [](void *ring, std::uint32_t offset) {
+                return reinterpret_cast<unsigned *>(static_cast<std::byte *>(ring) + offset);
+            };
+            sq_tail_ = at(p_sq_ring_, params.sq_off.tail);
+            sq_mask_ = at(p_sq_ring_, params.sq_off.ring_mask);
+            sq_array_ = at(p_sq_ring_, params.sq_off.array);
+            cq_head_ = at(p_cq_ring_, params.cq_off.head);
+            cq_tail_ = at(p_cq_ring_, params.cq_off.tail);
+            cq_mask_ = at(p_cq_ring_, params.cq_off.ring_mask);
+            cqes_ = reinterpret_cast<io_uring_cqe *>(static_cast<std::byte *>(p_cq_ring_) + params.cq_off.cqes);
+            // the completion queue holds all reads in flight
+            queue_depth_ = params.sq_entries;
+            backend_ = io_backend::io_uring;
+            return true;
+        }
+
+        auto unmap_ring() noexcept -> void {
+            if (sqes_ != nullptr)
+                ::munmap(sqes_, sqes_size_);
+            if (p_cq_ring_ != nullptr && p_cq_ring_ != p_sq_ring_)
+                ::munmap(p_cq_ring_, cq_ring_size_);
+            if (p_sq_ring_ != nullptr)
+                ::munmap(p_sq_ring_, sq_ring_size_);
+            if (ring_fd_ >= 0)
+                ::close(ring_fd_);
+            sqes_ = nullptr;
+            p_cq_ring_ = p_sq_ring_ = nullptr;
+            ring_fd_ = -1;
+        }
+
+        auto collect_completions(std::vector<read_completion> &completions) -> std::size_t {
+            auto head = *cq_head_;
+            auto const tail = std::atomic_ref(*cq_tail_).load(std::memory_order_acquire);
+            std::size_t count = 0;
+            for (; head != tail; ++head, ++count) {
+                auto const &cqe = cqes_[head & *cq_mask_];
+                completions.push_back({cqe.user_data, cqe.res});
+            }
+            // the kernel may reuse the entries once it sees the new head
+            std::atomic_ref(*cq_head_).store(head, std::memory_order_release);
+            in_flight_ -= unsigned(count);
+            return count;
+        }
+
+        int ring_fd_ = -1;
+        void *p_sq_ring_ = nullptr;
+        void *p_cq_ring_ = nullptr;
+        io_uring_sqe *sqes_ = nullptr;
+        std::size_t sq_ring_size_ = 0;
+        std::size_t cq_ring_size_ = 0;
+        std::size_t sqes_size_ = 0;
+        unsigned *sq_tail_ = nullptr;
+        unsigned *sq_mask_ = nullptr;
+        unsigned *sq_array_ = nullptr;
+        unsigned *cq_head_ = nullptr;
+        unsigned *cq_tail_ = nullptr;
+        unsigned *cq_mask_ = nullptr;
+        io_uring_cqe *cqes_ = nullptr;
+        unsigned unsubmitted_ = 0;
+#endif
+        unsigned queue_depth_;
+        unsigned in_flight_ = 0;
+        io_backend backend_ = io_backend::threads;
+        std::unique_ptr<thread_pool> pool_;
+        std::vector<std::pair<std::uint64_t, std::future<std::int64_t>>> futures_;
+    };
+}
+
+#endif //ASYNC_IO_H
@@ -0,0 +1,378 @@
+//
+// Created by arnoldm on 19.10.26.
+//
+
+#ifndef BINARY_IO_H
+#define BINARY_IO_H
+
+#include <algorithm>
+#include <bit>
+#include <cerrno>
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <istream>
+#include <optional>
+#include <ostream>
+#include <span>
+#include <stdexcept>
+#include <string>
+#include <system_error>
+#include <type_traits>
+#include <vector>
+
+#if __has_include(<unistd.h>)
+#include <sys/stat.h>
+#include <unistd.h>
+#define BT_HAS_FILE_DESCRIPTORS 1
+#endif
+
+namespace bt {
+    /**
+     * A 64 bit checksum of a byte stream, fed in pieces of any size: the stream is mixed in 8 byte words, each one
+     * by xor, multiply with the FNV prime and rotate. Every step is a bijection of the state, so a single changed
+     * word always changes the checksum. Detects corruption, not tampering.
+     */
+    class checksum {
+    public:
+        auto update(std::span<std::byte const> bytes) noexcept -> void {
+            auto const *p = bytes.data();
+            auto n = bytes.size();
+            length_ += n;
+            for (; n > 0 && pending_size_ != 0; ++p, --n)
+                add_byte(*p);
+            for (; n >= sizeof(std::uint64_t); p += sizeof(std::uint64_t), n -= sizeof(std::uint64_t)) {
+                std::uint64_t word;
+                std::memcpy(&word, p, sizeof(word));
+                mix(word);
+            }
+            for (; n > 0; ++p, --n)
+                add_byte(*p);
+        }
+
+        [[nodiscard]] auto value() const noexcept -> std::uint64_t {
+            auto copy = *this;
+            if (copy.pending_size_ != 0)
+                copy.mix(copy.pending_);
+            copy.mix(length_);
+            // final avalanche (murmur3 fmix64), so that every input bit reaches every output bit
+            auto h = copy.state_;
+            h ^= h >> 33;
+            h *= 0xff51afd7ed558ccdULL;
+            h ^= h >> 33;
+            h *= 0xc4ceb9fe1a85ec53ULL;
+            h ^= h >> 33;
+            return h;
+        }
+
+    private:
+        auto mix(std::uint64_t word) noexcept -> void {
+            state_ = std::rotl((state_ ^ word) * 0x100000001b3ULL, 29);
+        }
+
+        auto add_byte(std::byte b) noexcept -> void {
+            pending_ |= std::uint64_t(b) << (8 * pending_size_);
+            if (++pending_size_ == sizeof(std::uint64_t)) {
+                mix(pending_);
+                pending_ = 0;
+                pending_size_ = 0;
+            }
+        }
+
+        std::uint64_t state_ = 0xcbf29ce484222325ULL;
+        std::uint64_t length_ = 0;
+        std::uint64_t pending_ = 0;
+        std::size_t pending_size_ = 0;
+    };
+
+    /**
+     * Buffered binary output to a std::ostream or a file descriptor. finish() flushes the buffer and appends the
+     * checksum of all bytes written; a stream which is not finished has no checksum and fails binary_reader::finish().
+     * Throws std::runtime_error (std::system_error for file descriptors) if writing fails.
+     */
+    class binary_writer {
+    public:
+        static constexpr std::size_t BUFFER_SIZE = std::size_t(1) << 16;
+
+        explicit binary_writer(std::ostream &out) : p_out_(&out) { buffer_.reserve(BUFFER_SIZE); }
+
+#ifdef BT_HAS_FILE_DESCRIPTORS
+        /**
+         * @brief Write to the open file descriptor fd, which stays open
+         */
+        explicit binary_writer(int fd) : fd_(fd) { buffer_.reserve(BUFFER_SIZE); }
+#endif
+
+        binary_writer(binary_writer const &) = delete;
+
+        binary_writer & operator=(binary_writer const &) = delete;
+
+        auto write(void const *data, std::size_t size) -> void {
+            auto const *p = static_cast<std::byte const *>(data);
+            if (buffer_.size() + size > BUFFER_SIZE) {
+                flush_buffer();
+                // big blocks bypass the buffer
+                if (size >= BUFFER_SIZE) {
+                    checksum_.update({p, size});
+                    write_through(p, size);
+                    return;
+                }
+            }
+            buffer_.insert(buffer_.end(), p, p + size);
+        }
+
+        template<typename T> requires std::is_trivially_copyable_v<T>
+        auto write_value(T const &value) -> void { write(&value, sizeof(T)); }
+
+        /**
+         * @brief Flush and append the checksum
+         */
+        auto finish() -> void {
+            flush_buffer();
+            auto const sum = checksum_.value();
+            write_through(reinterpret_cast<std::byte const *>(&sum), sizeof(sum));
+            flush();
+        }
+
+        /**
+         * @brief Write the buffered bytes without a checksum, for formats which have checksums of their own
+         */
+        auto flush() -> void {
+            flush_buffer();
+            if (p_out_ != nullptr && !p_out_->flush())
+                throw std::runtime_error("binary_writer: flushing the stream failed");
+        }
+
+    private:
+        auto flush_buffer() -> void {
+            checksum_.update(buffer_);
+            write_through(buffer_.data(), buffer_.size());
+            buffer_.clear();
+        }
+
+        auto write_through(std::byte const *p, std::size_t size) -> void {
+            if (p_out_ != nullptr) {
+                if (!p_out_->write(reinterpret_cast<char const *>(p), static_cast<std::streamsize>(size)))
+                    throw std::runtime_error("binary_writer: writing to the stream failed");
+                return;
+            }
+#ifdef BT_HAS_FILE_DESCRIPTORS
+            while (size > 0) {
+                auto const written = ::write(fd_, p, size);
+                if (written < 0) {
+                    if (errno == EINTR)
+                        continue;
+                    throw std::system_error(errno, std::generic_category(), "binary_writer: write");
+                }
+                p += written;
+                size -= static_cast<std::size_t>(written);
+            }
+#endif
+        }
+
+        std::ostream *p_out_ = nullptr;
+        int fd_ = -1;
+        std::vector<std::byte> buffer_;
+        checksum checksum_;
+    };
+
+    /**
+     * Buffered binary input from a std::istream or a file descriptor, the counterpart of binary_writer. finish()
+     * reads the checksum and compares it to the one of all bytes read. Throws std::runtime_error if the input ends
+     * early or the checksums differ (std::system_error if reading a file descriptor fails).
+     */
+    class binary_reader {
+    public:
+        static constexpr std::size_t BUFFER_SIZE = binary_writer::BUFFER_SIZE;
+
+        explicit binary_reader(std::istream &in) : p_in_(&in), buffer_(BUFFER_SIZE) {}
+
+#ifdef BT_HAS_FILE_DESCRIPTORS
+        /**
+         * @brief Read from the open file descriptor fd, which stays open
+         */
+        explicit binary_reader(int fd) : fd_(fd), buffer_(BUFFER_SIZE) {}
+#endif
+
+        binary_reader(binary_reader const &) = delete;
+
+        binary_reader & operator=(binary_reader const &) = delete;
+
+        auto read(void *data, std::size_t size) -> void {
+            auto *p = static_cast<std::byte *>(data);
+            while (size > 0) {
+                if (position_ == end_) {
+                    // big blocks bypass the buffer
+                    if (size >= BUFFER_SIZE) {
+                        checksum_.update({buffer_.data() + checked_, end_ - checked_});
+                        checked_ = end_;
+                        read_through(p, size);
+                        checksum_.update({p, size});
+                        return;
+                    }
+                    refill();
+                }
+                auto const n = std::min(size, end_ - position_);
+                std::memcpy(p, buffer_.data() + position_, n);
+                position_ += n;
+                p += n;
+                size -= n;
+            }
+        }
+
+        template<typename T> requires std::is_trivially_copyable_v<T>
+        auto read_value() -> T {
+            T value;
+            read(&value, sizeof(T));
+            return value;
+        }
+
+        /**
+         * @return the number of bytes left in the input, std::nullopt if the input cannot tell (e.g. a pipe)
+         */
+        auto remaining() -> std::optional<std::size_t> {
+            auto const buffered = end_ - position_;
+            if (p_in_ != nullptr) {
+                auto const position = p_in_->tellg();
+                if (position == std::istream::pos_type(-1))
+                    return std::nullopt;
+                p_in_->seekg(0, std::ios_base::end);
+                auto const end = p_in_->tellg();
+                p_in_->seekg(position);
+                if (end == std::istream::pos_type(-1) || !*p_in_)
+                    return std::nullopt;
+                return buffered + static_cast<std::size_t>(end - position);
+            }
+#ifdef BT_HAS_FILE_DESCRIPTORS
+            struct stat status{};
+            auto const position = ::lseek(fd_, 0, SEEK_CUR);
+            if (position < 0 || ::fstat(fd_, &status) != 0 || !S_ISREG(status.st_mode) || status.st_size < position)
+                return std::nullopt;
+            return buffered + static_cast<std::size_t>(status.st_size - position);
+#else
+            return std::nullopt;
+#endif
+        }
+
+        /**
+         * @brief Read the checksum and compare it to the one of the bytes read so far
+         */
+        auto finish() -> void {
+            checksum_.update({buffer_.data() + checked_, position_ - checked_});
+            checked_ = position_;
+            auto const expected = checksum_.value();
+            std::uint64_t stored;
+            read(&stored, sizeof(stored));
+            if (stored != expected)
+                throw std::runtime_error("binary_reader: checksum mismatch, the input is corrupt");
+        }
+
+    private:
+        auto refill() -> void {
+            checksum_.update({buffer_.data() + checked_, end_ - checked_});
+            end_ = read_some(buffer_.data(), buffer_.size());
+            if (end_ == 0)
+                throw std::runtime_error("binary_reader: unexpected end of input");
+            position_ = 0;
+            checked_ = 0;
+        }
+
+        auto read_through(std::byte *p, std::size_t size) -> void {
+            while (size > 0) {
+                auto const n = read_some(p, size);
+                if (n == 0)
+                    throw std::runtime_error("binary_reader: unexpected end of input");
+                p += n;
+                size -= n;
+            }
+        }
+
+        /**
+         * @return the number of bytes read, 0 at the end of the input
+         */
+        auto read_some(std::byte *p, std::size_t size) -> std::size_t {
+            if (p_in_ != nullptr) {
+                p_in_->read(reinterpret_cast<char *>(p), static_cast<std::streamsize>(size));
+                return static_cast<std::size_t>(p_in_->gcount());
+            }
+#ifdef BT_HAS_FILE_DESCRIPTORS
+            for (;;) {
+                auto const n = ::read(fd_, p, size);
+                if (n >= 0)
+                    return static_cast<std::size_t>(n);
+                if (errno != EINTR)
+                    throw std::system_error(errno, std::generic_category(), "binary_reader: read");
+            }
+#else
+            return 0;
+#endif
+        }
+
+        std::istream *p_in_ = nullptr;
+        int fd_ = -1;
+        std::vector<std::byte> buffer_;
+        std::size_t position_ = 0;
+        std::size_t end_ = 0;
+        // bytes before checked_ in the buffer are part of checksum_
+        std::size_t checked_ = 0;
+        checksum checksum_;
+    };
+
+    /**
+     * Codec for binary_writer and binary_reader: trivially copyable types are copied as they are in memory, a whole
+     * span at once, strings as their length followed by their characters. A codec for other types provides the same
+     * write(binary_writer &, std::span<T const>) and read(binary_reader &, std::span<T>) members.
+     */
+    struct binary_codec {
+        // characters of a string read at once
+        static constexpr std::size_t STRING_CHUNK = std::size_t(1) << 20;
+
+        template<typename T> requires std::is_trivially_copyable_v<T>
+        auto write(binary_writer &out, std::span<T const> items) const -> void {
+            out.write(items.data(), items.size_bytes());
+        }
+
+        template<typename T> requires std::is_trivially_copyable_v<T>
+        auto read(binary_reader &in, std::span<T> items) const -> void {
+            in.read(items.data(), items.size_bytes());
+        }
+
+        template<typename Char, typename Traits, typename Allocator>
+        auto write(binary_writer &out, std::span<std::basic_string<Char, Traits, Allocator> const> items) const -> void {
+            for (auto const &item : items) {
+                out.write_value(std::uint64_t(item.size()));
+                out.write(item.data(), item.size() * sizeof(Char));
+            }
+        }
+
+        template<typename Char, typename Traits, typename Allocator>
+        auto read(binary_reader &in, std::span<std::basic_string<Char, Traits, Allocator>> items) const -> void {
+            for (auto &item : items) {
+                auto const length = in.read_value<std::uint64_t>();
+                // a corrupt length must not allocate more than the input holds: long strings are checked against the
+                // rest of the input if it is known, and grow with the characters actually read
+                if (length > STRING_CHUNK) {
+                    if (auto const remaining = in.remaining(); remaining && length > *remaining / sizeof(Char))
+                        throw std::runtime_error("binary_reader: string longer than the rest of the input, the input is corrupt");
+                }
+                item.clear();
+                for (auto left = length; left > 0;) {
+                    auto const n = static_cast<std::size_t>(std::min<std::uint64_t>(left, STRING_CHUNK));
+                    auto const size = item.size();
+                    item.resize(size + n);
+                    in.read(item.data() + size, n * sizeof(Char));
+                    left -= n;
+                }
+            }
+        }
+    };
+
+    template<typename Codec, typename T>
+    concept binary_codec_for = requires(Codec const &codec, binary_writer &out, binary_reader &in,
+                                        std::span<T const> items, std::span<T> buffer) {
+        codec.write(out, items);
+        codec.read(in, buffer);
+    };
+}
+
+#endif //BINARY_IO_H
@@ -0,0 +1,93 @@
+//
+// Created by arnoldm on 19.10.26.
+//
+
+#ifndef BLOOM_FILTER_H
+#define BLOOM_FILTER_H
+
+#include <algorithm>
+#include <array>
+#include <bit>
+#include <cmath>
+#include <cstddef>
+#include <cstdint>
+#include <functional>
+#include <utility>
+#include <vector>
+
+namespace bt {
+    /**
+     * A blocked Bloom filter of keys: may_contain() is false for keys never inserted, and true for all inserted
+     * keys and a fraction of the others (about 1% with 10 bits per key). All bits of a key lie in one block of a
+     * cache line, so a lookup costs one cache miss, for a slightly higher false positive rate than a filter which
+     * spreads the bits over the whole array.
+     *
+     * Hash is mixed with a 64 bit finalizer first, so an identity hash like std::hash<int> is fine.
+     */
+    template<typename Key, typename Hash = std::hash<Key>>
+    class bloom_filter {
+    public:
+        static constexpr std::size_t BLOCK_BITS = 512;
+
+        /**
+         * @brief A filter for about expected_count keys with bits_per_key bits each
+         */
+        explicit bloom_filter(std::size_t expected_count = 0, std::size_t bits_per_key = 10)
+            : blocks_(std::max<std::size_t>(1, (expected_count * bits_per_key + BLOCK_BITS - 1) / BLOCK_BITS)),
+              hash_count_(std::clamp<unsigned>(static_cast<unsigned>(std::lround(double(bits_per_key) * 0.69)), 1, 16)) {}
+
+        auto insert(Key const &key) noexcept -> void {
+            auto [block, h] = locate(key);
+            for (unsigned i = 0; i < hash_count_; ++i, h = next(h))
+                block->words[(h >> 6) % WORDS] |= std::uint64_t(1) << (h & 63);
+        }
+
+        [[nodiscard]] auto may_contain(Key const &key) const noexcept -> bool {
+            auto [block, h] = locate(key);
+            for (unsigned i = 0; i < hash_count_; ++i, h = next(h))
+                if ((block->words[(h >> 6) % WORDS] & (std::uint64_t(1) << (h & 63))) == 0)
+                    return false;
+            return true;
+        }
+
+        [[nodiscard]] auto bit_count() const noexcept -> std::size_t { return blocks_.size() * BLOCK_BITS; }
+
+        [[nodiscard]] auto hash_count() const noexcept -> unsigned { return hash_count_; }
+
+    private:
+        static constexpr std::size_t WORDS = BLOCK_BITS / 64;
+
+        struct alignas(64) block_type {
+            std::array<std::uint64_t, WORDS> words{};
+        };
+
+        static constexpr auto mix(std::uint64_t h) noexcept -> std::uint64_t {
+            h ^= h >> 33;
+            h *= 0xff51afd7ed558ccdULL;
+            h ^= h >> 33;
+            h *= 0xc4ceb9fe1a85ec53ULL;
+            h ^= h >> 33;
+            return h;
+        }
+
+        // the bits of a key: 9 bits of h each, h rotated in between
+        static constexpr auto next(std::uint64_t h) noexcept -> std::uint64_t { return std::rotr(h, 9) * 0x9e3779b97f4a7c15ULL; }
+
+        template<typename Self>
+        static auto locate_in(Self &self, Key const &key) noexcept {
+            auto const h = mix(static_cast<std::uint64_t>(Hash{}(key)));
+            // the high bits pick the block, the low bits the bits in it
+            auto const block = static_cast<std::size_t>((h >> 32) % self.blocks_.size());
+            return std::pair{&self.blocks_[block], h};
+        }
+
+        auto locate(Key const &key) noexcept { return locate_in(*this, key); }
+
+        auto locate(Key const &key) const noexcept { return locate_in(*this, key); }
+
+        std::vector<block_type> blocks_;
+        unsigned hash_count_;
+    };
+}
+
+#endif //BLOOM_FILTER_H
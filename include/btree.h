@@ -5,19 +5,391 @@
 #ifndef BTREE_H
 #define BTREE_H
 
+#include <array>
+#include <atomic>
+#include <cerrno>
+#include <chrono>
+#include <cstring>
+#include <concepts>
 #include <functional>
 #include <variant>
 #include <iosfwd>
 #include <string>
+#include <string_view>
 #include <algorithm>
 #include <numeric>
+#include <span>
+#include <vector>
 #include <sstream>
+#include <bit>
+#include <memory>
+#include <mutex>
+#include <system_error>
+#include <type_traits>
+#include <utility>
 #include "dyn_array.h"
+#include "huge_page_allocator.h"
+#include "stable_vector.h"
+#include "cow_vector.h"
+#include "paged_vector.h"
+#include "thread_pool.h"
+#include "binary_io.h"
 
 namespace bt {
     class btree_test_class;
 
-    template<typename Key, typename Value, typename Index, size_t Internal_order, size_t Leaf_order>
+    /**
+     * Split policy: a full leaf is split in half at its midpoint.
+     */
+    struct midpoint_split {
+        static constexpr bool shift_to_siblings = false;
+        static constexpr bool split_two_to_three = false;
+    };
+
+    /**
+     * B*-tree like split policy: entries of a full leaf are first shifted into the previous or next leaf
+     * if one of them has room. If the neighbour is full as well, both leaves are split into three leaves
+     * which are about 2/3 full afterwards.
+     */
+    struct bstar_split {
+        static constexpr bool shift_to_siblings = true;
+        static constexpr bool split_two_to_three = true;
+    };
+
+    template<typename T>
+    concept split_policy = requires {
+        { T::shift_to_siblings } -> std::convertible_to<bool>;
+        { T::split_two_to_three } -> std::convertible_to<bool>;
+    };
+
+    /**
+     * Rebalance policy: a node underflows if it has less than Underflow_percent of its order entries.
+     * An underflowing node is merged with a neighbour if that neighbour has at most Merge_percent of its order
+     * entries. Otherwise entries are moved over from the neighbour: just enough to end the underflow or, if
+     * Equalize is set, until both nodes have the same size.
+     *
+     * rebalance_policy<> is the classic B+tree behaviour. A lower underflow threshold together with
+     * equalizing (e.g. rebalance_policy<25, 50, true>) adds hysteresis: nodes are rebalanced less often and
+     * are far from the threshold afterwards.
+     *
+     * With Deferred, an erase only remembers the node it leaves underflowing and btree::maintain() rebalances it
+     * later, e.g. outside of request handling. A leaf which becomes empty or an internal node left with a single
+     * child is still rebalanced at once.
+     */
+    template<std::size_t Underflow_percent = 50, std::size_t Merge_percent = 50, bool Equalize = false,
+        bool Deferred = false>
+    struct rebalance_policy {
+        static_assert(Underflow_percent > 0 && Underflow_percent <= 50, "Underflow_percent must be in (0, 50]");
+        static_assert(Merge_percent >= Underflow_percent, "Merge_percent must not be below Underflow_percent");
+        static_assert(Underflow_percent + Merge_percent <= 100, "merged nodes would overflow");
+
+        static constexpr bool equalize = Equalize;
+        static constexpr bool deferred = Deferred;
+
+        template<std::size_t Order>
+        static consteval std::size_t min_size() { return std::max<std::size_t>(Order * Underflow_percent / 100, 1); }
+
+        template<std::size_t Order>
+        static consteval std::size_t merge_size() { return std::max<std::size_t>(Order * Merge_percent / 100, 1); }
+    };
+
+    template<typename T>
+    concept rebalance_policy_type = requires {
+        { T::equalize } -> std::convertible_to<bool>;
+        { T::template min_size<4>() } -> std::convertible_to<std::size_t>;
+        { T::template merge_size<4>() } -> std::convertible_to<std::size_t>;
+    };
+
+    inline constexpr std::size_t CACHE_LINE_SIZE = 64;
+
+    /**
+     * Storage policy: nodes are stored in a std::vector.
+     */
+    struct vector_storage {
+        static constexpr std::size_t node_alignment = 0;
+
+        template<typename Node>
+        using container_type = std::vector<Node>;
+    };
+
+    /**
+     * Storage policy: nodes never move in memory (see stable_vector), e.g. for readers which run concurrently
+     * to a writer adding nodes.
+     */
+    struct stable_storage {
+        static constexpr std::size_t node_alignment = 0;
+
+        template<typename Node>
+        using container_type = stable_vector<Node>;
+    };
+
+    /**
+     * Storage policy: copies of the tree share all nodes until one of them changes a node (see cow_vector), which
+     * makes btree::snapshot() O(1). Every change copies the chunks of Chunk_size nodes it touches on the way from
+     * the root to the leaf, if they are shared with a snapshot.
+     */
+    template<std::size_t Chunk_size = 4>
+    struct cow_storage {
+        static constexpr std::size_t node_alignment = 0;
+        static constexpr bool copy_on_write = true;
+
+        template<typename Node>
+        using container_type = cow_vector<Node, Chunk_size>;
+    };
+
+    /**
+     * Storage policy: every node is aligned to Alignment bytes and occupies a multiple of Alignment bytes, e.g. a
+     * cache line or a page. The variant holding a node adds its index to the node: with orders from best_order for
+     * Page_size a node takes two pages, choose the orders for a slightly smaller size (see page_storage_order).
+     * With Huge_pages the node storage is backed by 2 MB pages (see huge_page_allocator).
+     */
+    template<std::size_t Alignment = CACHE_LINE_SIZE, bool Huge_pages = false>
+    struct aligned_node_storage {
+        static_assert(std::has_single_bit(Alignment), "Alignment must be a power of 2");
+        static constexpr std::size_t node_alignment = Alignment;
+
+        template<typename Node>
+        using container_type = std::vector<Node, std::conditional_t<Huge_pages, huge_page_allocator<Node>, std::allocator<Node>>>;
+    };
+
+    /**
+     * Storage policy: nodes live in a page file, one per page of Page_size bytes, and at most Frames of them in
+     * memory (see paged_vector), for trees larger than memory. Nodes are written to the page file as they are in
+     * memory, so keys and values must be trivially copyable. With orders from page_storage_order a node fits into
+     * one page. Frames has to exceed 2 * (Internal_order + 1). Read via std::as_const where possible: non-const
+     * access marks pages dirty. Even reads change the buffer pool, so parallel_for_each() runs on the calling
+     * thread and bulk_load(entries, pool) only sorts in parallel.
+     *
+     * find_batch() reads the nodes of a level for many keys at once, scans read the next Read_ahead leaves ahead,
+     * both with asynchronous reads (see paged_vector::prefetch()). Direct_io bypasses the OS page cache.
+     */
+    template<std::size_t Frames = 1 << 14, std::size_t Page_size = 4096, std::size_t Read_ahead = 16, bool Direct_io = false>
+    requires (Read_ahead > 0)
+    struct paged_storage {
+        static constexpr std::size_t node_alignment = 0;
+        static constexpr bool paged = true;
+        static constexpr std::size_t frames = Frames;
+        static constexpr std::size_t read_ahead = Read_ahead;
+
+        template<typename Node>
+        using container_type = paged_vector<Node, Frames, Page_size, Direct_io>;
+    };
+
+    template<typename T>
+    concept storage_policy_type = requires {
+        { T::node_alignment } -> std::convertible_to<std::size_t>;
+        typename T::template container_type<int>;
+    };
+
+    template<typename T>
+    concept copy_on_write_storage = storage_policy_type<T> && requires { requires T::copy_on_write; };
+
+    /**
+     * The structural changes and descents counted by a Stats policy
+     */
+    enum class btree_event : std::uint8_t {
+        leaf_split, internal_split, leaf_merge, internal_merge, leaf_rebalance, internal_rebalance, grow, shrink,
+        parent_key_adjustment, descent, descent_node
+    };
+
+    inline constexpr std::size_t BTREE_EVENTS = 11;
+
+    inline constexpr std::array<std::string_view, BTREE_EVENTS> BTREE_EVENT_NAMES{
+        "leaf_split", "internal_split", "leaf_merge", "internal_merge", "leaf_rebalance", "internal_rebalance", "grow",
+        "shrink", "parent_key_adjustment", "descent", "descent_node"
+    };
+
+    /**
+     * Counts of btree_event, see btree::stats(). A descent is a search from the root to a leaf, descent_node counts
+     * the nodes it visits.
+     */
+    struct btree_stats {
+        std::array<std::uint64_t, BTREE_EVENTS> counts{};
+
+        auto operator[](btree_event event) const noexcept -> std::uint64_t { return counts[std::to_underlying(event)]; }
+
+        auto operator[](btree_event event) noexcept -> std::uint64_t & { return counts[std::to_underlying(event)]; }
+
+        [[nodiscard]] auto nodes_per_descent() const noexcept -> double {
+            auto const descents = (*this)[btree_event::descent];
+            return descents == 0 ? 0 : double((*this)[btree_event::descent_node]) / double(descents);
+        }
+
+        auto operator+=(btree_stats const &other) noexcept -> btree_stats & {
+            for (std::size_t i = 0; i < BTREE_EVENTS; ++i)
+                counts[i] += other.counts[i];
+            return *this;
+        }
+
+        friend auto operator==(btree_stats const &, btree_stats const &) -> bool = default;
+    };
+
+    /**
+     * Counters of no_stats: nothing
+     */
+    struct no_counters {
+        auto add(btree_event, std::uint64_t) const noexcept -> void {}
+
+        [[nodiscard]] auto value() const noexcept -> btree_stats { return {}; }
+
+        auto reset() noexcept -> void {}
+    };
+
+    /**
+     * Counters of tree_stats: plain integers, for a tree used by one thread at a time
+     */
+    class tree_counters {
+    public:
+        auto add(btree_event event, std::uint64_t n) noexcept -> void { stats_[event] += n; }
+
+        [[nodiscard]] auto value() const noexcept -> btree_stats { return stats_; }
+
+        auto reset() noexcept -> void { stats_ = {}; }
+
+    private:
+        btree_stats stats_;
+    };
+
+    /**
+     * Counters of per_thread_stats: every thread adds to its own cache line (threads beyond Stripes share them)
+     * with relaxed atomics, value() adds the stripes up
+     */
+    template<std::size_t Stripes>
+    class striped_counters {
+    public:
+        striped_counters() = default;
+
+        // a copy of a tree starts counting from 0
+        striped_counters(striped_counters const &) noexcept {}
+
+        auto operator=(striped_counters const &) noexcept -> striped_counters & { return *this; }
+
+        auto add(btree_event event, std::uint64_t n) noexcept -> void {
+            stripes_[stripe_index()].counts[std::to_underlying(event)].fetch_add(n, std::memory_order_relaxed);
+        }
+
+        [[nodiscard]] auto value() const noexcept -> btree_stats {
+            btree_stats stats;
+            for (auto const &stripe: stripes_)
+                for (std::size_t i = 0; i < BTREE_EVENTS; ++i)
+                    stats.counts[i] += stripe.counts[i].load(std::memory_order_relaxed);
+            return stats;
+        }
+
+        auto reset() noexcept -> void {
+            for (auto &stripe: stripes_)
+                for (auto &count: stripe.counts)
+                    count.store(0, std::memory_order_relaxed);
+        }
+
+    private:
+        struct alignas(CACHE_LINE_SIZE) stripe_type {
+            std::array<std::atomic<std::uint64_t>, BTREE_EVENTS> counts{};
+        };
+
+        static auto stripe_index() noexcept -> std::size_t {
+            static constinit std::atomic<std::size_t> next_thread{0};
+            thread_local std::size_t const index = next_thread.fetch_add(1, std::memory_order_relaxed) % Stripes;
+            return index;
+        }
+
+        std::array<stripe_type, Stripes> stripes_{};
+    };
+
+    /**
+     * Stats policy: nothing is counted, the tree is exactly as without it.
+     */
+    struct no_stats {
+        static constexpr bool enabled = false;
+        using counters_type = no_counters;
+    };
+
+    /**
+     * Stats policy: the tree counts its splits, merges, rebalances, root changes, parent key adjustments and
+     * descents (see btree_event), read by btree::stats(). A compare and an add per event, no synchronization:
+     * the descents of concurrent readers would race, use per_thread_stats for those.
+     */
+    struct tree_stats {
+        static constexpr bool enabled = true;
+        using counters_type = tree_counters;
+    };
+
+    /**
+     * Stats policy: like tree_stats, but every thread counts into its own stripe of the tree's counters and
+     * btree::stats() aggregates them, so that readers sharing a tree (e.g. under a shared lock) can count their
+     * descents without contending on a cache line.
+     */
+    template<std::size_t Stripes = 16>
+    struct per_thread_stats {
+        static_assert(Stripes > 0);
+        static constexpr bool enabled = true;
+        using counters_type = striped_counters<Stripes>;
+    };
+
+    template<typename T>
+    concept stats_policy_type = requires {
+        { T::enabled } -> std::convertible_to<bool>;
+        typename T::counters_type;
+    };
+
+    /**
+     * A std::variant aligned to Alignment bytes, so that its size is a multiple of Alignment too.
+     */
+    template<std::size_t Alignment, typename... Types>
+    struct alignas(Alignment) aligned_variant : std::variant<Types...> {
+        using std::variant<Types...>::variant;
+    };
+
+    /**
+     * Header of a tree image written by btree::save_image(): the nodes follow at offset IMAGE_ALIGNMENT as they are
+     * in memory, then the image_checksum() of the header page and the nodes.
+     */
+    struct btree_image_header {
+        static constexpr char MAGIC[8] = {'b', 't', '-', 'i', 'm', 'a', 'g', 'e'};
+        static constexpr std::uint32_t VERSION = 2;
+        static constexpr std::uint32_t BYTE_ORDER_MARK = 0x01020304;
+        static constexpr std::size_t IMAGE_ALIGNMENT = 4096;
+
+        char magic[8];
+        std::uint32_t version;
+        std::uint32_t byte_order;
+        std::uint64_t key_size;
+        std::uint64_t value_size;
+        std::uint64_t index_size;
+        std::uint64_t internal_order;
+        std::uint64_t leaf_order;
+        std::uint64_t node_size;
+        std::uint64_t node_count;
+        std::uint64_t root_index;
+        std::uint64_t first_leaf_index;
+        std::uint64_t last_leaf_index;
+        std::uint64_t entry_count;
+
+        /**
+         * @brief The checksum of a node of an image
+         */
+        static auto node_checksum(void const *p_node, std::size_t node_size) noexcept -> std::uint64_t {
+            checksum sum;
+            sum.update({static_cast<std::byte const *>(p_node), node_size});
+            return sum.value();
+        }
+
+        /**
+         * @brief The checksum at the end of an image: of the header page and the checksums of the nodes in order,
+         * so that a change of some nodes (btree::checkpoint()) only needs their new checksums, not the whole image
+         */
+        static auto image_checksum(std::span<std::byte const> header_page, std::span<std::uint64_t const> node_checksums) noexcept
+            -> std::uint64_t {
+            checksum sum;
+            sum.update(header_page);
+            sum.update(std::as_bytes(node_checksums));
+            return sum.value();
+        }
+    };
+
+    template<typename Key, typename Value, typename Index, size_t Internal_order, size_t Leaf_order,
+        typename Split_policy = midpoint_split, typename Rebalance_policy = rebalance_policy<>,
+        typename Storage_policy = vector_storage, typename Stats_policy = no_stats>
     class btree;
 
     template<typename Btree_traits, bool Is_leaf>
@@ -39,8 +411,7 @@ namespace bt {
         using key_type = typename Btree_traits::key_type;
         using value_type = typename Btree_traits::value_type;
         using index_type = typename Btree_traits::index_type;
-        using btree_type = btree<typename Btree_traits::key_type, typename Btree_traits::value_type, typename Btree_traits::index_type,
-        Btree_traits::internal_order, Btree_traits::leaf_order>;
+        using btree_type = typename Btree_traits::btree_type;
         using key_store_type = bt::dyn_array<key_type, Btree_traits::template get_order<Is_leaf>(), index_type>;
 
         static constexpr index_type INVALID_INDEX = std::numeric_limits<index_type>::max();
@@ -99,7 +470,7 @@ namespace bt {
         using index_type = typename Btree_traits::index_type;
         using this_type = btree_internal_node;
         using base_type = btree_node<Btree_traits, false>;
-        using btree_type = btree<key_type, value_type, index_type, Btree_traits::internal_order, Btree_traits::leaf_order>;
+        using btree_type = typename Btree_traits::btree_type;
         using index_store_type = bt::dyn_array<index_type, Btree_traits::internal_order + 1, index_type>;
 
         using base_type::INVALID_INDEX;
@@ -177,7 +548,7 @@ namespace bt {
         using index_type = typename Btree_traits::index_type;
         using this_type = btree_leaf_node;
         using base_type = btree_node<Btree_traits, true>;
-        using btree_type = btree<key_type, value_type, index_type, Btree_traits::internal_order, Btree_traits::leaf_order>;
+        using btree_type = typename Btree_traits::btree_type;
         using value_store_type = bt::dyn_array<value_type, Btree_traits::leaf_order, index_type>;
 
         using base_type::INVALID_INDEX;
@@ -248,15 +619,25 @@ namespace bt {
         value_store_type values_;
     };
 
-    template<typename Key, typename Value, typename Index, std::size_t Internal_order, std::size_t Leaf_order>
+    template<typename Key, typename Value, typename Index, std::size_t Internal_order, std::size_t Leaf_order,
+        typename Split_policy = midpoint_split, typename Rebalance_policy = rebalance_policy<>,
+        typename Storage_policy = vector_storage, typename Stats_policy = no_stats>
     struct traits_type {
         using key_type = Key;
         using value_type = Value;
         using index_type = Index;
+        using split_policy = Split_policy;
+        using rebalance_policy = Rebalance_policy;
+        using storage_policy = Storage_policy;
+        using stats_policy = Stats_policy;
+        using btree_type = btree<Key, Value, Index, Internal_order, Leaf_order, Split_policy, Rebalance_policy, Storage_policy, Stats_policy>;
         static constexpr std::size_t internal_order = Internal_order;
-        static constexpr std::size_t min_internal_order = std::max(Internal_order / 2, 1UL);
+        static constexpr std::size_t min_internal_order = Rebalance_policy::template min_size<Internal_order>();
+        static constexpr std::size_t merge_internal_order = Rebalance_policy::template merge_size<Internal_order>();
         static constexpr std::size_t leaf_order = Leaf_order;
-        static constexpr std::size_t min_leaf_order = std::max(Leaf_order / 2, 1UL);
+        static constexpr std::size_t min_leaf_order = Rebalance_policy::template min_size<Leaf_order>();
+        static constexpr std::size_t merge_leaf_order = Rebalance_policy::template merge_size<Leaf_order>();
+        static constexpr bool deferred_rebalance = requires { requires Rebalance_policy::deferred; };
         template<bool Is_leaf>
         static consteval  std::size_t get_order() {
             if constexpr  (Is_leaf) return leaf_order; else return internal_order;
@@ -265,6 +646,10 @@ namespace bt {
         static consteval std::size_t get_min_order() {
             if constexpr (Is_leaf) return min_leaf_order; else return min_internal_order;
         }
+        template<bool Is_leaf>
+        static consteval std::size_t get_merge_order() {
+            if constexpr (Is_leaf) return merge_leaf_order; else return merge_internal_order;
+        }
 
     };
 
@@ -282,6 +667,35 @@ namespace bt {
         return order;
     }
 
+    /**
+     * Size of a node of type Node_type rounded up to whole cache lines.
+     */
+    template<typename Node_type, std::size_t Cache_line_size = CACHE_LINE_SIZE>
+    constexpr std::size_t cache_line_aligned_size() {
+        return (sizeof(Node_type) + Cache_line_size - 1) / Cache_line_size * Cache_line_size;
+    }
+
+    /**
+     * Like best_order, but for a budget of whole cache lines: the biggest order whose node
+     * occupies at most Cache_lines cache lines, i.e. cache_line_aligned_size() <= Cache_lines * Cache_line_size.
+     */
+    template<template<typename> typename Node_type
+    , typename Key, typename Value, typename Index,
+        std::size_t Cache_lines, std::size_t Cache_line_size = CACHE_LINE_SIZE>
+    constexpr std::size_t best_cache_line_order() {
+        return best_order<Node_type, Key, Value, Index, Cache_lines * Cache_line_size>();
+    }
+
+    /**
+     * Like best_order, but leaves room for the index of the variant holding the node, so that a node takes exactly
+     * one page of Page_size bytes with aligned_node_storage<Page_size>.
+     */
+    template<template<typename> typename Node_type
+    , typename Key, typename Value, typename Index, std::size_t Page_size>
+    constexpr std::size_t page_storage_order() {
+        return best_order<Node_type, Key, Value, Index, Page_size - std::max({alignof(Key), alignof(Value), alignof(Index)})>();
+    }
+
     template<typename Btree_traits>
     class btree_iterator_base {
     public:
@@ -289,7 +703,7 @@ namespace bt {
         using value_type = typename Btree_traits::value_type;
         using index_type = typename Btree_traits::index_type;
         using this_type = btree_iterator_base;
-        using btree_type = btree<key_type, value_type, index_type, Btree_traits::internal_order, Btree_traits::leaf_order>;
+        using btree_type = typename Btree_traits::btree_type;
         using leaf_node_type = typename btree_type::leaf_node_type;
         using internal_node_type = typename btree_type::internal_node_type;
         using common_node_type = typename btree_type::common_node_type;
@@ -347,11 +761,12 @@ namespace bt {
         }
 
         auto current_leaf() const -> leaf_node_type const & {
-            return btree_->leaf_node(leaf_node_index_);
+            return std::as_const(*btree_).leaf_node(leaf_node_index_);
         }
 
+        // moving the iterator only reads the tree: no non-const access, which would copy shared nodes (cow_storage)
         auto incr() -> void {
-            auto &node = this->current_leaf();
+            auto &node = std::as_const(*this).current_leaf();
             ++leaf_index_;
             if (leaf_index_ >= node.keys().size())
                 this->go_forward();
@@ -365,9 +780,10 @@ namespace bt {
         }
 
         auto go_forward() -> void {
-            if (auto &node = current_leaf(); node.has_next_leaf_index()) {
+            if (auto &node = std::as_const(*this).current_leaf(); node.has_next_leaf_index()) {
                 leaf_node_index_ = node.next_leaf_index();
                 leaf_index_ = 0;
+                std::as_const(*btree_).read_ahead(node.index(), leaf_node_index_);
             } else {
                 set_end();
             }
@@ -375,12 +791,12 @@ namespace bt {
 
         auto go_backward() -> void {
             if (is_end()) {
-                leaf_node_index_ = btree_->last_leaf_index();
-                leaf_node_type const * p_leaf = &current_leaf();
+                leaf_node_index_ = std::as_const(*btree_).last_leaf_index();
+                leaf_node_type const * p_leaf = &std::as_const(*this).current_leaf();
                 leaf_index_ = p_leaf->keys().size() > index_type(0) ? p_leaf->keys().size() - index_type(1) : index_type(0);
-            } else if (auto &node = current_leaf(); node.has_previous_leaf_index()) {
+            } else if (auto &node = std::as_const(*this).current_leaf(); node.has_previous_leaf_index()) {
                 leaf_node_index_ = node.previous_leaf_index();
-                auto &prev_node = current_leaf();
+                auto &prev_node = std::as_const(*this).current_leaf();
                 leaf_index_ = prev_node.keys().size() > index_type(0) ? prev_node.keys().size() - index_type(1) : index_type(0);
             } else {
                 set_begin();
@@ -388,15 +804,15 @@ namespace bt {
         }
 
         auto set_end() -> void {
-            *this = btree_->end();
+            *this = std::as_const(*btree_).end();
         }
 
         [[nodiscard]] auto is_end() const -> bool {
-            return (*this) == btree_->end();
+            return (*this) == std::as_const(*btree_).end();
         }
 
         auto set_begin() -> void {
-            leaf_node_index_ = btree_->first_leaf_index();
+            leaf_node_index_ = std::as_const(*btree_).first_leaf_index();
             leaf_index_ = index_type(0);
         }
 
@@ -417,7 +833,7 @@ namespace bt {
         using index_type = typename Btree_traits::index_type;
         using this_type = btree_iterator;
         using base_type = btree_iterator_base<Btree_traits>;
-        using btree_type = btree<key_type, value_type, index_type, Btree_traits::internal_order, Btree_traits::leaf_order>;
+        using btree_type = typename Btree_traits::btree_type;
         using leaf_node_type = typename btree_type::leaf_node_type;
         using internal_node_type = typename btree_type::internal_node_type;
         using common_node_type = typename btree_type::common_node_type;
@@ -476,7 +892,7 @@ namespace bt {
         using index_type = typename Btree_traits::index_type;
         using this_type = btree_const_iterator;
         using base_type = btree_iterator_base<Btree_traits>;
-        using btree_type = btree<key_type, value_type, index_type, Btree_traits::internal_order, Btree_traits::leaf_order>;
+        using btree_type = typename Btree_traits::btree_type;
         using leaf_node_type = typename btree_type::leaf_node_type;
         using internal_node_type = typename btree_type::internal_node_type;
         using common_node_type = typename btree_type::common_node_type;
@@ -529,19 +945,33 @@ namespace bt {
         friend btree_test_class;
     };
 
-    template<typename Key, typename Value, typename Index, size_t Internal_order, size_t Leaf_order>
+    template<typename Key, typename Value, typename Index, size_t Internal_order, size_t Leaf_order, typename Split_policy,
+        typename Rebalance_policy, typename Storage_policy, typename Stats_policy>
     class btree {
     public:
         static_assert(std::numeric_limits<Index>::max() > Internal_order + 2); // + 2 for distance to end() of child_indices
         static_assert(std::numeric_limits<Index>::max() > Leaf_order + 1); // + 1 for distance to end()
-        using traits = traits_type<Key, Value, Index, Internal_order, Leaf_order>;
+        static_assert(split_policy<Split_policy>);
+        static_assert(rebalance_policy_type<Rebalance_policy>);
+        static_assert(storage_policy_type<Storage_policy>);
+        static_assert(stats_policy_type<Stats_policy>);
+        static constexpr bool paged_storage_policy = requires { requires Storage_policy::paged; };
+        static_assert(!paged_storage_policy || (std::is_trivially_copyable_v<Key> && std::is_trivially_copyable_v<Value>),
+                      "paged storage writes nodes as bytes, keys and values must be trivially copyable");
+        // room for the prefetched children of an internal node next to the nodes a split, merge or rebalance pins
+        static_assert(!paged_storage_policy || requires { requires Storage_policy::frames > 2 * (Internal_order + 1); },
+                      "paged storage needs more than 2 * (Internal_order + 1) frames");
+        using traits = traits_type<Key, Value, Index, Internal_order, Leaf_order, Split_policy, Rebalance_policy, Storage_policy, Stats_policy>;
         using key_type = typename traits::key_type;
         using value_type = typename traits::value_type;
         using index_type = typename traits::index_type;
         using this_type = btree;
         using internal_node_type = btree_internal_node<traits>;
         using leaf_node_type = btree_leaf_node<traits>;
-        using common_node_type = std::variant<internal_node_type, leaf_node_type>;
+        using common_node_type = std::conditional_t<Storage_policy::node_alignment == 0,
+            std::variant<internal_node_type, leaf_node_type>,
+            aligned_variant<Storage_policy::node_alignment, internal_node_type, leaf_node_type>>;
+        using nodes_type = typename Storage_policy::template container_type<common_node_type>;
 
         using iterator_base_type = btree_iterator_base<traits>;
         using iterator = btree_iterator<traits>;
@@ -553,19 +983,28 @@ namespace bt {
 
         btree(const btree &other)
             : nodes_(other.nodes_),
-              root_index_(other.root_index_) {
+              root_index_(other.root_index_),
+              free_indices_(other.free_indices_),
+              underflowing_(other.underflowing_) {
         }
 
         btree(btree &&other) noexcept
             : nodes_(std::move(other.nodes_)),
-              root_index_(std::move(other.root_index_)) {
+              root_index_(std::move(other.root_index_)),
+              free_indices_(std::move(other.free_indices_)),
+              underflowing_(std::move(other.underflowing_)),
+              p_checkpoint_(std::move(other.p_checkpoint_)) {
         }
 
+        // the image of checkpoint() stays with the tree, which is changed as a whole
         btree & operator=(const btree &other) {
             if (this == &other)
                 return *this;
             nodes_ = other.nodes_;
             root_index_ = other.root_index_;
+            free_indices_ = other.free_indices_;
+            underflowing_ = other.underflowing_;
+            mark_all_dirty();
             return *this;
         }
 
@@ -574,6 +1013,9 @@ namespace bt {
                 return *this;
             nodes_ = std::move(other.nodes_);
             root_index_ = std::move(other.root_index_);
+            free_indices_ = std::move(other.free_indices_);
+            underflowing_ = std::move(other.underflowing_);
+            mark_all_dirty();
             return *this;
         }
 
@@ -633,12 +1075,353 @@ namespace bt {
 
         auto find_last(key_type const& key) -> iterator;
 
+        /**
+         * @return an iterator to the first entry with a key not less than key, end() if there is none
+         */
+        auto lower_bound(key_type const& key) -> iterator;
+        auto lower_bound(key_type const& key) const -> const_iterator;
+
         auto contains(key_type const &key) const -> bool { return find(key) != end(); }
 
+        /**
+         * @brief find() for every key of keys. The keys descend level by level together, so that the nodes of a
+         * level can be read at once: with paged_storage they are read asynchronously, many at a time. The leaves
+         * found stay in the pool for about Frames further page reads, so batches of up to Frames / 4 keys whose
+         * results are used right away read every leaf once.
+         */
+        auto find_batch(std::span<key_type const> keys) const -> std::vector<const_iterator>;
+
         index_type depth() const {
             return node_depth(first_leaf_index());
         }
 
+        /**
+         * @return the number of nodes allocated by this tree, including nodes marked as deleted
+         */
+        [[nodiscard]] auto node_count() const -> std::size_t { return nodes_.size(); }
+
+        /**
+         * @brief The container of the nodes, e.g. for the buffer pool statistics of paged_storage
+         */
+        [[nodiscard]] auto node_storage() const -> nodes_type const & { return nodes_; }
+
+        /**
+         * @brief The structural changes and descents counted by Stats_policy since the tree was created (copies
+         * start from 0) or reset_stats() was called
+         */
+        [[nodiscard]] auto stats() const -> btree_stats requires Stats_policy::enabled { return stats_.value(); }
+
+        auto reset_stats() -> void requires Stats_policy::enabled { stats_.reset(); }
+
+        /**
+         * @brief An immutable copy of the tree in O(1): it shares all nodes with this tree, changes of this tree
+         * copy the nodes they touch. The snapshot can be read by another thread while this tree changes.
+         *
+         * Reading this tree through non-const member functions copies shared nodes too; read via std::as_const.
+         */
+        auto snapshot() const -> std::shared_ptr<btree const> requires copy_on_write_storage<Storage_policy> {
+            return std::make_shared<btree const>(*this);
+        }
+
+        /**
+         * @brief Renumber the nodes for locality: internal nodes in breadth first order followed by the leaves in
+         * key order, so that scans walk nodes_ sequentially. Nodes marked as deleted are dropped.
+         * Invalidates all iterators.
+         */
+        auto reorganize() -> void;
+
+        /**
+         * @brief Incremental reorganize(): move at most max_moves nodes to their place in locality order
+         *
+         * Can be interleaved with inserts and erases. Every call determines the locality order again, which reads
+         * the indices of all nodes, but moves no more than max_moves nodes. Invalidates all iterators.
+         * @return true if all nodes are in locality order (nodes marked as deleted are dropped then)
+         */
+        auto reorganize(std::size_t max_moves) -> bool;
+
+        /**
+         * @brief Replace the content by entries, built bottom up: entries are sorted by key (stable, so duplicates
+         * keep their order), leaves and internal nodes are filled completely and numbered in locality order (see
+         * reorganize()). Invalidates all iterators.
+         */
+        auto bulk_load(std::vector<std::pair<key_type, value_type>> entries) -> void;
+
+        /**
+         * @brief bulk_load() on the threads of pool: a parallel sort, then every thread builds a contiguous range of
+         * nodes. The shape of the tree follows from the number of entries, so every node is built independently.
+         */
+        auto bulk_load(std::vector<std::pair<key_type, value_type>> entries, thread_pool &pool) -> void;
+
+        /**
+         * @brief Rebalance the nodes erases left underflowing (see rebalance_policy Deferred), then compact the node
+         * storage by moving the last nodes into the slots of deleted ones, until budget is used up. Does at least one
+         * step. Invalidates all iterators.
+         * @return true if no work is left
+         */
+        auto maintain(std::chrono::nanoseconds budget) -> bool;
+
+        /**
+         * @return the number of nodes remembered for maintain() to rebalance (some may not underflow any more)
+         */
+        [[nodiscard]] auto deferred_count() const -> std::size_t { return underflowing_.size(); }
+
+        /**
+         * @brief Write the tree in a versioned binary format: a header with the format version and the sizes and
+         * orders of the tree type, then nodes_ in index order, then a checksum. Keys, values and child indices of a
+         * node are written as whole spans by codec (see binary_codec), so trivially copyable ones are copied as
+         * they are in memory. The format is not portable between machines of different byte order.
+         */
+        template<typename Codec = binary_codec>
+        auto save(std::ostream &out, Codec const &codec = {}) const -> void {
+            binary_writer writer(out);
+            save(writer, codec);
+            writer.finish();
+        }
+
+        /**
+         * @brief Replace the content by a tree written by save(). Node indices are the saved ones, so no key is
+         * compared or moved. Throws std::runtime_error if the input is of another format or tree type, ends early,
+         * fails the checksum or holds node indices out of bounds, the tree is unchanged then. Invalidates all
+         * iterators.
+         */
+        template<typename Codec = binary_codec>
+        auto load(std::istream &in, Codec const &codec = {}) -> void {
+            binary_reader reader(in);
+            load(reader, codec);
+        }
+
+#ifdef BT_HAS_FILE_DESCRIPTORS
+        /**
+         * @brief save() to the open file descriptor fd
+         */
+        template<typename Codec = binary_codec>
+        auto save(int fd, Codec const &codec = {}) const -> void {
+            binary_writer writer(fd);
+            save(writer, codec);
+            writer.finish();
+        }
+
+        /**
+         * @brief load() from the open file descriptor fd
+         */
+        template<typename Codec = binary_codec>
+        auto load(int fd, Codec const &codec = {}) -> void {
+            binary_reader reader(fd);
+            load(reader, codec);
+        }
+#endif
+
+        /**
+         * @brief Write an image of the tree which mapped_btree can use in place: nodes_ byte for byte after a
+         * btree_image_header. Nodes marked as deleted are written too, reorganize() first for a compact image in
+         * locality order. Only for trivially copyable keys and values, the image holds no pointers.
+         */
+        auto save_image(std::ostream &out) const -> void
+            requires std::is_trivially_copyable_v<key_type> && std::is_trivially_copyable_v<value_type> {
+            binary_writer writer(out);
+            save_image(writer);
+            writer.flush();
+        }
+
+#ifdef BT_HAS_FILE_DESCRIPTORS
+        /**
+         * @brief save_image() to the open file descriptor fd
+         */
+        auto save_image(int fd) const -> void
+            requires std::is_trivially_copyable_v<key_type> && std::is_trivially_copyable_v<value_type> {
+            binary_writer writer(fd);
+            save_image(writer);
+            writer.flush();
+        }
+
+        /**
+         * @brief Bring the image in the file fd up to date, writing only the nodes changed since the last call, the
+         * header page and the checksum: the I/O grows with the changes, not with the tree. The first call on a tree
+         * writes a whole image like save_image() and starts tracking changed nodes, later ones expect fd to hold the
+         * image of the previous call. Every non-const access marks a node as changed, read via std::as_const.
+         *
+         * The image is durable when checkpoint() returns: the nodes are synced before the header and checksum are
+         * written, and those are synced again. The image is changed in place though, so a crash during a checkpoint
+         * leaves a mix of old and new nodes. It fails mapped_btree::verify(), i.e. a torn checkpoint is detected but
+         * cannot be recovered from: keep a second image or a log (see durable_btree) to fall back on.
+         * @return the number of nodes written
+         */
+        auto checkpoint(int fd) -> std::size_t
+            requires std::is_trivially_copyable_v<key_type> && std::is_trivially_copyable_v<value_type>;
+#endif
+
+        /**
+         * A splittable range of the leaves of a subtree which may hold keys in [lo, hi) (no bound for a nullptr),
+         * split at the child boundaries of internal nodes. The tree must not change while the range is in use and
+         * lo and hi must outlive it.
+         */
+        class leaf_range {
+        public:
+            leaf_range(btree const &tree, index_type node_index, key_type const *p_lo = nullptr,
+                       key_type const *p_hi = nullptr)
+                : tree_(&tree), node_index_(node_index), p_lo_(p_lo), p_hi_(p_hi) {
+                select_children();
+            }
+
+            [[nodiscard]] auto empty() const -> bool { return first_child_ >= last_child_; }
+
+            /**
+             * @brief A range is not split below GRAIN leaves, so that a part is worth handing to another thread
+             */
+            [[nodiscard]] auto is_divisible() const -> bool {
+                auto const children = empty() ? 0 : last_child_ - first_child_;
+                return children > GRAIN || (children > 1 && !children_are_leaves());
+            }
+
+            /**
+             * @brief Both halves of the children of this range; a half with a single internal child is a range
+             * over the children of that child
+             */
+            [[nodiscard]] auto split() const -> std::pair<leaf_range, leaf_range> {
+                auto const middle = static_cast<index_type>(first_child_ + (last_child_ - first_child_) / 2);
+                return {leaf_range(*this, first_child_, middle), leaf_range(*this, middle, last_child_)};
+            }
+
+            /**
+             * @brief Call function(keys, values) with std::spans of the entries in [lo, hi) of every leaf of this range
+             * in key order, skipping leaves without such entries
+             */
+            template<typename Function>
+            auto for_each_leaf(Function const &function) const -> void {
+                if (empty())
+                    return;
+                if (std::holds_alternative<leaf_node_type>(tree_->node(node_index_))) {
+                    visit_leaf(node_index_, function);
+                    return;
+                }
+                for (auto i = first_child_; i < last_child_; ++i) {
+                    if constexpr (paged_storage_policy) {
+                        if ((i - first_child_) % Storage_policy::read_ahead == 0) {
+                            // the indices are read from the node while the children are read
+                            node_pin const pin(*tree_, node_index_);
+                            auto const &children = tree_->internal_node(node_index_).child_indices();
+                            tree_->prefetch_nodes(std::span<index_type const>(children.data() + i,
+                                                                              std::min<std::size_t>(last_child_ - i, Storage_policy::read_ahead)));
+                        }
+                    }
+                    // looked up for every child: with paged_storage a reference to the node would not outlive a subtree
+                    auto const child_index = tree_->internal_node(node_index_).child_indices()[i];
+                    if (std::holds_alternative<leaf_node_type>(tree_->node(child_index)))
+                        visit_leaf(child_index, function);
+                    else
+                        leaf_range(*tree_, child_index, p_lo_, p_hi_).for_each_leaf(function);
+                }
+            }
+
+        private:
+            static constexpr index_type GRAIN = 8;
+
+            leaf_range(leaf_range const &other, index_type first_child, index_type last_child)
+                : tree_(other.tree_), node_index_(other.node_index_), first_child_(first_child),
+                  last_child_(last_child), p_lo_(other.p_lo_), p_hi_(other.p_hi_) {
+                descend();
+            }
+
+            /**
+             * @brief The children of node_index_ which may hold keys in [lo, hi): child i holds keys from
+             * keys()[i - 1] up to keys()[i]. A leaf is its own single child.
+             */
+            auto select_children() -> void {
+                auto const *p_node = std::get_if<internal_node_type>(&tree_->node(node_index_));
+                if (p_node == nullptr) {
+                    first_child_ = 0;
+                    last_child_ = 1;
+                    return;
+                }
+                auto const &keys = p_node->keys();
+                first_child_ = p_lo_ == nullptr ? 0 : static_cast<index_type>(std::ranges::lower_bound(keys, *p_lo_) - keys.begin());
+                last_child_ = p_hi_ == nullptr
+                                  ? static_cast<index_type>(p_node->child_indices().size())
+                                  : static_cast<index_type>(std::ranges::lower_bound(keys, *p_hi_) - keys.begin() + 1);
+                descend();
+            }
+
+            /**
+             * @brief Make a range over a single internal child a range over the children of that child
+             */
+            auto descend() -> void {
+                if (last_child_ - first_child_ != 1 || children_are_leaves())
+                    return;
+                node_index_ = tree_->internal_node(node_index_).child_indices()[first_child_];
+                select_children();
+            }
+
+            [[nodiscard]] auto children_are_leaves() const -> bool {
+                auto const *p_node = std::get_if<internal_node_type>(&tree_->node(node_index_));
+                return p_node == nullptr || std::holds_alternative<leaf_node_type>(tree_->node(p_node->child_indices()[first_child_]));
+            }
+
+            template<typename Function>
+            auto visit_leaf(index_type leaf_index, Function const &function) const -> void {
+                auto const &leaf = tree_->leaf_node(leaf_index);
+                auto const &keys = leaf.keys();
+                auto const first = p_lo_ == nullptr ? keys.begin() : std::ranges::lower_bound(keys, *p_lo_);
+                auto const last = p_hi_ == nullptr ? keys.end() : std::ranges::lower_bound(keys, *p_hi_);
+                if (first >= last)
+                    return;
+                auto const offset = static_cast<std::size_t>(first - keys.begin());
+                auto const count = static_cast<std::size_t>(last - first);
+                function(std::span<key_type const>(keys.data() + offset, count),
+                         std::span<value_type const>(leaf.values().data() + offset, count));
+            }
+
+            btree const *tree_;
+            index_type node_index_;
+            index_type first_child_{0};
+            index_type last_child_{0};
+            key_type const *p_lo_;
+            key_type const *p_hi_;
+        };
+
+        [[nodiscard]] auto leaves() const -> leaf_range { return leaf_range(*this, root_index()); }
+
+        /**
+         * @brief The leaves which may hold keys in [lo, hi); lo and hi must outlive the range
+         */
+        [[nodiscard]] auto leaves(key_type const &lo, key_type const &hi) const -> leaf_range {
+            return leaf_range(*this, root_index(), &lo, &hi);
+        }
+
+        /**
+         * @brief Call function(keys, values) with std::spans of the entries of every leaf, in key order
+         */
+        template<typename Function>
+        auto for_each(Function const &function) const -> void { leaves().for_each_leaf(function); }
+
+        /**
+         * @brief Call function(keys, values) with std::spans of the entries in [lo, hi) of every leaf, in key order
+         */
+        template<typename Function>
+        auto for_each(key_type const &lo, key_type const &hi, Function const &function) const -> void {
+            leaves(lo, hi).for_each_leaf(function);
+        }
+
+        /**
+         * @brief for_each() on the threads of pool: subtrees are handed out by work_stealing_for_each(), so function
+         * is called concurrently and in no particular order. The tree must not change meanwhile.
+         */
+        template<typename Function>
+        auto parallel_for_each(Function const &function, thread_pool &pool) const -> void {
+            if constexpr (paged_storage_policy)
+                return for_each(function);
+            work_stealing_for_each(leaves(), pool, [&function](leaf_range const &part) { part.for_each_leaf(function); });
+        }
+
+        /**
+         * @brief for_each(lo, hi, function) on the threads of pool, see parallel_for_each(function, pool)
+         */
+        template<typename Function>
+        auto parallel_for_each(key_type const &lo, key_type const &hi, Function const &function, thread_pool &pool) const -> void {
+            if constexpr (paged_storage_policy)
+                return for_each(lo, hi, function);
+            work_stealing_for_each(leaves(lo, hi), pool, [&function](leaf_range const &part) { part.for_each_leaf(function); });
+        }
+
         // TODO: implement
         auto get(const key_type &key) const -> const value_type&;
         auto get_or(const key_type &key, const value_type &default_value = value_type()) -> value_type const&;
@@ -712,6 +1495,7 @@ namespace bt {
             assert((index < nodes_.size()) && "node index out of bounds");
             if (index >= nodes_.size())
                 throw std::out_of_range("node(index_type const & index): node index out of bounds");
+            mark_dirty(index);
             return nodes_[index];
         }
         auto node(index_type const & index) const -> const common_node_type& {
@@ -757,6 +1541,39 @@ namespace bt {
             return *p_internal;
         }
 
+        /**
+         * Keeps a node in memory while it is held by reference and other nodes are read: with paged_storage any
+         * read which misses may evict the frame of a node which is not pinned. Does nothing for other storage or for
+         * INVALID_INDEX, e.g. a missing leaf neighbour.
+         */
+        class node_pin {
+        public:
+            node_pin(btree const &tree, index_type index) : p_tree_(index == INVALID_INDEX ? nullptr : &tree), index_(index) {
+                if constexpr (paged_storage_policy) {
+                    if (p_tree_ != nullptr)
+                        (void) tree.nodes_.pin(index);
+                }
+            }
+            node_pin(node_pin const &) = delete;
+            auto operator=(node_pin const &) -> node_pin & = delete;
+            ~node_pin() { release(); }
+
+            /**
+             * @brief Unpin before the end of the scope, e.g. before a call up the tree, so that pins do not pile up
+             */
+            auto release() noexcept -> void {
+                if constexpr (paged_storage_policy) {
+                    if (p_tree_ != nullptr)
+                        p_tree_->nodes_.unpin(index_);
+                }
+                p_tree_ = nullptr;
+            }
+
+        private:
+            btree const *p_tree_;
+            index_type index_;
+        };
+
         auto minimum_key(index_type index) -> key_type const &;
 
         /**
@@ -782,12 +1599,54 @@ namespace bt {
 
         auto find_first(key_type const& key) const -> std::tuple<index_type, index_type>;
 
+        /**
+         * @brief One step of find_first(): the child of node whose subtree holds the first entry with key
+         */
+        static auto first_child_for(internal_node_type const &node, key_type const &key) -> index_type;
+
+        /**
+         * @brief The last step of find_first(): the position of the first entry with key in the leaf
+         */
+        auto find_first_in_leaf(index_type leaf_index, key_type const &key) const -> std::tuple<index_type, index_type>;
+
+        /**
+         * @brief Hint to the node storage that the nodes at indices are needed next, see paged_vector::prefetch()
+         */
+        template<typename Indices>
+        auto prefetch_nodes(Indices const &indices) const -> void {
+            if constexpr (requires { nodes_.prefetch(indices); })
+                nodes_.prefetch(indices);
+        }
+
+        /**
+         * @brief Called by a scan which moves from leaf previous_index to its next leaf next_index: with paged_storage
+         * read the next Storage_policy::read_ahead leaves at once, whenever the scan enters a new group of them
+         */
+        auto read_ahead(index_type previous_index, index_type next_index) const -> void;
+
+        /**
+         * @return leaf index and position of the first entry with a key not less than key, INVALID_INDEX if none
+         */
+        auto find_lower_bound(key_type const& key) const -> std::tuple<index_type, index_type>;
+
         auto insert_split_internal(index_type node_index, const key_type &key, index_type child_index) -> bool;
 
         auto insert_internal(index_type node_index, const key_type &key, index_type child_index, bool allow_recurse) -> bool;
 
         auto insert_split_leaf(iterator insert_pos, const key_type &key, const value_type &value) -> bool;
 
+        /**
+         * @brief Make room in the full leaf at insert_pos by shifting entries into its previous or next leaf, then insert
+         * @return false if neither neighbour has room
+         */
+        auto insert_shift_leaf(iterator insert_pos, const key_type &key, const value_type &value) -> bool;
+
+        /**
+         * @brief Split the full leaf at insert_pos and a full neighbour into three leaves, then insert
+         * @return false if the leaf has no full neighbour
+         */
+        auto insert_split_two_leaves(iterator insert_pos, const key_type &key, const value_type &value) -> bool;
+
         auto insert_leaf(iterator insert_pos, const key_type &key, const value_type &value, bool allow_recurse) -> bool;
 
         auto merge_internal(index_type left_node_index) -> bool;
@@ -800,82 +1659,346 @@ namespace bt {
 
         auto rebalance_leaf_node(index_type leaf_nodex_index) -> bool;
 
-        auto delete_node(index_type node_index);
+        /**
+         * @brief Number of entries to move from a neighbour into a node which underflows
+         * @return 0 if both nodes together are too small to be redistributed and have to be merged
+         */
+        template<bool Is_leaf>
+        static constexpr auto rebalance_count(index_type size, index_type neighbour_size) -> index_type;
 
         /**
-         * @brief For the node with child_node_index set the correlated key in the (internal) parent node to the first value of the child node
-         * @param child_node_index
-         * @param p_correlated_key a pointer to the first key of the child_node used to transport it further up the tree
+         * @brief Mark the node as deleted and remember its index for reuse by create_internal_node/create_leaf_node
          */
-        auto adjust_parent_key(index_type child_node_index, key_type const *p_correlated_key = nullptr) -> void;
+        auto delete_node(index_type node_index) -> void;
 
-#ifndef BTREE_TESTING
-    private:
+        /**
+         * @brief Indices of deleted nodes, reused by create_internal_node/create_leaf_node (last one first)
+         */
+        auto free_node_indices() -> std::vector<index_type> & { return free_indices_; }
+
+        /**
+         * @brief Latch taken while the free node indices or the nodes remembered by deferred erases change, for
+         * subclasses whose structure modifications of disjoint subtrees run concurrently; none by default
+         */
+        auto set_bookkeeping_latch(std::mutex *p_latch) noexcept -> void { p_bookkeeping_latch_ = p_latch; }
+
+        /**
+         * @brief Collect the indices of deleted nodes in *p_indices instead of free_node_indices(), for subclasses
+         * whose readers may still look at deleted nodes: they hand them on for reuse later. None by default
+         */
+        auto set_deleted_node_indices(std::vector<index_type> *p_indices) noexcept -> void { p_deleted_indices_ = p_indices; }
+
+        /**
+         * @brief Rebalance the node remembered by a deferred erase, if it still exists and underflows
+         */
+        auto rebalance_deferred(index_type node_index) -> void;
+
+        /**
+         * @brief Rebalance the node remembered last by a deferred erase (see rebalance_deferred)
+         * @return false if no node is remembered
+         */
+        auto rebalance_deferred_step() -> bool {
+            if (underflowing_.empty())
+                return false;
+            // rebalancing may leave the parent underflowing, which is pushed and handled next
+            auto index = underflowing_.back();
+            underflowing_.pop_back();
+            rebalance_deferred(index);
+            return true;
+        }
+
+        /**
+         * @brief Drop deleted nodes at the end of nodes_ and move the last node in use into the slot of a deleted one
+         * @return false if there are no deleted nodes
+         */
+        auto compact_step() -> bool;
+
+        static constexpr char FORMAT_MAGIC[8] = {'b', 't', '-', 'b', 't', 'r', 'e', 'e'};
+        static constexpr std::uint32_t FORMAT_VERSION = 1;
+
+        /**
+         * @brief The header, the nodes and the bookkeeping of save(), without the checksum
+         */
+        template<typename Codec>
+        auto save(binary_writer &out, Codec const &codec) const -> void;
+
+        /**
+         * @brief Read what save(binary_writer &, codec) wrote and the checksum, then replace the content
+         */
+        template<typename Codec>
+        auto load(binary_reader &in, Codec const &codec) -> void;
+
+        /**
+         * Per node of the image written last by checkpoint(): its checksum and the entries it adds to entry_count
+         */
+        struct image_node {
+            std::uint64_t checksum = 0;
+            std::uint64_t entry_count = 0;
+        };
+
+        /**
+         * Nodes changed since the last checkpoint(), only tracked once checkpoint() was called
+         */
+        struct checkpoint_state {
+            std::vector<bool> dirty;
+            std::vector<image_node> nodes;
+            std::uint64_t entry_count = 0;
+        };
+
+        /**
+         * @brief The header and the nodes of save_image() with the checksum
+         * @return the image_node of every node
+         */
+        auto save_image(binary_writer &out) const -> std::vector<image_node>;
+
+        [[nodiscard]] auto image_header(std::uint64_t entry_count) const -> btree_image_header;
+
+        /**
+         * The bytes of a node in an image
+         */
+        using node_bytes = std::array<std::byte, sizeof(common_node_type)>;
+
+        /**
+         * @brief A copy of node index made in zeroed memory, so that padding and the unused slots of its arrays are
+         * zero: images of equal trees are equal byte by byte and hold no uninitialized memory
+         */
+        [[nodiscard]] auto image_bytes_of(index_type index) const -> node_bytes;
+
+        [[nodiscard]] auto image_node_of(index_type index, node_bytes const &bytes) const -> image_node;
+
+        /**
+         * @brief Count n events, if Stats_policy is enabled (no_stats: nothing at all)
+         */
+        auto count(btree_event event, std::uint64_t n = 1) const noexcept -> void {
+            if constexpr (Stats_policy::enabled)
+                stats_.add(event, n);
+        }
+
+        /**
+         * @brief Count descents from the root to a leaf which visited nodes nodes each
+         */
+        auto count_descent(std::uint64_t nodes, std::uint64_t descents = 1) const noexcept -> void {
+            count(btree_event::descent, descents);
+            count(btree_event::descent_node, nodes * descents);
+        }
+
+        auto mark_dirty(index_type index) -> void {
+            if (p_checkpoint_ == nullptr) [[likely]]
+                return;
+            if (index >= p_checkpoint_->dirty.size())
+                p_checkpoint_->dirty.resize(std::size_t(index) + 1);
+            p_checkpoint_->dirty[index] = true;
+        }
+
+        /**
+         * @brief After the nodes were replaced or relabelled as a whole
+         */
+        auto mark_all_dirty() -> void {
+            if (p_checkpoint_ != nullptr)
+                p_checkpoint_->dirty.assign(nodes_.size(), true);
+        }
+
+        /**
+         * @brief Indices of all nodes in use: internal nodes in breadth first order, followed by the leaves in key order
+         */
+        [[nodiscard]] auto locality_order() const -> std::vector<index_type>;
+
+        /**
+         * @brief Shape of a tree built bottom up from entry_count entries: level 0 are the leaves, the last level is
+         * the root. Levels are numbered from the root down, so the leaves come last.
+         */
+        struct bulk_layout {
+            std::size_t entry_count;
+            std::vector<std::size_t> level_sizes;
+            std::vector<std::size_t> level_offsets;
+
+            explicit bulk_layout(std::size_t count);
+
+            [[nodiscard]] auto node_count() const -> std::size_t { return level_offsets.front() + level_sizes.front(); }
+
+            /**
+             * @brief First of the items of level - 1 below item (of level), or the first entry for level 0
+             */
+            [[nodiscard]] auto first_below(std::size_t level, std::size_t item) const -> std::size_t {
+                auto const below = level == 0 ? entry_count : level_sizes[level - 1];
+                return item * below / level_sizes[level];
+            }
+
+            /**
+             * @brief Index of the entry the subtree of item (of level) starts with
+             */
+            [[nodiscard]] auto first_entry(std::size_t level, std::size_t item) const -> std::size_t {
+                for (; level > 0; --level)
+                    item = first_below(level, item);
+                return first_below(0, item);
+            }
+
+            /**
+             * @brief Index of the parent of item (of level)
+             */
+            [[nodiscard]] auto parent(std::size_t level, std::size_t item) const -> std::size_t {
+                auto const items = level_sizes[level];
+                auto const groups = level_sizes[level + 1];
+                // the last group g with first_below(level + 1, g) <= item
+                return level_offsets[level + 1] + ((item + 1) * groups + items - 1) / items - 1;
+            }
+        };
+
+        /**
+         * @brief Build node index of layout from the sorted entries
+         */
+        auto bulk_node(bulk_layout const &layout, std::vector<std::pair<key_type, value_type>> const &entries,
+                       std::size_t index) const -> common_node_type;
+
+        /**
+         * @brief Replace the nodes by the ones of layout, building them with build_nodes(first, last, nodes)
+         */
+        template<typename Build_nodes>
+        auto bulk_build(bulk_layout const &layout, Build_nodes const &build_nodes) -> void;
+
+        /**
+         * @brief Swap the nodes at index a and b and rewrite all indices referring to them
+         */
+        auto swap_nodes(index_type a, index_type b) -> void;
+
+        /**
+         * @brief Replace every index stored in node (its own, parent, children or leaf neighbours) by relabel(index)
+         */
+        template<typename Node_type, typename Relabel>
+        static auto relabel_node(Node_type &node, Relabel const &relabel) -> void;
+
+        /**
+         * @brief For the node with child_node_index set the correlated key in the (internal) parent node to the first value of the child node
+         * @param child_node_index
+         * @param p_correlated_key a pointer to the first key of the child_node used to transport it further up the tree
+         */
+        auto adjust_parent_key(index_type child_node_index, key_type const *p_correlated_key = nullptr) -> void;
+
+#ifndef BTREE_TESTING
+    private:
 #endif
         friend iterator_base_type;
         friend iterator;
         friend const_iterator;
         friend btree_test_class;
 
-        std::vector<common_node_type> nodes_{leaf_node_type{0, INVALID_INDEX}};
+        nodes_type nodes_{leaf_node_type{0, INVALID_INDEX}};
         index_type root_index_{0};
+        std::vector<index_type> free_indices_;
+        // nodes left underflowing by a deferred erase
+        std::vector<index_type> underflowing_;
+        std::unique_ptr<checkpoint_state> p_checkpoint_;
+        // guards free_indices_ and underflowing_, see set_bookkeeping_latch(); copies and moves do not take it over
+        std::mutex *p_bookkeeping_latch_ = nullptr;
+        // see set_deleted_node_indices(), guarded by the bookkeeping latch as well
+        std::vector<index_type> *p_deleted_indices_ = nullptr;
+        [[no_unique_address]] mutable typename Stats_policy::counters_type stats_;
+
+        auto lock_bookkeeping() const -> std::unique_lock<std::mutex> {
+            return p_bookkeeping_latch_ != nullptr ? std::unique_lock(*p_bookkeeping_latch_) : std::unique_lock<std::mutex>();
+        }
+
+        /**
+         * @return a free node index for create_internal_node/create_leaf_node, INVALID_INDEX if there is none
+         */
+        auto take_free_index() -> index_type {
+            auto bookkeeping_lock = lock_bookkeeping();
+            if (free_indices_.empty())
+                return INVALID_INDEX;
+            auto index = free_indices_.back();
+            free_indices_.pop_back();
+            return index;
+        }
     };
 
-    template<typename Key, typename Value, typename Index, size_t Internal_order, size_t Leaf_order>
-    auto btree<Key, Value, Index, Internal_order, Leaf_order>::insert(key_type const &key, value_type const &value) -> bool {
+    template<typename Key, typename Value, typename Index, size_t Internal_order, size_t Leaf_order, typename Split_policy,
+        typename Rebalance_policy, typename Storage_policy, typename Stats_policy>
+    auto btree<Key, Value, Index, Internal_order, Leaf_order, Split_policy, Rebalance_policy, Storage_policy, Stats_policy>::insert(key_type const &key, value_type const &value) -> bool {
         iterator it = find_insert_position(key, root_index());
         return insert_leaf(it, key, value, true);
     }
 
-    // template<typename Key, typename Value, typename Index, size_t Internal_order, size_t Leaf_order>
-    // auto btree<Key, Value, Index, Internal_order, Leaf_order>::erase(key_type const &key) -> std::size_t {
+    // template<typename Key, typename Value, typename Index, size_t Internal_order, size_t Leaf_order, typename Split_policy,
+    //     typename Rebalance_policy, typename Storage_policy, typename Stats_policy>
+    // auto btree<Key, Value, Index, Internal_order, Leaf_order, Split_policy, Rebalance_policy, Storage_policy, Stats_policy>::erase(key_type const &key) -> std::size_t {
     //     return 0; // TODO
     // }
 
-    template<typename Key, typename Value, typename Index, size_t Internal_order, size_t Leaf_order>
-    auto btree<Key, Value, Index, Internal_order, Leaf_order>::erase(iterator it) -> std::size_t {
+    template<typename Key, typename Value, typename Index, size_t Internal_order, size_t Leaf_order, typename Split_policy,
+        typename Rebalance_policy, typename Storage_policy, typename Stats_policy>
+    auto btree<Key, Value, Index, Internal_order, Leaf_order, Split_policy, Rebalance_policy, Storage_policy, Stats_policy>::erase(iterator it) -> std::size_t {
+        node_pin leaf_pin(*this, it.leaf_node_index_);
         leaf_node_type& leaf = it.current_leaf();
         assert((leaf.size() > 0) && "erase(const_iterator it): leaf is empty");
         auto erase_key_it = leaf.keys().begin() + it.leaf_index_;
         leaf.keys().erase(erase_key_it);
         leaf.values().erase(leaf.values().begin() + it.leaf_index_);
-        if (erase_key_it == leaf.keys().begin() && !is_root(leaf.index())) {
+        if (erase_key_it == leaf.keys().begin() && !leaf.keys().empty() && !is_root(leaf.index())) {
             adjust_parent_key(leaf.index());
         }
         if (leaf.size() < traits::template get_min_order<true>()) {
-            rebalance_leaf_node(it.leaf_node_index_);
+            // remembered once, when the leaf starts to underflow
+            if (traits::deferred_rebalance && !leaf.keys().empty()) {
+                if (leaf.size() + 1 == traits::template get_min_order<true>()) {
+                    auto bookkeeping_lock = lock_bookkeeping();
+                    underflowing_.push_back(it.leaf_node_index_);
+                }
+            } else {
+                leaf_pin.release();
+                rebalance_leaf_node(it.leaf_node_index_);
+            }
         }
         return 1;
     }
 
-    // template<typename Key, typename Value, typename Index, size_t Internal_order, size_t Leaf_order>
-    // auto btree<Key, Value, Index, Internal_order, Leaf_order>::erase(const_iterator first,
+    // template<typename Key, typename Value, typename Index, size_t Internal_order, size_t Leaf_order, typename Split_policy,
+    //     typename Rebalance_policy, typename Storage_policy, typename Stats_policy>
+    // auto btree<Key, Value, Index, Internal_order, Leaf_order, Split_policy, Rebalance_policy, Storage_policy, Stats_policy>::erase(const_iterator first,
     //     const_iterator last) -> std::size_t {
     //     return 0; // TODO
     // }
 
-    template<typename Key, typename Value, typename Index, size_t Internal_order, size_t Leaf_order>
-    auto btree<Key, Value, Index, Internal_order, Leaf_order>::find(key_type const &key) -> iterator {
+    template<typename Key, typename Value, typename Index, size_t Internal_order, size_t Leaf_order, typename Split_policy,
+        typename Rebalance_policy, typename Storage_policy, typename Stats_policy>
+    auto btree<Key, Value, Index, Internal_order, Leaf_order, Split_policy, Rebalance_policy, Storage_policy, Stats_policy>::find(key_type const &key) -> iterator {
         auto [leaf_node_index, leaf_index] = find_first(key);
         return iterator(*this, leaf_node_index, leaf_index);
     }
 
-    template<typename Key, typename Value, typename Index, size_t Internal_order, size_t Leaf_order>
-    auto btree<Key, Value, Index, Internal_order, Leaf_order>::find(key_type const &key) const -> const_iterator {
+    template<typename Key, typename Value, typename Index, size_t Internal_order, size_t Leaf_order, typename Split_policy,
+        typename Rebalance_policy, typename Storage_policy, typename Stats_policy>
+    auto btree<Key, Value, Index, Internal_order, Leaf_order, Split_policy, Rebalance_policy, Storage_policy, Stats_policy>::find(key_type const &key) const -> const_iterator {
         auto [leaf_node_index, leaf_index] = find_first(key);
         return const_iterator(*this, leaf_node_index, leaf_index);
     }
 
-    template<typename Key, typename Value, typename Index, size_t Internal_order, size_t Leaf_order>
-    auto btree<Key, Value, Index, Internal_order, Leaf_order>::find_last(key_type const &key) -> iterator {
+    template<typename Key, typename Value, typename Index, size_t Internal_order, size_t Leaf_order, typename Split_policy,
+        typename Rebalance_policy, typename Storage_policy, typename Stats_policy>
+    auto btree<Key, Value, Index, Internal_order, Leaf_order, Split_policy, Rebalance_policy, Storage_policy, Stats_policy>::lower_bound(key_type const &key) -> iterator {
+        auto [leaf_node_index, leaf_index] = find_lower_bound(key);
+        return iterator(*this, leaf_node_index, leaf_index);
+    }
+
+    template<typename Key, typename Value, typename Index, size_t Internal_order, size_t Leaf_order, typename Split_policy,
+        typename Rebalance_policy, typename Storage_policy, typename Stats_policy>
+    auto btree<Key, Value, Index, Internal_order, Leaf_order, Split_policy, Rebalance_policy, Storage_policy, Stats_policy>::lower_bound(key_type const &key) const -> const_iterator {
+        auto [leaf_node_index, leaf_index] = find_lower_bound(key);
+        return const_iterator(*this, leaf_node_index, leaf_index);
+    }
+
+    template<typename Key, typename Value, typename Index, size_t Internal_order, size_t Leaf_order, typename Split_policy,
+        typename Rebalance_policy, typename Storage_policy, typename Stats_policy>
+    auto btree<Key, Value, Index, Internal_order, Leaf_order, Split_policy, Rebalance_policy, Storage_policy, Stats_policy>::find_last(key_type const &key) -> iterator {
         index_type index = root_index();
+        std::uint64_t visited = 1;
         for (const internal_node_type *p_node = std::get_if<internal_node_type>(&node(index));
              p_node != nullptr;
-             p_node = std::get_if<internal_node_type>(&node(index))) {
+             p_node = std::get_if<internal_node_type>(&node(index)), ++visited) {
             auto it = std::ranges::upper_bound(p_node->keys(), key);
             auto dist = std::distance(p_node->keys().begin(), it);
             index = p_node->child_indices().at(dist);
         }
+        count_descent(visited);
         leaf_node_type& leaf = leaf_node(index);
         auto it = std::ranges::upper_bound(leaf.keys(), key);
         it = std::ranges::prev(it, 1, leaf.keys().begin());
@@ -884,8 +2007,9 @@ namespace bt {
         return iterator(*this, index, index_type(std::distance(leaf.keys().begin(), it)));
     }
 
-    template<typename Key, typename Value, typename Index, size_t Internal_order, size_t Leaf_order>
-    auto btree<Key, Value, Index, Internal_order, Leaf_order>::minimum_key(index_type index) -> key_type const & {
+    template<typename Key, typename Value, typename Index, size_t Internal_order, size_t Leaf_order, typename Split_policy,
+        typename Rebalance_policy, typename Storage_policy, typename Stats_policy>
+    auto btree<Key, Value, Index, Internal_order, Leaf_order, Split_policy, Rebalance_policy, Storage_policy, Stats_policy>::minimum_key(index_type index) -> key_type const & {
         return std::visit([this](auto const & node) -> decltype(auto) {
             if constexpr (std::is_same_v<std::decay_t<decltype(node)>, leaf_node_type>) {
                 return node.keys().front();
@@ -895,10 +2019,12 @@ namespace bt {
         }, node(index));
     }
 
-    template<typename Key, typename Value, typename Index, size_t Internal_order, size_t Leaf_order>
-    auto btree<Key, Value, Index, Internal_order, Leaf_order>::grow(index_type left_index,
+    template<typename Key, typename Value, typename Index, size_t Internal_order, size_t Leaf_order, typename Split_policy,
+        typename Rebalance_policy, typename Storage_policy, typename Stats_policy>
+    auto btree<Key, Value, Index, Internal_order, Leaf_order, Split_policy, Rebalance_policy, Storage_policy, Stats_policy>::grow(index_type left_index,
                                                index_type right_index, key_type const &pivot_key) -> index_type {
         assert((is_root(left_index)) && "left node ist supposed the be the old root");
+        count(btree_event::grow);
         auto new_root_index = create_internal_node(INVALID_INDEX);
         internal_node_type& new_root = internal_node(new_root_index);
         new_root.child_indices().push_back(left_index);
@@ -917,16 +2043,19 @@ namespace bt {
         return new_root_index;
     }
 
-    template<typename Key, typename Value, typename Index, size_t Internal_order, size_t Leaf_order>
-    auto btree<Key, Value, Index, Internal_order, Leaf_order>::shrink() -> index_type {
+    template<typename Key, typename Value, typename Index, size_t Internal_order, size_t Leaf_order, typename Split_policy,
+        typename Rebalance_policy, typename Storage_policy, typename Stats_policy>
+    auto btree<Key, Value, Index, Internal_order, Leaf_order, Split_policy, Rebalance_policy, Storage_policy, Stats_policy>::shrink() -> index_type {
         auto& root_node = node(root_index());
         internal_node_type* p_old_root = std::get_if<internal_node_type>(&root_node);
         // assert((p_old_root != nullptr) && "Cannot shrink with leaf root node");
         if (p_old_root == nullptr)
             throw std::runtime_error("Cannot shrink with leaf root node");
         assert((p_old_root->child_indices().size() == 1) && "shrink(): root node has more or less than 1 child");
+        count(btree_event::shrink);
+        auto old_root_index = root_index_;
         root_index_ = p_old_root->child_indices().front();
-        p_old_root->mark_deleted();
+        delete_node(old_root_index);
         auto& new_root_node = node(root_index());
         std::visit([](auto & node) {
             node.set_parent_index(INVALID_INDEX);
@@ -934,24 +2063,39 @@ namespace bt {
         return root_index();
     }
 
-    template<typename Key, typename Value, typename Index, size_t Internal_order, size_t Leaf_order>
-    auto btree<Key, Value, Index, Internal_order, Leaf_order>::create_internal_node(index_type const &parent_index) -> index_type {
+    template<typename Key, typename Value, typename Index, size_t Internal_order, size_t Leaf_order, typename Split_policy,
+        typename Rebalance_policy, typename Storage_policy, typename Stats_policy>
+    auto btree<Key, Value, Index, Internal_order, Leaf_order, Split_policy, Rebalance_policy, Storage_policy, Stats_policy>::create_internal_node(index_type const &parent_index) -> index_type {
+        if (auto index = take_free_index(); index != INVALID_INDEX) {
+            nodes_[index] = internal_node_type(index, parent_index);
+            mark_dirty(index);
+            return index;
+        }
         auto index = index_type(nodes_.size());
         assert((index != INVALID_INDEX) && "create_internal_node: node index overflow");
         nodes_.emplace_back(std::move(internal_node_type(index, parent_index)));
+        mark_dirty(index);
         return index;
     }
 
-    template<typename Key, typename Value, typename Index, size_t Internal_order, size_t Leaf_order>
-    auto btree<Key, Value, Index, Internal_order, Leaf_order>::create_leaf_node(index_type const &parent_index) -> index_type {
+    template<typename Key, typename Value, typename Index, size_t Internal_order, size_t Leaf_order, typename Split_policy,
+        typename Rebalance_policy, typename Storage_policy, typename Stats_policy>
+    auto btree<Key, Value, Index, Internal_order, Leaf_order, Split_policy, Rebalance_policy, Storage_policy, Stats_policy>::create_leaf_node(index_type const &parent_index) -> index_type {
+        if (auto index = take_free_index(); index != INVALID_INDEX) {
+            nodes_[index] = leaf_node_type(index, parent_index);
+            mark_dirty(index);
+            return index;
+        }
         auto index = index_type(nodes_.size());
         assert((index != INVALID_INDEX) && "create_leaf_node: node index overflow");
         nodes_.emplace_back(std::move(leaf_node_type(index, parent_index)));
+        mark_dirty(index);
         return index;
     }
 
-    template<typename Key, typename Value, typename Index, size_t Internal_order, size_t Leaf_order>
-    auto btree<Key, Value, Index, Internal_order, Leaf_order>::first_leaf_index() const -> index_type {
+    template<typename Key, typename Value, typename Index, size_t Internal_order, size_t Leaf_order, typename Split_policy,
+        typename Rebalance_policy, typename Storage_policy, typename Stats_policy>
+    auto btree<Key, Value, Index, Internal_order, Leaf_order, Split_policy, Rebalance_policy, Storage_policy, Stats_policy>::first_leaf_index() const -> index_type {
         auto index = root_index_;
         for (const internal_node_type *p_node = std::get_if<internal_node_type>(&node(index));
             p_node != nullptr;
@@ -960,8 +2104,9 @@ namespace bt {
         return index;
     }
 
-    template<typename Key, typename Value, typename Index, size_t Internal_order, size_t Leaf_order>
-    auto btree<Key, Value, Index, Internal_order, Leaf_order>::last_leaf_index() const -> index_type {
+    template<typename Key, typename Value, typename Index, size_t Internal_order, size_t Leaf_order, typename Split_policy,
+        typename Rebalance_policy, typename Storage_policy, typename Stats_policy>
+    auto btree<Key, Value, Index, Internal_order, Leaf_order, Split_policy, Rebalance_policy, Storage_policy, Stats_policy>::last_leaf_index() const -> index_type {
         auto index = root_index_;
         for (const internal_node_type *p_node = std::get_if<internal_node_type>(&node(index));
             p_node != nullptr;
@@ -970,16 +2115,20 @@ namespace bt {
         return index;
     }
 
-    template<typename Key, typename Value, typename Index, size_t Internal_order, size_t Leaf_order>
-    auto btree<Key, Value, Index, Internal_order, Leaf_order>::find_insert_position(const key_type &key, const index_type &start_index) -> iterator {
+    template<typename Key, typename Value, typename Index, size_t Internal_order, size_t Leaf_order, typename Split_policy,
+        typename Rebalance_policy, typename Storage_policy, typename Stats_policy>
+    auto btree<Key, Value, Index, Internal_order, Leaf_order, Split_policy, Rebalance_policy, Storage_policy, Stats_policy>::find_insert_position(const key_type &key, const index_type &start_index) -> iterator {
         index_type node_index = start_index;
+        std::uint64_t visited = 0;
         do {
             if (node_index == INVALID_INDEX) {
                 assert((false) && "find_insert_position(const key_type &key, const index_type &start_index): should never happen");
                 return end();
             }
-            common_node_type *p_node = &node(node_index);
-            auto result = std::visit([&](auto &node) -> std::variant<index_type, iterator> {
+            // read only: the descent marks no node dirty (paged_storage) or copied (cow_storage)
+            common_node_type const *p_node = &std::as_const(*this).node(node_index);
+            ++visited;
+            auto result = std::visit([&](auto const &node) -> std::variant<index_type, iterator> {
                 auto found = std::ranges::upper_bound(node.keys(), key); // found > key
                 index_type found_index = index_type(std::distance(node.keys().begin(), found));
                 if constexpr (std::is_same_v<std::decay_t<decltype(node)>, internal_node_type>) {
@@ -990,37 +2139,159 @@ namespace bt {
                     return iterator(*this, node_index, found_index);
                 }
             }, *p_node);
-            if (std::holds_alternative<iterator>(result))
+            if (std::holds_alternative<iterator>(result)) {
+                // a search from the root, not the repositioning after a split
+                if (start_index == root_index_)
+                    count_descent(visited);
                 return std::get<iterator>(result);
+            }
         } while (true);
     }
 
-    template<typename Key, typename Value, typename Index, size_t Internal_order, size_t Leaf_order>
-    auto btree<Key, Value, Index, Internal_order, Leaf_order>::find_first(key_type const &key) const -> std::tuple<index_type, index_type> {
+    template<typename Key, typename Value, typename Index, size_t Internal_order, size_t Leaf_order, typename Split_policy,
+        typename Rebalance_policy, typename Storage_policy, typename Stats_policy>
+    auto btree<Key, Value, Index, Internal_order, Leaf_order, Split_policy, Rebalance_policy, Storage_policy, Stats_policy>::find_first(key_type const &key) const -> std::tuple<index_type, index_type> {
         index_type index = root_index();
+        std::uint64_t visited = 1;
         for (const internal_node_type *p_node = std::get_if<internal_node_type>(&node(index));
              p_node != nullptr;
-             p_node = std::get_if<internal_node_type>(&node(index))) {
+             p_node = std::get_if<internal_node_type>(&node(index)), ++visited) {
+            index = first_child_for(*p_node, key);
+        }
+        count_descent(visited);
+        return find_first_in_leaf(index, key);
+    }
+
+    template<typename Key, typename Value, typename Index, size_t Internal_order, size_t Leaf_order, typename Split_policy,
+        typename Rebalance_policy, typename Storage_policy, typename Stats_policy>
+    auto btree<Key, Value, Index, Internal_order, Leaf_order, Split_policy, Rebalance_policy, Storage_policy, Stats_policy>::first_child_for(
+        internal_node_type const &node, key_type const &key) -> index_type {
+        auto it = std::ranges::lower_bound(node.keys(), key);
+        auto dist = std::distance(node.keys().begin(), it);
+        if (it != node.keys().end() && *it == key)
+            ++dist;
+        return node.child_indices().at(static_cast<size_t>(dist));
+    }
+
+    template<typename Key, typename Value, typename Index, size_t Internal_order, size_t Leaf_order, typename Split_policy,
+        typename Rebalance_policy, typename Storage_policy, typename Stats_policy>
+    auto btree<Key, Value, Index, Internal_order, Leaf_order, Split_policy, Rebalance_policy, Storage_policy, Stats_policy>::find_first_in_leaf(
+        index_type leaf_index, key_type const &key) const -> std::tuple<index_type, index_type> {
+        leaf_node_type const & leaf = leaf_node(leaf_index);
+        auto it = std::ranges::lower_bound(leaf.keys(), key);
+        if (it == leaf.keys().end() || key != *it)
+            return std::make_tuple(INVALID_INDEX, 0);
+        return std::make_tuple(leaf_index, std::distance(leaf.keys().begin(), it));
+    }
+
+    template<typename Key, typename Value, typename Index, size_t Internal_order, size_t Leaf_order, typename Split_policy,
+        typename Rebalance_policy, typename Storage_policy, typename Stats_policy>
+    auto btree<Key, Value, Index, Internal_order, Leaf_order, Split_policy, Rebalance_policy, Storage_policy, Stats_policy>::find_batch(
+        std::span<key_type const> keys) const -> std::vector<const_iterator> {
+        // with paged_storage the nodes read for a group stay in the pool until the group has used them
+        static constexpr std::size_t GROUP_SIZE = [] {
+            if constexpr (paged_storage_policy)
+                return std::max<std::size_t>(Storage_policy::frames / 4, 1);
+            else
+                return std::size_t(256);
+        }();
+        std::vector<const_iterator> result;
+        result.reserve(keys.size());
+        std::vector<index_type> indices;
+        std::vector<index_type> level;
+        for (std::size_t first = 0; first < keys.size(); first += GROUP_SIZE) {
+            auto const group = keys.subspan(first, std::min(GROUP_SIZE, keys.size() - first));
+            // the tree is balanced: all keys of the group reach the leaves together
+            indices.assign(group.size(), root_index());
+            std::uint64_t depth = 1;
+            for (;;) {
+                level = indices;
+                std::ranges::sort(level);
+                level.erase(std::ranges::unique(level).begin(), level.end());
+                prefetch_nodes(level);
+                if (!std::holds_alternative<internal_node_type>(node(indices.front())))
+                    break;
+                for (std::size_t i = 0; i < group.size(); ++i)
+                    indices[i] = first_child_for(internal_node(indices[i]), group[i]);
+                ++depth;
+            }
+            count_descent(depth, group.size());
+            for (std::size_t i = 0; i < group.size(); ++i) {
+                auto [leaf_node_index, leaf_index] = find_first_in_leaf(indices[i], group[i]);
+                result.emplace_back(*this, leaf_node_index, leaf_index);
+            }
+        }
+        return result;
+    }
+
+    template<typename Key, typename Value, typename Index, size_t Internal_order, size_t Leaf_order, typename Split_policy,
+        typename Rebalance_policy, typename Storage_policy, typename Stats_policy>
+    auto btree<Key, Value, Index, Internal_order, Leaf_order, Split_policy, Rebalance_policy, Storage_policy, Stats_policy>::read_ahead(
+        index_type previous_index, index_type next_index) const -> void {
+        if constexpr (paged_storage_policy) {
+            static constexpr auto READ_AHEAD = std::ptrdiff_t(Storage_policy::read_ahead);
+            auto parent_index = leaf_node(previous_index).parent_index();
+            if (parent_index == INVALID_INDEX)
+                return;
+            // the parent knows the next leaves, the leaf chain would have to be read leaf by leaf
+            auto const *p_children = &internal_node(parent_index).child_indices();
+            auto it = std::ranges::find(*p_children, next_index);
+            if (it == p_children->end()) {
+                // the first child of the next parent
+                parent_index = leaf_node(next_index).parent_index();
+                p_children = &internal_node(parent_index).child_indices();
+                it = p_children->begin();
+            }
+            auto const position = std::distance(p_children->begin(), it);
+            if (position % READ_AHEAD == 0) {
+                // the indices are read from the parent while the leaves are read
+                node_pin const pin(*this, parent_index);
+                prefetch_nodes(std::span<index_type const>(p_children->data() + position,
+                                                           std::size_t(std::min(READ_AHEAD, std::distance(it, p_children->end())))));
+            }
+        } else {
+            (void) previous_index;
+            (void) next_index;
+        }
+    }
+
+    template<typename Key, typename Value, typename Index, size_t Internal_order, size_t Leaf_order, typename Split_policy,
+        typename Rebalance_policy, typename Storage_policy, typename Stats_policy>
+    auto btree<Key, Value, Index, Internal_order, Leaf_order, Split_policy, Rebalance_policy, Storage_policy, Stats_policy>::find_lower_bound(key_type const &key) const -> std::tuple<index_type, index_type> {
+        index_type index = root_index();
+        std::uint64_t visited = 1;
+        for (const internal_node_type *p_node = std::get_if<internal_node_type>(&node(index));
+             p_node != nullptr;
+             p_node = std::get_if<internal_node_type>(&node(index)), ++visited) {
             auto it = std::ranges::lower_bound(p_node->keys(), key);
             auto dist = std::distance(p_node->keys().begin(), it);
             if (it != p_node->keys().end() && *it == key)
                 ++dist;
             index = p_node->child_indices().at(static_cast<size_t>(dist));
         }
-        leaf_node_type const & leaf = leaf_node(index);
-        auto it = std::ranges::lower_bound(leaf.keys(), key);
-        if (it == leaf.keys().end() || key != *it)
-            return std::make_tuple(INVALID_INDEX, 0);
-        return std::make_tuple(index, std::distance(leaf.keys().begin(), it));
+        count_descent(visited);
+        // all keys of the leaf are less than key: the next leaf starts with a greater one
+        for (; index != INVALID_INDEX; index = leaf_node(index).next_leaf_index()) {
+            leaf_node_type const & leaf = leaf_node(index);
+            auto it = std::ranges::lower_bound(leaf.keys(), key);
+            if (it != leaf.keys().end())
+                return std::make_tuple(index, std::distance(leaf.keys().begin(), it));
+        }
+        return std::make_tuple(INVALID_INDEX, 0);
     }
 
-    template<typename Key, typename Value, typename Index, size_t Internal_order, size_t Leaf_order>
-    auto btree<Key, Value, Index, Internal_order, Leaf_order>::insert_split_internal(index_type node_index, const key_type &key,
+    template<typename Key, typename Value, typename Index, size_t Internal_order, size_t Leaf_order, typename Split_policy,
+        typename Rebalance_policy, typename Storage_policy, typename Stats_policy>
+    auto btree<Key, Value, Index, Internal_order, Leaf_order, Split_policy, Rebalance_policy, Storage_policy, Stats_policy>::insert_split_internal(index_type node_index, const key_type &key,
         index_type child_index) -> bool {
         assert((internal_node(node_index).size() == internal_node_type::order()) && "internal node should be full");
+        count(btree_event::internal_split);
 
         // create new internal
         index_type new_internal_index = create_internal_node(internal_node(node_index).parent_index());
+        // both nodes are held while the children and the minimum key are read
+        node_pin new_internal_pin(*this, new_internal_index);
+        node_pin internal_pin(*this, node_index);
         internal_node_type& new_internal = internal_node(new_internal_index);
 
         internal_node_type* p_internal = &internal_node(node_index);
@@ -1081,18 +2352,22 @@ namespace bt {
         }
 
         pivot_key = minimum_key(new_internal_index);
-        if (is_root(*p_internal)) {
+        auto const parent_index = p_internal->parent_index();
+        new_internal_pin.release();
+        internal_pin.release();
+        if (is_root(node_index)) {
             // pivot_key = minimum_key(new_internal_index);
             grow(node_index, new_internal_index, pivot_key);
         } else {
-            insert_internal(p_internal->parent_index(), pivot_key, new_internal_index, true);
+            insert_internal(parent_index, pivot_key, new_internal_index, true);
         }
 
         return true;
     }
 
-    template<typename Key, typename Value, typename Index, size_t Internal_order, size_t Leaf_order>
-    auto btree<Key, Value, Index, Internal_order, Leaf_order>::insert_internal(index_type node_index, const key_type &key,
+    template<typename Key, typename Value, typename Index, size_t Internal_order, size_t Leaf_order, typename Split_policy,
+        typename Rebalance_policy, typename Storage_policy, typename Stats_policy>
+    auto btree<Key, Value, Index, Internal_order, Leaf_order, Split_policy, Rebalance_policy, Storage_policy, Stats_policy>::insert_internal(index_type node_index, const key_type &key,
                                                           index_type child_index, bool allow_recurse) -> bool {
         internal_node_type& internal = internal_node(node_index);
         if (internal.size() < internal.order()) {
@@ -1112,12 +2387,26 @@ namespace bt {
         return true;
     }
 
-    template<typename Key, typename Value, typename Index, size_t Internal_order, size_t Leaf_order>
-    auto btree<Key, Value, Index, Internal_order, Leaf_order>::insert_split_leaf(iterator insert_pos, const key_type &key, const value_type &value)-> bool {
+    template<typename Key, typename Value, typename Index, size_t Internal_order, size_t Leaf_order, typename Split_policy,
+        typename Rebalance_policy, typename Storage_policy, typename Stats_policy>
+    auto btree<Key, Value, Index, Internal_order, Leaf_order, Split_policy, Rebalance_policy, Storage_policy, Stats_policy>::insert_split_leaf(iterator insert_pos, const key_type &key, const value_type &value)-> bool {
         assert((insert_pos.current_leaf().keys().size() == insert_pos.current_leaf().keys().capacity()) && "leaf node should be full");
 
+        if constexpr (traits::split_policy::shift_to_siblings) {
+            if (insert_shift_leaf(insert_pos, key, value))
+                return true;
+        }
+        if constexpr (traits::split_policy::split_two_to_three) {
+            if (insert_split_two_leaves(insert_pos, key, value))
+                return true;
+        }
+        count(btree_event::leaf_split);
+
         // create a new leaf
         index_type new_leaf_index = create_leaf_node(insert_pos.current_leaf().parent_index());
+        // both leaves are held while the next leaf is linked and the new entry is inserted
+        node_pin new_leaf_pin(*this, new_leaf_index);
+        node_pin leaf_pin(*this, insert_pos.leaf_node_index_);
         leaf_node_type& new_leaf = leaf_node(new_leaf_index);
 
         // p_leaf
@@ -1152,18 +2441,142 @@ namespace bt {
         auto new_insert_pos = find_insert_position(key, p_insert_leaf->index());
         insert_leaf(new_insert_pos, key, value, false);
 
-        if (is_root(*p_leaf)) {
-            grow(p_leaf->index(), new_leaf_index, pivot_key);
+        auto const leaf_index = p_leaf->index();
+        auto const parent_index = p_leaf->parent_index();
+        new_leaf_pin.release();
+        leaf_pin.release();
+        if (is_root(leaf_index)) {
+            grow(leaf_index, new_leaf_index, pivot_key);
         } else {
             // insert pivot_key into parent (internal) node
-            insert_internal(p_leaf->parent_index(), pivot_key, new_leaf_index, true);
+            insert_internal(parent_index, pivot_key, new_leaf_index, true);
+        }
+
+        return true;
+    }
+
+    template<typename Key, typename Value, typename Index, size_t Internal_order, size_t Leaf_order, typename Split_policy,
+        typename Rebalance_policy, typename Storage_policy, typename Stats_policy>
+    auto btree<Key, Value, Index, Internal_order, Leaf_order, Split_policy, Rebalance_policy, Storage_policy, Stats_policy>::insert_shift_leaf(iterator insert_pos, const key_type &key,
+        const value_type &value) -> bool {
+        node_pin const leaf_pin(*this, insert_pos.leaf_node_index_);
+        leaf_node_type& leaf = insert_pos.current_leaf();
+        node_pin const prev_leaf_pin(*this, leaf.previous_leaf_index());
+        node_pin const next_leaf_pin(*this, leaf.next_leaf_index());
+        index_type position = insert_pos.leaf_index_;
+        leaf_node_type* p_prev_leaf = leaf.has_previous_leaf_index() ? &leaf_node(leaf.previous_leaf_index()) : nullptr;
+        leaf_node_type* p_next_leaf = leaf.has_next_leaf_index() ? &leaf_node(leaf.next_leaf_index()) : nullptr;
+        // a neighbour needs room for at least one shifted entry plus the new one
+        bool prev_has_room = p_prev_leaf != nullptr && p_prev_leaf->size() + 1 < leaf_node_type::order();
+        bool next_has_room = p_next_leaf != nullptr && p_next_leaf->size() + 1 < leaf_node_type::order();
+        if (!prev_has_room && !next_has_room)
+            return false;
+
+        // shift half of the free space of the emptier neighbour, at least one entry
+        bool is_next = next_has_room && (!prev_has_room || p_next_leaf->size() <= p_prev_leaf->size());
+        leaf_node_type& neighbour = is_next ? *p_next_leaf : *p_prev_leaf;
+        index_type shift_cnt = std::max(index_type(1), index_type((leaf_node_type::order() - neighbour.size()) / 2));
+        if (is_next) {
+            // move from end of leaf to beginning of next
+            index_type first = index_type(leaf.size() - shift_cnt);
+            neighbour.keys().insert_space(neighbour.keys().begin(), shift_cnt);
+            neighbour.values().insert_space(neighbour.values().begin(), shift_cnt);
+            std::move(leaf.keys().begin() + first, leaf.keys().end(), neighbour.keys().begin());
+            std::move(leaf.values().begin() + first, leaf.values().end(), neighbour.values().begin());
+            leaf.keys().erase(leaf.keys().begin() + first, leaf.keys().end());
+            leaf.values().erase(leaf.values().begin() + first, leaf.values().end());
+            if (position <= first)
+                insert_leaf(iterator(*this, leaf.index(), position), key, value, false);
+            else
+                insert_leaf(iterator(*this, neighbour.index(), index_type(position - first)), key, value, false);
+            adjust_parent_key(neighbour.index());
+        } else {
+            // move from beginning of leaf to end of previous
+            index_type prev_size = neighbour.size();
+            std::move(leaf.keys().begin(), leaf.keys().begin() + shift_cnt, std::back_inserter(neighbour.keys()));
+            std::move(leaf.values().begin(), leaf.values().begin() + shift_cnt, std::back_inserter(neighbour.values()));
+            leaf.keys().erase(leaf.keys().begin(), leaf.keys().begin() + shift_cnt);
+            leaf.values().erase(leaf.values().begin(), leaf.values().begin() + shift_cnt);
+            if (position >= shift_cnt)
+                insert_leaf(iterator(*this, leaf.index(), index_type(position - shift_cnt)), key, value, false);
+            else
+                insert_leaf(iterator(*this, neighbour.index(), index_type(prev_size + position)), key, value, false);
+            adjust_parent_key(leaf.index());
         }
+        return true;
+    }
 
+    template<typename Key, typename Value, typename Index, size_t Internal_order, size_t Leaf_order, typename Split_policy,
+        typename Rebalance_policy, typename Storage_policy, typename Stats_policy>
+    auto btree<Key, Value, Index, Internal_order, Leaf_order, Split_policy, Rebalance_policy, Storage_policy, Stats_policy>::insert_split_two_leaves(iterator insert_pos,
+        const key_type &key, const value_type &value) -> bool {
+        leaf_node_type* p_leaf = &insert_pos.current_leaf();
+        index_type leaf_index = insert_pos.leaf_node_index_;
+        bool is_next = p_leaf->has_next_leaf_index();
+        index_type neighbour_index = is_next ? p_leaf->next_leaf_index() : p_leaf->previous_leaf_index();
+        if (neighbour_index == INVALID_INDEX || leaf_node(neighbour_index).size() + 1 < leaf_node_type::order())
+            return false;
+        count(btree_event::leaf_split);
+        index_type left_index = is_next ? leaf_index : neighbour_index;
+        index_type right_index = is_next ? neighbour_index : leaf_index;
+        std::size_t position = (is_next ? 0UL : leaf_node(left_index).size()) + insert_pos.leaf_index_;
+
+        // create the middle leaf, invalidates all node references
+        index_type middle_index = create_leaf_node(leaf_node(left_index).parent_index());
+        node_pin left_pin(*this, left_index);
+        node_pin middle_pin(*this, middle_index);
+        node_pin right_pin(*this, right_index);
+        leaf_node_type& left = leaf_node(left_index);
+        leaf_node_type& middle = leaf_node(middle_index);
+        leaf_node_type& right = leaf_node(right_index);
+
+        // collect the entries of both leaves and the new one
+        std::vector<key_type> keys;
+        std::vector<value_type> values;
+        keys.reserve(2 * leaf_node_type::order() + 1);
+        values.reserve(2 * leaf_node_type::order() + 1);
+        for (leaf_node_type* p_node : {&left, &right}) {
+            std::move(p_node->keys().begin(), p_node->keys().end(), std::back_inserter(keys));
+            std::move(p_node->values().begin(), p_node->values().end(), std::back_inserter(values));
+            p_node->keys().clear();
+            p_node->values().clear();
+        }
+        keys.insert(keys.begin() + static_cast<std::ptrdiff_t>(position), key);
+        values.insert(values.begin() + static_cast<std::ptrdiff_t>(position), value);
+
+        // distribute them evenly onto left, middle and right
+        std::size_t offset = 0;
+        std::size_t remaining_nodes = 3;
+        for (leaf_node_type* p_node : {&left, &middle, &right}) {
+            std::size_t cnt = (keys.size() - offset) / remaining_nodes--;
+            auto first = static_cast<std::ptrdiff_t>(offset);
+            auto last = static_cast<std::ptrdiff_t>(offset + cnt);
+            std::move(keys.begin() + first, keys.begin() + last, std::back_inserter(p_node->keys()));
+            std::move(values.begin() + first, values.begin() + last, std::back_inserter(p_node->values()));
+            offset += cnt;
+        }
+
+        // adjust links
+        middle.set_previous_leaf_index(left_index);
+        middle.set_next_leaf_index(right_index);
+        left.set_next_leaf_index(middle_index);
+        right.set_previous_leaf_index(middle_index);
+
+        key_type middle_key = middle.keys().front();
+        auto const parent_index = left.parent_index();
+        left_pin.release();
+        middle_pin.release();
+        right_pin.release();
+        // first fix the key of right which lost its first entries, otherwise middle might be inserted
+        // behind right into the parent of left in case of duplicate keys
+        adjust_parent_key(right_index);
+        insert_internal(parent_index, middle_key, middle_index, true);
         return true;
     }
 
-    template<typename Key, typename Value, typename Index, size_t Internal_order, size_t Leaf_order>
-    auto btree<Key, Value, Index, Internal_order, Leaf_order>::insert_leaf(iterator insert_pos, const key_type &key,
+    template<typename Key, typename Value, typename Index, size_t Internal_order, size_t Leaf_order, typename Split_policy,
+        typename Rebalance_policy, typename Storage_policy, typename Stats_policy>
+    auto btree<Key, Value, Index, Internal_order, Leaf_order, Split_policy, Rebalance_policy, Storage_policy, Stats_policy>::insert_leaf(iterator insert_pos, const key_type &key,
         const value_type &value, bool allow_recurse) -> bool {
         leaf_node_type& leaf = insert_pos.current_leaf();
         if (leaf.size() < leaf_node_type::order()) {
@@ -1176,14 +2589,20 @@ namespace bt {
         return true;
     }
 
-    template<typename Key, typename Value, typename Index, size_t Internal_order, size_t Leaf_order>
-    auto btree<Key, Value, Index, Internal_order, Leaf_order>::merge_internal(index_type left_node_index) -> bool {
+    template<typename Key, typename Value, typename Index, size_t Internal_order, size_t Leaf_order, typename Split_policy,
+        typename Rebalance_policy, typename Storage_policy, typename Stats_policy>
+    auto btree<Key, Value, Index, Internal_order, Leaf_order, Split_policy, Rebalance_policy, Storage_policy, Stats_policy>::merge_internal(index_type left_node_index) -> bool {
         assert(!is_root(left_node_index) && "merge_internal(index_type left_node_index): Cannot merge root node");
+        count(btree_event::internal_merge);
+        // the three nodes are held while the children of right are read
+        node_pin left_pin(*this, left_node_index);
         internal_node_type* p_left = &internal_node(left_node_index);
         // assert((p_left->size() < traits::min_internal_order) && "merge_internal(left_node_index internal_node_index): left node is to big to merge");
+        node_pin parent_pin(*this, p_left->parent_index());
         internal_node_type* p_parent = &internal_node(p_left->parent_index());
         auto [_, right_index] = p_parent->siblings_for_index(left_node_index);
         assert((right_index != INVALID_INDEX) && "merge_internal(index_type left_node_index): There is no right node to merge with");
+        node_pin right_pin(*this, right_index);
         internal_node_type* p_right = &internal_node(right_index);
         assert((p_left->size() + p_right->size() < traits::internal_order) && "merge_internal(left_node_index internal_node_index): left + right node are to big to merge");
 
@@ -1199,13 +2618,18 @@ namespace bt {
                 node.set_parent_index(left_node_index);
             }, node(i));
         }
-        erase_internal(p_right->parent_index(), right_index);
-        p_right->mark_deleted();
+        auto const parent_index = p_right->parent_index();
+        left_pin.release();
+        parent_pin.release();
+        right_pin.release();
+        erase_internal(parent_index, right_index);
+        delete_node(right_index);
         return true;
     }
 
-    template<typename Key, typename Value, typename Index, size_t Internal_order, size_t Leaf_order>
-    auto btree<Key, Value, Index, Internal_order, Leaf_order>::erase_internal(index_type internal_node_index,
+    template<typename Key, typename Value, typename Index, size_t Internal_order, size_t Leaf_order, typename Split_policy,
+        typename Rebalance_policy, typename Storage_policy, typename Stats_policy>
+    auto btree<Key, Value, Index, Internal_order, Leaf_order, Split_policy, Rebalance_policy, Storage_policy, Stats_policy>::erase_internal(index_type internal_node_index,
         index_type child_node_index) -> bool {
         internal_node_type &internal = internal_node(internal_node_index);
         auto [key_it, index_it] = internal.iterators_for_index(child_node_index);
@@ -1214,13 +2638,22 @@ namespace bt {
             key_it = internal.keys().begin();
         internal.child_indices().erase(index_it);
         internal.keys().erase(key_it);
-        if (internal.size() < traits::min_internal_order)
-            rebalance_internal_node(internal_node_index);
+        if (internal.size() < traits::min_internal_order) {
+            if (traits::deferred_rebalance && internal.size() > 0) {
+                if (internal.size() + 1 == traits::min_internal_order) {
+                    auto bookkeeping_lock = lock_bookkeeping();
+                    underflowing_.push_back(internal_node_index);
+                }
+            } else {
+                rebalance_internal_node(internal_node_index);
+            }
+        }
         return true;
     }
 
-    template<typename Key, typename Value, typename Index, size_t Internal_order, size_t Leaf_order>
-    auto btree<Key, Value, Index, Internal_order, Leaf_order>::merge_leaf(index_type left_leaf_index) -> bool {
+    template<typename Key, typename Value, typename Index, size_t Internal_order, size_t Leaf_order, typename Split_policy,
+        typename Rebalance_policy, typename Storage_policy, typename Stats_policy>
+    auto btree<Key, Value, Index, Internal_order, Leaf_order, Split_policy, Rebalance_policy, Storage_policy, Stats_policy>::merge_leaf(index_type left_leaf_index) -> bool {
         // merge with the neighbour with the same parent node as this_node
         //         - move all key/values to the lesser node
         //         - adjust previous and next node indexes
@@ -1228,35 +2661,46 @@ namespace bt {
         //         - mark right node as deleted/unused
         //         - check if we need to rebalance parent internal node (recurse)
         //         - check if we need to shrink
+        count(btree_event::leaf_merge);
+        node_pin left_leaf_pin(*this, left_leaf_index);
         leaf_node_type& left_leaf = leaf_node(left_leaf_index);
         assert((left_leaf.has_next_leaf_index() ) && "merge_leaf(index_type left_leaf_index): Left node has no next node");
         auto right_leaf_index = left_leaf.next_leaf_index();
+        node_pin right_leaf_pin(*this, right_leaf_index);
         leaf_node_type& right_leaf = leaf_node(right_leaf_index);
         // assert((left_leaf.parent_index() == right_leaf.parent_index()) && "merge_leaf(index_type left_leaf_index): Cannot merge leaf nodes with different parent nodes");
         assert((right_leaf.has_previous_leaf_index() && right_leaf.previous_leaf_index() == left_leaf_index) && "Right node does not point to left node");
-        assert((left_leaf.keys().front() <= right_leaf.keys().front()) && "merge_leaf(index_type left_leaf_index): order of nodes is obviously wrong");
-        assert((left_leaf.size() <= traits::min_leaf_order) && "merge_leaf(index_type left_leaf_index): left node is to big to merge");
-        assert((right_leaf.size() <= traits::min_leaf_order) && "merge_leaf(index_type left_leaf_index): right node is to big to merge");
+        assert((left_leaf.keys().empty() || right_leaf.keys().empty() || left_leaf.keys().front() <= right_leaf.keys().front())
+               && "merge_leaf(index_type left_leaf_index): order of nodes is obviously wrong");
+        bool const left_was_empty = left_leaf.keys().empty();
         assert((left_leaf.size() + right_leaf.size() <= traits::leaf_order) && "merge_leaf(index_type left_leaf_index): sizes of nodes to big to merge");
 
         std::move(right_leaf.keys().begin(), right_leaf.keys().end(), std::back_inserter(left_leaf.keys()));
         right_leaf.keys().clear();
         std::move(right_leaf.values().begin(), right_leaf.values().end(), std::back_inserter(left_leaf.values()));
         right_leaf.values().clear();
-
-        left_leaf.set_next_leaf_index(right_leaf.next_leaf_index());
-        erase_internal(right_leaf.parent_index(), right_leaf_index);
-        if (right_leaf.has_next_leaf_index()) {
-            auto& next_leaf = leaf_node(right_leaf.next_leaf_index());
-            adjust_parent_key(right_leaf.next_leaf_index());
-            next_leaf.set_previous_leaf_index(left_leaf.index());
-        }
-        right_leaf.mark_deleted();
+        // an empty leaf is only left by an erase, its parent key is the erased one
+        if (left_was_empty && !is_root(left_leaf_index))
+            adjust_parent_key(left_leaf_index);
+
+        auto const next_leaf_index = right_leaf.next_leaf_index();
+        auto const parent_index = right_leaf.parent_index();
+        left_leaf.set_next_leaf_index(next_leaf_index);
+        // erasing right from its parent may rebalance all the way up
+        left_leaf_pin.release();
+        right_leaf_pin.release();
+        erase_internal(parent_index, right_leaf_index);
+        if (next_leaf_index != INVALID_INDEX) {
+            adjust_parent_key(next_leaf_index);
+            leaf_node(next_leaf_index).set_previous_leaf_index(left_leaf_index);
+        }
+        delete_node(right_leaf_index);
         return true;
     }
 
-    template<typename Key, typename Value, typename Index, size_t Internal_order, size_t Leaf_order>
-    auto btree<Key, Value, Index, Internal_order, Leaf_order>::rebalance_internal_node(index_type internal_node_index) -> bool {
+    template<typename Key, typename Value, typename Index, size_t Internal_order, size_t Leaf_order, typename Split_policy,
+        typename Rebalance_policy, typename Storage_policy, typename Stats_policy>
+    auto btree<Key, Value, Index, Internal_order, Leaf_order, Split_policy, Rebalance_policy, Storage_policy, Stats_policy>::rebalance_internal_node(index_type internal_node_index) -> bool {
         internal_node_type* p_internal = &internal_node(internal_node_index);
         assert((p_internal->size() < traits::min_internal_order) && "rebalance_internal_node: left node has sufficient keys already");
         if (is_root(internal_node_index)) {
@@ -1266,8 +2710,19 @@ namespace bt {
             }
             return false;
         }
-        internal_node_type* p_parent = &internal_node(p_internal->parent_index());
-        auto [prev_index, next_index] = p_parent->siblings_for_index(internal_node_index);
+        count(btree_event::internal_rebalance);
+        auto [prev_index, next_index] = internal_node(p_internal->parent_index()).siblings_for_index(internal_node_index);
+        // the node and its siblings are held while the moved children are read, but not by a merge, which may
+        // rebalance all the way up
+        node_pin internal_pin(*this, internal_node_index);
+        node_pin prev_pin(*this, prev_index);
+        node_pin next_pin(*this, next_index);
+        auto release_pins = [&] {
+            internal_pin.release();
+            prev_pin.release();
+            next_pin.release();
+        };
+        p_internal = &internal_node(internal_node_index);
 
         internal_node_type* p_prev = nullptr;
         index_type prev_size = 0;
@@ -1284,7 +2739,7 @@ namespace bt {
         }
 
         internal_node_type* p_chosen_neighbour = nullptr;
-        switch(0x02 * (prev_size > traits::min_internal_order) + (next_size > traits::min_internal_order)) {
+        switch(0x02 * (prev_size > traits::merge_internal_order) + (next_size > traits::merge_internal_order)) {
             case 0x03: // both
                 p_chosen_neighbour = prev_size > next_size ? p_prev : p_next;
                 break;
@@ -1295,6 +2750,7 @@ namespace bt {
                 p_chosen_neighbour = p_next;
                 break;
             case 0x00: // none: merge
+                release_pins();
                 merge_internal(next_index != INVALID_INDEX ? internal_node_index : prev_index);
                 return true;
                 break;
@@ -1302,8 +2758,13 @@ namespace bt {
                 assert("rebalance_internal_node(index_type internal_nodex_index): Unreachable rebalance strategy");
         }
         if (p_chosen_neighbour != nullptr) {
-            index_type copy_cnt = std::min(index_type(1), std::midpoint(p_internal->size(), p_chosen_neighbour->size()));
+            index_type copy_cnt = rebalance_count<false>(p_internal->size(), p_chosen_neighbour->size());
             bool is_next = p_chosen_neighbour == p_next;
+            if (copy_cnt == 0) {
+                release_pins();
+                merge_internal(is_next ? internal_node_index : prev_index);
+                return true;
+            }
             index_type key_start_index = is_next ? 0 : p_chosen_neighbour->size() - copy_cnt;
             index_type value_start_index = is_next ? 0 : p_chosen_neighbour->child_indices().size() - copy_cnt;
             index_type key_end_index = is_next ? copy_cnt : p_chosen_neighbour->size();
@@ -1332,21 +2793,34 @@ namespace bt {
                               }, node(index));
                           }
             );
-            if (!is_next)
+            // a previous neighbour keeps its first child: only a next one needs its parent key adjusted
+            if (is_next)
+                adjust_parent_key(p_chosen_neighbour->index());
+            else
                 adjust_parent_key(p_internal->child_indices().at(copy_cnt));
-
-            adjust_parent_key(p_chosen_neighbour->index());
             // adjust_parent_key(internal_node_index);
         }
         return false;
     }
 
-    template<typename Key, typename Value, typename Index, size_t Internal_order, size_t Leaf_order>
+    template<typename Key, typename Value, typename Index, size_t Internal_order, size_t Leaf_order, typename Split_policy,
+        typename Rebalance_policy, typename Storage_policy, typename Stats_policy>
     auto btree<Key, Value, Index, Internal_order,
-        Leaf_order>::rebalance_leaf_node(index_type leaf_node_index) -> bool {
+        Leaf_order, Split_policy, Rebalance_policy, Storage_policy, Stats_policy>::rebalance_leaf_node(index_type leaf_node_index) -> bool {
         if (is_root(leaf_node_index))
             return false;
+        count(btree_event::leaf_rebalance);
+        // the leaf and its neighbours are held while parent keys are adjusted, but not by a merge, which may
+        // rebalance all the way up
+        node_pin leaf_pin(*this, leaf_node_index);
         leaf_node_type *p_leaf = &leaf_node(leaf_node_index);
+        node_pin next_leaf_pin(*this, p_leaf->next_leaf_index());
+        node_pin prev_leaf_pin(*this, p_leaf->previous_leaf_index());
+        auto release_pins = [&] {
+            leaf_pin.release();
+            next_leaf_pin.release();
+            prev_leaf_pin.release();
+        };
         leaf_node_type *p_next_leaf = nullptr;
         index_type next_size = index_type(0);
         leaf_node_type *p_prev_leaf = nullptr;
@@ -1365,12 +2839,13 @@ namespace bt {
         //  both:  pick neighbour with more nodes -> chosen_neighbour
         //  left:  left -> chosen_neighbour
         //  right: right -> chosen_neighbour
-        //         redistribute such that this_leaf and chosen_neighbour have same size +- 1
-        //         i.e. move (chosen_neighbour.size() - min_order) / 2 nodes into this_node
+        //         move rebalance_count() entries into this_node: just enough to reach min_order or, if the
+        //         rebalance policy equalizes, until this_leaf and chosen_neighbour have same size +- 1
         //  none:  merge with the neighbour with the same parent node as this_node
+        //         (neighbours are compared against merge_order of the rebalance policy, not min_order)
 
         leaf_node_type* p_chosen_neighbour = nullptr;
-        switch(0x02 * (prev_size > traits::min_leaf_order) + (next_size > traits::min_leaf_order)) {
+        switch(0x02 * (prev_size > traits::merge_leaf_order) + (next_size > traits::merge_leaf_order)) {
             case 0x03: // both
                 p_chosen_neighbour = prev_size > next_size ? p_prev_leaf : p_next_leaf;
                 break;
@@ -1381,6 +2856,7 @@ namespace bt {
                 p_chosen_neighbour = p_next_leaf;
                 break;
             case 0x00: // none: merge
+                release_pins();
                 merge_leaf(p_leaf->has_next_leaf_index() ? p_leaf->index() : p_leaf->previous_leaf_index() );
                 return true;
                 break;
@@ -1388,8 +2864,15 @@ namespace bt {
                 assert("rebalance_leaf_node(index_type leaf_nodex_index): Unreachable rebalance strategy");
         }
         if (p_chosen_neighbour != nullptr) {
-            index_type copy_cnt = std::min(index_type(1), std::midpoint(p_leaf->size(), p_chosen_neighbour->size()));
+            index_type copy_cnt = rebalance_count<true>(p_leaf->size(), p_chosen_neighbour->size());
             bool is_next = p_chosen_neighbour == p_next_leaf;
+            if (copy_cnt == 0) {
+                auto const left_leaf_index = is_next ? p_leaf->index() : p_leaf->previous_leaf_index();
+                release_pins();
+                merge_leaf(left_leaf_index);
+                return true;
+            }
+            bool const was_empty = p_leaf->keys().empty();
             index_type start_index = is_next ? 0 : p_chosen_neighbour->size() - copy_cnt;
             index_type end_index = is_next ? copy_cnt : p_chosen_neighbour->size();
             auto key_insertion_it = is_next ? p_leaf->keys().end() : p_leaf->keys().begin();
@@ -1408,37 +2891,629 @@ namespace bt {
             std::move(p_chosen_neighbour->values().begin() + start_index, p_chosen_neighbour->values().begin() + end_index, value_insertion_it);
             p_chosen_neighbour->values().erase(p_chosen_neighbour->values().begin() + start_index, p_chosen_neighbour->values().begin() + end_index);
 
-            if (is_next)
+            if (is_next) {
                 adjust_parent_key(p_chosen_neighbour->index());
-            else
+                if (was_empty)
+                    adjust_parent_key(p_leaf->index());
+            } else {
                 adjust_parent_key(p_leaf->index());
+            }
         }
         return true;
     }
 
-    template<typename Key, typename Value, typename Index, size_t Internal_order, size_t Leaf_order>
-    auto btree<Key, Value, Index, Internal_order, Leaf_order>::delete_node(index_type node_index) {
+    template<typename Key, typename Value, typename Index, size_t Internal_order, size_t Leaf_order, typename Split_policy,
+        typename Rebalance_policy, typename Storage_policy, typename Stats_policy>
+    template<bool Is_leaf>
+    constexpr auto btree<Key, Value, Index, Internal_order, Leaf_order, Split_policy, Rebalance_policy, Storage_policy, Stats_policy>::rebalance_count(index_type size,
+        index_type neighbour_size) -> index_type {
+        constexpr auto min_order = index_type(traits::template get_min_order<Is_leaf>());
+        // the neighbour must not underflow itself after giving away entries
+        if (size + neighbour_size < 2 * min_order)
+            return 0;
+        auto const needed = index_type(min_order - size);
+        if constexpr (traits::rebalance_policy::equalize)
+            return std::max(needed, index_type((neighbour_size - size) / 2));
+        else
+            return needed;
+    }
+
+    template<typename Key, typename Value, typename Index, size_t Internal_order, size_t Leaf_order, typename Split_policy,
+        typename Rebalance_policy, typename Storage_policy, typename Stats_policy>
+    auto btree<Key, Value, Index, Internal_order, Leaf_order, Split_policy, Rebalance_policy, Storage_policy, Stats_policy>::delete_node(index_type node_index) -> void {
         std::visit([](auto & node) {
             node.mark_deleted();
         }, node(node_index));
+        auto bookkeeping_lock = lock_bookkeeping();
+        (p_deleted_indices_ != nullptr ? *p_deleted_indices_ : free_indices_).push_back(node_index);
+    }
+
+    template<typename Key, typename Value, typename Index, size_t Internal_order, size_t Leaf_order, typename Split_policy,
+        typename Rebalance_policy, typename Storage_policy, typename Stats_policy>
+    auto btree<Key, Value, Index, Internal_order, Leaf_order, Split_policy, Rebalance_policy, Storage_policy, Stats_policy>::maintain(
+        std::chrono::nanoseconds budget) -> bool {
+        auto const deadline = std::chrono::steady_clock::now() + budget;
+        do {
+            if (!rebalance_deferred_step() && !compact_step())
+                return true;
+        } while (std::chrono::steady_clock::now() < deadline);
+        return underflowing_.empty() && free_indices_.empty();
+    }
+
+    template<typename Key, typename Value, typename Index, size_t Internal_order, size_t Leaf_order, typename Split_policy,
+        typename Rebalance_policy, typename Storage_policy, typename Stats_policy>
+    auto btree<Key, Value, Index, Internal_order, Leaf_order, Split_policy, Rebalance_policy, Storage_policy, Stats_policy>::rebalance_deferred(
+        index_type node_index) -> void {
+        if (node_index >= nodes_.size() || is_root(node_index))
+            return;
+        if (auto *p_leaf = std::get_if<leaf_node_type>(&node(node_index))) {
+            // deleted nodes have no parent
+            if (p_leaf->has_parent() && p_leaf->size() < traits::min_leaf_order)
+                rebalance_leaf_node(node_index);
+        } else if (internal_node(node_index).has_parent() && internal_node(node_index).size() < traits::min_internal_order) {
+            rebalance_internal_node(node_index);
+        }
+    }
+
+    template<typename Key, typename Value, typename Index, size_t Internal_order, size_t Leaf_order, typename Split_policy,
+        typename Rebalance_policy, typename Storage_policy, typename Stats_policy>
+    auto btree<Key, Value, Index, Internal_order, Leaf_order, Split_policy, Rebalance_policy, Storage_policy, Stats_policy>::compact_step() -> bool {
+        auto is_deleted = [this](index_type index) {
+            return !is_root(index) && !std::visit([](auto const & node) { return node.has_parent(); }, node(index));
+        };
+        while (!free_indices_.empty() && is_deleted(index_type(nodes_.size() - 1))) {
+            std::erase(free_indices_, index_type(nodes_.size() - 1));
+            nodes_.pop_back();
+        }
+        if (free_indices_.empty())
+            return false;
+        auto const last = index_type(nodes_.size() - 1);
+        swap_nodes(free_indices_.back(), last);
+        std::erase(free_indices_, last);
+        nodes_.pop_back();
+        return true;
     }
 
-    template<typename Key, typename Value, typename Index, size_t Internal_order, size_t Leaf_order>
-    auto btree<Key, Value, Index, Internal_order, Leaf_order>::adjust_parent_key(index_type child_node_index, key_type const *p_correlated_key) -> void {
+    template<typename Key, typename Value, typename Index, size_t Internal_order, size_t Leaf_order, typename Split_policy,
+        typename Rebalance_policy, typename Storage_policy, typename Stats_policy>
+    template<typename Codec>
+    auto btree<Key, Value, Index, Internal_order, Leaf_order, Split_policy, Rebalance_policy, Storage_policy, Stats_policy>::save(
+        binary_writer &out, Codec const &codec) const -> void {
+        static_assert(binary_codec_for<Codec, key_type> && binary_codec_for<Codec, value_type>,
+                      "Codec cannot write the keys or values");
+        out.write(FORMAT_MAGIC, sizeof(FORMAT_MAGIC));
+        out.write_value(FORMAT_VERSION);
+        out.write_value(std::uint32_t(0x01020304)); // byte order
+        for (std::uint64_t field : {sizeof(key_type), sizeof(value_type), sizeof(index_type), Internal_order, Leaf_order})
+            out.write_value(field);
+        auto write_indices = [&out](auto const &indices) {
+            out.write_value(std::uint64_t(indices.size()));
+            out.write(indices.data(), indices.size() * sizeof(index_type));
+        };
+        out.write_value(std::uint64_t(nodes_.size()));
+        out.write_value(root_index_);
+        write_indices(free_indices_);
+        // a node can be remembered more than once
+        auto underflowing = underflowing_;
+        std::ranges::sort(underflowing);
+        underflowing.erase(std::ranges::unique(underflowing).begin(), underflowing.end());
+        write_indices(underflowing);
+        // a node's own index is its position, it is not written
+        for (std::size_t i = 0; i < nodes_.size(); ++i) {
+            std::visit([&out, &codec, &write_indices](auto const &node) {
+                out.write_value(std::uint8_t(node.is_leaf()));
+                out.write_value(node.parent_index());
+                out.write_value(node.size());
+                if constexpr (std::is_same_v<std::decay_t<decltype(node)>, leaf_node_type>) {
+                    out.write_value(node.previous_leaf_index());
+                    out.write_value(node.next_leaf_index());
+                    codec.write(out, std::span<key_type const>(node.keys().data(), node.size()));
+                    codec.write(out, std::span<value_type const>(node.values().data(), node.size()));
+                } else {
+                    codec.write(out, std::span<key_type const>(node.keys().data(), node.size()));
+                    write_indices(node.child_indices());
+                }
+            }, nodes_[i]);
+        }
+    }
+
+    template<typename Key, typename Value, typename Index, size_t Internal_order, size_t Leaf_order, typename Split_policy,
+        typename Rebalance_policy, typename Storage_policy, typename Stats_policy>
+    template<typename Codec>
+    auto btree<Key, Value, Index, Internal_order, Leaf_order, Split_policy, Rebalance_policy, Storage_policy, Stats_policy>::load(
+        binary_reader &in, Codec const &codec) -> void {
+        static_assert(binary_codec_for<Codec, key_type> && binary_codec_for<Codec, value_type>,
+                      "Codec cannot read the keys or values");
+        auto corrupt = [](bool condition) {
+            if (condition)
+                throw std::runtime_error("load: the input is corrupt");
+        };
+        char magic[sizeof(FORMAT_MAGIC)];
+        in.read(magic, sizeof(magic));
+        if (!std::ranges::equal(magic, FORMAT_MAGIC))
+            throw std::runtime_error("load: the input is no saved btree");
+        if (in.read_value<std::uint32_t>() != FORMAT_VERSION)
+            throw std::runtime_error("load: unsupported format version");
+        if (in.read_value<std::uint32_t>() != 0x01020304)
+            throw std::runtime_error("load: saved on a machine of other byte order");
+        for (std::uint64_t field : {sizeof(key_type), sizeof(value_type), sizeof(index_type), Internal_order, Leaf_order})
+            if (in.read_value<std::uint64_t>() != field)
+                throw std::runtime_error("load: saved by a btree of other key, value or index size or order");
+        auto const node_count = in.read_value<std::uint64_t>();
+        corrupt(node_count == 0 || node_count >= INVALID_INDEX);
+        // every node takes at least its type, parent index and size
+        if (auto const remaining = in.remaining())
+            corrupt(node_count > *remaining / (sizeof(std::uint8_t) + 2 * sizeof(index_type)));
+        auto const root_index = in.read_value<index_type>();
+        corrupt(root_index >= node_count);
+        // sizes are checked before anything is allocated for them, the checksum is only known at the end
+        auto read_indices = [&in, &corrupt](auto &indices, std::uint64_t max_count) {
+            auto const count = in.read_value<std::uint64_t>();
+            corrupt(count > max_count);
+            indices.resize(static_cast<std::size_t>(count));
+            in.read(indices.data(), indices.size() * sizeof(index_type));
+        };
+        std::vector<index_type> free_indices;
+        read_indices(free_indices, node_count);
+        std::vector<index_type> underflowing;
+        read_indices(underflowing, node_count);
+        nodes_type nodes;
+        nodes.resize(node_count);
+        for (std::size_t i = 0; i < node_count; ++i) {
+            auto const is_leaf = in.read_value<std::uint8_t>();
+            auto const parent_index = in.read_value<index_type>();
+            auto const size = in.read_value<index_type>();
+            corrupt(is_leaf > 1 || size > (is_leaf ? Leaf_order : Internal_order));
+            // emplaced in place: nodes are big, moving them would copy every entry
+            if (is_leaf) {
+                auto const previous_leaf_index = in.read_value<index_type>();
+                auto const next_leaf_index = in.read_value<index_type>();
+                auto &leaf = nodes[i].template emplace<leaf_node_type>(index_type(i), parent_index, previous_leaf_index, next_leaf_index);
+                leaf.keys().resize(size);
+                codec.read(in, std::span<key_type>(leaf.keys().data(), size));
+                leaf.values().resize(size);
+                codec.read(in, std::span<value_type>(leaf.values().data(), size));
+            } else {
+                auto &node = nodes[i].template emplace<internal_node_type>(index_type(i), parent_index);
+                node.keys().resize(size);
+                codec.read(in, std::span<key_type>(node.keys().data(), size));
+                read_indices(node.child_indices(), Internal_order + 1);
+            }
+        }
+        // the checksum detects corruption, not tampering: every index is checked before the tree follows it
+        auto valid = [node_count](index_type index) { return index < node_count; };
+        auto is_leaf_or_none = [&nodes, &valid](index_type index) {
+            return index == INVALID_INDEX || (valid(index) && std::holds_alternative<leaf_node_type>(nodes[index]));
+        };
+        corrupt(!std::ranges::all_of(free_indices, valid) || !std::ranges::all_of(underflowing, valid));
+        for (std::size_t i = 0; i < node_count; ++i) {
+            // with paged_storage reading the other nodes may evict node, unless it is pinned
+            if constexpr (paged_storage_policy)
+                (void) nodes.pin(i);
+            std::visit([&](auto const &node) {
+                corrupt(node.has_parent()
+                        && (!valid(node.parent_index()) || !std::holds_alternative<internal_node_type>(nodes[node.parent_index()])));
+                if constexpr (std::is_same_v<std::decay_t<decltype(node)>, leaf_node_type>) {
+                    corrupt(!is_leaf_or_none(node.previous_leaf_index()) || !is_leaf_or_none(node.next_leaf_index()));
+                } else {
+                    corrupt(!std::ranges::all_of(node.child_indices(), valid));
+                    // deleted nodes keep what they held, the ones in the tree have a child more than keys
+                    corrupt((node.has_parent() || i == root_index) && node.child_indices().size() != node.size() + 1);
+                }
+            }, nodes[i]);
+            if constexpr (paged_storage_policy)
+                nodes.unpin(i);
+        }
+        in.finish();
+        nodes_ = std::move(nodes);
+        root_index_ = root_index;
+        free_indices_ = std::move(free_indices);
+        underflowing_ = std::move(underflowing);
+        mark_all_dirty();
+    }
+
+    template<typename Key, typename Value, typename Index, size_t Internal_order, size_t Leaf_order, typename Split_policy,
+        typename Rebalance_policy, typename Storage_policy, typename Stats_policy>
+    auto btree<Key, Value, Index, Internal_order, Leaf_order, Split_policy, Rebalance_policy, Storage_policy, Stats_policy>::save_image(
+        binary_writer &out) const -> std::vector<image_node> {
+        std::uint64_t entry_count = 0;
+        for (auto index = first_leaf_index(); index != INVALID_INDEX; index = leaf_node(index).next_leaf_index())
+            entry_count += leaf_node(index).size();
+        std::array<std::byte, btree_image_header::IMAGE_ALIGNMENT> page{};
+        auto const header = image_header(entry_count);
+        std::memcpy(page.data(), &header, sizeof(header));
+        out.write(page.data(), page.size());
+        std::vector<image_node> nodes(nodes_.size());
+        std::vector<std::uint64_t> checksums(nodes_.size());
+        // node storage need not be contiguous (stable_storage, cow_storage)
+        for (std::size_t i = 0; i < nodes_.size(); ++i) {
+            auto const bytes = image_bytes_of(index_type(i));
+            out.write(bytes.data(), bytes.size());
+            nodes[i] = image_node_of(index_type(i), bytes);
+            checksums[i] = nodes[i].checksum;
+        }
+        out.write_value(btree_image_header::image_checksum(page, checksums));
+        return nodes;
+    }
+
+    template<typename Key, typename Value, typename Index, size_t Internal_order, size_t Leaf_order, typename Split_policy,
+        typename Rebalance_policy, typename Storage_policy, typename Stats_policy>
+    auto btree<Key, Value, Index, Internal_order, Leaf_order, Split_policy, Rebalance_policy, Storage_policy, Stats_policy>::image_header(
+        std::uint64_t entry_count) const -> btree_image_header {
+        static_assert(alignof(common_node_type) <= btree_image_header::IMAGE_ALIGNMENT);
+        btree_image_header header{};
+        std::ranges::copy(btree_image_header::MAGIC, header.magic);
+        header.version = btree_image_header::VERSION;
+        header.byte_order = btree_image_header::BYTE_ORDER_MARK;
+        header.key_size = sizeof(key_type);
+        header.value_size = sizeof(value_type);
+        header.index_size = sizeof(index_type);
+        header.internal_order = Internal_order;
+        header.leaf_order = Leaf_order;
+        header.node_size = sizeof(common_node_type);
+        header.node_count = nodes_.size();
+        header.root_index = root_index_;
+        header.first_leaf_index = first_leaf_index();
+        header.last_leaf_index = last_leaf_index();
+        header.entry_count = entry_count;
+        return header;
+    }
+
+    template<typename Key, typename Value, typename Index, size_t Internal_order, size_t Leaf_order, typename Split_policy,
+        typename Rebalance_policy, typename Storage_policy, typename Stats_policy>
+    auto btree<Key, Value, Index, Internal_order, Leaf_order, Split_policy, Rebalance_policy, Storage_policy, Stats_policy>::image_bytes_of(
+        index_type index) const -> node_bytes {
+        // the compiler may drop zeroing storage in which an object is constructed next (lifetime dead store
+        // elimination), but not a call through a volatile pointer
+        static void *(*volatile const zero_memory)(void *, int, std::size_t) = std::memset;
+        alignas(common_node_type) node_bytes copy;
+        zero_memory(copy.data(), 0, copy.size());
+        auto *p_copy = std::construct_at(reinterpret_cast<common_node_type *>(copy.data()), node(index));
+        node_bytes bytes;
+        std::memcpy(bytes.data(), copy.data(), bytes.size());
+        std::destroy_at(p_copy);
+        return bytes;
+    }
+
+    template<typename Key, typename Value, typename Index, size_t Internal_order, size_t Leaf_order, typename Split_policy,
+        typename Rebalance_policy, typename Storage_policy, typename Stats_policy>
+    auto btree<Key, Value, Index, Internal_order, Leaf_order, Split_policy, Rebalance_policy, Storage_policy, Stats_policy>::image_node_of(
+        index_type index, node_bytes const &bytes) const -> image_node {
+        // the entries of the leaves in use, deleted nodes have no parent
+        auto const *p_leaf = std::get_if<leaf_node_type>(&node(index));
+        auto const in_use = p_leaf != nullptr && (p_leaf->has_parent() || is_root(index));
+        return {btree_image_header::node_checksum(bytes.data(), bytes.size()), in_use ? std::uint64_t(p_leaf->size()) : 0};
+    }
+
+#ifdef BT_HAS_FILE_DESCRIPTORS
+    template<typename Key, typename Value, typename Index, size_t Internal_order, size_t Leaf_order, typename Split_policy,
+        typename Rebalance_policy, typename Storage_policy, typename Stats_policy>
+    auto btree<Key, Value, Index, Internal_order, Leaf_order, Split_policy, Rebalance_policy, Storage_policy, Stats_policy>::checkpoint(
+        int fd) -> std::size_t
+        requires std::is_trivially_copyable_v<key_type> && std::is_trivially_copyable_v<value_type> {
+        auto check = [](bool ok, char const *what) {
+            if (!ok)
+                throw std::system_error(errno, std::generic_category(), what);
+        };
+        auto write_at = [fd, &check](void const *data, std::size_t size, std::uint64_t offset) {
+            auto const *p = static_cast<std::byte const *>(data);
+            while (size > 0) {
+                auto const written = ::pwrite(fd, p, size, static_cast<off_t>(offset));
+                if (written < 0 && errno == EINTR)
+                    continue;
+                check(written >= 0, "checkpoint: pwrite");
+                p += written;
+                offset += static_cast<std::uint64_t>(written);
+                size -= static_cast<std::size_t>(written);
+            }
+        };
+        auto const count = nodes_.size();
+        auto const image_size = btree_image_header::IMAGE_ALIGNMENT + count * sizeof(common_node_type) + sizeof(std::uint64_t);
+        if (p_checkpoint_ == nullptr) {
+            check(::lseek(fd, 0, SEEK_SET) == 0, "checkpoint: lseek");
+            auto state = std::make_unique<checkpoint_state>();
+            binary_writer writer(fd);
+            state->nodes = save_image(writer);
+            writer.flush();
+            check(::ftruncate(fd, static_cast<off_t>(image_size)) == 0, "checkpoint: ftruncate");
+            check(::fdatasync(fd) == 0, "checkpoint: fdatasync");
+            state->dirty.assign(count, false);
+            for (auto const &n : state->nodes)
+                state->entry_count += n.entry_count;
+            p_checkpoint_ = std::move(state);
+            return count;
+        }
+        auto &state = *p_checkpoint_;
+        // nodes removed from the end since the last checkpoint
+        for (auto i = count; i < state.nodes.size(); ++i)
+            state.entry_count -= state.nodes[i].entry_count;
+        state.nodes.resize(count);
+        state.dirty.resize(count);
+        std::size_t written = 0;
+        for (std::size_t i = 0; i < count; ++i) {
+            if (!state.dirty[i])
+                continue;
+            auto const bytes = image_bytes_of(index_type(i));
+            write_at(bytes.data(), bytes.size(), btree_image_header::IMAGE_ALIGNMENT + i * sizeof(common_node_type));
+            auto const updated = image_node_of(index_type(i), bytes);
+            state.entry_count += updated.entry_count - state.nodes[i].entry_count;
+            state.nodes[i] = updated;
+            ++written;
+        }
+        check(::ftruncate(fd, static_cast<off_t>(image_size)) == 0, "checkpoint: ftruncate");
+        // the nodes are on disk before the header and checksum which describe them
+        check(::fdatasync(fd) == 0, "checkpoint: fdatasync");
+        std::array<std::byte, btree_image_header::IMAGE_ALIGNMENT> page{};
+        auto const header = image_header(state.entry_count);
+        std::memcpy(page.data(), &header, sizeof(header));
+        write_at(page.data(), page.size(), 0);
+        std::vector<std::uint64_t> checksums(count);
+        std::ranges::transform(state.nodes, checksums.begin(), &image_node::checksum);
+        auto const sum = btree_image_header::image_checksum(page, checksums);
+        write_at(&sum, sizeof(sum), image_size - sizeof(sum));
+        check(::fdatasync(fd) == 0, "checkpoint: fdatasync");
+        state.dirty.assign(count, false);
+        return written;
+    }
+#endif
+
+    template<typename Key, typename Value, typename Index, size_t Internal_order, size_t Leaf_order, typename Split_policy,
+        typename Rebalance_policy, typename Storage_policy, typename Stats_policy>
+    auto btree<Key, Value, Index, Internal_order, Leaf_order, Split_policy, Rebalance_policy, Storage_policy, Stats_policy>::reorganize() -> void {
+        auto order = locality_order();
+        std::vector<index_type> new_index(nodes_.size(), INVALID_INDEX);
+        for (index_type i = 0; i < order.size(); ++i)
+            new_index[order[i]] = i;
+        auto relabel = [&new_index](index_type index) {
+            return index == INVALID_INDEX ? INVALID_INDEX : new_index[index];
+        };
+        nodes_type nodes;
+        nodes.reserve(order.size());
+        for (auto index : order) {
+            nodes.push_back(std::move(nodes_[index]));
+            std::visit([&relabel](auto & node) {
+                relabel_node(node, relabel);
+            }, nodes.back());
+        }
+        nodes_ = std::move(nodes);
+        root_index_ = relabel(root_index_);
+        free_indices_.clear();
+        mark_all_dirty();
+        // remembered nodes which were deleted meanwhile are dropped
+        for (auto & index : underflowing_)
+            index = relabel(index);
+        std::erase(underflowing_, INVALID_INDEX);
+    }
+
+    template<typename Key, typename Value, typename Index, size_t Internal_order, size_t Leaf_order, typename Split_policy,
+        typename Rebalance_policy, typename Storage_policy, typename Stats_policy>
+    auto btree<Key, Value, Index, Internal_order, Leaf_order, Split_policy, Rebalance_policy, Storage_policy, Stats_policy>::reorganize(std::size_t max_moves) -> bool {
+        auto order = locality_order();
+        // order holds the indices before this call, follow the nodes while they are swapped
+        std::vector<index_type> position_of(nodes_.size());
+        std::iota(position_of.begin(), position_of.end(), index_type(0));
+        std::vector<index_type> original_at = position_of;
+        std::size_t moves = 0;
+        for (index_type position = 0; position < order.size(); ++position) {
+            auto current = position_of[order[position]];
+            if (current == position)
+                continue;
+            if (moves == max_moves)
+                return false;
+            swap_nodes(position, current);
+            std::swap(original_at[position], original_at[current]);
+            position_of[original_at[position]] = position;
+            position_of[original_at[current]] = current;
+            ++moves;
+        }
+        // only deleted nodes are left behind the nodes in use
+        nodes_.erase(nodes_.begin() + static_cast<std::ptrdiff_t>(order.size()), nodes_.end());
+        free_indices_.clear();
+        return true;
+    }
+
+    template<typename Key, typename Value, typename Index, size_t Internal_order, size_t Leaf_order, typename Split_policy,
+        typename Rebalance_policy, typename Storage_policy, typename Stats_policy>
+    auto btree<Key, Value, Index, Internal_order, Leaf_order, Split_policy, Rebalance_policy, Storage_policy, Stats_policy>::bulk_load(
+        std::vector<std::pair<key_type, value_type>> entries) -> void {
+        std::ranges::stable_sort(entries, std::ranges::less{}, &std::pair<key_type, value_type>::first);
+        bulk_layout const layout(entries.size());
+        bulk_build(layout, [this, &layout, &entries](std::size_t first, std::size_t last, nodes_type &nodes) {
+            for (auto index = first; index < last; ++index)
+                nodes[index] = bulk_node(layout, entries, index);
+        });
+    }
+
+    template<typename Key, typename Value, typename Index, size_t Internal_order, size_t Leaf_order, typename Split_policy,
+        typename Rebalance_policy, typename Storage_policy, typename Stats_policy>
+    auto btree<Key, Value, Index, Internal_order, Leaf_order, Split_policy, Rebalance_policy, Storage_policy, Stats_policy>::bulk_load(
+        std::vector<std::pair<key_type, value_type>> entries, thread_pool &pool) -> void {
+        parallel_stable_sort(entries.begin(), entries.end(), pool, [](auto const &lhs, auto const &rhs) {
+            return std::ranges::less{}(lhs.first, rhs.first);
+        });
+        bulk_layout const layout(entries.size());
+        if constexpr (paged_storage_policy) {
+            bulk_build(layout, [this, &layout, &entries](std::size_t first, std::size_t last, nodes_type &nodes) {
+                for (auto index = first; index < last; ++index)
+                    nodes[index] = bulk_node(layout, entries, index);
+            });
+            return;
+        }
+        bulk_build(layout, [this, &layout, &entries, &pool](std::size_t first, std::size_t last, nodes_type &nodes) {
+            pool.parallel_for(last - first, [this, &layout, &entries, &nodes, first](std::size_t block_first, std::size_t block_last) {
+                for (auto index = first + block_first; index < first + block_last; ++index)
+                    nodes[index] = bulk_node(layout, entries, index);
+            });
+        });
+    }
+
+    template<typename Key, typename Value, typename Index, size_t Internal_order, size_t Leaf_order, typename Split_policy,
+        typename Rebalance_policy, typename Storage_policy, typename Stats_policy>
+    btree<Key, Value, Index, Internal_order, Leaf_order, Split_policy, Rebalance_policy, Storage_policy, Stats_policy>::bulk_layout::bulk_layout(
+        std::size_t count) : entry_count(count) {
+        level_sizes.push_back(std::max<std::size_t>(1, (count + Leaf_order - 1) / Leaf_order));
+        while (level_sizes.back() > 1)
+            level_sizes.push_back((level_sizes.back() + Internal_order) / (Internal_order + 1));
+        level_offsets.resize(level_sizes.size());
+        for (auto level = level_sizes.size() - 1; level > 0; --level)
+            level_offsets[level - 1] = level_offsets[level] + level_sizes[level];
+    }
+
+    template<typename Key, typename Value, typename Index, size_t Internal_order, size_t Leaf_order, typename Split_policy,
+        typename Rebalance_policy, typename Storage_policy, typename Stats_policy>
+    auto btree<Key, Value, Index, Internal_order, Leaf_order, Split_policy, Rebalance_policy, Storage_policy, Stats_policy>::bulk_node(
+        bulk_layout const &layout, std::vector<std::pair<key_type, value_type>> const &entries,
+        std::size_t index) const -> common_node_type {
+        std::size_t level = 0;
+        while (index < layout.level_offsets[level])
+            ++level;
+        auto const item = index - layout.level_offsets[level];
+        auto const root = level + 1 == layout.level_sizes.size();
+        auto const parent_index = root ? INVALID_INDEX : index_type(layout.parent(level, item));
+        if (level == 0) {
+            leaf_node_type leaf(index_type(index), parent_index,
+                                item > 0 ? index_type(index - 1) : INVALID_INDEX,
+                                item + 1 < layout.level_sizes[0] ? index_type(index + 1) : INVALID_INDEX);
+            for (auto entry = layout.first_below(0, item); entry < layout.first_below(0, item + 1); ++entry) {
+                leaf.keys().push_back(entries[entry].first);
+                leaf.values().push_back(entries[entry].second);
+            }
+            return leaf;
+        }
+        internal_node_type node(index_type(index), parent_index);
+        auto const first_child = layout.first_below(level, item);
+        auto const last_child = layout.first_below(level, item + 1);
+        for (auto child = first_child; child < last_child; ++child) {
+            if (child != first_child)
+                node.keys().push_back(entries[layout.first_entry(level - 1, child)].first);
+            node.child_indices().push_back(index_type(layout.level_offsets[level - 1] + child));
+        }
+        return node;
+    }
+
+    template<typename Key, typename Value, typename Index, size_t Internal_order, size_t Leaf_order, typename Split_policy,
+        typename Rebalance_policy, typename Storage_policy, typename Stats_policy>
+    template<typename Build_nodes>
+    auto btree<Key, Value, Index, Internal_order, Leaf_order, Split_policy, Rebalance_policy, Storage_policy, Stats_policy>::bulk_build(
+        bulk_layout const &layout, Build_nodes const &build_nodes) -> void {
+        if (layout.node_count() >= INVALID_INDEX)
+            throw std::length_error("bulk_load: too many nodes for index_type");
+        nodes_type nodes;
+        nodes.resize(layout.node_count());
+        build_nodes(std::size_t(0), layout.node_count(), nodes);
+        nodes_ = std::move(nodes);
+        root_index_ = 0;
+        free_indices_.clear();
+        underflowing_.clear();
+        mark_all_dirty();
+    }
+
+    template<typename Key, typename Value, typename Index, size_t Internal_order, size_t Leaf_order, typename Split_policy,
+        typename Rebalance_policy, typename Storage_policy, typename Stats_policy>
+    auto btree<Key, Value, Index, Internal_order, Leaf_order, Split_policy, Rebalance_policy, Storage_policy, Stats_policy>::locality_order() const -> std::vector<index_type> {
+        std::vector<index_type> order;
+        if (std::holds_alternative<internal_node_type>(node(root_index())))
+            order.push_back(root_index());
+        // breadth first: order itself is the queue of internal nodes
+        for (std::size_t i = 0; i < order.size(); ++i) {
+            for (auto child_index : internal_node(order[i]).child_indices())
+                if (std::holds_alternative<internal_node_type>(node(child_index)))
+                    order.push_back(child_index);
+        }
+        for (auto index = first_leaf_index(); index != INVALID_INDEX; index = leaf_node(index).next_leaf_index())
+            order.push_back(index);
+        return order;
+    }
+
+    template<typename Key, typename Value, typename Index, size_t Internal_order, size_t Leaf_order, typename Split_policy,
+        typename Rebalance_policy, typename Storage_policy, typename Stats_policy>
+    auto btree<Key, Value, Index, Internal_order, Leaf_order, Split_policy, Rebalance_policy, Storage_policy, Stats_policy>::swap_nodes(index_type a, index_type b) -> void {
+        assert((a != b) && "swap_nodes(index_type a, index_type b): cannot swap a node with itself");
+        {
+            node_pin const pin(*this, a);
+            std::swap(nodes_[a], nodes_[b]);
+        }
+        auto relabel = [a, b](index_type index) {
+            return index == a ? b : (index == b ? a : index);
+        };
+        // the only nodes which store a or b: the two swapped nodes, their parents, children and leaf neighbours
+        std::vector<index_type> affected{a, b};
+        for (auto index : {a, b}) {
+            std::visit([&affected, &relabel](auto const & node) {
+                if (node.has_parent())
+                    affected.push_back(relabel(node.parent_index()));
+                if constexpr (std::is_same_v<std::decay_t<decltype(node)>, leaf_node_type>) {
+                    if (node.has_previous_leaf_index())
+                        affected.push_back(relabel(node.previous_leaf_index()));
+                    if (node.has_next_leaf_index())
+                        affected.push_back(relabel(node.next_leaf_index()));
+                } else {
+                    for (auto child_index : node.child_indices())
+                        affected.push_back(relabel(child_index));
+                }
+            }, nodes_[index]);
+        }
+        std::ranges::sort(affected);
+        auto [first, last] = std::ranges::unique(affected);
+        affected.erase(first, last);
+        for (auto index : affected) {
+            std::visit([&relabel](auto & node) {
+                relabel_node(node, relabel);
+            }, nodes_[index]);
+            mark_dirty(index);
+        }
+        root_index_ = relabel(root_index_);
+        for (auto & index : free_indices_)
+            index = relabel(index);
+        for (auto & index : underflowing_)
+            index = relabel(index);
+    }
+
+    template<typename Key, typename Value, typename Index, size_t Internal_order, size_t Leaf_order, typename Split_policy,
+        typename Rebalance_policy, typename Storage_policy, typename Stats_policy>
+    template<typename Node_type, typename Relabel>
+    auto btree<Key, Value, Index, Internal_order, Leaf_order, Split_policy, Rebalance_policy, Storage_policy, Stats_policy>::relabel_node(Node_type &node,
+        Relabel const &relabel) -> void {
+        node.set_index(relabel(node.index()));
+        if (node.has_parent())
+            node.set_parent_index(relabel(node.parent_index()));
+        if constexpr (std::is_same_v<Node_type, leaf_node_type>) {
+            if (node.has_previous_leaf_index())
+                node.set_previous_leaf_index(relabel(node.previous_leaf_index()));
+            if (node.has_next_leaf_index())
+                node.set_next_leaf_index(relabel(node.next_leaf_index()));
+        } else {
+            for (auto & child_index : node.child_indices())
+                child_index = relabel(child_index);
+        }
+    }
+
+    template<typename Key, typename Value, typename Index, size_t Internal_order, size_t Leaf_order, typename Split_policy,
+        typename Rebalance_policy, typename Storage_policy, typename Stats_policy>
+    auto btree<Key, Value, Index, Internal_order, Leaf_order, Split_policy, Rebalance_policy, Storage_policy, Stats_policy>::adjust_parent_key(index_type child_node_index, key_type const *p_correlated_key) -> void {
         if (is_root(child_node_index))
             return;
+        if constexpr (paged_storage_policy) {
+            // a copy: the leaf holding the minimum key may be evicted while the parents are read
+            if (p_correlated_key == nullptr) {
+                key_type const correlated_key = minimum_key(child_node_index);
+                adjust_parent_key(child_node_index, &correlated_key);
+                return;
+            }
+        }
+        count(btree_event::parent_key_adjustment);
         if (p_correlated_key == nullptr)
             p_correlated_key = &minimum_key(child_node_index);
-        auto const & child_node = node(child_node_index);
-        std::visit([this, p_correlated_key](auto & node) {
+        auto const parent_index = std::visit([](auto const & node) {
             assert((node.keys().size() > 0) && "adjust_parent_key(index_type): Child node has no keys!");
-            internal_node_type& parent = internal_node(node.parent_index());
-            auto [key_it, child_index_it] = parent.iterators_for_index(node.index());
-            if (key_it != parent.keys().end())
-                *key_it = *p_correlated_key;
-            else
-                adjust_parent_key(parent.index(), p_correlated_key);
-        }, child_node);
+            return node.parent_index();
+        }, node(child_node_index));
+        internal_node_type& parent = internal_node(parent_index);
+        auto [key_it, child_index_it] = parent.iterators_for_index(child_node_index);
+        if (key_it != parent.keys().end())
+            *key_it = *p_correlated_key;
+        else
+            adjust_parent_key(parent_index, p_correlated_key);
     }
 } // namespace btree
 
@@ -0,0 +1,300 @@
+//
+// Created by arnoldm on 19.10.26.
+//
+
+#ifndef BUFFERED_BTREE_H
+#define BUFFERED_BTREE_H
+
+#include <algorithm>
+#include <cstddef>
+#include <cstdint>
+#include <iterator>
+#include <optional>
+#include <tuple>
+#include <utility>
+#include <variant>
+#include <vector>
+#include "btree.h"
+
+namespace bt {
+    /**
+     * A btree for write heavy workloads in the style of a Bε-tree: inserts and erases become messages which are
+     * appended to a buffer of the root and move down the internal nodes in batches. A full buffer (Buffer_size
+     * messages) is flushed by handing all its messages to the buffers of the children; the buffers of the parents of
+     * leaves are applied to the leaves, in key order. A leaf is then touched once for all the messages which
+     * accumulated for it instead of once per message, which amortises its cache misses.
+     *
+     * Lookups consult the buffers on the path from the root first, the newest message for the key wins. They scan
+     * every buffer on the path, so reads are slower than on a btree.
+     *
+     * A buffer has to follow the keys of its node when the tree changes shape. Leaves only split while their
+     * ancestors are flushed, and flushing empties the buffer, so splits need no extra work. An erase which makes a
+     * leaf underflow can redistribute keys to or merge nodes of other parents: all buffered messages are then moved
+     * to the parents of the leaves again. Splits of two full leaves into three (bstar_split) would add children to
+     * nodes with a full buffer, so Split_policy must not split two to three.
+     *
+     * Keys are unique: an insert of a key which is in the tree replaces its value when it reaches the leaf, so a
+     * lookup returns the same value before and after a flush.
+     */
+    template<typename Key, typename Value, typename Index, size_t Internal_order, size_t Leaf_order,
+        std::size_t Buffer_size = 4 * Internal_order, typename Split_policy = midpoint_split,
+        typename Rebalance_policy = rebalance_policy<>, typename Storage_policy = vector_storage>
+    class buffered_btree : protected btree<Key, Value, Index, Internal_order, Leaf_order, Split_policy, Rebalance_policy, Storage_policy> {
+        static_assert(!Split_policy::split_two_to_three, "buffered_btree cannot split two leaves into three");
+        static_assert(Buffer_size > 0, "Buffer_size must be positive");
+    public:
+        using base_type = btree<Key, Value, Index, Internal_order, Leaf_order, Split_policy, Rebalance_policy, Storage_policy>;
+        using typename base_type::traits;
+        using typename base_type::key_type;
+        using typename base_type::value_type;
+        using typename base_type::index_type;
+        using typename base_type::internal_node_type;
+        using typename base_type::leaf_node_type;
+
+        /**
+         * @brief Insert key with value, or replace the value of key, once the message reaches the leaves
+         */
+        auto insert(key_type const &key, value_type const &value) -> void { add({key, value, operation::insert, next_sequence_++}); }
+
+        /**
+         * @brief Erase key, once the message reaches the leaves
+         */
+        auto erase(key_type const &key) -> void { add({key, value_type{}, operation::erase, next_sequence_++}); }
+
+        /**
+         * @return a copy of the value of the newest buffered insert of key or of the entry with key
+         */
+        auto find(key_type const &key) const -> std::optional<value_type>;
+
+        auto contains(key_type const &key) const -> bool { return find(key).has_value(); }
+
+        /**
+         * @brief Apply all buffered messages to the leaves
+         */
+        auto flush() -> void;
+
+        /**
+         * @return the number of messages not applied to the leaves yet
+         */
+        [[nodiscard]] auto buffered_size() const -> std::size_t { return buffered_size_; }
+
+        /**
+         * @brief The tree without the buffered messages, e.g. for iterating after flush()
+         */
+        auto unbuffered() const -> base_type const & { return *this; }
+
+    protected:
+        enum class operation : unsigned char { insert, erase };
+
+        struct message {
+            key_type key;
+            value_type value;
+            operation op;
+            std::uint64_t sequence;
+        };
+
+        using buffer_type = std::vector<message>;
+
+        auto add(message &&m) -> void;
+
+        /**
+         * @brief Position of the child of node to look for key in, like btree::find_first
+         */
+        static auto child_position(internal_node_type const &node, key_type const &key) -> std::size_t {
+            auto it = std::ranges::lower_bound(node.keys(), key);
+            auto position = static_cast<std::size_t>(std::distance(node.keys().begin(), it));
+            return it != node.keys().end() && *it == key ? position + 1 : position;
+        }
+
+        auto is_internal(index_type index) const -> bool {
+            return std::holds_alternative<internal_node_type>(this->node(index));
+        }
+
+        /**
+         * @brief Flush full buffers, starting with node_index, depth first
+         */
+        auto flush_full(index_type node_index) -> void;
+
+        /**
+         * @brief Hand the messages of the buffer of node_index to its children
+         * @return true if applying messages to leaves made one of them underflow
+         */
+        auto flush_node(index_type node_index) -> bool;
+
+        /**
+         * @brief Apply messages to the leaves in key order, messages with equal keys in their order
+         * @return true if a leaf underflowed
+         */
+        auto apply(buffer_type &messages) -> bool;
+
+        /**
+         * @brief Remove all messages from the buffers, oldest first
+         */
+        auto take_all() -> buffer_type;
+
+        /**
+         * @brief Move all messages to the buffers of the parents of the leaves, after the tree changed shape
+         */
+        auto rehome() -> void;
+
+        std::vector<buffer_type> buffers_;
+        std::size_t buffered_size_ = 0;
+        std::uint64_t next_sequence_ = 0;
+        // nodes whose buffer may be full, flushed last in first
+        std::vector<index_type> pending_;
+        // the messages of the buffer being flushed, their capacity is handed back to the buffer
+        buffer_type flushing_;
+        buffer_type leaf_messages_;
+    };
+
+    template<typename Key, typename Value, typename Index, size_t Internal_order, size_t Leaf_order, std::size_t Buffer_size,
+        typename Split_policy, typename Rebalance_policy, typename Storage_policy>
+    auto buffered_btree<Key, Value, Index, Internal_order, Leaf_order, Buffer_size, Split_policy, Rebalance_policy,
+        Storage_policy>::add(message &&m) -> void {
+        auto root = this->root_index();
+        if (!is_internal(root)) {
+            buffer_type messages{std::move(m)};
+            apply(messages);
+            return;
+        }
+        buffers_.resize(this->node_count());
+        buffers_[root].push_back(std::move(m));
+        ++buffered_size_;
+        if (buffers_[root].size() >= Buffer_size)
+            flush_full(root);
+    }
+
+    template<typename Key, typename Value, typename Index, size_t Internal_order, size_t Leaf_order, std::size_t Buffer_size,
+        typename Split_policy, typename Rebalance_policy, typename Storage_policy>
+    auto buffered_btree<Key, Value, Index, Internal_order, Leaf_order, Buffer_size, Split_policy, Rebalance_policy,
+        Storage_policy>::find(key_type const &key) const -> std::optional<value_type> {
+        auto index = this->root_index();
+        for (auto const *p_node = std::get_if<internal_node_type>(&this->node(index));
+             p_node != nullptr;
+             p_node = std::get_if<internal_node_type>(&this->node(index))) {
+            if (index < buffers_.size()) {
+                auto const &buffer = buffers_[index];
+                auto newest = std::ranges::find_if(buffer.rbegin(), buffer.rend(), [&key](message const &m) { return m.key == key; });
+                if (newest != buffer.rend())
+                    return newest->op == operation::insert ? std::optional<value_type>(newest->value) : std::nullopt;
+            }
+            index = p_node->child_indices()[child_position(*p_node, key)];
+        }
+        auto it = base_type::find(key);
+        if (it == base_type::end())
+            return std::nullopt;
+        return (*it).second;
+    }
+
+    template<typename Key, typename Value, typename Index, size_t Internal_order, size_t Leaf_order, std::size_t Buffer_size,
+        typename Split_policy, typename Rebalance_policy, typename Storage_policy>
+    auto buffered_btree<Key, Value, Index, Internal_order, Leaf_order, Buffer_size, Split_policy, Rebalance_policy,
+        Storage_policy>::flush() -> void {
+        auto messages = take_all();
+        apply(messages);
+    }
+
+    template<typename Key, typename Value, typename Index, size_t Internal_order, size_t Leaf_order, std::size_t Buffer_size,
+        typename Split_policy, typename Rebalance_policy, typename Storage_policy>
+    auto buffered_btree<Key, Value, Index, Internal_order, Leaf_order, Buffer_size, Split_policy, Rebalance_policy,
+        Storage_policy>::flush_full(index_type node_index) -> void {
+        // depth first: the ancestors of a node are flushed, i.e. empty, when it is flushed, so that splits moving
+        // children to new nodes move no messages
+        pending_.push_back(node_index);
+        while (!pending_.empty()) {
+            auto index = pending_.back();
+            pending_.pop_back();
+            if (index >= buffers_.size() || buffers_[index].size() < Buffer_size || !is_internal(index))
+                continue;
+            if (flush_node(index))
+                rehome();
+        }
+    }
+
+    template<typename Key, typename Value, typename Index, size_t Internal_order, size_t Leaf_order, std::size_t Buffer_size,
+        typename Split_policy, typename Rebalance_policy, typename Storage_policy>
+    auto buffered_btree<Key, Value, Index, Internal_order, Leaf_order, Buffer_size, Split_policy, Rebalance_policy,
+        Storage_policy>::flush_node(index_type node_index) -> bool {
+        flushing_.swap(buffers_[node_index]);
+        leaf_messages_.clear();
+        auto const &node = this->internal_node(node_index);
+        for (auto &m : flushing_) {
+            auto child = node.child_indices()[child_position(node, m.key)];
+            if (!is_internal(child)) {
+                leaf_messages_.push_back(std::move(m));
+                continue;
+            }
+            buffers_[child].push_back(std::move(m));
+            if (buffers_[child].size() == Buffer_size)
+                pending_.push_back(child);
+        }
+        flushing_.clear();
+        return apply(leaf_messages_);
+    }
+
+    template<typename Key, typename Value, typename Index, size_t Internal_order, size_t Leaf_order, std::size_t Buffer_size,
+        typename Split_policy, typename Rebalance_policy, typename Storage_policy>
+    auto buffered_btree<Key, Value, Index, Internal_order, Leaf_order, Buffer_size, Split_policy, Rebalance_policy,
+        Storage_policy>::apply(buffer_type &messages) -> bool {
+        std::ranges::stable_sort(messages, {}, &message::key);
+        bool underflow = false;
+        for (auto &m : messages) {
+            if (m.op == operation::insert) {
+                if (auto it = base_type::find(m.key); it != base_type::end())
+                    (*it).second = m.value;
+                else
+                    base_type::insert(m.key, m.value);
+            } else {
+                for (auto [leaf_index, position] = this->find_first(m.key); leaf_index != base_type::INVALID_INDEX;
+                     std::tie(leaf_index, position) = this->find_first(m.key)) {
+                    underflow |= !this->is_root(leaf_index) && this->leaf_node(leaf_index).size() <= traits::min_leaf_order;
+                    base_type::erase(base_type::find(m.key));
+                }
+            }
+        }
+        buffered_size_ -= std::min(buffered_size_, messages.size());
+        messages.clear();
+        buffers_.resize(this->node_count());
+        return underflow;
+    }
+
+    template<typename Key, typename Value, typename Index, size_t Internal_order, size_t Leaf_order, std::size_t Buffer_size,
+        typename Split_policy, typename Rebalance_policy, typename Storage_policy>
+    auto buffered_btree<Key, Value, Index, Internal_order, Leaf_order, Buffer_size, Split_policy, Rebalance_policy,
+        Storage_policy>::take_all() -> buffer_type {
+        buffer_type messages;
+        // deleted nodes may still hold messages: an underflow merged them into a neighbour
+        for (auto &buffer : buffers_) {
+            std::ranges::move(buffer, std::back_inserter(messages));
+            buffer.clear();
+        }
+        std::ranges::sort(messages, {}, &message::sequence);
+        return messages;
+    }
+
+    template<typename Key, typename Value, typename Index, size_t Internal_order, size_t Leaf_order, std::size_t Buffer_size,
+        typename Split_policy, typename Rebalance_policy, typename Storage_policy>
+    auto buffered_btree<Key, Value, Index, Internal_order, Leaf_order, Buffer_size, Split_policy, Rebalance_policy,
+        Storage_policy>::rehome() -> void {
+        auto messages = take_all();
+        if (!is_internal(this->root_index())) {
+            apply(messages);
+            return;
+        }
+        for (auto &m : messages) {
+            auto index = this->root_index();
+            for (;;) {
+                auto const &node = this->internal_node(index);
+                auto child = node.child_indices()[child_position(node, m.key)];
+                if (!is_internal(child))
+                    break;
+                index = child;
+            }
+            buffers_[index].push_back(std::move(m));
+            if (buffers_[index].size() == Buffer_size)
+                pending_.push_back(index);
+        }
+    }
+}
+
+#endif //BUFFERED_BTREE_H
@@ -0,0 +1,455 @@
+//
+// Created by arnoldm on 19.10.26.
+//
+
+#ifndef CONCURRENT_BTREE_H
+#define CONCURRENT_BTREE_H
+
+#include <chrono>
+#include <condition_variable>
+#include <deque>
+#include <mutex>
+#include <optional>
+#include <shared_mutex>
+#include <stop_token>
+#include <thread>
+#include <tuple>
+#include <variant>
+#include <vector>
+#include "btree.h"
+
+namespace bt {
+    /**
+     * Whether nodes in Storage_policy can be read by concurrent readers: plain containers only. cow_storage copies
+     * shared chunks and paged_storage fetches, evicts and pins frames even on reads, which would race under the
+     * shared tree latch.
+     */
+    template<typename Storage_policy>
+    inline constexpr bool concurrent_storage = std::is_same_v<Storage_policy, vector_storage> ||
+                                               std::is_same_v<Storage_policy, stable_storage>;
+
+    template<std::size_t Alignment, bool Huge_pages>
+    inline constexpr bool concurrent_storage<aligned_node_storage<Alignment, Huge_pages>> = true;
+
+    /**
+     * A btree for concurrent readers and writers.
+     *
+     * Latch crabbing with a reader/writer latch per node: a descent latches a child before it releases the
+     * parent. Readers keep the latch of the parent of the leaf while they read the leaf, so that a writer which
+     * latches an internal node exclusively owns all leaves below it without latching them. Leaf latches only
+     * order readers and the writers which change a single leaf in place.
+     *
+     * Writers first descend like readers and latch the leaf exclusively. If the leaf is safe, i.e. an insert does
+     * not split it and an erase neither lets it underflow nor changes its first key, they change it in place.
+     * Otherwise they descend again and latch the internal nodes on the way exclusively, releasing the ancestors
+     * whenever a node is safe: it neither splits nor underflows when a child is added or removed, its subtree
+     * holds the neighbours of the leaf which a split, shift, merge or redistribution may touch, and, for an
+     * erase, the leaf is not its first descendant, so that adjusting parent keys ends there. The split or merge
+     * reaches the neighbours of the leaf through the leaf links and the first keys of subtrees through their first
+     * children, so the writer latches the whole subtree of the lowest node for which all but the last condition
+     * hold, top down, and then splits or merges holding just these latches. That subtree is usually the parent of
+     * the leaf and its children. Writers in disjoint subtrees do not wait for each other.
+     *
+     * The tree latch is held shared by every operation, which keeps the root index stable, and exclusively only
+     * by a split or merge which changes the root, by maintain() and for growing the node storage, which may move
+     * all nodes. Splits never grow the storage: they take the nodes they create from free nodes reserved before
+     * latching (see set_bookkeeping_latch()).
+     *
+     * With a deferred rebalance policy an erase which lets the leaf underflow is safe as well, as long as the leaf
+     * keeps an entry: the leaf is only remembered, and maintain() or a background maintenance thread (see
+     * start_maintenance()) rebalance it under the exclusive tree latch within a time budget.
+     *
+     * No iterators: use unsynchronized() for phases without concurrent writers.
+     *
+     * Storage_policy must be one of vector_storage, stable_storage or aligned_node_storage (see concurrent_storage).
+     */
+    template<typename Key, typename Value, typename Index, size_t Internal_order, size_t Leaf_order,
+        typename Split_policy = midpoint_split, typename Rebalance_policy = rebalance_policy<>,
+        typename Storage_policy = vector_storage>
+    class concurrent_btree : protected btree<Key, Value, Index, Internal_order, Leaf_order, Split_policy, Rebalance_policy, Storage_policy> {
+        static_assert(concurrent_storage<Storage_policy>,
+                      "concurrent_btree needs storage which concurrent readers do not change");
+    public:
+        using base_type = btree<Key, Value, Index, Internal_order, Leaf_order, Split_policy, Rebalance_policy, Storage_policy>;
+        using typename base_type::traits;
+        using typename base_type::key_type;
+        using typename base_type::value_type;
+        using typename base_type::index_type;
+        using typename base_type::internal_node_type;
+        using typename base_type::leaf_node_type;
+        using typename base_type::iterator;
+        using base_type::INVALID_INDEX;
+
+        concurrent_btree() {
+            this->set_bookkeeping_latch(&bookkeeping_latch_);
+            grow_latches();
+        }
+
+        concurrent_btree(const concurrent_btree &) = delete;
+
+        concurrent_btree & operator=(const concurrent_btree &) = delete;
+
+        auto insert(key_type const &key, value_type const &value) -> bool;
+
+        /**
+         * @brief Erase the first entry with key
+         * @return the number of erased entries (0 or 1)
+         */
+        auto erase(key_type const &key) -> std::size_t;
+
+        /**
+         * @return a copy of the value of the first entry with key
+         */
+        auto find(key_type const &key) const -> std::optional<value_type>;
+
+        auto contains(key_type const &key) const -> bool { return find(key).has_value(); }
+
+        /**
+         * @brief The tree without any synchronisation, e.g. for iterating after all writers finished
+         */
+        auto unsynchronized() -> base_type & { return *this; }
+        auto unsynchronized() const -> base_type const & { return *this; }
+
+        /**
+         * @brief btree::maintain() under the exclusive tree latch
+         */
+        auto maintain(std::chrono::nanoseconds budget) -> bool {
+            std::unique_lock tree_lock(tree_latch_);
+            return base_type::maintain(budget);
+        }
+
+        /**
+         * @brief Call maintain(budget) every interval on a background thread, until the tree is destroyed or
+         * stop_maintenance() is called. Replaces a running maintenance thread.
+         */
+        auto start_maintenance(std::chrono::nanoseconds interval, std::chrono::nanoseconds budget) -> void {
+            maintenance_ = std::jthread([this, interval, budget](std::stop_token stop) {
+                std::mutex mutex;
+                std::condition_variable_any wake_up;
+                while (true) {
+                    {
+                        std::unique_lock lock(mutex);
+                        if (wake_up.wait_for(lock, stop, interval, [&stop] { return stop.stop_requested(); }))
+                            return;
+                    }
+                    maintain(budget);
+                }
+            });
+        }
+
+        auto stop_maintenance() -> void { maintenance_ = std::jthread(); }
+
+    protected:
+        using latch_type = std::shared_mutex;
+
+        /**
+         * @brief A latch on its own cache line, so that latches of neighbouring nodes do not share one
+         */
+        struct alignas(CACHE_LINE_SIZE) node_latch {
+            mutable latch_type latch;
+        };
+
+        /**
+         * @brief The internal nodes a split or merge of a leaf may change, latched exclusively
+         */
+        struct region {
+            // from the topmost latched node down to the parent of the leaf
+            std::vector<index_type> path;
+            // position in path of the node whose whole subtree the split or merge may change
+            std::size_t subtree_root = 0;
+            std::vector<std::unique_lock<latch_type>> locks;
+            index_type leaf_index = INVALID_INDEX;
+        };
+
+        auto latch(index_type index) const -> latch_type & {
+            return latches_[index].latch;
+        }
+
+        /**
+         * @brief Provide a latch for every node; only with the tree latch held exclusively (or no concurrency)
+         */
+        auto grow_latches() -> void {
+            while (latches_.size() < this->node_count())
+                latches_.emplace_back();
+        }
+
+        /**
+         * @brief Descend from the root to a leaf, latching each node shared before releasing its parent
+         * @param select_position returns the position of the child of an internal node to descend into
+         * @return the leaf, the latch of its parent (none if the leaf is the root) and the latch of the leaf, taken
+         * with Leaf_lock
+         */
+        template<typename Leaf_lock, typename Select_position>
+        auto descend(Select_position const &select_position) const
+            -> std::tuple<index_type, std::shared_lock<latch_type>, Leaf_lock>;
+
+        /**
+         * @brief Descend from the root latching the internal nodes exclusively, releasing the ancestors of safe nodes
+         * (see the class description)
+         * @return the latched nodes, without the subtree (see latch_subtree()), or none if the split or merge may
+         * reach the root
+         */
+        template<typename Select_position>
+        auto latch_region(Select_position const &select_position, bool inserting) -> std::optional<region>;
+
+        /**
+         * @brief Latch the internal nodes below the subtree root of the region exclusively, level by level
+         */
+        auto latch_subtree(region &latched) -> void;
+
+        /**
+         * @brief Reserve count free nodes for the splits of one insert
+         * @return false if there are not enough free nodes, see grow_storage()
+         */
+        auto reserve_nodes(std::size_t count) -> bool {
+            std::lock_guard bookkeeping_lock(bookkeeping_latch_);
+            if (this->free_node_indices().size() < reserved_nodes_ + count)
+                return false;
+            reserved_nodes_ += count;
+            return true;
+        }
+
+        auto release_nodes(std::size_t count) -> void {
+            std::lock_guard bookkeeping_lock(bookkeeping_latch_);
+            reserved_nodes_ -= count;
+        }
+
+        /**
+         * @brief Provide at least count free nodes, and some more, under the exclusive tree latch
+         */
+        auto grow_storage(std::size_t count) -> void;
+
+        /**
+         * @brief Position of the child to descend into to find the first entry with key, like btree::find_first
+         */
+        static auto find_position(internal_node_type const &node, key_type const &key) -> std::size_t;
+
+        /**
+         * @brief Position of the child to descend into to insert key, like btree::find_insert_position
+         */
+        static auto insert_position(internal_node_type const &node, key_type const &key) -> std::size_t;
+
+    private:
+        mutable latch_type tree_latch_;
+        std::deque<node_latch> latches_;
+        // guards the free node indices and the deferred nodes of the tree, and reserved_nodes_
+        std::mutex bookkeeping_latch_;
+        // free nodes reserved by inserts which split
+        std::size_t reserved_nodes_ = 0;
+        // last, so that it stops before the tree goes away
+        std::jthread maintenance_;
+    };
+
+    template<typename Key, typename Value, typename Index, size_t Internal_order, size_t Leaf_order, typename Split_policy,
+        typename Rebalance_policy, typename Storage_policy>
+    auto concurrent_btree<Key, Value, Index, Internal_order, Leaf_order, Split_policy, Rebalance_policy, Storage_policy>::insert(key_type const &key,
+        value_type const &value) -> bool {
+        auto const select_position = [&key](internal_node_type const &node) { return insert_position(node, key); };
+        auto const leaf_position = [&key](leaf_node_type const &leaf) {
+            return index_type(std::distance(leaf.keys().begin(), std::ranges::upper_bound(leaf.keys(), key)));
+        };
+        while (true) {
+            std::shared_lock tree_lock(tree_latch_);
+            {
+                auto [leaf_index, parent_lock, leaf_lock] = descend<std::unique_lock<latch_type>>(select_position);
+                leaf_node_type &leaf = this->leaf_node(leaf_index);
+                if (leaf.size() < leaf_node_type::order())
+                    return this->insert_leaf(iterator(*this, leaf_index, leaf_position(leaf)), key, value, false);
+            }
+            // the leaf is full: latch the nodes its split may change
+            auto latched = latch_region(select_position, true);
+            if (!latched)
+                break;
+            leaf_node_type &leaf = this->leaf_node(latched->leaf_index);
+            iterator const insert_pos(*this, latched->leaf_index, leaf_position(leaf));
+            if (leaf.size() < leaf_node_type::order())
+                return this->insert_leaf(insert_pos, key, value, false);
+            // one new node per latched level and one for the leaf
+            auto const count = latched->path.size() + 1;
+            if (!reserve_nodes(count)) {
+                latched.reset();
+                tree_lock.unlock();
+                grow_storage(count);
+                continue;
+            }
+            latch_subtree(*latched);
+            this->insert_leaf(insert_pos, key, value, true);
+            release_nodes(count);
+            return true;
+        }
+        // the split reaches the root
+        std::unique_lock tree_lock(tree_latch_);
+        auto result = base_type::insert(key, value);
+        grow_latches();
+        return result;
+    }
+
+    template<typename Key, typename Value, typename Index, size_t Internal_order, size_t Leaf_order, typename Split_policy,
+        typename Rebalance_policy, typename Storage_policy>
+    auto concurrent_btree<Key, Value, Index, Internal_order, Leaf_order, Split_policy, Rebalance_policy, Storage_policy>::erase(key_type const &key) -> std::size_t {
+        auto const select_position = [&key](internal_node_type const &node) { return find_position(node, key); };
+        {
+            std::shared_lock tree_lock(tree_latch_);
+            {
+                auto [leaf_index, parent_lock, leaf_lock] = descend<std::unique_lock<latch_type>>(select_position);
+                leaf_node_type &leaf = this->leaf_node(leaf_index);
+                auto it = std::ranges::lower_bound(leaf.keys(), key);
+                if (it == leaf.keys().end() || key != *it)
+                    return 0;
+                auto position = index_type(std::distance(leaf.keys().begin(), it));
+                bool safe = this->is_root(leaf_index)
+                            || (position != 0 && leaf.size() > traits::min_leaf_order)
+                            || (position != 0 && traits::deferred_rebalance && leaf.size() > 1);
+                if (safe)
+                    return base_type::erase(iterator(*this, leaf_index, position));
+            }
+            // the leaf underflows or its first key changes: latch the nodes a merge or redistribution may change
+            if (auto latched = latch_region(select_position, false)) {
+                leaf_node_type &leaf = this->leaf_node(latched->leaf_index);
+                auto it = std::ranges::lower_bound(leaf.keys(), key);
+                if (it == leaf.keys().end() || key != *it)
+                    return 0;
+                latch_subtree(*latched);
+                return base_type::erase(iterator(*this, latched->leaf_index, index_type(std::distance(leaf.keys().begin(), it))));
+            }
+        }
+        // rebalancing reaches the root
+        std::unique_lock tree_lock(tree_latch_);
+        auto it = base_type::find(key);
+        if (it == base_type::end())
+            return 0;
+        base_type::erase(it);
+        return 1;
+    }
+
+    template<typename Key, typename Value, typename Index, size_t Internal_order, size_t Leaf_order, typename Split_policy,
+        typename Rebalance_policy, typename Storage_policy>
+    auto concurrent_btree<Key, Value, Index, Internal_order, Leaf_order, Split_policy, Rebalance_policy, Storage_policy>::find(key_type const &key) const -> std::optional<value_type> {
+        std::shared_lock tree_lock(tree_latch_);
+        auto [leaf_index, parent_lock, leaf_lock] = descend<std::shared_lock<latch_type>>([&key](internal_node_type const &node) {
+            return find_position(node, key);
+        });
+        leaf_node_type const &leaf = this->leaf_node(leaf_index);
+        auto it = std::ranges::lower_bound(leaf.keys(), key);
+        if (it == leaf.keys().end() || key != *it)
+            return std::nullopt;
+        return leaf.values()[index_type(std::distance(leaf.keys().begin(), it))];
+    }
+
+    template<typename Key, typename Value, typename Index, size_t Internal_order, size_t Leaf_order, typename Split_policy,
+        typename Rebalance_policy, typename Storage_policy>
+    template<typename Leaf_lock, typename Select_position>
+    auto concurrent_btree<Key, Value, Index, Internal_order, Leaf_order, Split_policy, Rebalance_policy, Storage_policy>::descend(Select_position const &select_position) const
+        -> std::tuple<index_type, std::shared_lock<latch_type>, Leaf_lock> {
+        index_type index = this->root_index();
+        std::shared_lock<latch_type> parent_lock;
+        for (auto const *p_node = std::get_if<internal_node_type>(&this->node(index));
+             p_node != nullptr;
+             p_node = std::get_if<internal_node_type>(&this->node(index))) {
+            // the node is latched before the latch of its parent is released
+            parent_lock = std::shared_lock(latch(index));
+            index = p_node->child_indices()[select_position(*p_node)];
+        }
+        return {index, std::move(parent_lock), Leaf_lock(latch(index))};
+    }
+
+    template<typename Key, typename Value, typename Index, size_t Internal_order, size_t Leaf_order, typename Split_policy,
+        typename Rebalance_policy, typename Storage_policy>
+    template<typename Select_position>
+    auto concurrent_btree<Key, Value, Index, Internal_order, Leaf_order, Split_policy, Rebalance_policy, Storage_policy>::latch_region(
+        Select_position const &select_position, bool inserting) -> std::optional<region> {
+        // the neighbours of the leaf a split or merge may touch: shifts and splits of two leaves into three use
+        // the previous one as well, merges the one after the next
+        constexpr bool inserts_into_previous = traits::split_policy::shift_to_siblings || traits::split_policy::split_two_to_three;
+        region latched;
+        std::optional<std::size_t> subtree_root;
+        // whether the latched node is the first or last one of its level: no leaf lies before or after its subtree
+        bool leftmost = true;
+        bool rightmost = true;
+        for (index_type index = this->root_index(); std::holds_alternative<internal_node_type>(this->node(index)); ) {
+            latched.locks.emplace_back(latch(index));
+            latched.path.push_back(index);
+            internal_node_type const &node = this->internal_node(index);
+            auto const size = std::size_t(node.size());
+            auto const position = select_position(node);
+            auto const child_index = node.child_indices()[position];
+            bool const parent_of_leaf = !std::holds_alternative<internal_node_type>(this->node(child_index));
+            bool const keeps_shape = inserting ? size < internal_node_type::order()
+                                     : this->is_root(index) ? size > 1
+                                     : size > traits::min_internal_order || (traits::deferred_rebalance && size > 1);
+            bool const holds_next = rightmost || position + (parent_of_leaf && !inserting ? 2 : 1) <= size;
+            bool const holds_previous = leftmost || position > 0 || (inserting && !inserts_into_previous);
+            if (keeps_shape && holds_next && holds_previous) {
+                // an erase of the first entry of the leaf adjusts the keys of the ancestors it is the first descendant of
+                if (inserting || position > 0 || this->is_root(index)) {
+                    latched.locks.erase(latched.locks.begin(), latched.locks.end() - 1);
+                    latched.path.erase(latched.path.begin(), latched.path.end() - 1);
+                }
+                subtree_root = latched.path.size() - 1;
+            }
+            leftmost = leftmost && position == 0;
+            rightmost = rightmost && position == size;
+            if (parent_of_leaf) {
+                latched.leaf_index = child_index;
+                break;
+            }
+            index = child_index;
+        }
+        if (!subtree_root)
+            return std::nullopt;
+        latched.subtree_root = *subtree_root;
+        return latched;
+    }
+
+    template<typename Key, typename Value, typename Index, size_t Internal_order, size_t Leaf_order, typename Split_policy,
+        typename Rebalance_policy, typename Storage_policy>
+    auto concurrent_btree<Key, Value, Index, Internal_order, Leaf_order, Split_policy, Rebalance_policy, Storage_policy>::latch_subtree(region &latched) -> void {
+        // the leaves are owned through their parents; the nodes of the path are latched already
+        std::vector<index_type> level{latched.path[latched.subtree_root]};
+        for (auto depth = latched.subtree_root; depth + 1 < latched.path.size(); ++depth) {
+            std::vector<index_type> children;
+            for (auto index : level) {
+                for (auto child_index : this->internal_node(index).child_indices()) {
+                    children.push_back(child_index);
+                    if (child_index != latched.path[depth + 1])
+                        latched.locks.emplace_back(latch(child_index));
+                }
+            }
+            level = std::move(children);
+        }
+    }
+
+    template<typename Key, typename Value, typename Index, size_t Internal_order, size_t Leaf_order, typename Split_policy,
+        typename Rebalance_policy, typename Storage_policy>
+    auto concurrent_btree<Key, Value, Index, Internal_order, Leaf_order, Split_policy, Rebalance_policy, Storage_policy>::grow_storage(std::size_t count) -> void {
+        std::unique_lock tree_lock(tree_latch_);
+        auto &free_indices = this->free_node_indices();
+        if (free_indices.size() >= count)
+            return;
+        // create_leaf_node() takes the free nodes first; deleting in reverse hands out the lowest indices first again
+        std::vector<index_type> created;
+        while (created.size() < count + this->node_count() / 8)
+            created.push_back(this->create_leaf_node());
+        for (auto it = created.rbegin(); it != created.rend(); ++it)
+            this->delete_node(*it);
+        grow_latches();
+    }
+
+    template<typename Key, typename Value, typename Index, size_t Internal_order, size_t Leaf_order, typename Split_policy,
+        typename Rebalance_policy, typename Storage_policy>
+    auto concurrent_btree<Key, Value, Index, Internal_order, Leaf_order, Split_policy, Rebalance_policy, Storage_policy>::find_position(internal_node_type const &node,
+        key_type const &key) -> std::size_t {
+        auto it = std::ranges::lower_bound(node.keys(), key);
+        auto position = std::size_t(std::distance(node.keys().begin(), it));
+        return it != node.keys().end() && *it == key ? position + 1 : position;
+    }
+
+    template<typename Key, typename Value, typename Index, size_t Internal_order, size_t Leaf_order, typename Split_policy,
+        typename Rebalance_policy, typename Storage_policy>
+    auto concurrent_btree<Key, Value, Index, Internal_order, Leaf_order, Split_policy, Rebalance_policy, Storage_policy>::insert_position(internal_node_type const &node,
+        key_type const &key) -> std::size_t {
+        return std::size_t(std::distance(node.keys().begin(), std::ranges::upper_bound(node.keys(), key)));
+    }
+}
+
+#endif //CONCURRENT_BTREE_H
@@ -0,0 +1,277 @@
+//
+// Created by arnoldm on 19.10.26.
+//
+
+#ifndef COW_VECTOR_H
+#define COW_VECTOR_H
+
+#include <array>
+#include <atomic>
+#include <bit>
+#include <cassert>
+#include <compare>
+#include <cstddef>
+#include <initializer_list>
+#include <iterator>
+#include <memory>
+#include <stdexcept>
+#include <type_traits>
+#include <utility>
+#include "dyn_array.h"
+
+namespace bt {
+    /**
+    * Like a std::vector, but copies are O(1) and share all elements: the elements live in chunks of Chunk_size
+    * elements, which are the leaves of a trie with Fanout children per branch. Chunks and branches are reference
+    * counted. Non-const access to an element copies its chunk and the branches above it, if they are shared with a
+    * copy (path copying), so a copy never sees changes of the original and vice versa.
+    *
+    * A reference returned by non-const access stays valid until the vector is copied. Copies can be read and
+    * destroyed by other threads while the original is changed.
+    */
+    template<typename Value, std::size_t Chunk_size = 4, std::size_t Fanout = 32>
+    requires (std::has_single_bit(Chunk_size) && std::has_single_bit(Fanout) && Fanout > 1)
+    class cow_vector {
+    public:
+        typedef Value value_type;
+        typedef value_type *pointer;
+        typedef const value_type *const_pointer;
+        typedef value_type &reference;
+        typedef const value_type &const_reference;
+        typedef std::size_t size_type;
+        typedef std::ptrdiff_t difference_type;
+
+        template<bool Const>
+        class basic_iterator {
+        public:
+            using iterator_category = std::random_access_iterator_tag;
+            using value_type = Value;
+            using difference_type = std::ptrdiff_t;
+            using pointer = std::conditional_t<Const, const Value *, Value *>;
+            using reference = std::conditional_t<Const, const Value &, Value &>;
+            using container_type = std::conditional_t<Const, const cow_vector, cow_vector>;
+
+            basic_iterator() = default;
+            basic_iterator(container_type *container, size_type index) : container_(container), index_(index) {}
+            operator basic_iterator<true>() const { return basic_iterator<true>(container_, index_); }
+
+            reference operator*() const { return (*container_)[index_]; }
+            pointer operator->() const { return &(*container_)[index_]; }
+            reference operator[](difference_type n) const { return *(*this + n); }
+
+            basic_iterator &operator++() { ++index_; return *this; }
+            basic_iterator operator++(int) { auto tmp = *this; ++index_; return tmp; }
+            basic_iterator &operator--() { --index_; return *this; }
+            basic_iterator operator--(int) { auto tmp = *this; --index_; return tmp; }
+            basic_iterator &operator+=(difference_type n) { index_ = size_type(difference_type(index_) + n); return *this; }
+            basic_iterator &operator-=(difference_type n) { return *this += -n; }
+            friend basic_iterator operator+(basic_iterator it, difference_type n) { return it += n; }
+            friend basic_iterator operator+(difference_type n, basic_iterator it) { return it += n; }
+            friend basic_iterator operator-(basic_iterator it, difference_type n) { return it -= n; }
+            friend difference_type operator-(basic_iterator const &lhs, basic_iterator const &rhs) {
+                return difference_type(lhs.index_) - difference_type(rhs.index_);
+            }
+            friend bool operator==(basic_iterator const &lhs, basic_iterator const &rhs) { return lhs.index_ == rhs.index_; }
+            friend auto operator<=>(basic_iterator const &lhs, basic_iterator const &rhs) { return lhs.index_ <=> rhs.index_; }
+
+            [[nodiscard]] size_type index() const noexcept { return index_; }
+
+        private:
+            container_type *container_ = nullptr;
+            size_type index_ = 0;
+        };
+
+        typedef basic_iterator<false> iterator;
+        typedef basic_iterator<true> const_iterator;
+
+        cow_vector() = default;
+
+        cow_vector(const cow_vector &other) = default;
+
+        cow_vector(cow_vector &&other) noexcept
+            : root_(std::move(other.root_)),
+              height_(std::exchange(other.height_, 0)),
+              size_(std::exchange(other.size_, 0)) {
+        }
+
+        cow_vector(std::initializer_list<value_type> init_list) {
+            for (auto const &value : init_list)
+                push_back(value);
+        }
+
+        ~cow_vector() noexcept = default;
+
+        cow_vector & operator=(const cow_vector &other) = default;
+
+        cow_vector & operator=(cow_vector &&other) noexcept {
+            if (this == &other)
+                return *this;
+            root_ = std::move(other.root_);
+            height_ = std::exchange(other.height_, 0);
+            size_ = std::exchange(other.size_, 0);
+            return *this;
+        }
+
+        //front
+        [[nodiscard]] reference front() { return (*this)[0]; }
+        [[nodiscard]] const_reference front() const noexcept { return (*this)[0]; }
+
+        //back
+        [[nodiscard]] reference back() { return (*this)[size() - 1]; }
+        [[nodiscard]] const_reference back() const noexcept { return (*this)[size() - 1]; }
+
+        //begin
+        [[nodiscard]] iterator begin() noexcept { return iterator(this, 0); }
+        [[nodiscard]] const_iterator begin() const noexcept { return const_iterator(this, 0); }
+        [[nodiscard]] const_iterator cbegin() const noexcept { return begin(); }
+
+        //end
+        [[nodiscard]] iterator end() noexcept { return iterator(this, size()); }
+        [[nodiscard]] const_iterator end() const noexcept { return const_iterator(this, size()); }
+        [[nodiscard]] const_iterator cend() const noexcept { return end(); }
+
+        //empty
+        [[nodiscard]] bool empty() const noexcept { return size() == 0; }
+
+        //size
+        [[nodiscard]] size_type size() const noexcept { return size_; }
+
+        [[nodiscard]] reference at(size_type index) {
+            if (index >= size())
+                throw std::out_of_range("index out of range");
+            return (*this)[index];
+        }
+        [[nodiscard]] const_reference at(size_type index) const {
+            if (index >= size())
+                throw std::out_of_range("index out of range");
+            return (*this)[index];
+        }
+
+        /**
+         * @brief Copies the chunk of the element and the branches above it if they are shared
+         */
+        [[nodiscard]] reference operator[](size_type index) {
+            return unshared_chunk(index)[index % Chunk_size];
+        }
+        [[nodiscard]] const_reference operator[](size_type index) const noexcept {
+            void const *p = root_.get();
+            for (auto level = height_; level > 0; --level)
+                p = static_cast<branch const *>(p)->children[child_position(index, level)].get();
+            return (*static_cast<chunk const *>(p))[index % Chunk_size];
+        }
+
+        /**
+         * @brief Whether this and other share the chunk of the element at index, i.e. it was not changed since one
+         * was copied from the other
+         */
+        [[nodiscard]] bool shares_element(cow_vector const &other, size_type index) const noexcept {
+            return &(*this)[index] == &other[index];
+        }
+
+        /**
+         * @brief Nothing to reserve: chunks are added one by one
+         */
+        void reserve(size_type) noexcept {}
+
+        /**
+         * @brief Append default constructed elements or erase elements at the end until size() == count
+         */
+        void resize(size_type count) {
+            while (size() > count)
+                pop_back();
+            while (size() < count)
+                emplace_back();
+        }
+
+        void push_back(const value_type &value) { emplace_back(value); }
+
+        void push_back(value_type &&value) { emplace_back(std::move(value)); }
+
+        template<typename... Args>
+        reference emplace_back(Args&&... args) {
+            if (root_ && size_ == capacity()) {
+                // the trie is full: the old root becomes the first child of a new root
+                auto new_root = std::make_shared<branch>();
+                new_root->children[0] = std::move(root_);
+                root_ = std::move(new_root);
+                ++height_;
+            }
+            auto &values = unshared_chunk(size_);
+            values.emplace_back(std::forward<Args>(args)...);
+            ++size_;
+            return values.back();
+        }
+
+        void pop_back() {
+            assert((!empty()) && "pop_back undefined if empty");
+            unshared_chunk(size_ - 1).pop_back();
+            --size_;
+        }
+
+        /**
+         * @brief Erase [first, last), last has to be end()
+         */
+        iterator erase(const_iterator first, const_iterator last) {
+            if (last != end())
+                throw std::invalid_argument("cow_vector can only erase at the end");
+            while (size() > first.index())
+                pop_back();
+            return end();
+        }
+
+        void clear() noexcept {
+            root_.reset();
+            height_ = 0;
+            size_ = 0;
+        }
+
+    private:
+        using chunk = dyn_array<Value, Chunk_size>;
+
+        struct branch {
+            // branches on the level above the chunks hold chunks, all others hold branches
+            std::array<std::shared_ptr<void>, Fanout> children;
+        };
+
+        static constexpr size_type FANOUT_BITS = size_type(std::countr_zero(Fanout));
+
+        [[nodiscard]] size_type capacity() const noexcept {
+            return Chunk_size << (FANOUT_BITS * height_);
+        }
+
+        static constexpr auto child_position(size_type index, size_type level) noexcept -> size_type {
+            return (index / Chunk_size >> (FANOUT_BITS * (level - 1))) & (Fanout - 1);
+        }
+
+        /**
+         * @brief Make p point to a node nobody else refers to, copying it if it is shared
+         */
+        template<typename Node>
+        static auto unshare(std::shared_ptr<void> &p) -> Node & {
+            if (!p) {
+                p = std::make_shared<Node>();
+            } else if (p.use_count() != 1) {
+                p = std::make_shared<Node>(*static_cast<Node const *>(p.get()));
+            } else {
+                // see the changes of a copy which released p in another thread
+                std::atomic_thread_fence(std::memory_order_acquire);
+            }
+            return *static_cast<Node *>(p.get());
+        }
+
+        auto unshared_chunk(size_type index) -> chunk & {
+            if (height_ == 0)
+                return unshare<chunk>(root_);
+            auto *p_branch = &unshare<branch>(root_);
+            for (auto level = height_; level > 1; --level)
+                p_branch = &unshare<branch>(p_branch->children[child_position(index, level)]);
+            return unshare<chunk>(p_branch->children[child_position(index, 1)]);
+        }
+
+        std::shared_ptr<void> root_;
+        size_type height_ = 0;
+        size_type size_ = 0;
+    };
+}
+
+#endif //COW_VECTOR_H
@@ -0,0 +1,252 @@
+//
+// Created by arnoldm on 19.10.26.
+//
+
+#ifndef DURABLE_BTREE_H
+#define DURABLE_BTREE_H
+
+#include <cerrno>
+#include <cstdint>
+#include <filesystem>
+#include <mutex>
+#include <optional>
+#include <shared_mutex>
+#include <stdexcept>
+#include <system_error>
+#include <utility>
+#include <fcntl.h>
+#include <unistd.h>
+#include "btree.h"
+#include "write_ahead_log.h"
+
+namespace bt {
+    /**
+     * An in-memory btree of type Btree whose changes survive a restart: a directory holds a snapshot, written by
+     * checkpoint() with Btree::save(), and a write_ahead_log of the inserts and erases since then. Opening the
+     * directory loads the snapshot and replays the log.
+     *
+     * With commit_mode::group an insert or erase returns once its record is durable. Writers change the tree and
+     * append their record under an exclusive latch, in the same order, and wait for the log's group commit after
+     * releasing it: concurrent writers share one fdatasync(). With commit_mode::deferred they return at once and
+     * sync() makes all changes so far durable, trading the changes since the last sync() for throughput.
+     *
+     * Thread safe; readers share a latch, except with paged_storage, whose buffer pool even reads change.
+     */
+    template<typename Btree>
+    class durable_btree {
+    public:
+        using btree_type = Btree;
+        using key_type = typename btree_type::key_type;
+        using value_type = typename btree_type::value_type;
+        using log_type = write_ahead_log<key_type, value_type>;
+        using operation = typename log_type::operation;
+
+        enum class commit_mode { group, deferred };
+
+        /**
+         * @brief Open or create the tree in directory. Throws std::system_error if a file cannot be opened and
+         * std::runtime_error if the snapshot is corrupt.
+         */
+        explicit durable_btree(std::filesystem::path const &directory, commit_mode mode = commit_mode::group)
+            : directory_(prepare(directory)), mode_(mode), snapshot_lsn_(load_snapshot()),
+              log_(directory_ / LOG_NAME, snapshot_lsn_) {
+            log_.replay(snapshot_lsn_, [this](operation op, std::uint64_t, key_type const &key, value_type const &value) {
+                apply(op, key, value);
+            });
+        }
+
+        /**
+         * @brief Makes the changes of commit_mode::deferred durable, as far as possible
+         */
+        ~durable_btree() {
+            try {
+                log_.sync();
+            } catch (...) {
+            }
+        }
+
+        durable_btree(durable_btree const &) = delete;
+
+        durable_btree & operator=(durable_btree const &) = delete;
+
+        auto insert(key_type const &key, value_type const &value) -> bool {
+            std::uint64_t lsn = 0;
+            bool inserted;
+            {
+                std::unique_lock lock(latch_);
+                inserted = apply(operation::insert, key, value);
+                if (inserted)
+                    lsn = log_.append(operation::insert, key, value);
+            }
+            if (mode_ == commit_mode::group)
+                log_.commit(lsn);
+            return inserted;
+        }
+
+        /**
+         * @brief Erase the first entry with key
+         * @return the number of erased entries (0 or 1)
+         */
+        auto erase(key_type const &key) -> std::size_t {
+            std::uint64_t lsn = 0;
+            bool erased;
+            {
+                std::unique_lock lock(latch_);
+                erased = apply(operation::erase, key, value_type{});
+                if (erased)
+                    lsn = log_.append(operation::erase, key);
+            }
+            if (mode_ == commit_mode::group)
+                log_.commit(lsn);
+            return erased ? 1 : 0;
+        }
+
+        /**
+         * @return a copy of the value of the first entry with key
+         */
+        auto find(key_type const &key) const -> std::optional<value_type> {
+            auto read = [this, &key]() -> std::optional<value_type> {
+                auto it = tree_.find(key);
+                if (it == tree_.end())
+                    return std::nullopt;
+                return (*it).second;
+            };
+            if constexpr (btree_type::paged_storage_policy) {
+                std::unique_lock lock(latch_);
+                return read();
+            } else {
+                std::shared_lock lock(latch_);
+                return read();
+            }
+        }
+
+        auto contains(key_type const &key) const -> bool { return find(key).has_value(); }
+
+        /**
+         * @brief Make all changes so far durable
+         */
+        auto sync() -> void { log_.sync(); }
+
+        /**
+         * @brief Write a snapshot of the tree and empty the log, so that the next start replays nothing. Writers
+         * wait meanwhile. The snapshot is written to a temporary file and renamed, a crash leaves the old one.
+         */
+        auto checkpoint() -> void;
+
+        /**
+         * @brief The tree, for phases without concurrent writers
+         */
+        [[nodiscard]] auto unsynchronized() const -> btree_type const & { return tree_; }
+
+        [[nodiscard]] auto log() const -> log_type const & { return log_; }
+
+        /**
+         * @return the LSN of the last change in the snapshot
+         */
+        [[nodiscard]] auto snapshot_lsn() const -> std::uint64_t {
+            std::shared_lock lock(latch_);
+            return snapshot_lsn_;
+        }
+
+        [[nodiscard]] auto directory() const -> std::filesystem::path const & { return directory_; }
+
+    private:
+        static constexpr char const *SNAPSHOT_NAME = "snapshot";
+        static constexpr char const *LOG_NAME = "log";
+
+        struct snapshot_header {
+            static constexpr std::uint64_t MAGIC = 0x50414e5354425442; // "BTBTSNAP"
+
+            std::uint64_t magic;
+            std::uint64_t lsn;
+        };
+
+        static auto prepare(std::filesystem::path const &directory) -> std::filesystem::path {
+            std::filesystem::create_directories(directory);
+            return directory;
+        }
+
+        /**
+         * @brief Load the snapshot into tree_, if there is one
+         * @return its LSN, 0 without a snapshot
+         */
+        auto load_snapshot() -> std::uint64_t;
+
+        /**
+         * @return true if the operation changed the tree
+         */
+        auto apply(operation op, key_type const &key, value_type const &value) -> bool {
+            if (op == operation::insert)
+                return tree_.insert(key, value);
+            auto it = tree_.find(key);
+            if (it == tree_.end())
+                return false;
+            tree_.erase(it);
+            return true;
+        }
+
+        static auto check(bool ok, char const *what) -> void {
+            if (!ok)
+                throw std::system_error(errno, std::generic_category(), what);
+        }
+
+        std::filesystem::path directory_;
+        commit_mode mode_;
+        mutable std::shared_mutex latch_;
+        btree_type tree_;
+        std::uint64_t snapshot_lsn_;
+        log_type log_;
+    };
+
+    template<typename Btree>
+    auto durable_btree<Btree>::load_snapshot() -> std::uint64_t {
+        auto const path = directory_ / SNAPSHOT_NAME;
+        auto const fd = ::open(path.c_str(), O_RDONLY | O_CLOEXEC);
+        if (fd < 0) {
+            if (errno == ENOENT)
+                return 0;
+            throw std::system_error(errno, std::generic_category(), "durable_btree: open " + path.string());
+        }
+        try {
+            snapshot_header header{};
+            if (::read(fd, &header, sizeof(header)) != ssize_t(sizeof(header)) || header.magic != snapshot_header::MAGIC)
+                throw std::runtime_error("durable_btree: " + path.string() + " is no snapshot");
+            tree_.load(fd);
+            ::close(fd);
+            return header.lsn;
+        } catch (...) {
+            ::close(fd);
+            throw;
+        }
+    }
+
+    template<typename Btree>
+    auto durable_btree<Btree>::checkpoint() -> void {
+        std::unique_lock lock(latch_);
+        auto const lsn = log_.last_lsn();
+        auto const temporary = directory_ / (std::string(SNAPSHOT_NAME) + ".tmp");
+        auto const fd = ::open(temporary.c_str(), O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0644);
+        check(fd >= 0, "durable_btree: open snapshot");
+        try {
+            snapshot_header const header{snapshot_header::MAGIC, lsn};
+            check(::write(fd, &header, sizeof(header)) == ssize_t(sizeof(header)), "durable_btree: write snapshot");
+            tree_.save(fd);
+            check(::fsync(fd) == 0, "durable_btree: fsync snapshot");
+        } catch (...) {
+            ::close(fd);
+            throw;
+        }
+        ::close(fd);
+        std::filesystem::rename(temporary, directory_ / SNAPSHOT_NAME);
+        // the rename is durable once the directory is synced
+        auto const directory_fd = ::open(directory_.c_str(), O_RDONLY | O_DIRECTORY | O_CLOEXEC);
+        check(directory_fd >= 0, "durable_btree: open directory");
+        auto const synced = ::fsync(directory_fd) == 0;
+        ::close(directory_fd);
+        check(synced, "durable_btree: fsync directory");
+        log_.truncate(lsn);
+        snapshot_lsn_ = lsn;
+    }
+}
+
+#endif //DURABLE_BTREE_H
@@ -227,7 +227,7 @@ namespace bt {
         }
 
         iterator insert_space(iterator pos, size_type count) {
-            assert((size() + count < capacity()) && "insert_space: capacity exceeded");
+            assert((size() + count <= capacity()) && "insert_space: capacity exceeded");
             assert((begin() <= pos && pos <= end()) && "insert: pos iterator of invalid range");
             if (count == 0)
                 return pos;
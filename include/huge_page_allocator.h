@@ -0,0 +1,90 @@
+//
+// Created by arnoldm on 19.10.26.
+//
+
+#ifndef HUGE_PAGE_ALLOCATOR_H
+#define HUGE_PAGE_ALLOCATOR_H
+
+#include <cstddef>
+#include <cstdint>
+#include <limits>
+#include <new>
+
+#if defined(__linux__)
+#include <sys/mman.h>
+#endif
+
+namespace bt {
+    inline constexpr std::size_t HUGE_PAGE_SIZE = std::size_t(2) << 20;
+
+    /**
+    * Allocator backing allocations of at least one huge page with 2 MB pages.
+    *
+    * Tries explicit huge pages (MAP_HUGETLB) first, falls back to transparent huge pages
+    * (madvise(MADV_HUGEPAGE)) on a 2 MB aligned mapping. Smaller allocations and non-Linux
+    * platforms use aligned operator new.
+    */
+    template<typename T>
+    class huge_page_allocator {
+    public:
+        using value_type = T;
+
+        huge_page_allocator() noexcept = default;
+
+        template<typename U>
+        huge_page_allocator(huge_page_allocator<U> const &) noexcept {}
+
+        [[nodiscard]] T *allocate(std::size_t n) {
+            if (n > std::numeric_limits<std::size_t>::max() / sizeof(T))
+                throw std::bad_array_new_length();
+            std::size_t const bytes = n * sizeof(T);
+#if defined(__linux__)
+            if (bytes >= HUGE_PAGE_SIZE)
+                return static_cast<T *>(map_huge_pages(mapped_size(bytes)));
+#endif
+            return static_cast<T *>(::operator new(bytes, std::align_val_t(alignof(T))));
+        }
+
+        void deallocate(T *p, std::size_t n) noexcept {
+            std::size_t const bytes = n * sizeof(T);
+#if defined(__linux__)
+            if (bytes >= HUGE_PAGE_SIZE) {
+                ::munmap(p, mapped_size(bytes));
+                return;
+            }
+#endif
+            ::operator delete(p, std::align_val_t(alignof(T)));
+        }
+
+        template<typename U>
+        friend bool operator==(huge_page_allocator const &, huge_page_allocator<U> const &) noexcept { return true; }
+
+    private:
+        static constexpr std::size_t mapped_size(std::size_t bytes) noexcept {
+            return (bytes + HUGE_PAGE_SIZE - 1) / HUGE_PAGE_SIZE * HUGE_PAGE_SIZE;
+        }
+
+#if defined(__linux__)
+        static void *map_huge_pages(std::size_t size) {
+            void *p = ::mmap(nullptr, size, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS | MAP_HUGETLB, -1, 0);
+            if (p != MAP_FAILED)
+                return p;
+            // no reserved huge pages: map 2 MB more than needed and cut it down to a 2 MB aligned range
+            p = ::mmap(nullptr, size + HUGE_PAGE_SIZE, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+            if (p == MAP_FAILED)
+                throw std::bad_alloc();
+            auto *const begin = static_cast<std::byte *>(p);
+            auto const offset = reinterpret_cast<std::uintptr_t>(begin) % HUGE_PAGE_SIZE;
+            auto *const aligned = begin + (offset == 0 ? 0 : HUGE_PAGE_SIZE - offset);
+            if (aligned != begin)
+                ::munmap(begin, static_cast<std::size_t>(aligned - begin));
+            if (auto *const end = begin + size + HUGE_PAGE_SIZE; aligned + size != end)
+                ::munmap(aligned + size, static_cast<std::size_t>(end - (aligned + size)));
+            ::madvise(aligned, size, MADV_HUGEPAGE);
+            return aligned;
+        }
+#endif
+    };
+}
+
+#endif //HUGE_PAGE_ALLOCATOR_H
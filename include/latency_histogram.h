@@ -0,0 +1,108 @@
+//
+// Created by arnoldm on 19.10.26.
+//
+
+#ifndef LATENCY_HISTOGRAM_H
+#define LATENCY_HISTOGRAM_H
+
+#include <algorithm>
+#include <array>
+#include <bit>
+#include <cmath>
+#include <cstddef>
+#include <cstdint>
+#include <limits>
+
+namespace bt {
+    /**
+     * A histogram of latencies, or of any unsigned 64 bit values, in the manner of HdrHistogram: values below
+     * 2 * Sub_buckets are counted exactly, bigger ones in Sub_buckets linear buckets per power of 2, so the
+     * percentiles are within 1 / Sub_buckets of the recorded values over the whole range. record() increments a
+     * counter in a fixed array and is cheap enough to time every single operation.
+     */
+    template<std::size_t Sub_buckets = 128>
+    class latency_histogram {
+        static_assert(std::has_single_bit(Sub_buckets) && Sub_buckets >= 2, "Sub_buckets must be a power of 2");
+    public:
+        auto record(std::uint64_t value) noexcept -> void {
+            ++counts_[bucket_of(value)];
+            ++count_;
+            sum_ += static_cast<double>(value);
+            min_ = std::min(min_, value);
+            max_ = std::max(max_, value);
+        }
+
+        /**
+         * @brief Add the values recorded in other
+         */
+        auto merge(latency_histogram const &other) noexcept -> void {
+            for (std::size_t i = 0; i < BUCKETS; ++i)
+                counts_[i] += other.counts_[i];
+            count_ += other.count_;
+            sum_ += other.sum_;
+            min_ = std::min(min_, other.min_);
+            max_ = std::max(max_, other.max_);
+        }
+
+        auto reset() noexcept -> void { *this = latency_histogram(); }
+
+        [[nodiscard]] auto count() const noexcept -> std::uint64_t { return count_; }
+
+        [[nodiscard]] auto min() const noexcept -> std::uint64_t { return count_ == 0 ? 0 : min_; }
+
+        [[nodiscard]] auto max() const noexcept -> std::uint64_t { return max_; }
+
+        [[nodiscard]] auto mean() const noexcept -> double {
+            return count_ == 0 ? 0 : sum_ / static_cast<double>(count_);
+        }
+
+        /**
+         * @return the smallest value at or below which percent of the recorded values lie, rounded up to the
+         * highest value of its bucket but at most max()
+         */
+        [[nodiscard]] auto percentile(double percent) const noexcept -> std::uint64_t {
+            if (count_ == 0)
+                return 0;
+            auto const rank = std::max(std::uint64_t{1}, static_cast<std::uint64_t>(
+                                           std::ceil(std::clamp(percent, 0.0, 100.0) / 100.0 *
+                                                     static_cast<double>(count_))));
+            std::uint64_t seen = 0;
+            for (std::size_t i = 0; i < BUCKETS; ++i) {
+                seen += counts_[i];
+                if (seen >= rank)
+                    return std::min(highest_value_of(i), max_);
+            }
+            return max_;
+        }
+
+    private:
+        static constexpr int SUB_BUCKET_BITS = std::countr_zero(Sub_buckets);
+        static constexpr std::size_t EXACT = 2 * Sub_buckets;
+        static constexpr std::size_t BUCKETS = EXACT + (64 - SUB_BUCKET_BITS - 1) * Sub_buckets;
+
+        static constexpr auto bucket_of(std::uint64_t value) noexcept -> std::size_t {
+            if (value < EXACT)
+                return static_cast<std::size_t>(value);
+            // value >> shift lies in [Sub_buckets, 2 * Sub_buckets)
+            auto const shift = std::bit_width(value) - SUB_BUCKET_BITS - 1;
+            return EXACT + static_cast<std::size_t>(shift - 1) * Sub_buckets +
+                   static_cast<std::size_t>((value >> shift) - Sub_buckets);
+        }
+
+        static constexpr auto highest_value_of(std::size_t bucket) noexcept -> std::uint64_t {
+            if (bucket < EXACT)
+                return bucket;
+            auto const shift = static_cast<int>((bucket - EXACT) / Sub_buckets) + 1;
+            auto const lowest = static_cast<std::uint64_t>((bucket - EXACT) % Sub_buckets + Sub_buckets) << shift;
+            return lowest + ((std::uint64_t{1} << shift) - 1);
+        }
+
+        std::array<std::uint64_t, BUCKETS> counts_{};
+        std::uint64_t count_ = 0;
+        double sum_ = 0;
+        std::uint64_t min_ = std::numeric_limits<std::uint64_t>::max();
+        std::uint64_t max_ = 0;
+    };
+}
+
+#endif //LATENCY_HISTOGRAM_H
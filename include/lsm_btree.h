@@ -0,0 +1,574 @@
+//
+// Created by arnoldm on 19.10.26.
+//
+
+#ifndef LSM_BTREE_H
+#define LSM_BTREE_H
+
+#include <algorithm>
+#include <atomic>
+#include <condition_variable>
+#include <cstddef>
+#include <cstdint>
+#include <cstdlib>
+#include <exception>
+#include <filesystem>
+#include <iterator>
+#include <memory>
+#include <mutex>
+#include <optional>
+#include <shared_mutex>
+#include <stop_token>
+#include <system_error>
+#include <thread>
+#include <type_traits>
+#include <utility>
+#include <variant>
+#include <vector>
+#include <unistd.h>
+#include "bloom_filter.h"
+#include "btree.h"
+#include "mapped_btree.h"
+
+namespace bt {
+    /**
+     * The value of an entry of the memtable or a run of an lsm_btree: a value or a tombstone, which hides the older
+     * entries of its key.
+     */
+    template<typename Value>
+    struct lsm_entry {
+        Value value;
+        bool erased;
+    };
+
+    struct lsm_stats {
+        std::uint64_t runs_written;
+        std::uint64_t compactions;
+        // lookups in runs, and runs skipped because their Bloom filter lacks the key
+        std::uint64_t run_lookups;
+        std::uint64_t filtered_lookups;
+    };
+
+    /**
+     * A log-structured merge tree of btrees, for sustained inserts: inserts and erases go to a btree in memory, the
+     * memtable. A full memtable is frozen, and a background thread writes it as a run: an image of a bulk loaded
+     * btree (see btree::save_image()) in a file in directory, one sequential write of full nodes, which is then
+     * used in place as a mapped_btree. The same thread merges runs: once there are Fan_in of them, the Fan_in
+     * neighbouring runs with the fewest entries become one, so that runs grow geometrically and a lookup visits a
+     * logarithmic number of them.
+     *
+     * Lookups go from the newest data to the oldest, the memtable, the frozen memtables and the runs, and the first
+     * entry of the key decides. Every run has a bloom_filter, runs which certainly lack the key are skipped.
+     * entries() merges all of them in key order. Erasing writes a tombstone, which is dropped when the oldest run is
+     * merged.
+     *
+     * Keys and values must be trivially copyable. Merging reads the merged runs into memory before it writes the
+     * new one. Run files are unlinked once mapped, they vanish with the tree: for durability combine it with a
+     * write_ahead_log. Thread safe; writers wait while MAX_FROZEN memtables are waiting to be written.
+     *
+     * An exception of the background thread, say a full or missing directory, stops it. The tree keeps the frozen
+     * memtables and stays readable, and insert(), erase(), flush() and compact() rethrow the exception from then on.
+     */
+    template<typename Key, typename Value, typename Index, std::size_t Internal_order, std::size_t Leaf_order>
+    class lsm_btree {
+    public:
+        using key_type = Key;
+        using value_type = Value;
+        using entry_type = lsm_entry<Value>;
+        using memtable_type = btree<Key, entry_type, Index, Internal_order, Leaf_order>;
+        using run_tree_type = mapped_btree<memtable_type>;
+
+        static_assert(std::is_trivially_copyable_v<key_type> && std::is_trivially_copyable_v<value_type>,
+                      "runs hold keys and values as bytes, they must be trivially copyable");
+
+        static constexpr std::size_t DEFAULT_MEMTABLE_CAPACITY = std::size_t(1) << 20;
+        static constexpr std::size_t MAX_FROZEN = 2;
+        static constexpr std::size_t BLOOM_BITS_PER_KEY = 10;
+
+    private:
+        struct run {
+            run_tree_type tree;
+            bloom_filter<key_type> filter;
+        };
+
+        using memtable_range = std::pair<typename memtable_type::const_iterator, typename memtable_type::const_iterator>;
+        using run_range = std::pair<typename run_tree_type::const_iterator, typename run_tree_type::const_iterator>;
+
+        /**
+         * k-way merge of sorted ranges, added newest first: yields every key once, with the entry of the newest
+         * range holding it
+         */
+        class merger {
+        public:
+            explicit merger(bool skip_erased) : skip_erased_(skip_erased) {}
+
+            template<typename Range>
+            auto add(Range range) -> void {
+                if (range.first != range.second)
+                    cursors_.push_back({std::move(range)});
+            }
+
+            auto start() -> void {
+                for (std::size_t i = 0; i < cursors_.size(); ++i)
+                    heap_.push_back(i);
+                std::ranges::make_heap(heap_, later());
+                next();
+            }
+
+            [[nodiscard]] auto done() const noexcept -> bool { return done_; }
+
+            [[nodiscard]] auto key() const noexcept -> key_type const & { return key_; }
+
+            [[nodiscard]] auto entry() const noexcept -> entry_type const & { return entry_; }
+
+            auto next() -> void {
+                do {
+                    if (heap_.empty()) {
+                        done_ = true;
+                        return;
+                    }
+                    key_ = cursors_[heap_.front()].key();
+                    entry_ = cursors_[heap_.front()].entry();
+                    // the older entries of the key are skipped
+                    while (!heap_.empty() && !(key_ < cursors_[heap_.front()].key())) {
+                        std::ranges::pop_heap(heap_, later());
+                        if (cursors_[heap_.back()].advance())
+                            std::ranges::push_heap(heap_, later());
+                        else
+                            heap_.pop_back();
+                    }
+                } while (skip_erased_ && entry_.erased);
+            }
+
+        private:
+            struct cursor {
+                std::variant<memtable_range, run_range> range;
+
+                [[nodiscard]] auto key() const -> key_type const & {
+                    return std::visit([](auto const &r) -> key_type const & { return (*r.first).first; }, range);
+                }
+
+                [[nodiscard]] auto entry() const -> entry_type const & {
+                    return std::visit([](auto const &r) -> entry_type const & { return (*r.first).second; }, range);
+                }
+
+                /**
+                 * @return false at the end of the range
+                 */
+                auto advance() -> bool {
+                    return std::visit([](auto &r) { return ++r.first != r.second; }, range);
+                }
+            };
+
+            // for the max heap of std: the cursor with the smaller key, or the newer one with equal keys, first
+            auto later() const {
+                return [this](std::size_t lhs, std::size_t rhs) {
+                    auto const &lhs_key = cursors_[lhs].key();
+                    auto const &rhs_key = cursors_[rhs].key();
+                    return rhs_key < lhs_key || (!(lhs_key < rhs_key) && rhs < lhs);
+                };
+            }
+
+            std::vector<cursor> cursors_;
+            std::vector<std::size_t> heap_;
+            bool skip_erased_;
+            bool done_ = false;
+            key_type key_{};
+            entry_type entry_{};
+        };
+
+    public:
+        /**
+         * The entries of an lsm_btree in key order, every key once with its newest value, merged from the
+         * memtables and runs. Holds the shared latch of the tree while it lives, writers wait. A single pass range.
+         */
+        class entry_range {
+        public:
+            class iterator {
+            public:
+                using iterator_category = std::input_iterator_tag;
+                using difference_type = std::ptrdiff_t;
+                using value_type = std::pair<key_type const &, typename lsm_btree::value_type const &>;
+
+                auto operator*() const -> value_type { return {p_merger_->key(), p_merger_->entry().value}; }
+
+                auto operator++() -> iterator & {
+                    p_merger_->next();
+                    return *this;
+                }
+
+                auto operator++(int) -> void { ++*this; }
+
+                friend bool operator==(iterator const &it, std::default_sentinel_t) { return it.p_merger_->done(); }
+
+            private:
+                friend entry_range;
+
+                explicit iterator(merger *p_merger) : p_merger_(p_merger) {}
+
+                merger *p_merger_;
+            };
+
+            entry_range(entry_range const &) = delete;
+
+            entry_range & operator=(entry_range const &) = delete;
+
+            auto begin() -> iterator { return iterator(&merger_); }
+
+            auto end() const -> std::default_sentinel_t { return {}; }
+
+        private:
+            friend lsm_btree;
+
+            entry_range(std::shared_mutex &latch, lsm_btree const &tree, key_type const *p_from)
+                : lock_(latch), merger_(true) {
+                tree.add_ranges(merger_, p_from);
+                merger_.start();
+            }
+
+            std::shared_lock<std::shared_mutex> lock_;
+            merger merger_;
+        };
+
+        /**
+         * @brief A tree with memtables of memtable_capacity entries and runs in files in directory
+         */
+        explicit lsm_btree(std::size_t memtable_capacity = DEFAULT_MEMTABLE_CAPACITY, std::size_t fan_in = 4,
+                           std::filesystem::path directory = std::filesystem::temp_directory_path())
+            : memtable_capacity_(std::max<std::size_t>(memtable_capacity, 1)), fan_in_(std::max<std::size_t>(fan_in, 2)),
+              directory_(std::move(directory)),
+              worker_([this](std::stop_token stop) { work(stop); }) {}
+
+        lsm_btree(lsm_btree const &) = delete;
+
+        lsm_btree & operator=(lsm_btree const &) = delete;
+
+        /**
+         * @brief Insert key with value, or replace the value of key
+         */
+        auto insert(key_type const &key, value_type const &value) -> void { write(key, {value, false}); }
+
+        /**
+         * @brief Erase key, by a tombstone
+         */
+        auto erase(key_type const &key) -> void { write(key, {value_type{}, true}); }
+
+        /**
+         * @return a copy of the value of key
+         */
+        auto find(key_type const &key) const -> std::optional<value_type>;
+
+        auto contains(key_type const &key) const -> bool { return find(key).has_value(); }
+
+        /**
+         * @brief All entries in key order
+         */
+        auto entries() const -> entry_range { return entry_range(latch_, *this, nullptr); }
+
+        /**
+         * @brief The entries with keys not less than from, in key order
+         */
+        auto entries(key_type const &from) const -> entry_range { return entry_range(latch_, *this, &from); }
+
+        /**
+         * @brief Freeze the memtable and wait until all frozen memtables are written as runs
+         */
+        auto flush() -> void {
+            std::unique_lock lock(latch_);
+            rethrow_failure();
+            freeze();
+            changed_.wait(lock, [this] { return frozen_.empty() || failure_ != nullptr; });
+            rethrow_failure();
+        }
+
+        /**
+         * @brief flush() and wait until the background thread merged all runs into one, which holds no tombstones
+         */
+        auto compact() -> void {
+            std::unique_lock lock(latch_);
+            rethrow_failure();
+            freeze();
+            full_compaction_ = true;
+            work_to_do_.notify_one();
+            changed_.wait(lock, [this] { return (frozen_.empty() && !full_compaction_) || failure_ != nullptr; });
+            rethrow_failure();
+        }
+
+        [[nodiscard]] auto run_count() const -> std::size_t {
+            std::shared_lock lock(latch_);
+            return runs_.size();
+        }
+
+        /**
+         * @return the number of entries of each run, tombstones included, oldest first
+         */
+        [[nodiscard]] auto run_sizes() const -> std::vector<std::size_t> {
+            std::shared_lock lock(latch_);
+            std::vector<std::size_t> sizes;
+            for (auto const &p_run : runs_)
+                sizes.push_back(p_run->tree.size());
+            return sizes;
+        }
+
+        [[nodiscard]] auto memtable_size() const -> std::size_t {
+            std::shared_lock lock(latch_);
+            return memtable_size_;
+        }
+
+        [[nodiscard]] auto stats() const noexcept -> lsm_stats {
+            return {runs_written_.load(std::memory_order_relaxed), compactions_.load(std::memory_order_relaxed),
+                    run_lookups_.load(std::memory_order_relaxed), filtered_lookups_.load(std::memory_order_relaxed)};
+        }
+
+        [[nodiscard]] auto directory() const -> std::filesystem::path const & { return directory_; }
+
+    private:
+        using entries_type = std::vector<std::pair<key_type, entry_type>>;
+
+        auto write(key_type const &key, entry_type const &entry) -> void;
+
+        /**
+         * @brief Queue the memtable for writing, with the latch held exclusively
+         */
+        auto freeze() -> void {
+            if (memtable_size_ == 0)
+                return;
+            frozen_.push_back(std::make_shared<memtable_type const>(std::move(memtable_)));
+            memtable_ = memtable_type();
+            memtable_size_ = 0;
+            work_to_do_.notify_one();
+        }
+
+        /**
+         * @brief Add the ranges of memtables and runs to m, newest first, with the latch held
+         */
+        auto add_ranges(merger &m, key_type const *p_from) const -> void {
+            auto add_tree = [&m, p_from](auto const &tree) {
+                m.add(std::pair{p_from != nullptr ? tree.lower_bound(*p_from) : tree.begin(), tree.end()});
+            };
+            add_tree(memtable_);
+            for (auto it = frozen_.rbegin(); it != frozen_.rend(); ++it)
+                add_tree(**it);
+            for (auto it = runs_.rbegin(); it != runs_.rend(); ++it)
+                add_tree((*it)->tree);
+        }
+
+        /**
+         * @brief Throw the exception which stopped the background thread, if any, with the latch held
+         */
+        auto rethrow_failure() const -> void {
+            if (failure_ != nullptr)
+                std::rethrow_exception(failure_);
+        }
+
+        auto needs_compaction() const -> bool {
+            return runs_.size() >= fan_in_ || (full_compaction_ && frozen_.empty());
+        }
+
+        /**
+         * @brief The background thread: writes frozen memtables, then merges runs, until it is stopped or fails
+         */
+        auto work(std::stop_token stop) -> void;
+
+        /**
+         * @brief Write a frozen memtable or merge runs
+         * @return false once stopped
+         */
+        auto work_step(std::stop_token const &stop) -> bool;
+
+        /**
+         * @brief Merge neighbouring runs into one, on the background thread, which alone changes runs_
+         */
+        auto compact_step() -> void;
+
+        /**
+         * @brief Write entries, sorted by key, as a run
+         */
+        auto write_run(entries_type entries) const -> std::shared_ptr<run const>;
+
+        std::size_t memtable_capacity_;
+        std::size_t fan_in_;
+        std::filesystem::path directory_;
+        mutable std::shared_mutex latch_;
+        memtable_type memtable_;
+        std::size_t memtable_size_ = 0;
+        // oldest first
+        std::vector<std::shared_ptr<memtable_type const>> frozen_;
+        std::vector<std::shared_ptr<run const>> runs_;
+        bool full_compaction_ = false;
+        // the exception which stopped the background thread
+        std::exception_ptr failure_;
+        std::condition_variable_any work_to_do_;
+        // frozen_ or runs_ changed
+        mutable std::condition_variable_any changed_;
+        std::atomic<std::uint64_t> runs_written_ = 0;
+        std::atomic<std::uint64_t> compactions_ = 0;
+        mutable std::atomic<std::uint64_t> run_lookups_ = 0;
+        mutable std::atomic<std::uint64_t> filtered_lookups_ = 0;
+        // last, so that it stops before the rest goes away
+        std::jthread worker_;
+    };
+
+    template<typename Key, typename Value, typename Index, std::size_t Internal_order, std::size_t Leaf_order>
+    auto lsm_btree<Key, Value, Index, Internal_order, Leaf_order>::write(key_type const &key, entry_type const &entry) -> void {
+        std::unique_lock lock(latch_);
+        rethrow_failure();
+        if (auto it = memtable_.find(key); it != memtable_.end()) {
+            (*it).second = entry;
+            return;
+        }
+        memtable_.insert(key, entry);
+        if (++memtable_size_ < memtable_capacity_)
+            return;
+        // the background thread is behind, writes wait for it
+        changed_.wait(lock, [this] { return frozen_.size() < MAX_FROZEN || failure_ != nullptr; });
+        rethrow_failure();
+        freeze();
+    }
+
+    template<typename Key, typename Value, typename Index, std::size_t Internal_order, std::size_t Leaf_order>
+    auto lsm_btree<Key, Value, Index, Internal_order, Leaf_order>::find(key_type const &key) const -> std::optional<value_type> {
+        auto result = [](entry_type const &entry) {
+            return entry.erased ? std::nullopt : std::optional<value_type>(entry.value);
+        };
+        std::shared_lock lock(latch_);
+        if (auto it = memtable_.find(key); it != memtable_.end())
+            return result((*it).second);
+        for (auto p = frozen_.rbegin(); p != frozen_.rend(); ++p)
+            if (auto it = (*p)->find(key); it != (*p)->end())
+                return result((*it).second);
+        for (auto p = runs_.rbegin(); p != runs_.rend(); ++p) {
+            if (!(*p)->filter.may_contain(key)) {
+                filtered_lookups_.fetch_add(1, std::memory_order_relaxed);
+                continue;
+            }
+            run_lookups_.fetch_add(1, std::memory_order_relaxed);
+            if (auto it = (*p)->tree.find(key); it != (*p)->tree.end())
+                return result((*it).second);
+        }
+        return std::nullopt;
+    }
+
+    template<typename Key, typename Value, typename Index, std::size_t Internal_order, std::size_t Leaf_order>
+    auto lsm_btree<Key, Value, Index, Internal_order, Leaf_order>::work(std::stop_token stop) -> void {
+        try {
+            while (work_step(stop)) {}
+        } catch (...) {
+            // the runs and frozen memtables are unchanged, the waiting threads find the exception
+            {
+                std::unique_lock lock(latch_);
+                failure_ = std::current_exception();
+            }
+            changed_.notify_all();
+        }
+    }
+
+    template<typename Key, typename Value, typename Index, std::size_t Internal_order, std::size_t Leaf_order>
+    auto lsm_btree<Key, Value, Index, Internal_order, Leaf_order>::work_step(std::stop_token const &stop) -> bool {
+        std::shared_ptr<memtable_type const> frozen;
+        {
+            std::unique_lock lock(latch_);
+            if (!work_to_do_.wait(lock, stop, [this] { return !frozen_.empty() || needs_compaction(); }))
+                return false;
+            // merging first keeps the number of runs bounded while writers keep the thread busy
+            if (!frozen_.empty() && runs_.size() < fan_in_)
+                frozen = frozen_.front();
+        }
+        if (frozen == nullptr) {
+            compact_step();
+            return true;
+        }
+        // the frozen memtable does not change, it is written without the latch
+        entries_type entries;
+        for (auto const &[key, entry] : *frozen)
+            entries.emplace_back(key, entry);
+        auto p_run = write_run(std::move(entries));
+        {
+            std::unique_lock lock(latch_);
+            frozen_.erase(frozen_.begin());
+            runs_.push_back(std::move(p_run));
+        }
+        runs_written_.fetch_add(1, std::memory_order_relaxed);
+        changed_.notify_all();
+        return true;
+    }
+
+    template<typename Key, typename Value, typename Index, std::size_t Internal_order, std::size_t Leaf_order>
+    auto lsm_btree<Key, Value, Index, Internal_order, Leaf_order>::compact_step() -> void {
+        std::vector<std::shared_ptr<run const>> runs;
+        bool full;
+        {
+            std::shared_lock lock(latch_);
+            runs = runs_;
+            // a full compaction waits for the frozen memtables
+            full = full_compaction_ && frozen_.empty();
+        }
+        std::size_t first = 0;
+        std::size_t count = runs.size();
+        if (!full) {
+            // the fan_in_ neighbouring runs with the fewest entries
+            count = fan_in_;
+            std::size_t fewest = SIZE_MAX;
+            for (std::size_t i = 0; i + count <= runs.size(); ++i) {
+                std::size_t entries = 0;
+                for (std::size_t j = i; j < i + count; ++j)
+                    entries += runs[j]->tree.size();
+                if (entries < fewest) {
+                    fewest = entries;
+                    first = i;
+                }
+            }
+        }
+        std::shared_ptr<run const> p_merged;
+        // a single run of a full compaction is merged only to drop its tombstones
+        if (count > 0) {
+            // nothing older is left to hide once the oldest run is merged
+            merger m(first == 0);
+            for (auto i = first + count; i-- > first;)
+                m.add(run_range{runs[i]->tree.begin(), runs[i]->tree.end()});
+            m.start();
+            entries_type entries;
+            for (; !m.done(); m.next())
+                entries.emplace_back(m.key(), m.entry());
+            if (!entries.empty())
+                p_merged = write_run(std::move(entries));
+        }
+        {
+            std::unique_lock lock(latch_);
+            auto const position = runs_.erase(runs_.begin() + std::ptrdiff_t(first), runs_.begin() + std::ptrdiff_t(first + count));
+            if (p_merged != nullptr)
+                runs_.insert(position, std::move(p_merged));
+            if (full)
+                full_compaction_ = false;
+        }
+        compactions_.fetch_add(1, std::memory_order_relaxed);
+        changed_.notify_all();
+    }
+
+    template<typename Key, typename Value, typename Index, std::size_t Internal_order, std::size_t Leaf_order>
+    auto lsm_btree<Key, Value, Index, Internal_order, Leaf_order>::write_run(entries_type entries) const -> std::shared_ptr<run const> {
+        bloom_filter<key_type> filter(entries.size(), BLOOM_BITS_PER_KEY);
+        for (auto const &entry : entries)
+            filter.insert(entry.first);
+        memtable_type tree;
+        tree.bulk_load(std::move(entries));
+        auto path = (directory_ / "lsm_run.XXXXXX").string();
+        auto const fd = ::mkstemp(path.data());
+        if (fd < 0)
+            throw std::system_error(errno, std::generic_category(), "lsm_btree: mkstemp in " + directory_.string());
+        try {
+            tree.save_image(fd);
+            ::close(fd);
+            run_tree_type mapped(path);
+            // the mapping keeps the file
+            ::unlink(path.c_str());
+            return std::make_shared<run const>(run{std::move(mapped), std::move(filter)});
+        } catch (...) {
+            ::close(fd);
+            ::unlink(path.c_str());
+            throw;
+        }
+    }
+}
+
+#endif //LSM_BTREE_H
@@ -0,0 +1,318 @@
+//
+// Created by arnoldm on 19.10.26.
+//
+
+#ifndef MAPPED_BTREE_H
+#define MAPPED_BTREE_H
+
+#include <algorithm>
+#include <cerrno>
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <filesystem>
+#include <iterator>
+#include <new>
+#include <span>
+#include <stdexcept>
+#include <string>
+#include <system_error>
+#include <tuple>
+#include <type_traits>
+#include <utility>
+#include <variant>
+#include <vector>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#include "btree.h"
+
+namespace bt {
+    /**
+     * A read-only btree of type Btree on a memory mapped image written by Btree::save_image(). The nodes are used
+     * in place: opening maps the file and checks the header only, pages are read by the first lookup touching
+     * them. Opening takes the same time for any size of the image, the file must not change while it is mapped.
+     *
+     * The image holds the nodes byte for byte, so it must have been written by the same Btree type built by the
+     * same compiler; the header rejects other key, value, index and node sizes and orders. verify() reads the
+     * whole image to compare its checksum. Without verify() a corrupt image is not trusted either: every node index
+     * followed, the kind of the node and its size are checked when the node is used, and a lookup or iteration
+     * which meets a bad one throws std::runtime_error instead of reading outside of the image.
+     */
+    template<typename Btree>
+    class mapped_btree {
+    public:
+        using btree_type = Btree;
+        using key_type = typename btree_type::key_type;
+        using value_type = typename btree_type::value_type;
+        using index_type = typename btree_type::index_type;
+        using common_node_type = typename btree_type::common_node_type;
+        using internal_node_type = typename btree_type::internal_node_type;
+        using leaf_node_type = typename btree_type::leaf_node_type;
+
+        static_assert(std::is_trivially_copyable_v<key_type> && std::is_trivially_copyable_v<value_type>,
+                      "a mapped image can only hold trivially copyable keys and values");
+
+        static constexpr index_type INVALID_INDEX = btree_type::INVALID_INDEX;
+
+        /**
+         * Iterates the entries in key order, like btree::const_iterator. *it is a pair of references into the image.
+         */
+        class const_iterator {
+        public:
+            using iterator_category = std::forward_iterator_tag;
+            using difference_type = std::ptrdiff_t;
+            using value_type = std::pair<key_type const &, typename mapped_btree::value_type const &>;
+
+            const_iterator() = default;
+
+            auto operator*() const -> value_type {
+                auto const &leaf = tree_->leaf_node(leaf_index_);
+                return {leaf.keys()[position_], leaf.values()[position_]};
+            }
+
+            auto operator++() -> const_iterator & {
+                auto const *p_leaf = &tree_->leaf_node(leaf_index_);
+                ++position_;
+                // empty leaves are skipped, end() is past the last entry of the last leaf
+                while (position_ >= p_leaf->size() && p_leaf->has_next_leaf_index()) {
+                    leaf_index_ = p_leaf->next_leaf_index();
+                    position_ = 0;
+                    p_leaf = &tree_->leaf_node(leaf_index_);
+                }
+                return *this;
+            }
+
+            auto operator++(int) -> const_iterator {
+                auto tmp = *this;
+                ++*this;
+                return tmp;
+            }
+
+            friend bool operator==(const_iterator const &lhs, const_iterator const &rhs) {
+                return std::tie(lhs.tree_, lhs.leaf_index_, lhs.position_) == std::tie(rhs.tree_, rhs.leaf_index_, rhs.position_);
+            }
+
+        private:
+            friend mapped_btree;
+
+            const_iterator(mapped_btree const *tree, index_type leaf_index, index_type position)
+                : tree_(tree), leaf_index_(leaf_index), position_(position) {}
+
+            mapped_btree const *tree_ = nullptr;
+            index_type leaf_index_ = INVALID_INDEX;
+            index_type position_ = 0;
+        };
+
+        using iterator = const_iterator;
+
+        /**
+         * @brief Map the image at path. Throws std::system_error if it cannot be opened or mapped and
+         * std::runtime_error if it is no image of Btree.
+         */
+        explicit mapped_btree(std::filesystem::path const &path);
+
+        ~mapped_btree() { unmap(); }
+
+        mapped_btree(mapped_btree const &) = delete;
+
+        mapped_btree & operator=(mapped_btree const &) = delete;
+
+        mapped_btree(mapped_btree &&other) noexcept
+            : p_image_(std::exchange(other.p_image_, nullptr)), image_size_(std::exchange(other.image_size_, 0)),
+              header_(other.header_), p_nodes_(std::exchange(other.p_nodes_, nullptr)) {}
+
+        mapped_btree & operator=(mapped_btree &&other) noexcept {
+            if (this == &other)
+                return *this;
+            unmap();
+            p_image_ = std::exchange(other.p_image_, nullptr);
+            image_size_ = std::exchange(other.image_size_, 0);
+            header_ = other.header_;
+            p_nodes_ = std::exchange(other.p_nodes_, nullptr);
+            return *this;
+        }
+
+        auto begin() const -> const_iterator;
+
+        auto end() const -> const_iterator {
+            auto const last = index_type(header_.last_leaf_index);
+            return {this, last, leaf_node(last).size()};
+        }
+
+        /**
+         * @return an iterator to the first entry with key, end() if there is none
+         */
+        auto find(key_type const &key) const -> const_iterator {
+            auto it = lower_bound(key);
+            return it != end() && (*it).first == key ? it : end();
+        }
+
+        /**
+         * @return an iterator to the first entry with a key not less than key, end() if there is none
+         */
+        auto lower_bound(key_type const &key) const -> const_iterator;
+
+        auto contains(key_type const &key) const -> bool { return find(key) != end(); }
+
+        [[nodiscard]] auto size() const noexcept -> std::size_t { return static_cast<std::size_t>(header_.entry_count); }
+
+        [[nodiscard]] auto empty() const noexcept -> bool { return size() == 0; }
+
+        [[nodiscard]] auto node_count() const noexcept -> std::size_t { return static_cast<std::size_t>(header_.node_count); }
+
+        /**
+         * @brief Read the whole image and compare its checksum
+         */
+        [[nodiscard]] auto verify() const -> bool;
+
+        /**
+         * @brief Pass advice for the whole image to madvise(), e.g. MADV_WILLNEED to read it ahead or MADV_RANDOM
+         * to read no pages around the ones touched
+         */
+        auto advise(int advice) const -> void {
+            if (::madvise(p_image_, image_size_, advice) != 0)
+                throw std::system_error(errno, std::generic_category(), "mapped_btree: madvise");
+        }
+
+    private:
+        static auto corrupt(char const *reason) -> std::runtime_error {
+            return std::runtime_error(std::string("mapped_btree: corrupt image, ") + reason);
+        }
+
+        auto node(index_type index) const -> common_node_type const & {
+            if (index >= header_.node_count)
+                throw corrupt("node index out of bounds");
+            return p_nodes_[index];
+        }
+
+        auto leaf_node(index_type index) const -> leaf_node_type const & {
+            auto const *p_leaf = std::get_if<leaf_node_type>(&node(index));
+            if (p_leaf == nullptr)
+                throw corrupt("no leaf node");
+            if (p_leaf->size() > leaf_node_type::order())
+                throw corrupt("leaf node overflows");
+            return *p_leaf;
+        }
+
+        /**
+         * @return the internal node at index, nullptr for a leaf
+         */
+        auto internal_node_if(index_type index) const -> internal_node_type const * {
+            auto const *p_internal = std::get_if<internal_node_type>(&node(index));
+            if (p_internal != nullptr && p_internal->size() > internal_node_type::order())
+                throw corrupt("internal node overflows");
+            return p_internal;
+        }
+
+        auto unmap() noexcept -> void {
+            if (p_image_ != nullptr)
+                ::munmap(p_image_, image_size_);
+            p_image_ = nullptr;
+        }
+
+        void *p_image_ = nullptr;
+        std::size_t image_size_ = 0;
+        btree_image_header header_{};
+        common_node_type const *p_nodes_ = nullptr;
+    };
+
+    template<typename Btree>
+    mapped_btree<Btree>::mapped_btree(std::filesystem::path const &path) {
+        auto const fd = ::open(path.c_str(), O_RDONLY | O_CLOEXEC);
+        if (fd < 0)
+            throw std::system_error(errno, std::generic_category(), "mapped_btree: open " + path.string());
+        struct stat status{};
+        if (::fstat(fd, &status) != 0) {
+            auto const error = errno;
+            ::close(fd);
+            throw std::system_error(error, std::generic_category(), "mapped_btree: fstat");
+        }
+        image_size_ = static_cast<std::size_t>(status.st_size);
+        if (image_size_ < btree_image_header::IMAGE_ALIGNMENT) {
+            ::close(fd);
+            throw std::runtime_error("mapped_btree: " + path.string() + " is no btree image");
+        }
+        p_image_ = ::mmap(nullptr, image_size_, PROT_READ, MAP_SHARED, fd, 0);
+        auto const error = errno;
+        // the mapping keeps the file open
+        ::close(fd);
+        if (p_image_ == MAP_FAILED) {
+            p_image_ = nullptr;
+            throw std::system_error(error, std::generic_category(), "mapped_btree: mmap");
+        }
+        std::memcpy(&header_, p_image_, sizeof(header_));
+        auto const invalid = [this, &path](char const *reason) {
+            unmap();
+            return std::runtime_error("mapped_btree: " + path.string() + ": " + reason);
+        };
+        if (!std::ranges::equal(header_.magic, btree_image_header::MAGIC))
+            throw invalid("no btree image");
+        if (header_.version != btree_image_header::VERSION)
+            throw invalid("unsupported image version");
+        if (header_.byte_order != btree_image_header::BYTE_ORDER_MARK)
+            throw invalid("written on a machine of other byte order");
+        if (header_.key_size != sizeof(key_type) || header_.value_size != sizeof(value_type)
+            || header_.index_size != sizeof(index_type) || header_.internal_order != internal_node_type::order()
+            || header_.leaf_order != leaf_node_type::order() || header_.node_size != sizeof(common_node_type))
+            throw invalid("written by a btree of other key, value or index size or order");
+        // the header page is there, the node count is compared by division, a corrupt one cannot overflow
+        auto const node_space = image_size_ - btree_image_header::IMAGE_ALIGNMENT;
+        if (header_.node_count == 0 || header_.root_index >= header_.node_count
+            || header_.first_leaf_index >= header_.node_count || header_.last_leaf_index >= header_.node_count
+            || node_space < sizeof(std::uint64_t)
+            || header_.node_count > (node_space - sizeof(std::uint64_t)) / sizeof(common_node_type))
+            throw invalid("image is truncated or corrupt");
+        // the nodes were written by save_image() as they are in memory, they are used as they are in the mapping
+        p_nodes_ = std::launder(reinterpret_cast<common_node_type const *>(
+            static_cast<std::byte const *>(p_image_) + btree_image_header::IMAGE_ALIGNMENT));
+    }
+
+    template<typename Btree>
+    auto mapped_btree<Btree>::begin() const -> const_iterator {
+        auto first = index_type(header_.first_leaf_index);
+        // skip empty leaves, like operator++
+        auto const *p_leaf = &leaf_node(first);
+        while (p_leaf->size() == 0 && p_leaf->has_next_leaf_index()) {
+            first = p_leaf->next_leaf_index();
+            p_leaf = &leaf_node(first);
+        }
+        return {this, first, 0};
+    }
+
+    template<typename Btree>
+    auto mapped_btree<Btree>::lower_bound(key_type const &key) const -> const_iterator {
+        // descends like btree::find_lower_bound
+        auto index = index_type(header_.root_index);
+        for (auto const *p_node = internal_node_if(index); p_node != nullptr; p_node = internal_node_if(index)) {
+            auto it = std::ranges::lower_bound(p_node->keys(), key);
+            auto dist = std::distance(p_node->keys().begin(), it);
+            if (it != p_node->keys().end() && *it == key)
+                ++dist;
+            index = p_node->child_indices()[static_cast<std::size_t>(dist)];
+        }
+        for (; index != INVALID_INDEX; index = leaf_node(index).next_leaf_index()) {
+            auto const &leaf = leaf_node(index);
+            auto it = std::ranges::lower_bound(leaf.keys(), key);
+            if (it != leaf.keys().end())
+                return {this, index, index_type(std::distance(leaf.keys().begin(), it))};
+        }
+        return end();
+    }
+
+    template<typename Btree>
+    auto mapped_btree<Btree>::verify() const -> bool {
+        auto const *p_bytes = static_cast<std::byte const *>(p_image_);
+        auto const count = static_cast<std::size_t>(header_.node_count);
+        std::vector<std::uint64_t> checksums(count);
+        for (std::size_t i = 0; i < count; ++i)
+            checksums[i] = btree_image_header::node_checksum(p_bytes + btree_image_header::IMAGE_ALIGNMENT + i * sizeof(common_node_type),
+                                                             sizeof(common_node_type));
+        std::uint64_t stored;
+        std::memcpy(&stored, p_bytes + btree_image_header::IMAGE_ALIGNMENT + count * sizeof(common_node_type), sizeof(stored));
+        return stored == btree_image_header::image_checksum({p_bytes, btree_image_header::IMAGE_ALIGNMENT}, checksums);
+    }
+}
+
+#endif //MAPPED_BTREE_H
@@ -0,0 +1,772 @@
+//
+// Created by arnoldm on 19.10.26.
+//
+
+#ifndef OLC_BTREE_H
+#define OLC_BTREE_H
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <limits>
+#include <memory>
+#include <mutex>
+#include <optional>
+#include <shared_mutex>
+#include <stdexcept>
+#include <thread>
+#include <type_traits>
+#include <vector>
+#include "btree.h"
+#include "stable_vector.h"
+
+#if defined(__SANITIZE_THREAD__)
+#define BT_HAS_TSAN 1
+#elif defined(__has_feature)
+#if __has_feature(thread_sanitizer)
+#define BT_HAS_TSAN 1
+#endif
+#endif
+
+#ifdef BT_HAS_TSAN
+// dynamic annotations of ThreadSanitizer
+extern "C" void AnnotateIgnoreReadsBegin(const char *file, int line);
+extern "C" void AnnotateIgnoreReadsEnd(const char *file, int line);
+#endif
+
+namespace bt {
+    /**
+     * Small dense ids for threads, given back when a thread ends. While MAX_THREADS other threads hold an id, a
+     * thread gets none, and asks again the next time.
+     */
+    class thread_slot {
+    public:
+        static constexpr std::size_t MAX_THREADS = 256;
+
+        /**
+         * @return the id of the calling thread, none if all ids are taken
+         */
+        static auto id() -> std::optional<std::size_t> {
+            thread_local registration r;
+            if (!r.id)
+                r.acquire();
+            return r.id;
+        }
+
+    private:
+        struct registration {
+            std::optional<std::size_t> id;
+
+            registration() { acquire(); }
+
+            ~registration() {
+                if (!id)
+                    return;
+                std::lock_guard lock(mutex());
+                free_ids().push_back(*id);
+            }
+
+            auto acquire() -> void {
+                std::lock_guard lock(mutex());
+                if (!free_ids().empty()) {
+                    id = free_ids().back();
+                    free_ids().pop_back();
+                } else if (next_id() < MAX_THREADS) {
+                    id = next_id()++;
+                }
+            }
+        };
+
+        static auto mutex() -> std::mutex & { static std::mutex m; return m; }
+        static auto free_ids() -> std::vector<std::size_t> & { static std::vector<std::size_t> ids; return ids; }
+        static auto next_id() -> std::size_t & { static std::size_t id = 0; return id; }
+    };
+
+    /**
+     * A btree for concurrent readers and writers with optimistic lock coupling: readers do not write any shared
+     * memory, so read throughput scales with the number of cores.
+     *
+     * Every node, internal or leaf, has a version word (bit 0: locked), which a writer locks while it changes the
+     * node and advances when it unlocks it. A reader remembers the version of a node, reads the child index to
+     * follow, remembers the version of the child and validates the version of the node before and after reading
+     * that of the child; at the leaf it reads the entry and validates the version of the leaf. Whenever a version
+     * changed, or a node is locked, the reader restarts from the root.
+     *
+     * Writers descend like readers and lock the leaf. If the leaf is safe, i.e. an insert does not split it and an
+     * erase neither lets it underflow nor changes its first key, they change it in place. Otherwise they descend
+     * again, locking the internal nodes on the way and unlocking the ancestors whenever a node is safe, like the
+     * latches of concurrent_btree. They then lock the internal nodes of the whole subtree of the lowest node which
+     * keeps its shape and holds the neighbours of the leaf, and the leaves the split or merge touches: the
+     * neighbours of the leaf, or all leaves of the subtree if internal nodes split or merge as well, which read
+     * the first keys of the subtrees they move. They split or merge holding only these locks, with nodes reserved
+     * beforehand. Writers in disjoint subtrees do not wait for each other, readers outside of the
+     * locked nodes do not notice them.
+     *
+     * Splits and merges which change the root, maintain() and growing the node storage hold a writer latch
+     * exclusively, which all other writers hold shared, and make the root version odd while they run. Readers
+     * validate the root version along with the versions of the nodes, so that these modifications need not lock
+     * every node they touch.
+     *
+     * Nodes never move (stable_storage). Deleted nodes are reused only when no reader which might still look at
+     * them is active: readers announce the epoch in which they started, a node deleted in epoch e is reused when
+     * all active readers started after e. Readers beyond thread_slot::MAX_THREADS, which have no slot to announce
+     * their epoch in, hold a latch shared instead, and no deleted node is handed out for reuse while one runs.
+     *
+     * With a deferred rebalance policy an erase which lets the leaf underflow is safe as well, as long as the leaf
+     * keeps an entry: the leaf is only remembered. Call maintain() to rebalance the remembered leaves.
+     *
+     * Readers read keys and values while a writer may change them (the result is discarded then), so keys and
+     * values have to be trivially copyable.
+     *
+     * The optimistic reads of node sizes, keys, values, child indices and the root index are plain loads racing
+     * with the writer, which is undefined behaviour by the C++ memory model. Like other optimistic lock coupling
+     * implementations this relies on the compiler not inventing values for racy loads of trivially copyable
+     * data, and on the version checks discarding whatever was read. Under ThreadSanitizer the optimistic reads
+     * are hidden from it (see optimistic_reads), so it still reports races between writers.
+     */
+    template<typename Key, typename Value, typename Index, size_t Internal_order, size_t Leaf_order,
+        typename Split_policy = midpoint_split, typename Rebalance_policy = rebalance_policy<>>
+    class olc_btree : protected btree<Key, Value, Index, Internal_order, Leaf_order, Split_policy, Rebalance_policy, stable_storage> {
+        static_assert(std::is_trivially_copyable_v<Key> && std::is_trivially_copyable_v<Value>,
+                      "olc_btree needs trivially copyable keys and values");
+    public:
+        using base_type = btree<Key, Value, Index, Internal_order, Leaf_order, Split_policy, Rebalance_policy, stable_storage>;
+        using typename base_type::traits;
+        using typename base_type::key_type;
+        using typename base_type::value_type;
+        using typename base_type::index_type;
+        using typename base_type::internal_node_type;
+        using typename base_type::leaf_node_type;
+        using typename base_type::iterator;
+        using base_type::INVALID_INDEX;
+
+        olc_btree() : reader_epochs_(std::make_unique<reader_epoch[]>(thread_slot::MAX_THREADS)) {
+            this->set_bookkeeping_latch(&bookkeeping_latch_);
+            this->set_deleted_node_indices(&deleted_);
+            grow_versions();
+        }
+
+        olc_btree(const olc_btree &) = delete;
+
+        olc_btree & operator=(const olc_btree &) = delete;
+
+        auto insert(key_type const &key, value_type const &value) -> bool;
+
+        /**
+         * @brief Erase the first entry with key
+         * @return the number of erased entries (0 or 1)
+         */
+        auto erase(key_type const &key) -> std::size_t;
+
+        /**
+         * @return a copy of the value of the first entry with key
+         */
+        auto find(key_type const &key) const -> std::optional<value_type>;
+
+        auto contains(key_type const &key) const -> bool { return find(key).has_value(); }
+
+        /**
+         * @brief Rebalance the nodes erases left underflowing (see rebalance_policy Deferred) under the exclusive
+         * writer latch, until budget is used up. Does at least one step. Unlike btree::maintain() it does not
+         * compact the node storage: that would free slots of nodes readers may still look at, deleted nodes are
+         * reused instead once no reader can see them.
+         * @return true if no work is left
+         */
+        auto maintain(std::chrono::nanoseconds budget) -> bool {
+            return exclusive_modification([this, budget] {
+                auto const deadline = std::chrono::steady_clock::now() + budget;
+                do {
+                    if (!this->rebalance_deferred_step())
+                        return true;
+                } while (std::chrono::steady_clock::now() < deadline);
+                return this->deferred_count() == 0;
+            });
+        }
+
+        /**
+         * @brief The tree without any synchronisation, e.g. for iterating after all writers finished
+         */
+        auto unsynchronized() -> base_type & { return *this; }
+        auto unsynchronized() const -> base_type const & { return *this; }
+
+    protected:
+        using version_type = std::uint64_t;
+        static constexpr version_type LOCKED = 1;
+        static constexpr std::uint64_t INACTIVE = std::numeric_limits<std::uint64_t>::max();
+        // the neighbours of the leaf a split or merge may touch: shifts and splits of two leaves into three use
+        // the previous one as well, merges the one after the next
+        static constexpr bool INSERTS_INTO_PREVIOUS = traits::split_policy::shift_to_siblings || traits::split_policy::split_two_to_three;
+
+        /**
+         * @brief The epoch a reader started in, on its own cache line
+         */
+        struct alignas(CACHE_LINE_SIZE) reader_epoch {
+            std::atomic<std::uint64_t> epoch{INACTIVE};
+        };
+
+        /**
+         * @brief Announces the current epoch for the calling thread while it reads, or holds the latch of the
+         * readers without a thread slot shared
+         */
+        class epoch_guard {
+        public:
+            explicit epoch_guard(olc_btree const &tree) {
+                if (auto slot = thread_slot::id()) {
+                    p_epoch_ = &tree.reader_epochs_[*slot].epoch;
+                    p_epoch_->store(tree.epoch_.load());
+                } else {
+                    unregistered_lock_ = std::shared_lock(tree.unregistered_readers_);
+                }
+            }
+            ~epoch_guard() {
+                if (p_epoch_ != nullptr)
+                    p_epoch_->store(INACTIVE, std::memory_order_release);
+            }
+            epoch_guard(epoch_guard const &) = delete;
+            epoch_guard & operator=(epoch_guard const &) = delete;
+        private:
+            std::atomic<std::uint64_t> *p_epoch_ = nullptr;
+            std::shared_lock<std::shared_mutex> unregistered_lock_;
+        };
+
+        /**
+         * @brief While it exists, ThreadSanitizer ignores the reads of the calling thread: optimistic reads race
+         * with writers by design and are validated afterwards
+         */
+        struct optimistic_reads {
+#ifdef BT_HAS_TSAN
+            optimistic_reads() { AnnotateIgnoreReadsBegin(__FILE__, __LINE__); }
+            ~optimistic_reads() { AnnotateIgnoreReadsEnd(__FILE__, __LINE__); }
+            optimistic_reads(optimistic_reads const &) = delete;
+            optimistic_reads & operator=(optimistic_reads const &) = delete;
+#endif
+        };
+
+        /**
+         * @brief The nodes a split or merge of a leaf may change, locked; they are unlocked with a new version when
+         * the region goes away
+         */
+        struct region {
+            explicit region(olc_btree &tree) : p_tree(&tree) {}
+            region(region const &) = delete;
+            region & operator=(region const &) = delete;
+            ~region() { unlock(); }
+
+            auto unlock() -> void {
+                for (auto [index, version] : locks)
+                    p_tree->unlock_node(index, version + 2);
+                locks.clear();
+            }
+
+            olc_btree *p_tree;
+            // from the topmost locked node down to the parent of the leaf
+            std::vector<index_type> path;
+            // position in path of the node whose whole subtree the split or merge may change
+            std::size_t subtree_root = 0;
+            // the locked nodes and their versions before locking
+            std::vector<std::pair<index_type, version_type>> locks;
+            index_type leaf_index = INVALID_INDEX;
+            bool inserting = false;
+        };
+
+        /**
+         * @brief Descend from the root to a leaf, validating the version of each node before and after reading the
+         * version of its child
+         * @param select_position returns the position of the child of an internal node to descend into
+         * @return the leaf and its version, or nothing if a writer interfered
+         */
+        template<typename Select_position>
+        auto optimistic_descend(Select_position const &select_position, version_type root_version) const
+            -> std::optional<std::pair<index_type, version_type>>;
+
+        /**
+         * @return true if the node still has version and the root version did not change
+         */
+        auto validate(index_type index, version_type version, version_type root_version) const -> bool {
+            std::atomic_thread_fence(std::memory_order_acquire);
+            return versions_[index].load(std::memory_order_relaxed) == version
+                   && root_version_.load(std::memory_order_relaxed) == root_version;
+        }
+
+        /**
+         * @brief Descend optimistically and lock the leaf, until both succeed; with the writer latch held shared
+         * @return the leaf and its version before locking
+         */
+        template<typename Select_position>
+        auto lock_leaf(Select_position const &select_position) -> std::pair<index_type, version_type>;
+
+        /**
+         * @brief Descend from the root locking the internal nodes, unlocking the ancestors of safe nodes (see the
+         * class description), and lock the leaf
+         * @return false if the split or merge may reach the root
+         */
+        template<typename Select_position>
+        auto lock_region(Select_position const &select_position, bool inserting, region &locked) -> bool;
+
+        /**
+         * @brief Lock the nodes below the subtree root of the region, level by level, and the leaves the split or
+         * merge may touch last
+         */
+        auto lock_subtree(region &locked) -> void;
+
+        /**
+         * @brief Position of the child to descend into to find the first entry with key, like btree::find_first
+         */
+        static auto find_position(internal_node_type const &node, key_type const &key) -> std::size_t;
+
+        /**
+         * @brief Position of the child to descend into to insert key, like btree::find_insert_position
+         */
+        static auto insert_position(internal_node_type const &node, key_type const &key) -> std::size_t;
+
+        /**
+         * @brief Spin until the version word of the node is locked by this thread
+         * @return the version before locking
+         */
+        auto lock_node(index_type index) -> version_type;
+
+        /**
+         * @brief Lock the version word of the node if it still has version
+         */
+        auto try_lock_node(index_type index, version_type version) -> bool;
+
+        auto unlock_node(index_type index, version_type version) -> void {
+            versions_[index].store(version, std::memory_order_release);
+        }
+
+        /**
+         * @brief Run modification, which may change the root, with the writer latch held exclusively
+         */
+        template<typename Modification>
+        auto exclusive_modification(Modification const &modification);
+
+        /**
+         * @brief Reserve count free nodes for the splits of one insert, reclaiming deleted nodes if needed
+         * @return false if there are not enough free nodes, see grow_storage()
+         */
+        auto reserve_nodes(std::size_t count) -> bool {
+            std::lock_guard bookkeeping_lock(bookkeeping_latch_);
+            if (this->free_node_indices().size() < reserved_nodes_ + count)
+                reclaim();
+            if (this->free_node_indices().size() < reserved_nodes_ + count)
+                return false;
+            reserved_nodes_ += count;
+            return true;
+        }
+
+        auto release_nodes(std::size_t count) -> void {
+            std::lock_guard bookkeeping_lock(bookkeeping_latch_);
+            reserved_nodes_ -= count;
+        }
+
+        /**
+         * @brief Provide at least count free nodes, and some more, under the exclusive writer latch
+         */
+        auto grow_storage(std::size_t count) -> void;
+
+        /**
+         * @brief Hand deleted nodes no active reader can see any more to the btree for reuse; with the bookkeeping
+         * latch held
+         */
+        auto reclaim() -> void;
+
+        /**
+         * @brief Keep the nodes deleted so far from reuse, start a new epoch
+         */
+        auto retire() -> void;
+
+        auto grow_versions() -> void {
+            while (versions_.size() < this->node_count())
+                versions_.emplace_back(version_type(0));
+        }
+
+    private:
+        // held shared by writers, exclusively by modifications which may change the root
+        std::shared_mutex writer_latch_;
+        // odd while a modification under the exclusive writer latch runs
+        std::atomic<version_type> root_version_{0};
+        stable_vector<std::atomic<version_type>> versions_;
+        // guards the free, deleted and deferred nodes of the tree, reserved_nodes_ and retired_
+        std::mutex bookkeeping_latch_;
+        // free nodes reserved by inserts which split
+        std::size_t reserved_nodes_ = 0;
+        // deleted nodes which readers may still look at, see btree::set_deleted_node_indices()
+        std::vector<index_type> deleted_;
+        std::atomic<std::uint64_t> epoch_{0};
+        std::unique_ptr<reader_epoch[]> reader_epochs_;
+        // held shared by readers without a thread slot
+        mutable std::shared_mutex unregistered_readers_;
+        std::vector<std::pair<index_type, std::uint64_t>> retired_;
+    };
+
+    template<typename Key, typename Value, typename Index, size_t Internal_order, size_t Leaf_order, typename Split_policy,
+        typename Rebalance_policy>
+    auto olc_btree<Key, Value, Index, Internal_order, Leaf_order, Split_policy, Rebalance_policy>::insert(key_type const &key,
+        value_type const &value) -> bool {
+        auto const select_position = [&key](internal_node_type const &node) { return insert_position(node, key); };
+        auto const leaf_position = [&key](leaf_node_type const &leaf) {
+            return index_type(std::distance(leaf.keys().begin(), std::ranges::upper_bound(leaf.keys(), key)));
+        };
+        epoch_guard guard(*this);
+        while (true) {
+            std::shared_lock writer_lock(writer_latch_);
+            auto [leaf_index, version] = lock_leaf(select_position);
+            leaf_node_type &leaf = this->leaf_node(leaf_index);
+            if (leaf.size() < leaf_node_type::order()) {
+                this->insert_leaf(iterator(*this, leaf_index, leaf_position(leaf)), key, value, false);
+                unlock_node(leaf_index, version + 2);
+                return true;
+            }
+            unlock_node(leaf_index, version);
+            // the leaf is full: lock the nodes its split may change
+            region locked(*this);
+            if (!lock_region(select_position, true, locked))
+                break;
+            leaf_node_type &locked_leaf = this->leaf_node(locked.leaf_index);
+            iterator const insert_pos(*this, locked.leaf_index, leaf_position(locked_leaf));
+            if (locked_leaf.size() < leaf_node_type::order())
+                return this->insert_leaf(insert_pos, key, value, false);
+            // one new node per locked level and one for the leaf
+            auto const count = locked.path.size() + 1;
+            if (!reserve_nodes(count)) {
+                locked.unlock();
+                writer_lock.unlock();
+                grow_storage(count);
+                continue;
+            }
+            lock_subtree(locked);
+            this->insert_leaf(insert_pos, key, value, true);
+            release_nodes(count);
+            return true;
+        }
+        // the split reaches the root
+        return exclusive_modification([this, &key, &value] { return base_type::insert(key, value); });
+    }
+
+    template<typename Key, typename Value, typename Index, size_t Internal_order, size_t Leaf_order, typename Split_policy,
+        typename Rebalance_policy>
+    auto olc_btree<Key, Value, Index, Internal_order, Leaf_order, Split_policy, Rebalance_policy>::erase(key_type const &key) -> std::size_t {
+        auto const select_position = [&key](internal_node_type const &node) { return find_position(node, key); };
+        {
+            epoch_guard guard(*this);
+            std::shared_lock writer_lock(writer_latch_);
+            auto [leaf_index, version] = lock_leaf(select_position);
+            leaf_node_type &leaf = this->leaf_node(leaf_index);
+            auto it = std::ranges::lower_bound(leaf.keys(), key);
+            if (it == leaf.keys().end() || key != *it) {
+                unlock_node(leaf_index, version);
+                return 0;
+            }
+            auto position = index_type(std::distance(leaf.keys().begin(), it));
+            bool safe = this->is_root(leaf_index)
+                        || (position != 0 && leaf.size() > traits::min_leaf_order)
+                        || (position != 0 && traits::deferred_rebalance && leaf.size() > 1);
+            if (safe) {
+                base_type::erase(iterator(*this, leaf_index, position));
+                unlock_node(leaf_index, version + 2);
+                return 1;
+            }
+            unlock_node(leaf_index, version);
+            // the leaf underflows or its first key changes: lock the nodes a merge or redistribution may change
+            region locked(*this);
+            if (lock_region(select_position, false, locked)) {
+                leaf_node_type &locked_leaf = this->leaf_node(locked.leaf_index);
+                auto locked_it = std::ranges::lower_bound(locked_leaf.keys(), key);
+                if (locked_it == locked_leaf.keys().end() || key != *locked_it)
+                    return 0;
+                lock_subtree(locked);
+                base_type::erase(iterator(*this, locked.leaf_index, index_type(std::distance(locked_leaf.keys().begin(), locked_it))));
+                locked.unlock();
+                retire();
+                return 1;
+            }
+        }
+        // rebalancing reaches the root
+        return exclusive_modification([this, &key] () -> std::size_t {
+            auto it = base_type::find(key);
+            if (it == base_type::end())
+                return 0;
+            base_type::erase(it);
+            return 1;
+        });
+    }
+
+    template<typename Key, typename Value, typename Index, size_t Internal_order, size_t Leaf_order, typename Split_policy,
+        typename Rebalance_policy>
+    auto olc_btree<Key, Value, Index, Internal_order, Leaf_order, Split_policy, Rebalance_policy>::find(key_type const &key) const -> std::optional<value_type> {
+        auto const select_position = [&key](internal_node_type const &node) { return find_position(node, key); };
+        epoch_guard guard(*this);
+        [[maybe_unused]] optimistic_reads reads;
+        while (true) {
+            auto root_version = root_version_.load(std::memory_order_acquire);
+            if (root_version & LOCKED) {
+                std::this_thread::yield();
+                continue;
+            }
+            auto leaf = optimistic_descend(select_position, root_version);
+            if (!leaf)
+                continue;
+            auto [leaf_index, version] = *leaf;
+            leaf_node_type const &leaf_node = *std::get_if<leaf_node_type>(&this->node(leaf_index));
+            std::optional<value_type> result;
+            auto it = std::ranges::lower_bound(leaf_node.keys(), key);
+            if (it != leaf_node.keys().end() && key == *it)
+                result = leaf_node.values().data()[std::distance(leaf_node.keys().begin(), it)];
+            if (validate(leaf_index, version, root_version))
+                return result;
+        }
+    }
+
+    template<typename Key, typename Value, typename Index, size_t Internal_order, size_t Leaf_order, typename Split_policy,
+        typename Rebalance_policy>
+    template<typename Select_position>
+    auto olc_btree<Key, Value, Index, Internal_order, Leaf_order, Split_policy, Rebalance_policy>::optimistic_descend(
+        Select_position const &select_position, version_type root_version) const -> std::optional<std::pair<index_type, version_type>> {
+        [[maybe_unused]] optimistic_reads reads;
+        index_type index = this->root_index();
+        std::atomic_thread_fence(std::memory_order_acquire);
+        if (root_version_.load(std::memory_order_relaxed) != root_version)
+            return std::nullopt;
+        auto version = versions_[index].load(std::memory_order_acquire);
+        if (version & LOCKED)
+            return std::nullopt;
+        for (auto const *p_node = std::get_if<internal_node_type>(&this->node(index));
+             p_node != nullptr;
+             p_node = std::get_if<internal_node_type>(&this->node(index))) {
+            // the node may change while it is read: no bounds checks, the child index is validated before it is used
+            auto child_index = p_node->child_indices().data()[select_position(*p_node)];
+            if (!validate(index, version, root_version))
+                return std::nullopt;
+            auto child_version = versions_[child_index].load(std::memory_order_acquire);
+            // the child may have changed before its version was read only if the node changed as well
+            if ((child_version & LOCKED) || !validate(index, version, root_version))
+                return std::nullopt;
+            index = child_index;
+            version = child_version;
+        }
+        return std::pair(index, version);
+    }
+
+    template<typename Key, typename Value, typename Index, size_t Internal_order, size_t Leaf_order, typename Split_policy,
+        typename Rebalance_policy>
+    template<typename Select_position>
+    auto olc_btree<Key, Value, Index, Internal_order, Leaf_order, Split_policy, Rebalance_policy>::lock_leaf(
+        Select_position const &select_position) -> std::pair<index_type, version_type> {
+        while (true) {
+            // the root version does not change while the writer latch is held shared
+            auto leaf = optimistic_descend(select_position, root_version_.load(std::memory_order_acquire));
+            if (leaf && try_lock_node(leaf->first, leaf->second))
+                return *leaf;
+            std::this_thread::yield();
+        }
+    }
+
+    template<typename Key, typename Value, typename Index, size_t Internal_order, size_t Leaf_order, typename Split_policy,
+        typename Rebalance_policy>
+    template<typename Select_position>
+    auto olc_btree<Key, Value, Index, Internal_order, Leaf_order, Split_policy, Rebalance_policy>::lock_region(
+        Select_position const &select_position, bool inserting, region &locked) -> bool {
+        locked.inserting = inserting;
+        std::optional<std::size_t> subtree_root;
+        // whether the locked node is the first or last one of its level: no leaf lies before or after its subtree
+        bool leftmost = true;
+        bool rightmost = true;
+        for (index_type index = this->root_index(); std::holds_alternative<internal_node_type>(this->node(index)); ) {
+            locked.locks.emplace_back(index, lock_node(index));
+            locked.path.push_back(index);
+            internal_node_type const &node = this->internal_node(index);
+            auto const size = std::size_t(node.size());
+            auto const position = select_position(node);
+            auto const child_index = node.child_indices()[position];
+            bool const parent_of_leaf = !std::holds_alternative<internal_node_type>(this->node(child_index));
+            bool const keeps_shape = inserting ? size < internal_node_type::order()
+                                     : this->is_root(index) ? size > 1
+                                     : size > traits::min_internal_order || (traits::deferred_rebalance && size > 1);
+            bool const holds_next = rightmost || position + (parent_of_leaf && !inserting ? 2 : 1) <= size;
+            bool const holds_previous = leftmost || position > 0 || (inserting && !INSERTS_INTO_PREVIOUS);
+            if (keeps_shape && holds_next && holds_previous) {
+                // an erase of the first entry of the leaf adjusts the keys of the ancestors it is the first descendant of
+                if (inserting || position > 0 || this->is_root(index)) {
+                    // the ancestors did not change
+                    for (auto it = locked.locks.begin(); it != locked.locks.end() - 1; ++it)
+                        unlock_node(it->first, it->second);
+                    locked.locks.erase(locked.locks.begin(), locked.locks.end() - 1);
+                    locked.path.erase(locked.path.begin(), locked.path.end() - 1);
+                }
+                subtree_root = locked.path.size() - 1;
+            }
+            leftmost = leftmost && position == 0;
+            rightmost = rightmost && position == size;
+            if (parent_of_leaf) {
+                locked.leaf_index = child_index;
+                locked.locks.emplace_back(child_index, lock_node(child_index));
+                break;
+            }
+            index = child_index;
+        }
+        locked.subtree_root = subtree_root.value_or(0);
+        return subtree_root.has_value();
+    }
+
+    template<typename Key, typename Value, typename Index, size_t Internal_order, size_t Leaf_order, typename Split_policy,
+        typename Rebalance_policy>
+    auto olc_btree<Key, Value, Index, Internal_order, Leaf_order, Split_policy, Rebalance_policy>::lock_subtree(region &locked) -> void {
+        // the nodes of the path and the leaf are locked already
+        std::vector<index_type> level{locked.path[locked.subtree_root]};
+        for (auto depth = locked.subtree_root; depth + 1 < locked.path.size(); ++depth) {
+            std::vector<index_type> children;
+            for (auto index : level) {
+                for (auto child_index : this->internal_node(index).child_indices()) {
+                    children.push_back(child_index);
+                    if (child_index != locked.path[depth + 1])
+                        locked.locks.emplace_back(child_index, lock_node(child_index));
+                }
+            }
+            level = std::move(children);
+        }
+        // readers and writers of single leaves do not lock the parents: lock the leaves as well
+        if (locked.subtree_root + 1 == locked.path.size()) {
+            // no internal node splits or merges: only the neighbours of the leaf change, and the leaf links do not
+            // change while the leaf is locked
+            leaf_node_type const &leaf = this->leaf_node(locked.leaf_index);
+            if (auto previous = leaf.previous_leaf_index(); previous != INVALID_INDEX && (!locked.inserting || INSERTS_INTO_PREVIOUS))
+                locked.locks.emplace_back(previous, lock_node(previous));
+            if (auto next = leaf.next_leaf_index(); next != INVALID_INDEX) {
+                locked.locks.emplace_back(next, lock_node(next));
+                if (auto after_next = this->leaf_node(next).next_leaf_index(); after_next != INVALID_INDEX && !locked.inserting)
+                    locked.locks.emplace_back(after_next, lock_node(after_next));
+            }
+            return;
+        }
+        // splits and merges of internal nodes read the first keys of subtrees below them
+        for (auto index : level) {
+            for (auto child_index : this->internal_node(index).child_indices()) {
+                if (child_index != locked.leaf_index)
+                    locked.locks.emplace_back(child_index, lock_node(child_index));
+            }
+        }
+    }
+
+    template<typename Key, typename Value, typename Index, size_t Internal_order, size_t Leaf_order, typename Split_policy,
+        typename Rebalance_policy>
+    auto olc_btree<Key, Value, Index, Internal_order, Leaf_order, Split_policy, Rebalance_policy>::find_position(internal_node_type const &node,
+        key_type const &key) -> std::size_t {
+        auto it = std::ranges::lower_bound(node.keys(), key);
+        auto position = std::size_t(std::distance(node.keys().begin(), it));
+        return it != node.keys().end() && *it == key ? position + 1 : position;
+    }
+
+    template<typename Key, typename Value, typename Index, size_t Internal_order, size_t Leaf_order, typename Split_policy,
+        typename Rebalance_policy>
+    auto olc_btree<Key, Value, Index, Internal_order, Leaf_order, Split_policy, Rebalance_policy>::insert_position(internal_node_type const &node,
+        key_type const &key) -> std::size_t {
+        return std::size_t(std::distance(node.keys().begin(), std::ranges::upper_bound(node.keys(), key)));
+    }
+
+    template<typename Key, typename Value, typename Index, size_t Internal_order, size_t Leaf_order, typename Split_policy,
+        typename Rebalance_policy>
+    auto olc_btree<Key, Value, Index, Internal_order, Leaf_order, Split_policy, Rebalance_policy>::lock_node(index_type index) -> version_type {
+        auto &version_word = versions_[index];
+        auto version = version_word.load(std::memory_order_relaxed);
+        while (true) {
+            if (version & LOCKED) {
+                std::this_thread::yield();
+                version = version_word.load(std::memory_order_relaxed);
+            } else if (version_word.compare_exchange_weak(version, version | LOCKED, std::memory_order_acquire)) {
+                // readers which see any change of the node see the lock as well
+                std::atomic_thread_fence(std::memory_order_release);
+                return version;
+            }
+        }
+    }
+
+    template<typename Key, typename Value, typename Index, size_t Internal_order, size_t Leaf_order, typename Split_policy,
+        typename Rebalance_policy>
+    auto olc_btree<Key, Value, Index, Internal_order, Leaf_order, Split_policy, Rebalance_policy>::try_lock_node(index_type index,
+        version_type version) -> bool {
+        if (!versions_[index].compare_exchange_strong(version, version | LOCKED, std::memory_order_acquire))
+            return false;
+        std::atomic_thread_fence(std::memory_order_release);
+        return true;
+    }
+
+    template<typename Key, typename Value, typename Index, size_t Internal_order, size_t Leaf_order, typename Split_policy,
+        typename Rebalance_policy>
+    template<typename Modification>
+    auto olc_btree<Key, Value, Index, Internal_order, Leaf_order, Split_policy, Rebalance_policy>::exclusive_modification(Modification const &modification) {
+        std::unique_lock writer_lock(writer_latch_);
+        {
+            std::lock_guard bookkeeping_lock(bookkeeping_latch_);
+            reclaim();
+        }
+        root_version_.fetch_add(1, std::memory_order_relaxed);
+        std::atomic_thread_fence(std::memory_order_release);
+        auto result = modification();
+        grow_versions();
+        root_version_.fetch_add(1, std::memory_order_release);
+        retire();
+        return result;
+    }
+
+    template<typename Key, typename Value, typename Index, size_t Internal_order, size_t Leaf_order, typename Split_policy,
+        typename Rebalance_policy>
+    auto olc_btree<Key, Value, Index, Internal_order, Leaf_order, Split_policy, Rebalance_policy>::grow_storage(std::size_t count) -> void {
+        std::unique_lock writer_lock(writer_latch_);
+        {
+            std::lock_guard bookkeeping_lock(bookkeeping_latch_);
+            reclaim();
+            if (this->free_node_indices().size() >= count)
+                return;
+        }
+        // create_leaf_node() takes the free nodes first; deleting in reverse hands out the lowest indices first again
+        std::vector<index_type> created;
+        while (created.size() < count + this->node_count() / 8)
+            created.push_back(this->create_leaf_node());
+        grow_versions();
+        for (auto it = created.rbegin(); it != created.rend(); ++it)
+            this->delete_node(*it);
+        // no reader has seen the new nodes: they are free right away
+        std::lock_guard bookkeeping_lock(bookkeeping_latch_);
+        auto &free_indices = this->free_node_indices();
+        auto const first_created = deleted_.end() - std::ptrdiff_t(created.size());
+        free_indices.insert(free_indices.end(), first_created, deleted_.end());
+        deleted_.erase(first_created, deleted_.end());
+    }
+
+    template<typename Key, typename Value, typename Index, size_t Internal_order, size_t Leaf_order, typename Split_policy,
+        typename Rebalance_policy>
+    auto olc_btree<Key, Value, Index, Internal_order, Leaf_order, Split_policy, Rebalance_policy>::reclaim() -> void {
+        if (retired_.empty())
+            return;
+        // readers without a thread slot announce no epoch: while one runs, nothing is reclaimed
+        std::unique_lock unregistered_lock(unregistered_readers_, std::try_to_lock);
+        if (!unregistered_lock)
+            return;
+        auto oldest = INACTIVE;
+        for (std::size_t i = 0; i < thread_slot::MAX_THREADS; ++i)
+            oldest = std::min(oldest, reader_epochs_[i].epoch.load());
+        auto &free_indices = this->free_node_indices();
+        std::erase_if(retired_, [oldest, &free_indices](auto const &retired) {
+            if (retired.second >= oldest)
+                return false;
+            free_indices.push_back(retired.first);
+            return true;
+        });
+    }
+
+    template<typename Key, typename Value, typename Index, size_t Internal_order, size_t Leaf_order, typename Split_policy,
+        typename Rebalance_policy>
+    auto olc_btree<Key, Value, Index, Internal_order, Leaf_order, Split_policy, Rebalance_policy>::retire() -> void {
+        std::lock_guard bookkeeping_lock(bookkeeping_latch_);
+        if (deleted_.empty())
+            return;
+        // the deleted nodes are unlinked already: readers which start in the new epoch cannot reach them
+        auto epoch = epoch_.fetch_add(1);
+        for (auto index : deleted_)
+            retired_.emplace_back(index, epoch);
+        deleted_.clear();
+    }
+}
+
+#endif //OLC_BTREE_H
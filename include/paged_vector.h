@@ -0,0 +1,519 @@
+//
+// Created by arnoldm on 19.10.26.
+//
+
+#ifndef PAGED_VECTOR_H
+#define PAGED_VECTOR_H
+
+#include <algorithm>
+#include <bit>
+#include <cassert>
+#include <cerrno>
+#include <compare>
+#include <cstddef>
+#include <cstdint>
+#include <filesystem>
+#include <initializer_list>
+#include <iterator>
+#include <limits>
+#include <memory>
+#include <new>
+#include <ranges>
+#include <stdexcept>
+#include <string>
+#include <system_error>
+#include <type_traits>
+#include <utility>
+#include <vector>
+#include <fcntl.h>
+#include <stdlib.h>
+#include <unistd.h>
+#include "async_io.h"
+
+namespace bt {
+    /**
+     * Counters of a paged_vector's buffer pool.
+     */
+    struct buffer_pool_stats {
+        std::size_t hits = 0;
+        std::size_t misses = 0;
+        std::size_t evictions = 0;
+        std::size_t writes = 0;
+        // pages read by prefetch(), a later access to them is a hit
+        std::size_t prefetches = 0;
+
+        [[nodiscard]] auto hit_rate() const noexcept -> double {
+            return hits + misses == 0 ? 1.0 : double(hits) / double(hits + misses);
+        }
+    };
+
+    /**
+    * Like a std::vector, but for more elements than fit into memory: every element occupies its own page of a
+    * multiple of Page_size bytes in an unlinked temporary page file (in std::filesystem::temp_directory_path(), set
+    * TMPDIR to choose the device). At most Frames pages are in memory, in the frames of a buffer pool.
+    *
+    * Accessing an element which is not in memory reads its page into a free frame or evicts a page chosen by the
+    * clock algorithm: a page accessed since the clock hand passed it last is skipped once. Non-const access marks
+    * the page dirty; dirty pages are written back when they are evicted, read via const access where possible.
+    * Elements are moved to and from the page file as bytes, so Value must not own memory outside itself (e.g. a
+    * btree node of trivially copyable keys and values); an evicted element is not destroyed.
+    *
+    * A reference returned by operator[] is only valid until the next access which reads a page: when every frame
+    * was accessed since the clock hand passed it, the hand clears them all and evicts the next frame which is not
+    * pinned, even the one accessed last. pin() keeps an element in memory until unpin(). Not thread safe, not even
+    * for concurrent readers: reading changes the pool.
+    *
+    * prefetch() reads many pages at once with an async_reader (io_uring where available). With Direct_io the page
+    * file bypasses the OS page cache (O_DIRECT, if the file system supports it), so the pool is the only cache.
+    */
+    template<typename Value, std::size_t Frames = 1 << 14, std::size_t Page_size = 4096, bool Direct_io = false>
+    requires (Frames >= 16 && std::has_single_bit(Page_size))
+    class paged_vector {
+    public:
+        typedef Value value_type;
+        typedef value_type *pointer;
+        typedef const value_type *const_pointer;
+        typedef value_type &reference;
+        typedef const value_type &const_reference;
+        typedef std::size_t size_type;
+        typedef std::ptrdiff_t difference_type;
+
+        static constexpr size_type PAGE_BYTES = (sizeof(Value) + Page_size - 1) / Page_size * Page_size;
+
+        template<bool Const>
+        class basic_iterator {
+        public:
+            using iterator_category = std::random_access_iterator_tag;
+            using value_type = Value;
+            using difference_type = std::ptrdiff_t;
+            using pointer = std::conditional_t<Const, const Value *, Value *>;
+            using reference = std::conditional_t<Const, const Value &, Value &>;
+            using container_type = std::conditional_t<Const, const paged_vector, paged_vector>;
+
+            basic_iterator() = default;
+            basic_iterator(container_type *container, size_type index) : container_(container), index_(index) {}
+            operator basic_iterator<true>() const { return basic_iterator<true>(container_, index_); }
+
+            reference operator*() const { return (*container_)[index_]; }
+            pointer operator->() const { return &(*container_)[index_]; }
+            reference operator[](difference_type n) const { return *(*this + n); }
+
+            basic_iterator &operator++() { ++index_; return *this; }
+            basic_iterator operator++(int) { auto tmp = *this; ++index_; return tmp; }
+            basic_iterator &operator--() { --index_; return *this; }
+            basic_iterator operator--(int) { auto tmp = *this; --index_; return tmp; }
+            basic_iterator &operator+=(difference_type n) { index_ = size_type(difference_type(index_) + n); return *this; }
+            basic_iterator &operator-=(difference_type n) { return *this += -n; }
+            friend basic_iterator operator+(basic_iterator it, difference_type n) { return it += n; }
+            friend basic_iterator operator+(difference_type n, basic_iterator it) { return it += n; }
+            friend basic_iterator operator-(basic_iterator it, difference_type n) { return it -= n; }
+            friend difference_type operator-(basic_iterator const &lhs, basic_iterator const &rhs) {
+                return difference_type(lhs.index_) - difference_type(rhs.index_);
+            }
+            friend bool operator==(basic_iterator const &lhs, basic_iterator const &rhs) { return lhs.index_ == rhs.index_; }
+            friend auto operator<=>(basic_iterator const &lhs, basic_iterator const &rhs) { return lhs.index_ <=> rhs.index_; }
+
+            [[nodiscard]] size_type index() const noexcept { return index_; }
+
+        private:
+            container_type *container_ = nullptr;
+            size_type index_ = 0;
+        };
+
+        typedef basic_iterator<false> iterator;
+        typedef basic_iterator<true> const_iterator;
+
+        paged_vector() = default;
+
+        paged_vector(const paged_vector &other) {
+            for (size_type i = 0; i < other.size(); ++i)
+                push_back(other[i]);
+        }
+
+        paged_vector(paged_vector &&other) noexcept {
+            steal(other);
+        }
+
+        paged_vector(std::initializer_list<value_type> init_list) {
+            for (auto const &value : init_list)
+                push_back(value);
+        }
+
+        ~paged_vector() noexcept {
+            release();
+        }
+
+        paged_vector & operator=(const paged_vector &other) {
+            if (this == &other)
+                return *this;
+            clear();
+            for (size_type i = 0; i < other.size(); ++i)
+                push_back(other[i]);
+            return *this;
+        }
+
+        paged_vector & operator=(paged_vector &&other) noexcept {
+            if (this == &other)
+                return *this;
+            release();
+            steal(other);
+            return *this;
+        }
+
+        //front
+        [[nodiscard]] reference front() { return (*this)[0]; }
+        [[nodiscard]] const_reference front() const { return (*this)[0]; }
+
+        //back
+        [[nodiscard]] reference back() { return (*this)[size() - 1]; }
+        [[nodiscard]] const_reference back() const { return (*this)[size() - 1]; }
+
+        //begin
+        [[nodiscard]] iterator begin() noexcept { return iterator(this, 0); }
+        [[nodiscard]] const_iterator begin() const noexcept { return const_iterator(this, 0); }
+        [[nodiscard]] const_iterator cbegin() const noexcept { return begin(); }
+
+        //end
+        [[nodiscard]] iterator end() noexcept { return iterator(this, size()); }
+        [[nodiscard]] const_iterator end() const noexcept { return const_iterator(this, size()); }
+        [[nodiscard]] const_iterator cend() const noexcept { return end(); }
+
+        //empty
+        [[nodiscard]] bool empty() const noexcept { return size() == 0; }
+
+        //size
+        [[nodiscard]] size_type size() const noexcept { return page_frames_.size(); }
+
+        [[nodiscard]] reference at(size_type index) {
+            if (index >= size())
+                throw std::out_of_range("index out of range");
+            return (*this)[index];
+        }
+        [[nodiscard]] const_reference at(size_type index) const {
+            if (index >= size())
+                throw std::out_of_range("index out of range");
+            return (*this)[index];
+        }
+
+        /**
+         * @brief The element at index, read into the pool if necessary; marks its page dirty
+         */
+        [[nodiscard]] reference operator[](size_type index) { return *element(fetch(index, true)); }
+
+        [[nodiscard]] const_reference operator[](size_type index) const { return *element(fetch(index, false)); }
+
+        /**
+         * @brief Nothing to reserve: the page file grows with the elements
+         */
+        void reserve(size_type) noexcept {}
+
+        /**
+         * @brief Append default constructed elements or erase elements at the end until size() == count
+         */
+        void resize(size_type count) {
+            while (size() > count)
+                pop_back();
+            while (size() < count)
+                emplace_back();
+        }
+
+        void push_back(const value_type &value) { emplace_back(value); }
+
+        void push_back(value_type &&value) { emplace_back(std::move(value)); }
+
+        template<typename... Args>
+        reference emplace_back(Args&&... args) {
+            if (size() >= NO_FRAME)
+                throw std::length_error("paged_vector: too many elements");
+            auto const frame = free_frame();
+            pointer p = std::construct_at(element(frame), std::forward<Args>(args)...);
+            frames_[frame].page = size();
+            frames_[frame].dirty = true;
+            frames_[frame].referenced = true;
+            page_frames_.push_back(frame);
+            return *p;
+        }
+
+        /**
+         * @brief Drop the last element; its page stays in the page file, for the next element appended
+         */
+        void pop_back() noexcept {
+            assert((!empty()) && "pop_back undefined if empty");
+            if (auto const frame = page_frames_.back(); frame != NO_FRAME) {
+                frames_[frame] = frame_type{std::move(frames_[frame].data)};
+                free_frames_.push_back(frame);
+            }
+            page_frames_.pop_back();
+        }
+
+        /**
+         * @brief Erase [first, last), last has to be end()
+         */
+        iterator erase(const_iterator first, const_iterator last) {
+            if (last != end())
+                throw std::invalid_argument("paged_vector can only erase at the end");
+            while (size() > first.index())
+                pop_back();
+            return end();
+        }
+
+        void clear() noexcept {
+            while (!empty())
+                pop_back();
+        }
+
+        /**
+         * @brief Keep the element at index in memory until a matching unpin(), e.g. to hold a reference to it
+         * across many other accesses. Throws std::runtime_error if every frame is pinned when a page is needed.
+         */
+        auto pin(size_type index) const -> const_reference {
+            auto const frame = fetch(index, false);
+            ++frames_[frame].pins;
+            return *element(frame);
+        }
+
+        auto unpin(size_type index) const noexcept -> void {
+            assert((page_frames_[index] != NO_FRAME && frames_[page_frames_[index]].pins > 0) && "unpin: not pinned");
+            --frames_[page_frames_[index]].pins;
+        }
+
+        /**
+         * @brief Read the pages of the elements at indices which are not in memory, with up to
+         * async_reader::DEFAULT_QUEUE_DEPTH reads in flight, instead of one after the other on access. A hint: reads
+         * at most Frames / 2 pages, so that they do not evict each other, and ignores indices out of range.
+         */
+        template<std::ranges::input_range Indices>
+        auto prefetch(Indices const &indices) const -> void {
+            // every page is in memory until the first one is written
+            if (fd_ < 0)
+                return;
+            if (!reader_)
+                reader_ = std::make_unique<async_reader>();
+            std::vector<read_completion> completions;
+            auto drain = [this, &completions](std::size_t min_count) {
+                completions.clear();
+                reader_->reap(completions, min_count);
+                for (auto const &completion : completions) {
+                    auto &frame = frames_[completion.tag];
+                    --frame.pins;
+                    // after a failed read the page is not in memory, an access reads it again and reports the error
+                    if (completion.result != std::int64_t(PAGE_BYTES)) {
+                        page_frames_[frame.page] = NO_FRAME;
+                        frame = frame_type{std::move(frame.data)};
+                        free_frames_.push_back(std::uint32_t(completion.tag));
+                    }
+                }
+            };
+            std::size_t budget = Frames / 2;
+            try {
+                for (auto index : indices) {
+                    auto const page = static_cast<size_type>(index);
+                    if (page >= size() || page_frames_[page] != NO_FRAME)
+                        continue;
+                    if (budget-- == 0)
+                        break;
+                    if (reader_->in_flight() == reader_->queue_depth())
+                        drain(1);
+                    // pinned while the read is in flight
+                    auto const frame = free_frame();
+                    frames_[frame].page = page;
+                    frames_[frame].pins = 1;
+                    frames_[frame].referenced = true;
+                    page_frames_[page] = frame;
+                    ++stats_.prefetches;
+                    reader_->read(fd_, frames_[frame].data.get(), PAGE_BYTES, page * PAGE_BYTES, frame);
+                }
+            } catch (...) {
+                drain(reader_->in_flight());
+                throw;
+            }
+            drain(reader_->in_flight());
+        }
+
+        /**
+         * @brief Write all dirty pages to the page file, they stay in memory
+         */
+        auto flush() const -> void {
+            for (auto &frame : frames_)
+                if (frame.page != NO_PAGE && frame.dirty)
+                    write_back(frame);
+        }
+
+        /**
+         * @return the number of elements in memory
+         */
+        [[nodiscard]] auto resident_count() const noexcept -> size_type { return frames_.size() - free_frames_.size(); }
+
+        [[nodiscard]] auto stats() const noexcept -> buffer_pool_stats const & { return stats_; }
+
+        auto reset_stats() const noexcept -> void { stats_ = {}; }
+
+    private:
+        static constexpr std::uint32_t NO_FRAME = std::numeric_limits<std::uint32_t>::max();
+        static constexpr size_type NO_PAGE = std::numeric_limits<size_type>::max();
+        static constexpr std::size_t FRAME_ALIGNMENT = std::max(Page_size, alignof(Value));
+
+        struct frame_deleter {
+            void operator()(std::byte *p) const noexcept { ::operator delete[](p, std::align_val_t(FRAME_ALIGNMENT)); }
+        };
+
+        struct frame_type {
+            std::unique_ptr<std::byte[], frame_deleter> data;
+            size_type page = NO_PAGE;
+            std::uint32_t pins = 0;
+            bool dirty = false;
+            bool referenced = false;
+        };
+
+        auto element(std::uint32_t frame) const noexcept -> pointer {
+            return std::launder(reinterpret_cast<pointer>(frames_[frame].data.get()));
+        }
+
+        auto fetch(size_type index, bool dirty) const -> std::uint32_t {
+            assert((index < size()) && "paged_vector: index out of bounds");
+            auto frame = page_frames_[index];
+            if (frame == NO_FRAME) {
+                ++stats_.misses;
+                frame = free_frame();
+                try {
+                    read_page(index, frames_[frame].data.get());
+                } catch (...) {
+                    // the frame holds no page, without giving it back every failed read would shrink the pool
+                    frames_[frame] = frame_type{std::move(frames_[frame].data)};
+                    free_frames_.push_back(frame);
+                    throw;
+                }
+                frames_[frame].page = index;
+                page_frames_[index] = frame;
+            } else {
+                ++stats_.hits;
+            }
+            frames_[frame].referenced = true;
+            frames_[frame].dirty |= dirty;
+            return frame;
+        }
+
+        /**
+         * @brief A frame holding no page: a new one while there are less than Frames, else the clock victim
+         */
+        auto free_frame() const -> std::uint32_t {
+            if (!free_frames_.empty()) {
+                auto const frame = free_frames_.back();
+                free_frames_.pop_back();
+                return frame;
+            }
+            if (frames_.size() < Frames) {
+                frames_.push_back(frame_type{std::unique_ptr<std::byte[], frame_deleter>(
+                    new (std::align_val_t(FRAME_ALIGNMENT)) std::byte[PAGE_BYTES])});
+                return std::uint32_t(frames_.size() - 1);
+            }
+            // two rounds: the first one may only clear referenced bits
+            for (std::size_t step = 0; step <= 2 * Frames; ++step) {
+                auto const frame = clock_hand_;
+                clock_hand_ = (clock_hand_ + 1) % std::uint32_t(Frames);
+                auto &candidate = frames_[frame];
+                if (candidate.pins > 0)
+                    continue;
+                if (candidate.referenced) {
+                    candidate.referenced = false;
+                    continue;
+                }
+                if (candidate.dirty)
+                    write_back(candidate);
+                page_frames_[candidate.page] = NO_FRAME;
+                candidate.page = NO_PAGE;
+                ++stats_.evictions;
+                return frame;
+            }
+            throw std::runtime_error("paged_vector: all frames are pinned");
+        }
+
+        auto write_back(frame_type &frame) const -> void {
+            open_file();
+            auto const *p = frame.data.get();
+            auto offset = static_cast<off_t>(frame.page * PAGE_BYTES);
+            for (size_type remaining = PAGE_BYTES; remaining > 0;) {
+                auto const written = ::pwrite(fd_, p, remaining, offset);
+                if (written < 0) {
+                    if (errno == EINTR)
+                        continue;
+                    throw std::system_error(errno, std::generic_category(), "paged_vector: pwrite");
+                }
+                p += written;
+                offset += written;
+                remaining -= static_cast<size_type>(written);
+            }
+            frame.dirty = false;
+            ++stats_.writes;
+        }
+
+        /**
+         * @brief Read page index, which is in the page file: pages are created in memory and written when evicted
+         */
+        auto read_page(size_type index, std::byte *p) const -> void {
+            auto offset = static_cast<off_t>(index * PAGE_BYTES);
+            for (size_type remaining = PAGE_BYTES; remaining > 0;) {
+                auto const n = ::pread(fd_, p, remaining, offset);
+                if (n <= 0) {
+                    if (n < 0 && errno == EINTR)
+                        continue;
+                    throw std::system_error(n < 0 ? errno : EIO, std::generic_category(), "paged_vector: pread");
+                }
+                p += n;
+                offset += n;
+                remaining -= static_cast<size_type>(n);
+            }
+        }
+
+        auto open_file() const -> void {
+            if (fd_ >= 0)
+                return;
+            auto path = (std::filesystem::temp_directory_path() / "bt_paged_vector.XXXXXX").string();
+            fd_ = ::mkstemp(path.data());
+            if (fd_ < 0)
+                throw std::system_error(errno, std::generic_category(), "paged_vector: mkstemp " + path);
+            // the file lives as long as it is open
+            ::unlink(path.c_str());
+#ifdef O_DIRECT
+            // the frames and pages are aligned to Page_size; without support for O_DIRECT the page cache stays
+            if constexpr (Direct_io)
+                ::fcntl(fd_, F_SETFL, ::fcntl(fd_, F_GETFL) | O_DIRECT);
+#endif
+        }
+
+        void release() noexcept {
+            frames_.clear();
+            free_frames_.clear();
+            page_frames_.clear();
+            clock_hand_ = 0;
+            reader_.reset();
+            if (fd_ >= 0)
+                ::close(fd_);
+            fd_ = -1;
+        }
+
+        void steal(paged_vector &other) noexcept {
+            frames_ = std::move(other.frames_);
+            free_frames_ = std::move(other.free_frames_);
+            page_frames_ = std::move(other.page_frames_);
+            clock_hand_ = std::exchange(other.clock_hand_, 0);
+            fd_ = std::exchange(other.fd_, -1);
+            reader_ = std::move(other.reader_);
+            stats_ = std::exchange(other.stats_, {});
+            other.release();
+        }
+
+        // the pool changes on every access, also on const access
+        mutable std::vector<frame_type> frames_;
+        mutable std::vector<std::uint32_t> free_frames_;
+        // the frame of every page or NO_FRAME
+        mutable std::vector<std::uint32_t> page_frames_;
+        mutable std::uint32_t clock_hand_ = 0;
+        mutable int fd_ = -1;
+        // created by the first prefetch()
+        mutable std::unique_ptr<async_reader> reader_;
+        mutable buffer_pool_stats stats_;
+    };
+}
+
+#endif //PAGED_VECTOR_H
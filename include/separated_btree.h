@@ -0,0 +1,163 @@
+//
+// Created by arnoldm on 19.10.26.
+//
+
+#ifndef SEPARATED_BTREE_H
+#define SEPARATED_BTREE_H
+
+#include <cstddef>
+#include <cstdint>
+#include <filesystem>
+#include <mutex>
+#include <optional>
+#include <shared_mutex>
+#include <span>
+#include <type_traits>
+#include <utility>
+#include <vector>
+#include "btree.h"
+#include "value_log.h"
+
+namespace bt {
+    /**
+     * A btree of type Btree with key-value separation: the tree maps every key to a value_handle, and the values,
+     * blobs of any length, are in a value_log in directory. Leaves stay small and splits, merges and rebalancing
+     * move handles only. Reads cost one pread() of the value after the lookup; find_handle() looks up without
+     * reading, for reading the value later, if at all.
+     *
+     * Keys are unique, insert() replaces the value of a key present. The old value becomes garbage in the log,
+     * collect_garbage() frees it. The log is the write-ahead log of the tree too: opening the directory replays it,
+     * so the tree lives in memory only. Inserts and erases are durable after sync().
+     *
+     * Thread safe; readers share a latch, writers and collect_garbage() hold it exclusively.
+     */
+    template<typename Btree>
+    class separated_btree {
+    public:
+        using btree_type = Btree;
+        using key_type = typename btree_type::key_type;
+        using log_type = value_log<key_type>;
+
+        static_assert(std::is_same_v<typename btree_type::value_type, value_handle>,
+                      "the tree of a separated_btree holds value_handle");
+
+        /**
+         * @brief Open or create the tree in directory, with log segments of about segment_size bytes
+         */
+        explicit separated_btree(std::filesystem::path const &directory,
+                                 std::size_t segment_size = log_type::DEFAULT_SEGMENT_SIZE)
+            : log_(directory, segment_size) {
+            log_.replay([this](key_type const &key, std::optional<value_handle> handle) { apply(key, handle); });
+        }
+
+        separated_btree(separated_btree const &) = delete;
+
+        separated_btree & operator=(separated_btree const &) = delete;
+
+        /**
+         * @brief Insert key with value, or replace the value of key
+         */
+        auto insert(key_type const &key, std::span<std::byte const> value) -> void {
+            std::unique_lock lock(latch_);
+            apply(key, log_.append(key, value));
+        }
+
+        /**
+         * @return the number of erased entries (0 or 1)
+         */
+        auto erase(key_type const &key) -> std::size_t {
+            std::unique_lock lock(latch_);
+            if (std::as_const(tree_).find(key) == tree_.cend())
+                return 0;
+            log_.append_erase(key);
+            apply(key, std::nullopt);
+            return 1;
+        }
+
+        /**
+         * @return a copy of the value of key
+         */
+        auto find(key_type const &key) const -> std::optional<std::vector<std::byte>> {
+            std::shared_lock lock(latch_);
+            auto it = tree_.find(key);
+            if (it == tree_.end())
+                return std::nullopt;
+            return log_.read((*it).second);
+        }
+
+        /**
+         * @return the handle of the value of key, valid until the next collect_garbage()
+         */
+        auto find_handle(key_type const &key) const -> std::optional<value_handle> {
+            std::shared_lock lock(latch_);
+            auto it = tree_.find(key);
+            if (it == tree_.end())
+                return std::nullopt;
+            return (*it).second;
+        }
+
+        auto contains(key_type const &key) const -> bool { return find_handle(key).has_value(); }
+
+        /**
+         * @brief The value of a handle of find_handle() or of the tree
+         */
+        auto read(value_handle handle) const -> std::vector<std::byte> { return log_.read(handle); }
+
+        /**
+         * @brief Collect the oldest segments of the log while at least min_garbage_ratio of the oldest is garbage,
+         * moving its live values to the end of the log. Collects each segment older than the newest one at most
+         * once, not the segments the moved values fill. Readers and writers wait meanwhile.
+         * @return the number of bytes freed
+         */
+        auto collect_garbage(double min_garbage_ratio = 0.5) -> std::uint64_t {
+            std::unique_lock lock(latch_);
+            std::uint64_t freed = 0;
+            for (auto count = log_.segment_count() - 1;
+                 count > 0 && log_.oldest_garbage_ratio() >= min_garbage_ratio; --count) {
+                freed += log_.collect_oldest(
+                    [this](key_type const &key, value_handle handle) {
+                        auto it = std::as_const(tree_).find(key);
+                        return it != tree_.cend() && (*it).second.offset == handle.offset;
+                    },
+                    [this](key_type const &key, value_handle, value_handle moved) { (*tree_.find(key)).second = moved; });
+            }
+            return freed;
+        }
+
+        /**
+         * @brief Make all inserts and erases so far durable
+         */
+        auto sync() -> void { log_.sync(); }
+
+        /**
+         * @brief The tree of handles, for phases without concurrent writers
+         */
+        [[nodiscard]] auto unsynchronized() const -> btree_type const & { return tree_; }
+
+        [[nodiscard]] auto log() const -> log_type const & { return log_; }
+
+    private:
+        /**
+         * @brief Point key to handle, or erase it without handle; the value replaced becomes garbage
+         */
+        auto apply(key_type const &key, std::optional<value_handle> handle) -> void {
+            auto it = tree_.find(key);
+            if (it == tree_.end()) {
+                if (handle)
+                    tree_.insert(key, *handle);
+                return;
+            }
+            log_.release((*it).second);
+            if (handle)
+                (*it).second = *handle;
+            else
+                tree_.erase(it);
+        }
+
+        mutable std::shared_mutex latch_;
+        btree_type tree_;
+        log_type log_;
+    };
+}
+
+#endif //SEPARATED_BTREE_H
@@ -0,0 +1,320 @@
+//
+// Created by arnoldm on 19.10.26.
+//
+
+#ifndef SHARDED_BTREE_H
+#define SHARDED_BTREE_H
+
+#include <algorithm>
+#include <atomic>
+#include <concepts>
+#include <deque>
+#include <limits>
+#include <mutex>
+#include <optional>
+#include <shared_mutex>
+#include <stdexcept>
+#include <utility>
+#include <vector>
+#include "btree.h"
+
+namespace bt {
+    /**
+     * A btree for concurrent writers which partitions the key space into ranges (shards), each a bt::btree with its
+     * own latch. Operations on different shards never wait for each other, so writes of uniformly distributed keys
+     * scale with the number of shards and cores.
+     *
+     * Shard i holds the keys in [boundaries[i - 1], boundaries[i]). Every operation holds the boundary latch shared
+     * while it routes the key and works on the shard. When a shard holds more than Skew_factor times the average
+     * number of entries, its entries and the ones of its neighbours are distributed evenly over them anew, with the
+     * boundary latch held exclusively. The window of neighbours grows until no shard in it is left with more than
+     * (Skew_factor + 1) / 2 times the average, so skewed inserts spread out over more and more shards.
+     *
+     * Iteration walks the shards in key order, through the leaf chain of one shard after the other. Iterators are
+     * not synchronised: iterate when no writer runs.
+     */
+    template<typename Key, typename Value, typename Index, size_t Internal_order, size_t Leaf_order,
+        typename Split_policy = midpoint_split, typename Rebalance_policy = rebalance_policy<>,
+        typename Storage_policy = vector_storage, std::size_t Skew_factor = 2>
+    class sharded_btree {
+    public:
+        static_assert(Skew_factor > 1, "Skew_factor has to be greater than 1");
+        using btree_type = btree<Key, Value, Index, Internal_order, Leaf_order, Split_policy, Rebalance_policy, Storage_policy>;
+        using key_type = typename btree_type::key_type;
+        using value_type = typename btree_type::value_type;
+        using shard_iterator = typename btree_type::const_iterator;
+
+        /**
+         * Walks the shards in key order
+         */
+        class const_iterator {
+        public:
+            const_iterator & operator++() {
+                ++it_;
+                skip_shard_ends();
+                return *this;
+            }
+
+            const_iterator operator++(int) {
+                const_iterator tmp = *this;
+                ++*this;
+                return tmp;
+            }
+
+            auto operator*() const { return *it_; }
+
+            friend bool operator==(const_iterator const &lhs, const_iterator const &rhs) {
+                return lhs.shard_ == rhs.shard_ && lhs.it_ == rhs.it_;
+            }
+
+        private:
+            friend sharded_btree;
+
+            const_iterator(sharded_btree const &tree, std::size_t shard, shard_iterator it)
+                : tree_(&tree), shard_(shard), it_(it) {
+                skip_shard_ends();
+            }
+
+            // the end of every shard but the last is the begin of the next shard
+            auto skip_shard_ends() -> void {
+                while (shard_ + 1 < tree_->shard_count() && it_ == tree_->shard(shard_).end())
+                    it_ = tree_->shard(++shard_).begin();
+            }
+
+            sharded_btree const *tree_ = nullptr;
+            std::size_t shard_ = 0;
+            shard_iterator it_;
+        };
+
+        using iterator = const_iterator;
+
+        /**
+         * @param boundaries the smallest key of every shard but the first, sorted: boundaries.size() + 1 shards
+         */
+        explicit sharded_btree(std::vector<key_type> boundaries)
+            : boundaries_(std::move(boundaries)),
+              shards_(boundaries_.size() + 1) {
+            if (!std::ranges::is_sorted(boundaries_))
+                throw std::invalid_argument("sharded_btree: boundaries have to be sorted");
+        }
+
+        /**
+         * @brief shard_count shards of equal key ranges over all values of Key
+         */
+        explicit sharded_btree(std::size_t shard_count) requires std::integral<Key>
+            : sharded_btree(even_boundaries(shard_count)) {
+        }
+
+        sharded_btree(const sharded_btree &) = delete;
+
+        sharded_btree & operator=(const sharded_btree &) = delete;
+
+        auto insert(key_type const &key, value_type const &value) -> bool;
+
+        /**
+         * @brief Erase the first entry with key
+         * @return the number of erased entries (0 or 1)
+         */
+        auto erase(key_type const &key) -> std::size_t;
+
+        /**
+         * @return a copy of the value of the first entry with key
+         */
+        auto find(key_type const &key) const -> std::optional<value_type>;
+
+        auto contains(key_type const &key) const -> bool { return find(key).has_value(); }
+
+        /**
+         * @return the number of entries, exact only if no writer runs
+         */
+        [[nodiscard]] auto size() const -> std::size_t;
+
+        [[nodiscard]] auto shard_count() const -> std::size_t { return shards_.size(); }
+
+        /**
+         * @return the number of entries of shard index, exact only if no writer runs
+         */
+        [[nodiscard]] auto shard_size(std::size_t index) const -> std::size_t {
+            return shards_[index].size.load(std::memory_order_relaxed);
+        }
+
+        /**
+         * @brief The tree of shard index without synchronisation
+         */
+        [[nodiscard]] auto shard(std::size_t index) const -> btree_type const & { return shards_[index].tree; }
+
+        [[nodiscard]] auto boundaries() const -> std::vector<key_type> {
+            std::shared_lock boundaries_lock(boundaries_latch_);
+            return boundaries_;
+        }
+
+        auto begin() const -> const_iterator { return const_iterator(*this, 0, shard(0).begin()); }
+        auto end() const -> const_iterator { return const_iterator(*this, shard_count() - 1, shard(shard_count() - 1).end()); }
+
+    protected:
+        using latch_type = std::shared_mutex;
+
+        // only rebalance shards with at least this many entries
+        static constexpr std::size_t MIN_REBALANCE_SIZE = 1024;
+        // check for skew every CHECK_INTERVAL inserts into a shard
+        static constexpr std::size_t CHECK_INTERVAL = 1024;
+
+        /**
+         * @brief A shard on its own cache lines, so that writers of neighbouring shards do not share one
+         */
+        struct alignas(CACHE_LINE_SIZE) shard_type {
+            mutable latch_type latch;
+            btree_type tree;
+            std::atomic<std::size_t> size = 0;
+        };
+
+        static auto even_boundaries(std::size_t shard_count) -> std::vector<key_type>;
+
+        /**
+         * @brief Index of the shard for key; with the boundary latch held
+         */
+        auto shard_of(key_type const &key) const -> std::size_t {
+            return static_cast<std::size_t>(std::distance(boundaries_.begin(), std::ranges::upper_bound(boundaries_, key)));
+        }
+
+        auto overloaded(std::size_t index) const -> bool {
+            auto shard_entries = shard_size(index);
+            return shard_entries >= MIN_REBALANCE_SIZE && shard_entries > Skew_factor * size() / shard_count();
+        }
+
+        /**
+         * @brief Distribute the entries of shard index and its neighbours evenly over them
+         */
+        auto rebalance(std::size_t index) -> void;
+
+    private:
+        mutable latch_type boundaries_latch_;
+        std::vector<key_type> boundaries_;
+        std::deque<shard_type> shards_;
+    };
+
+    template<typename Key, typename Value, typename Index, size_t Internal_order, size_t Leaf_order, typename Split_policy,
+        typename Rebalance_policy, typename Storage_policy, std::size_t Skew_factor>
+    auto sharded_btree<Key, Value, Index, Internal_order, Leaf_order, Split_policy, Rebalance_policy, Storage_policy, Skew_factor>::insert(
+        key_type const &key, value_type const &value) -> bool {
+        std::size_t index;
+        bool check;
+        {
+            std::shared_lock boundaries_lock(boundaries_latch_);
+            index = shard_of(key);
+            auto &shard = shards_[index];
+            std::unique_lock shard_lock(shard.latch);
+            if (!shard.tree.insert(key, value))
+                return false;
+            check = (shard.size.fetch_add(1, std::memory_order_relaxed) + 1) % CHECK_INTERVAL == 0;
+        }
+        if (check && overloaded(index))
+            rebalance(index);
+        return true;
+    }
+
+    template<typename Key, typename Value, typename Index, size_t Internal_order, size_t Leaf_order, typename Split_policy,
+        typename Rebalance_policy, typename Storage_policy, std::size_t Skew_factor>
+    auto sharded_btree<Key, Value, Index, Internal_order, Leaf_order, Split_policy, Rebalance_policy, Storage_policy, Skew_factor>::erase(
+        key_type const &key) -> std::size_t {
+        std::shared_lock boundaries_lock(boundaries_latch_);
+        auto &shard = shards_[shard_of(key)];
+        std::unique_lock shard_lock(shard.latch);
+        auto it = shard.tree.find(key);
+        if (it == shard.tree.end())
+            return 0;
+        shard.tree.erase(it);
+        shard.size.fetch_sub(1, std::memory_order_relaxed);
+        return 1;
+    }
+
+    template<typename Key, typename Value, typename Index, size_t Internal_order, size_t Leaf_order, typename Split_policy,
+        typename Rebalance_policy, typename Storage_policy, std::size_t Skew_factor>
+    auto sharded_btree<Key, Value, Index, Internal_order, Leaf_order, Split_policy, Rebalance_policy, Storage_policy, Skew_factor>::find(
+        key_type const &key) const -> std::optional<value_type> {
+        std::shared_lock boundaries_lock(boundaries_latch_);
+        auto const &shard = shards_[shard_of(key)];
+        std::shared_lock shard_lock(shard.latch);
+        auto it = shard.tree.find(key);
+        if (it == shard.tree.end())
+            return std::nullopt;
+        return (*it).second;
+    }
+
+    template<typename Key, typename Value, typename Index, size_t Internal_order, size_t Leaf_order, typename Split_policy,
+        typename Rebalance_policy, typename Storage_policy, std::size_t Skew_factor>
+    auto sharded_btree<Key, Value, Index, Internal_order, Leaf_order, Split_policy, Rebalance_policy, Storage_policy, Skew_factor>::size() const -> std::size_t {
+        std::size_t result = 0;
+        for (auto const &shard : shards_)
+            result += shard.size.load(std::memory_order_relaxed);
+        return result;
+    }
+
+    template<typename Key, typename Value, typename Index, size_t Internal_order, size_t Leaf_order, typename Split_policy,
+        typename Rebalance_policy, typename Storage_policy, std::size_t Skew_factor>
+    auto sharded_btree<Key, Value, Index, Internal_order, Leaf_order, Split_policy, Rebalance_policy, Storage_policy, Skew_factor>::even_boundaries(
+        std::size_t shard_count) -> std::vector<key_type> {
+        if (shard_count == 0)
+            throw std::invalid_argument("sharded_btree: at least one shard");
+        auto const lowest = static_cast<long double>(std::numeric_limits<key_type>::lowest());
+        auto const width = static_cast<long double>(std::numeric_limits<key_type>::max()) - lowest;
+        std::vector<key_type> result;
+        for (std::size_t i = 1; i < shard_count; ++i)
+            result.push_back(static_cast<key_type>(lowest + width * static_cast<long double>(i) / static_cast<long double>(shard_count)));
+        return result;
+    }
+
+    template<typename Key, typename Value, typename Index, size_t Internal_order, size_t Leaf_order, typename Split_policy,
+        typename Rebalance_policy, typename Storage_policy, std::size_t Skew_factor>
+    auto sharded_btree<Key, Value, Index, Internal_order, Leaf_order, Split_policy, Rebalance_policy, Storage_policy, Skew_factor>::rebalance(
+        std::size_t index) -> void {
+        std::unique_lock boundaries_lock(boundaries_latch_, std::try_to_lock);
+        // another writer rebalances already
+        if (!boundaries_lock.owns_lock() || !overloaded(index))
+            return;
+        // widen the window of shards around index, by the smaller neighbour first, until the entries of the
+        // window split evenly leave every shard well below the overload threshold
+        auto const target = (Skew_factor + 1) * size() / (2 * shard_count());
+        std::size_t first = index;
+        std::size_t last = index;
+        std::size_t window_size = shard_size(index);
+        while (window_size > (last - first + 1) * target && (first > 0 || last + 1 < shard_count())) {
+            if (last + 1 == shard_count() || (first > 0 && shard_size(first - 1) <= shard_size(last + 1)))
+                window_size += shard_size(--first);
+            else
+                window_size += shard_size(++last);
+        }
+        if (first == last)
+            return;
+
+        std::vector<std::pair<key_type, value_type>> entries;
+        entries.reserve(window_size);
+        for (auto i = first; i <= last; ++i)
+            for (auto const &[key, value] : shards_[i].tree)
+                entries.emplace_back(key, value);
+        auto const proj = &std::pair<key_type, value_type>::first;
+        auto const width = last - first + 1;
+        auto cut = entries.begin();
+        for (std::size_t i = 0; i < width; ++i) {
+            auto next = entries.end();
+            if (i + 1 < width) {
+                // equal keys stay in one shard
+                next = entries.begin() + static_cast<std::ptrdiff_t>((i + 1) * entries.size() / width);
+                if (next != entries.begin() && std::prev(next)->first == next->first) {
+                    auto after = std::ranges::upper_bound(next, entries.end(), next->first, {}, proj);
+                    next = after != entries.end() ? after : std::ranges::lower_bound(entries.begin(), next, next->first, {}, proj);
+                }
+                next = std::max(next, cut);
+                boundaries_[first + i] = next->first;
+            }
+            btree_type tree;
+            for (auto it = cut; it != next; ++it)
+                tree.insert(it->first, it->second);
+            shards_[first + i].tree = std::move(tree);
+            shards_[first + i].size.store(static_cast<std::size_t>(std::distance(cut, next)), std::memory_order_relaxed);
+            cut = next;
+        }
+    }
+}
+
+#endif //SHARDED_BTREE_H
@@ -0,0 +1,252 @@
+//
+// Created by arnoldm on 19.10.26.
+//
+
+#ifndef STABLE_VECTOR_H
+#define STABLE_VECTOR_H
+
+#include <array>
+#include <atomic>
+#include <bit>
+#include <cassert>
+#include <compare>
+#include <cstddef>
+#include <initializer_list>
+#include <iterator>
+#include <limits>
+#include <memory>
+#include <new>
+#include <stdexcept>
+#include <type_traits>
+#include <utility>
+
+namespace bt {
+    /**
+    * Like a std::vector, but elements never move: the elements live in chunks which double in size,
+    * a new chunk is added when the last one is full.
+    *
+    * Reading an element (operator[], size()) while another thread appends is safe: chunk pointers
+    * and the size are atomics. Erasing is only supported at the end.
+    */
+    template<typename Value, std::size_t First_chunk_size = 64>
+    requires (std::has_single_bit(First_chunk_size))
+    class stable_vector {
+    public:
+        typedef Value value_type;
+        typedef value_type *pointer;
+        typedef const value_type *const_pointer;
+        typedef value_type &reference;
+        typedef const value_type &const_reference;
+        typedef std::size_t size_type;
+        typedef std::ptrdiff_t difference_type;
+
+        template<bool Const>
+        class basic_iterator {
+        public:
+            using iterator_category = std::random_access_iterator_tag;
+            using value_type = Value;
+            using difference_type = std::ptrdiff_t;
+            using pointer = std::conditional_t<Const, const Value *, Value *>;
+            using reference = std::conditional_t<Const, const Value &, Value &>;
+            using container_type = std::conditional_t<Const, const stable_vector, stable_vector>;
+
+            basic_iterator() = default;
+            basic_iterator(container_type *container, size_type index) : container_(container), index_(index) {}
+            operator basic_iterator<true>() const { return basic_iterator<true>(container_, index_); }
+
+            reference operator*() const { return (*container_)[index_]; }
+            pointer operator->() const { return &(*container_)[index_]; }
+            reference operator[](difference_type n) const { return *(*this + n); }
+
+            basic_iterator &operator++() { ++index_; return *this; }
+            basic_iterator operator++(int) { auto tmp = *this; ++index_; return tmp; }
+            basic_iterator &operator--() { --index_; return *this; }
+            basic_iterator operator--(int) { auto tmp = *this; --index_; return tmp; }
+            basic_iterator &operator+=(difference_type n) { index_ = size_type(difference_type(index_) + n); return *this; }
+            basic_iterator &operator-=(difference_type n) { return *this += -n; }
+            friend basic_iterator operator+(basic_iterator it, difference_type n) { return it += n; }
+            friend basic_iterator operator+(difference_type n, basic_iterator it) { return it += n; }
+            friend basic_iterator operator-(basic_iterator it, difference_type n) { return it -= n; }
+            friend difference_type operator-(basic_iterator const &lhs, basic_iterator const &rhs) {
+                return difference_type(lhs.index_) - difference_type(rhs.index_);
+            }
+            friend bool operator==(basic_iterator const &lhs, basic_iterator const &rhs) { return lhs.index_ == rhs.index_; }
+            friend auto operator<=>(basic_iterator const &lhs, basic_iterator const &rhs) { return lhs.index_ <=> rhs.index_; }
+
+            [[nodiscard]] size_type index() const noexcept { return index_; }
+
+        private:
+            container_type *container_ = nullptr;
+            size_type index_ = 0;
+        };
+
+        typedef basic_iterator<false> iterator;
+        typedef basic_iterator<true> const_iterator;
+
+        stable_vector() = default;
+
+        stable_vector(const stable_vector &other) {
+            for (auto const &e : other)
+                push_back(e);
+        }
+
+        stable_vector(stable_vector &&other) noexcept {
+            steal(other);
+        }
+
+        stable_vector(std::initializer_list<value_type> init_list) {
+            for (auto const &value : init_list)
+                push_back(value);
+        }
+
+        ~stable_vector() noexcept {
+            release();
+        }
+
+        stable_vector & operator=(const stable_vector &other) {
+            if (this == &other)
+                return *this;
+            clear();
+            for (auto const &value : other)
+                push_back(value);
+            return *this;
+        }
+
+        stable_vector & operator=(stable_vector &&other) noexcept {
+            if (this == &other)
+                return *this;
+            release();
+            steal(other);
+            return *this;
+        }
+
+        //front
+        [[nodiscard]] reference front() noexcept { return (*this)[0]; }
+        [[nodiscard]] const_reference front() const noexcept { return (*this)[0]; }
+
+        //back
+        [[nodiscard]] reference back() noexcept { return (*this)[size() - 1]; }
+        [[nodiscard]] const_reference back() const noexcept { return (*this)[size() - 1]; }
+
+        //begin
+        [[nodiscard]] iterator begin() noexcept { return iterator(this, 0); }
+        [[nodiscard]] const_iterator begin() const noexcept { return const_iterator(this, 0); }
+        [[nodiscard]] const_iterator cbegin() const noexcept { return begin(); }
+
+        //end
+        [[nodiscard]] iterator end() noexcept { return iterator(this, size()); }
+        [[nodiscard]] const_iterator end() const noexcept { return const_iterator(this, size()); }
+        [[nodiscard]] const_iterator cend() const noexcept { return end(); }
+
+        //empty
+        [[nodiscard]] bool empty() const noexcept { return size() == 0; }
+
+        //size
+        [[nodiscard]] size_type size() const noexcept { return size_.load(std::memory_order_acquire); }
+
+        [[nodiscard]] reference at(size_type index) {
+            if (index >= size())
+                throw std::out_of_range("index out of range");
+            return (*this)[index];
+        }
+        [[nodiscard]] const_reference at(size_type index) const {
+            if (index >= size())
+                throw std::out_of_range("index out of range");
+            return (*this)[index];
+        }
+        [[nodiscard]] reference operator[](size_type index) noexcept {
+            auto [chunk, offset] = locate(index);
+            return chunks_[chunk].load(std::memory_order_acquire)[offset];
+        }
+        [[nodiscard]] const_reference operator[](size_type index) const noexcept {
+            auto [chunk, offset] = locate(index);
+            return chunks_[chunk].load(std::memory_order_acquire)[offset];
+        }
+
+        /**
+         * @brief Nothing to reserve: elements never move
+         */
+        void reserve(size_type) noexcept {}
+
+        /**
+         * @brief Append default constructed elements or erase elements at the end until size() == count
+         */
+        void resize(size_type count) {
+            while (size() > count)
+                pop_back();
+            while (size() < count)
+                emplace_back();
+        }
+
+        void push_back(const value_type &value) { emplace_back(value); }
+
+        void push_back(value_type &&value) { emplace_back(std::move(value)); }
+
+        template<typename... Args>
+        reference emplace_back(Args&&... args) {
+            auto const index = size_.load(std::memory_order_relaxed);
+            auto [chunk, offset] = locate(index);
+            pointer p_chunk = chunks_[chunk].load(std::memory_order_relaxed);
+            if (p_chunk == nullptr) {
+                p_chunk = static_cast<pointer>(::operator new(chunk_size(chunk) * sizeof(value_type), std::align_val_t(alignof(value_type))));
+                chunks_[chunk].store(p_chunk, std::memory_order_release);
+            }
+            pointer p = std::construct_at(p_chunk + offset, std::forward<Args>(args)...);
+            size_.store(index + 1, std::memory_order_release);
+            return *p;
+        }
+
+        void pop_back() noexcept {
+            assert((!empty()) && "pop_back undefined if empty");
+            auto const index = size() - 1;
+            std::destroy_at(&(*this)[index]);
+            size_.store(index, std::memory_order_release);
+        }
+
+        /**
+         * @brief Erase [first, last), last has to be end()
+         */
+        iterator erase(const_iterator first, const_iterator last) {
+            if (last != end())
+                throw std::invalid_argument("stable_vector can only erase at the end");
+            while (size() > first.index())
+                pop_back();
+            return end();
+        }
+
+        void clear() noexcept {
+            while (!empty())
+                pop_back();
+        }
+
+    private:
+        static constexpr std::size_t MAX_CHUNKS = std::numeric_limits<size_type>::digits - std::countr_zero(First_chunk_size);
+
+        static constexpr size_type chunk_size(size_type chunk) noexcept { return First_chunk_size << chunk; }
+
+        // chunk k holds the elements [First_chunk_size * (2^k - 1), First_chunk_size * (2^(k+1) - 1))
+        static constexpr auto locate(size_type index) noexcept -> std::pair<size_type, size_type> {
+            auto const chunk = size_type(std::bit_width(index / First_chunk_size + 1) - 1);
+            return {chunk, index - First_chunk_size * ((size_type(1) << chunk) - 1)};
+        }
+
+        void release() noexcept {
+            clear();
+            for (auto &chunk : chunks_) {
+                if (auto p = chunk.exchange(nullptr, std::memory_order_relaxed))
+                    ::operator delete(p, std::align_val_t(alignof(value_type)));
+            }
+        }
+
+        void steal(stable_vector &other) noexcept {
+            for (std::size_t i = 0; i < MAX_CHUNKS; ++i)
+                chunks_[i].store(other.chunks_[i].exchange(nullptr, std::memory_order_relaxed), std::memory_order_relaxed);
+            size_.store(other.size_.exchange(0, std::memory_order_relaxed), std::memory_order_release);
+        }
+
+        std::array<std::atomic<pointer>, MAX_CHUNKS> chunks_{};
+        std::atomic<size_type> size_ = 0;
+    };
+}
+
+#endif //STABLE_VECTOR_H
@@ -0,0 +1,229 @@
+//
+// Created by arnoldm on 19.10.26.
+//
+
+#ifndef THREAD_POOL_H
+#define THREAD_POOL_H
+
+#include <algorithm>
+#include <atomic>
+#include <concepts>
+#include <condition_variable>
+#include <cstddef>
+#include <deque>
+#include <exception>
+#include <functional>
+#include <future>
+#include <iterator>
+#include <memory>
+#include <optional>
+#include <mutex>
+#include <thread>
+#include <type_traits>
+#include <utility>
+#include <vector>
+
+namespace bt {
+    /**
+     * A fixed number of worker threads which run submitted tasks in submission order.
+     */
+    class thread_pool {
+    public:
+        explicit thread_pool(std::size_t thread_count = std::max(1U, std::thread::hardware_concurrency())) {
+            for (std::size_t i = 0; i < std::max<std::size_t>(thread_count, 1); ++i)
+                workers_.emplace_back([this] { work(); });
+        }
+
+        /**
+         * @brief Runs the tasks still queued, then joins the workers
+         */
+        ~thread_pool() {
+            {
+                std::lock_guard lock(mutex_);
+                stop_ = true;
+            }
+            condition_.notify_all();
+            for (auto &worker : workers_)
+                worker.join();
+        }
+
+        thread_pool(const thread_pool &) = delete;
+
+        thread_pool & operator=(const thread_pool &) = delete;
+
+        [[nodiscard]] auto size() const noexcept -> std::size_t { return workers_.size(); }
+
+        template<typename Function>
+        auto submit(Function &&function) -> std::future<std::invoke_result_t<std::decay_t<Function>>> {
+            using result_type = std::invoke_result_t<std::decay_t<Function>>;
+            // std::function needs a copyable target
+            auto task = std::make_shared<std::packaged_task<result_type()>>(std::forward<Function>(function));
+            auto result = task->get_future();
+            {
+                std::lock_guard lock(mutex_);
+                tasks_.emplace_back([task] { (*task)(); });
+            }
+            condition_.notify_one();
+            return result;
+        }
+
+        /**
+         * @brief Call function(first, last) for size() blocks of about equal length covering [0, count) on the
+         * workers and wait for all of them. Rethrows the first exception of a block.
+         *
+         * Must not be called by a task of this pool: the task would wait for blocks queued behind it.
+         */
+        template<typename Function>
+        void parallel_for(std::size_t count, Function const &function) {
+            auto const blocks = std::min(count, size());
+            std::vector<std::future<void>> results;
+            for (std::size_t block = 0; block < blocks; ++block) {
+                results.push_back(submit([&function, first = block * count / blocks, last = (block + 1) * count / blocks] {
+                    function(first, last);
+                }));
+            }
+            for (auto &result : results)
+                result.wait();
+            for (auto &result : results)
+                result.get();
+        }
+
+    private:
+        void work() {
+            while (true) {
+                std::function<void()> task;
+                {
+                    std::unique_lock lock(mutex_);
+                    condition_.wait(lock, [this] { return stop_ || !tasks_.empty(); });
+                    if (tasks_.empty())
+                        return;
+                    task = std::move(tasks_.front());
+                    tasks_.pop_front();
+                }
+                task();
+            }
+        }
+
+        std::mutex mutex_;
+        std::condition_variable condition_;
+        std::deque<std::function<void()>> tasks_;
+        bool stop_ = false;
+        std::vector<std::thread> workers_;
+    };
+
+    /**
+     * @brief std::stable_sort of [first, last) on the threads of pool: every thread sorts a block, then neighbouring
+     * blocks are merged in parallel rounds.
+     */
+    template<std::random_access_iterator Iterator, typename Compare = std::less<>>
+    void parallel_stable_sort(Iterator first, Iterator last, thread_pool &pool, Compare comp = {}) {
+        static constexpr std::size_t MIN_BLOCK_SIZE = 1 << 14;
+        auto const count = static_cast<std::size_t>(std::distance(first, last));
+        auto const blocks = std::min(pool.size(), count / MIN_BLOCK_SIZE);
+        if (blocks <= 1) {
+            std::stable_sort(first, last, comp);
+            return;
+        }
+        std::vector<Iterator> bounds;
+        for (std::size_t block = 0; block <= blocks; ++block)
+            bounds.push_back(first + static_cast<std::ptrdiff_t>(block * count / blocks));
+        pool.parallel_for(blocks, [&bounds, &comp](std::size_t first_block, std::size_t last_block) {
+            for (auto block = first_block; block < last_block; ++block)
+                std::stable_sort(bounds[block], bounds[block + 1], comp);
+        });
+        // merge pairs of neighbouring blocks until one block is left
+        while (bounds.size() > 2) {
+            std::size_t const pairs = (bounds.size() - 1) / 2;
+            pool.parallel_for(pairs, [&bounds, &comp](std::size_t first_pair, std::size_t last_pair) {
+                for (auto pair = first_pair; pair < last_pair; ++pair)
+                    std::inplace_merge(bounds[2 * pair], bounds[2 * pair + 1], bounds[2 * pair + 2], comp);
+            });
+            std::vector<Iterator> merged;
+            for (std::size_t i = 0; i < bounds.size(); i += 2)
+                merged.push_back(bounds[i]);
+            if (merged.back() != bounds.back())
+                merged.push_back(bounds.back());
+            bounds = std::move(merged);
+        }
+    }
+    /**
+     * A range which can be split into two disjoint halves, like a subtree into groups of its children.
+     */
+    template<typename Range>
+    concept splittable_range = std::copy_constructible<Range> && requires(Range const &range)
+    {
+        { range.is_divisible() } -> std::convertible_to<bool>;
+        { range.split() } -> std::same_as<std::pair<Range, Range>>;
+    };
+
+    /**
+     * @brief Call function(part) for every indivisible part of range on the threads of pool, with work stealing.
+     *
+     * Every thread has a deque of ranges. It takes the range pushed last, splits it until it is no longer divisible,
+     * pushing every right half, and processes the rest. An idle thread steals the range pushed first (the biggest
+     * one) of another thread, so the threads share the work however unevenly range splits. Rethrows the first
+     * exception of function once all threads have stopped. Must not be called by a task of pool.
+     */
+    template<splittable_range Range, typename Function>
+    void work_stealing_for_each(Range range, thread_pool &pool, Function const &function) {
+        struct alignas(64) range_deque {
+            std::mutex mutex;
+            std::deque<Range> ranges;
+        };
+        std::vector<range_deque> deques(pool.size());
+        // ranges pushed but not processed yet; 0 ends the workers
+        std::atomic<std::size_t> pending{1};
+        std::atomic<bool> failed{false};
+        std::exception_ptr error;
+        deques.front().ranges.push_back(std::move(range));
+
+        auto take = [&deques](std::size_t thread) -> std::optional<Range> {
+            for (std::size_t i = 0; i < deques.size(); ++i) {
+                auto &victim = deques[(thread + i) % deques.size()];
+                std::lock_guard lock(victim.mutex);
+                if (victim.ranges.empty())
+                    continue;
+                // the own deque LIFO for locality, other ones FIFO for big pieces
+                Range taken = i == 0 ? std::move(victim.ranges.back()) : std::move(victim.ranges.front());
+                if (i == 0)
+                    victim.ranges.pop_back();
+                else
+                    victim.ranges.pop_front();
+                return taken;
+            }
+            return std::nullopt;
+        };
+
+        pool.parallel_for(deques.size(), [&](std::size_t first_thread, std::size_t last_thread) {
+            for (auto thread = first_thread; thread < last_thread; ++thread) {
+                while (pending.load(std::memory_order_acquire) > 0 && !failed.load(std::memory_order_relaxed)) {
+                    auto part = take(thread);
+                    if (!part) {
+                        std::this_thread::yield();
+                        continue;
+                    }
+                    try {
+                        while (part->is_divisible()) {
+                            auto [left, right] = part->split();
+                            pending.fetch_add(1, std::memory_order_relaxed);
+                            {
+                                std::lock_guard lock(deques[thread].mutex);
+                                deques[thread].ranges.push_back(std::move(right));
+                            }
+                            part.emplace(std::move(left));
+                        }
+                        function(*part);
+                    } catch (...) {
+                        if (!failed.exchange(true))
+                            error = std::current_exception();
+                    }
+                    pending.fetch_sub(1, std::memory_order_release);
+                }
+            }
+        });
+        if (error)
+            std::rethrow_exception(error);
+    }
+}
+
+#endif //THREAD_POOL_H
@@ -0,0 +1,469 @@
+//
+// Created by arnoldm on 19.10.26.
+//
+
+#ifndef VALUE_LOG_H
+#define VALUE_LOG_H
+
+#include <algorithm>
+#include <cerrno>
+#include <charconv>
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <deque>
+#include <filesystem>
+#include <memory>
+#include <mutex>
+#include <optional>
+#include <span>
+#include <stdexcept>
+#include <string>
+#include <string_view>
+#include <system_error>
+#include <type_traits>
+#include <utility>
+#include <vector>
+#include <fcntl.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#include "binary_io.h"
+
+namespace bt {
+    /**
+     * Where a value_log keeps a value: the record at offset, the segment number in the upper 32 bits and the
+     * position in the segment file in the lower ones, and the length of the value. A tree of handles moves 16
+     * bytes per value on splits and merges, whatever the size of the values.
+     */
+    struct value_handle {
+        std::uint64_t offset;
+        std::uint32_t length;
+    };
+
+    /**
+     * An append-only log of values of any length, for a tree which keeps only value_handle (see separated_btree).
+     * The log is a directory of segment files: values are appended to the newest segment, a new one is started
+     * when it is full, and garbage collection rewrites the live values of the oldest segment at the end and
+     * deletes it, as in WiscKey.
+     *
+     * A record is a record_header, with the key and the checksum of key and value, and the value. Erases append a
+     * record without value, so replaying the log from the oldest segment rebuilds the tree: the log is the write
+     * ahead log of the tree, too. Collecting only the oldest segment keeps that true, an erase record is dropped
+     * only with the records it hides. Opening drops an incomplete record at the end of the newest segment. Full
+     * segments are synced before the next one is started, sync() syncs the newest one.
+     *
+     * Key must be trivially copyable. Thread safe; a read of a segment which collect_oldest() deletes meanwhile
+     * completes, later reads of its handles throw.
+     */
+    template<typename Key>
+    class value_log {
+        static_assert(std::is_trivially_copyable_v<Key>, "the log holds keys as bytes, they must be trivially copyable");
+    public:
+        using key_type = Key;
+
+        static constexpr std::size_t DEFAULT_SEGMENT_SIZE = std::size_t(64) << 20;
+
+        struct record_header {
+            static constexpr std::uint32_t MAGIC = 0x474c5642; // "BVLG"
+            // the length of erase records
+            static constexpr std::uint32_t ERASED = UINT32_MAX;
+
+            std::uint32_t magic;
+            std::uint32_t length;
+            std::uint64_t checksum;
+            key_type key;
+        };
+
+        /**
+         * @brief Open or create the log in directory, with segments of about segment_size bytes. Throws
+         * std::system_error if a file cannot be opened and std::runtime_error if a full segment is corrupt.
+         */
+        explicit value_log(std::filesystem::path directory, std::size_t segment_size = DEFAULT_SEGMENT_SIZE);
+
+        value_log(value_log const &) = delete;
+
+        value_log & operator=(value_log const &) = delete;
+
+        [[nodiscard]] auto directory() const -> std::filesystem::path const & { return directory_; }
+
+        /**
+         * @brief Append value of key, not durable before sync()
+         */
+        auto append(key_type const &key, std::span<std::byte const> value) -> value_handle;
+
+        /**
+         * @brief Append the erase of key, for replay()
+         */
+        auto append_erase(key_type const &key) -> void {
+            append_record(key, record_header::ERASED, {});
+        }
+
+        /**
+         * @brief Read the value at handle into out, which must have handle.length bytes. Throws std::runtime_error
+         * if the record is corrupt or its segment was collected.
+         */
+        auto read(value_handle handle, std::span<std::byte> out) const -> void;
+
+        auto read(value_handle handle) const -> std::vector<std::byte> {
+            std::vector<std::byte> value(handle.length);
+            read(handle, value);
+            return value;
+        }
+
+        /**
+         * @brief Count the value at handle as garbage, once the tree dropped or replaced it
+         */
+        auto release(value_handle handle) -> void {
+            std::lock_guard lock(mutex_);
+            if (auto *p_segment = find_segment(handle.offset))
+                p_segment->live -= sizeof(record_header) + handle.length;
+        }
+
+        /**
+         * @brief Call function(key, handle) for every record from the oldest to the newest, with std::nullopt for
+         * erases. Reads only the headers. Not while records are appended.
+         */
+        template<typename Function>
+        auto replay(Function const &function) const -> void;
+
+        /**
+         * @brief Collect the oldest segment, unless it is the only one: append the values for which
+         * is_live(key, handle) holds again, call moved(key, old handle, new handle) for each, sync, then delete the
+         * segment.
+         * @return the number of bytes freed
+         */
+        template<typename Is_live, typename Moved>
+        auto collect_oldest(Is_live const &is_live, Moved const &moved) -> std::uint64_t;
+
+        /**
+         * @brief Make all records appended so far durable
+         */
+        auto sync() -> void {
+            std::shared_ptr<segment> p_active;
+            {
+                std::lock_guard lock(mutex_);
+                p_active = segments_.back();
+            }
+            check(::fdatasync(p_active->fd) == 0, "value_log: fdatasync");
+        }
+
+        /**
+         * @return the size of all segments
+         */
+        [[nodiscard]] auto size() const -> std::uint64_t {
+            std::lock_guard lock(mutex_);
+            std::uint64_t size = 0;
+            for (auto const &p_segment : segments_)
+                size += p_segment->size;
+            return size;
+        }
+
+        /**
+         * @return the size of the records of the values not released
+         */
+        [[nodiscard]] auto live_size() const -> std::uint64_t {
+            std::lock_guard lock(mutex_);
+            std::uint64_t live = 0;
+            for (auto const &p_segment : segments_)
+                live += p_segment->live;
+            return live;
+        }
+
+        [[nodiscard]] auto segment_count() const -> std::size_t {
+            std::lock_guard lock(mutex_);
+            return segments_.size();
+        }
+
+        /**
+         * @return the fraction of the oldest segment which collect_oldest() would free, 0 if it is the only one
+         */
+        [[nodiscard]] auto oldest_garbage_ratio() const -> double {
+            std::lock_guard lock(mutex_);
+            if (segments_.size() < 2 || segments_.front()->size == 0)
+                return 0;
+            auto const &oldest = *segments_.front();
+            return double(oldest.size - oldest.live) / double(oldest.size);
+        }
+
+    private:
+        static constexpr char const *SUFFIX = ".vlog";
+
+        struct segment {
+            std::uint32_t number;
+            int fd;
+            std::uint64_t size = 0;
+            // bytes of the records of values not released
+            std::uint64_t live = 0;
+
+            segment(std::uint32_t number_, int fd_) : number(number_), fd(fd_) {}
+
+            ~segment() { ::close(fd); }
+
+            segment(segment const &) = delete;
+
+            segment & operator=(segment const &) = delete;
+        };
+
+        static auto check(bool ok, char const *what) -> void {
+            if (!ok)
+                throw std::system_error(errno, std::generic_category(), what);
+        }
+
+        static auto record_size(std::uint32_t length) -> std::uint64_t {
+            return sizeof(record_header) + (length == record_header::ERASED ? 0 : length);
+        }
+
+        static auto record_checksum(record_header const &header, std::span<std::byte const> value) -> std::uint64_t {
+            checksum sum;
+            sum.update(std::as_bytes(std::span(&header.key, 1)));
+            sum.update(value);
+            return sum.value();
+        }
+
+        auto path_of(std::uint32_t number) const -> std::filesystem::path {
+            return directory_ / (std::to_string(number) + SUFFIX);
+        }
+
+        auto open_segment(std::uint32_t number, int flags) const -> std::shared_ptr<segment> {
+            auto const path = path_of(number);
+            auto const fd = ::open(path.c_str(), O_RDWR | O_CLOEXEC | flags, 0644);
+            if (fd < 0)
+                throw std::system_error(errno, std::generic_category(), "value_log: open " + path.string());
+            return std::make_shared<segment>(number, fd);
+        }
+
+        auto sync_directory() const -> void {
+            auto const fd = ::open(directory_.c_str(), O_RDONLY | O_DIRECTORY | O_CLOEXEC);
+            check(fd >= 0, "value_log: open directory");
+            auto const synced = ::fsync(fd) == 0;
+            ::close(fd);
+            check(synced, "value_log: fsync directory");
+        }
+
+        /**
+         * @brief Read the records of a segment file of file_size bytes, call function(header, position) for each
+         * @return the end of the last complete record; with verify, the last one whose checksum matches
+         */
+        template<typename Function>
+        auto scan(segment const &s, std::uint64_t file_size, bool verify, Function const &function) const -> std::uint64_t;
+
+        /**
+         * @return the segment holding offset, nullptr if it was collected; with mutex_ held
+         */
+        auto find_segment(std::uint64_t offset) const -> segment * {
+            auto const number = std::uint32_t(offset >> 32);
+            if (segments_.empty() || number < segments_.front()->number || number > segments_.back()->number)
+                return nullptr;
+            return segments_[number - segments_.front()->number].get();
+        }
+
+        auto append_record(key_type const &key, std::uint32_t length, std::span<std::byte const> value) -> value_handle;
+
+        static auto read_at(int fd, void *data, std::size_t size, std::uint64_t offset) -> bool {
+            auto *p = static_cast<std::byte *>(data);
+            while (size > 0) {
+                auto const n = ::pread(fd, p, size, static_cast<off_t>(offset));
+                if (n < 0 && errno == EINTR)
+                    continue;
+                check(n >= 0, "value_log: pread");
+                if (n == 0)
+                    return false;
+                p += n;
+                offset += static_cast<std::uint64_t>(n);
+                size -= static_cast<std::size_t>(n);
+            }
+            return true;
+        }
+
+        static auto write_at(int fd, void const *data, std::size_t size, std::uint64_t offset) -> void {
+            auto const *p = static_cast<std::byte const *>(data);
+            while (size > 0) {
+                auto const written = ::pwrite(fd, p, size, static_cast<off_t>(offset));
+                if (written < 0 && errno == EINTR)
+                    continue;
+                check(written >= 0, "value_log: pwrite");
+                p += written;
+                offset += static_cast<std::uint64_t>(written);
+                size -= static_cast<std::size_t>(written);
+            }
+        }
+
+        std::filesystem::path directory_;
+        std::uint64_t segment_size_;
+        mutable std::mutex mutex_;
+        // oldest first, numbered consecutively
+        std::deque<std::shared_ptr<segment>> segments_;
+        // a record in frame format, for a single pwrite
+        std::vector<std::byte> buffer_;
+    };
+
+    template<typename Key>
+    value_log<Key>::value_log(std::filesystem::path directory, std::size_t segment_size)
+        : directory_(std::move(directory)),
+          // positions in a segment have 32 bits
+          segment_size_(std::clamp<std::uint64_t>(segment_size, sizeof(record_header), std::uint64_t(1) << 31)) {
+        std::filesystem::create_directories(directory_);
+        std::vector<std::uint32_t> numbers;
+        for (auto const &entry : std::filesystem::directory_iterator(directory_)) {
+            auto const name = entry.path().filename().string();
+            std::uint32_t number;
+            auto const [end, error] = std::from_chars(name.data(), name.data() + name.size(), number);
+            if (error == std::errc() && std::string_view(end, name.data() + name.size()) == SUFFIX)
+                numbers.push_back(number);
+        }
+        std::ranges::sort(numbers);
+        for (std::size_t i = 1; i < numbers.size(); ++i)
+            if (numbers[i] != numbers[i - 1] + 1)
+                throw std::runtime_error("value_log: segment " + std::to_string(numbers[i - 1] + 1) + " is missing");
+        for (auto number : numbers) {
+            auto p_segment = open_segment(number, 0);
+            struct stat status{};
+            check(::fstat(p_segment->fd, &status) == 0, "value_log: fstat");
+            auto const file_size = static_cast<std::uint64_t>(status.st_size);
+            auto const newest = number == numbers.back();
+            // full segments were synced, only the newest can end in a torn record
+            auto const end = scan(*p_segment, file_size, newest, [&p_segment](record_header const &header, std::uint64_t) {
+                if (header.length != record_header::ERASED)
+                    p_segment->live += record_size(header.length);
+            });
+            if (end != file_size) {
+                if (!newest)
+                    throw std::runtime_error("value_log: segment " + path_of(number).string() + " is corrupt");
+                check(::ftruncate(p_segment->fd, static_cast<off_t>(end)) == 0, "value_log: ftruncate");
+            }
+            p_segment->size = end;
+            segments_.push_back(std::move(p_segment));
+        }
+        if (segments_.empty()) {
+            segments_.push_back(open_segment(0, O_CREAT | O_TRUNC));
+            sync_directory();
+        }
+    }
+
+    template<typename Key>
+    auto value_log<Key>::append(key_type const &key, std::span<std::byte const> value) -> value_handle {
+        if (value.size() >= record_header::ERASED)
+            throw std::length_error("value_log: value too long");
+        return append_record(key, static_cast<std::uint32_t>(value.size()), value);
+    }
+
+    template<typename Key>
+    auto value_log<Key>::append_record(key_type const &key, std::uint32_t length, std::span<std::byte const> value) -> value_handle {
+        record_header header{record_header::MAGIC, length, 0, key};
+        header.checksum = record_checksum(header, value);
+        std::lock_guard lock(mutex_);
+        auto const size = record_size(length);
+        if (segments_.back()->size > 0 && segments_.back()->size + size > segment_size_) {
+            // the full segment is durable before the next one is used
+            check(::fdatasync(segments_.back()->fd) == 0, "value_log: fdatasync");
+            auto const number = segments_.back()->number + 1;
+            if (number == 0)
+                throw std::length_error("value_log: out of segment numbers");
+            segments_.push_back(open_segment(number, O_CREAT | O_TRUNC));
+            sync_directory();
+        }
+        auto &active = *segments_.back();
+        buffer_.resize(static_cast<std::size_t>(size));
+        std::memcpy(buffer_.data(), &header, sizeof(header));
+        std::ranges::copy(value, buffer_.begin() + sizeof(header));
+        write_at(active.fd, buffer_.data(), buffer_.size(), active.size);
+        value_handle const handle{(std::uint64_t(active.number) << 32) | active.size, length};
+        active.size += size;
+        if (length != record_header::ERASED)
+            active.live += size;
+        return handle;
+    }
+
+    template<typename Key>
+    auto value_log<Key>::read(value_handle handle, std::span<std::byte> out) const -> void {
+        std::shared_ptr<segment> p_segment;
+        {
+            std::lock_guard lock(mutex_);
+            if (auto *p = find_segment(handle.offset))
+                p_segment = segments_[p->number - segments_.front()->number];
+        }
+        if (p_segment == nullptr)
+            throw std::runtime_error("value_log: the segment of the handle was collected");
+        auto const position = handle.offset & UINT32_MAX;
+        record_header header{};
+        if (out.size() != handle.length || !read_at(p_segment->fd, &header, sizeof(header), position)
+            || header.magic != record_header::MAGIC || header.length != handle.length
+            || !read_at(p_segment->fd, out.data(), out.size(), position + sizeof(header))
+            || header.checksum != record_checksum(header, out))
+            throw std::runtime_error("value_log: corrupt record at " + std::to_string(handle.offset));
+    }
+
+    template<typename Key>
+    template<typename Function>
+    auto value_log<Key>::scan(segment const &s, std::uint64_t file_size, bool verify, Function const &function) const -> std::uint64_t {
+        std::uint64_t position = 0;
+        std::vector<std::byte> value;
+        record_header header{};
+        while (position + sizeof(header) <= file_size && read_at(s.fd, &header, sizeof(header), position)
+               && header.magic == record_header::MAGIC && position + record_size(header.length) <= file_size) {
+            if (verify) {
+                value.resize(header.length == record_header::ERASED ? 0 : header.length);
+                if (!read_at(s.fd, value.data(), value.size(), position + sizeof(header))
+                    || header.checksum != record_checksum(header, value))
+                    break;
+            }
+            function(header, position);
+            position += record_size(header.length);
+        }
+        return position;
+    }
+
+    template<typename Key>
+    template<typename Function>
+    auto value_log<Key>::replay(Function const &function) const -> void {
+        std::deque<std::shared_ptr<segment>> segments;
+        {
+            std::lock_guard lock(mutex_);
+            segments = segments_;
+        }
+        for (auto const &p_segment : segments) {
+            auto const base = std::uint64_t(p_segment->number) << 32;
+            scan(*p_segment, p_segment->size, false, [&function, base](record_header const &header, std::uint64_t position) {
+                if (header.length == record_header::ERASED)
+                    function(header.key, std::optional<value_handle>());
+                else
+                    function(header.key, std::optional(value_handle{base | position, header.length}));
+            });
+        }
+    }
+
+    template<typename Key>
+    template<typename Is_live, typename Moved>
+    auto value_log<Key>::collect_oldest(Is_live const &is_live, Moved const &moved) -> std::uint64_t {
+        std::shared_ptr<segment> p_oldest;
+        {
+            std::lock_guard lock(mutex_);
+            if (segments_.size() < 2)
+                return 0;
+            p_oldest = segments_.front();
+        }
+        auto const base = std::uint64_t(p_oldest->number) << 32;
+        std::vector<std::byte> value;
+        std::uint64_t moved_size = 0;
+        scan(*p_oldest, p_oldest->size, false, [&](record_header const &header, std::uint64_t position) {
+            value_handle const handle{base | position, header.length};
+            if (header.length == record_header::ERASED || !is_live(header.key, handle))
+                return;
+            value.resize(header.length);
+            read(handle, value);
+            moved(header.key, handle, append(header.key, value));
+            moved_size += record_size(header.length);
+        });
+        // the moved values are durable before their old records go
+        sync();
+        {
+            std::lock_guard lock(mutex_);
+            segments_.pop_front();
+        }
+        std::filesystem::remove(path_of(p_oldest->number));
+        sync_directory();
+        return p_oldest->size - moved_size;
+    }
+}
+
+#endif //VALUE_LOG_H
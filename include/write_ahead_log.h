@@ -0,0 +1,328 @@
+//
+// Created by arnoldm on 19.10.26.
+//
+
+#ifndef WRITE_AHEAD_LOG_H
+#define WRITE_AHEAD_LOG_H
+
+#include <algorithm>
+#include <cerrno>
+#include <condition_variable>
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <exception>
+#include <filesystem>
+#include <mutex>
+#include <stdexcept>
+#include <system_error>
+#include <type_traits>
+#include <utility>
+#include <vector>
+#include <fcntl.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#include "binary_io.h"
+
+namespace bt {
+    /**
+     * An append-only log of inserts and erases of Key and Value, for replaying changes of an in-memory tree after
+     * a restart. Every record gets a log sequence number (LSN), counting up from 1 over the life of the log.
+     *
+     * append() only adds the record to a buffer in memory. commit(lsn) makes all records up to lsn durable with
+     * group commit: the first waiting thread becomes the leader, writes everything buffered as one frame and calls
+     * fdatasync(), while threads appending meanwhile wait for the next frame, which one of them writes with the next
+     * fdatasync(). Concurrent writers so share the cost of a sync, the more of them the more records per sync.
+     *
+     * A frame is a frame_header and the records, each an operation byte, the key and (for inserts) the value, as
+     * they are in memory, so Key and Value must be trivially copyable. The header holds the checksum of the records:
+     * opening the log ends it before the first incomplete or corrupt frame, which a crash during a write leaves.
+     * Thread safe.
+     */
+    template<typename Key, typename Value>
+    class write_ahead_log {
+        static_assert(std::is_trivially_copyable_v<Key> && std::is_trivially_copyable_v<Value>,
+                      "the log holds keys and values as bytes, they must be trivially copyable");
+    public:
+        using key_type = Key;
+        using value_type = Value;
+
+        enum class operation : std::uint8_t { insert = 1, erase = 2 };
+
+        struct frame_header {
+            static constexpr std::uint32_t MAGIC = 0x4c415742; // "BWAL"
+
+            std::uint32_t magic;
+            std::uint32_t record_count;
+            std::uint64_t size;
+            std::uint64_t first_lsn;
+            std::uint64_t checksum;
+        };
+
+        /**
+         * @brief Open or create the log at path and find its end. LSNs continue after the last record in the log,
+         * or after base_lsn if that is greater (the LSN of a snapshot, the log is empty after truncate()). Throws
+         * std::system_error if the file cannot be opened.
+         */
+        explicit write_ahead_log(std::filesystem::path path, std::uint64_t base_lsn = 0) : path_(std::move(path)) {
+            fd_ = ::open(path_.c_str(), O_RDWR | O_CREAT | O_CLOEXEC, 0644);
+            if (fd_ < 0)
+                throw std::system_error(errno, std::generic_category(), "write_ahead_log: open " + path_.string());
+            auto const [end_offset, last_lsn] = scan([](operation, std::uint64_t, key_type const &, value_type const &) {});
+            // a torn frame at the end is dropped, new frames follow the last complete one
+            if (::ftruncate(fd_, static_cast<off_t>(end_offset)) != 0) {
+                auto const error = errno;
+                ::close(fd_);
+                throw std::system_error(error, std::generic_category(), "write_ahead_log: ftruncate");
+            }
+            end_offset_ = end_offset;
+            last_lsn_ = durable_lsn_ = std::max(last_lsn, base_lsn);
+        }
+
+        ~write_ahead_log() {
+            ::close(fd_);
+        }
+
+        write_ahead_log(write_ahead_log const &) = delete;
+
+        write_ahead_log & operator=(write_ahead_log const &) = delete;
+
+        [[nodiscard]] auto path() const -> std::filesystem::path const & { return path_; }
+
+        /**
+         * @brief Call function(op, lsn, key, value) for every record with an LSN greater than after_lsn, in log
+         * order; value is value_type{} for erases. Not while records are appended.
+         */
+        template<typename Function>
+        auto replay(std::uint64_t after_lsn, Function const &function) const -> void {
+            std::lock_guard lock(mutex_);
+            scan([after_lsn, &function](operation op, std::uint64_t lsn, key_type const &key, value_type const &value) {
+                if (lsn > after_lsn)
+                    function(op, lsn, key, value);
+            });
+        }
+
+        /**
+         * @brief Buffer a record, not durable before commit()
+         * @return its LSN
+         */
+        auto append(operation op, key_type const &key, value_type const &value = value_type{}) -> std::uint64_t {
+            std::lock_guard lock(mutex_);
+            pending_.push_back(static_cast<std::byte>(op));
+            append_bytes(key);
+            if (op == operation::insert)
+                append_bytes(value);
+            ++pending_count_;
+            return ++last_lsn_;
+        }
+
+        /**
+         * @brief Wait until the records up to lsn are durable, writing and syncing them if no other thread does.
+         * Rethrows the error of a failed write in every later commit: the records of that frame are lost.
+         */
+        auto commit(std::uint64_t lsn) -> void {
+            std::unique_lock lock(mutex_);
+            lsn = std::min(lsn, last_lsn_);
+            while (durable_lsn_ < lsn) {
+                if (error_)
+                    std::rethrow_exception(error_);
+                if (flushing_) {
+                    flushed_.wait(lock);
+                    continue;
+                }
+                flushing_ = true;
+                std::vector<std::byte> frame;
+                frame.swap(pending_);
+                auto const count = std::exchange(pending_count_, 0);
+                auto const last = last_lsn_;
+                auto const offset = end_offset_;
+                lock.unlock();
+                try {
+                    write_frame(frame, count, last - count + 1, offset);
+                } catch (...) {
+                    lock.lock();
+                    error_ = std::current_exception();
+                    flushing_ = false;
+                    flushed_.notify_all();
+                    throw;
+                }
+                lock.lock();
+                end_offset_ = offset + sizeof(frame_header) + frame.size();
+                durable_lsn_ = last;
+                ++syncs_;
+                flushing_ = false;
+                // the buffer of the frame is reused for the next one
+                if (pending_.empty()) {
+                    frame.clear();
+                    pending_.swap(frame);
+                }
+                flushed_.notify_all();
+            }
+        }
+
+        /**
+         * @brief commit() all records appended so far
+         */
+        auto sync() -> void {
+            commit(last_lsn());
+        }
+
+        /**
+         * @brief Empty the log once a snapshot holds all records up to lsn, which must be the last one appended.
+         * The LSNs go on counting from lsn.
+         */
+        auto truncate(std::uint64_t lsn) -> void {
+            std::unique_lock lock(mutex_);
+            flushed_.wait(lock, [this] { return !flushing_; });
+            if (lsn != last_lsn_)
+                throw std::logic_error("write_ahead_log: truncate at an LSN other than the last one");
+            if (::ftruncate(fd_, 0) != 0 || ::fdatasync(fd_) != 0)
+                throw std::system_error(errno, std::generic_category(), "write_ahead_log: truncate");
+            pending_.clear();
+            pending_count_ = 0;
+            end_offset_ = 0;
+            // waiting writers find their records in the snapshot
+            durable_lsn_ = lsn;
+            flushed_.notify_all();
+        }
+
+        [[nodiscard]] auto last_lsn() const -> std::uint64_t {
+            std::lock_guard lock(mutex_);
+            return last_lsn_;
+        }
+
+        [[nodiscard]] auto durable_lsn() const -> std::uint64_t {
+            std::lock_guard lock(mutex_);
+            return durable_lsn_;
+        }
+
+        /**
+         * @return the number of frames written and synced, for comparison with the number of commits
+         */
+        [[nodiscard]] auto sync_count() const -> std::uint64_t {
+            std::lock_guard lock(mutex_);
+            return syncs_;
+        }
+
+        /**
+         * @return the size of the complete frames in the file
+         */
+        [[nodiscard]] auto size() const -> std::uint64_t {
+            std::lock_guard lock(mutex_);
+            return end_offset_;
+        }
+
+    private:
+        template<typename T>
+        auto append_bytes(T const &item) -> void {
+            auto const *p = reinterpret_cast<std::byte const *>(&item);
+            pending_.insert(pending_.end(), p, p + sizeof(T));
+        }
+
+        auto write_frame(std::vector<std::byte> const &records, std::uint32_t count, std::uint64_t first_lsn,
+                         std::uint64_t offset) const -> void {
+            checksum sum;
+            sum.update(records);
+            frame_header const header{frame_header::MAGIC, count, records.size(), first_lsn, sum.value()};
+            write_at(&header, sizeof(header), offset);
+            write_at(records.data(), records.size(), offset + sizeof(header));
+            if (::fdatasync(fd_) != 0)
+                throw std::system_error(errno, std::generic_category(), "write_ahead_log: fdatasync");
+        }
+
+        auto write_at(void const *data, std::size_t size, std::uint64_t offset) const -> void {
+            auto const *p = static_cast<std::byte const *>(data);
+            while (size > 0) {
+                auto const written = ::pwrite(fd_, p, size, static_cast<off_t>(offset));
+                if (written < 0) {
+                    if (errno == EINTR)
+                        continue;
+                    throw std::system_error(errno, std::generic_category(), "write_ahead_log: pwrite");
+                }
+                p += written;
+                offset += static_cast<std::uint64_t>(written);
+                size -= static_cast<std::size_t>(written);
+            }
+        }
+
+        /**
+         * @brief Read the complete frames from the start and call function for each record
+         * @return the end of the last complete frame and the LSN of its last record
+         */
+        template<typename Function>
+        auto scan(Function const &function) const -> std::pair<std::uint64_t, std::uint64_t> {
+            std::uint64_t offset = 0;
+            std::uint64_t lsn = 0;
+            std::vector<std::byte> records;
+            for (;;) {
+                frame_header header{};
+                if (!read_at(&header, sizeof(header), offset) || header.magic != frame_header::MAGIC
+                    || header.size > std::uint64_t(1) << 40)
+                    break;
+                records.resize(static_cast<std::size_t>(header.size));
+                if (!read_at(records.data(), records.size(), offset + sizeof(header)))
+                    break;
+                checksum sum;
+                sum.update(records);
+                if (sum.value() != header.checksum)
+                    break;
+                std::size_t position = 0;
+                auto take = [&records, &position]<typename T>(T &item) {
+                    if (position + sizeof(T) > records.size())
+                        throw std::runtime_error("write_ahead_log: corrupt frame");
+                    std::memcpy(&item, records.data() + position, sizeof(T));
+                    position += sizeof(T);
+                };
+                for (std::uint32_t i = 0; i < header.record_count; ++i) {
+                    std::uint8_t op;
+                    key_type key;
+                    value_type value{};
+                    take(op);
+                    take(key);
+                    if (operation(op) == operation::insert)
+                        take(value);
+                    function(operation(op), header.first_lsn + i, key, value);
+                }
+                lsn = header.first_lsn + header.record_count - 1;
+                offset += sizeof(header) + header.size;
+            }
+            return {offset, lsn};
+        }
+
+        /**
+         * @return false if the file ends before size bytes
+         */
+        auto read_at(void *data, std::size_t size, std::uint64_t offset) const -> bool {
+            auto *p = static_cast<std::byte *>(data);
+            while (size > 0) {
+                auto const n = ::pread(fd_, p, size, static_cast<off_t>(offset));
+                if (n < 0 && errno == EINTR)
+                    continue;
+                if (n < 0)
+                    throw std::system_error(errno, std::generic_category(), "write_ahead_log: pread");
+                if (n == 0)
+                    return false;
+                p += n;
+                offset += static_cast<std::uint64_t>(n);
+                size -= static_cast<std::size_t>(n);
+            }
+            return true;
+        }
+
+        std::filesystem::path path_;
+        int fd_ = -1;
+        mutable std::mutex mutex_;
+        std::condition_variable flushed_;
+        // records appended but not written, in frame format
+        std::vector<std::byte> pending_;
+        std::uint32_t pending_count_ = 0;
+        bool flushing_ = false;
+        std::exception_ptr error_;
+        std::uint64_t last_lsn_ = 0;
+        std::uint64_t durable_lsn_ = 0;
+        std::uint64_t end_offset_ = 0;
+        std::uint64_t syncs_ = 0;
+    };
+}
+
+#endif //WRITE_AHEAD_LOG_H
@@ -7,11 +7,35 @@
 #define BTREE_TESTING
 #endif
 #include "btree.h"
+#include "bloom_filter.h"
+#include "buffered_btree.h"
+#include "durable_btree.h"
+#include "latency_histogram.h"
+#include "lsm_btree.h"
+#include "mapped_btree.h"
+#include "separated_btree.h"
 #include "dyn_array.h"
 #include "test_class.h"
 #include "create_trees.h"
 #include <functional>
 #include <random>
+#include <atomic>
+#include <chrono>
+#include <cstdio>
+#include <cstring>
+#include <filesystem>
+#include <fstream>
+#include <limits>
+#include <map>
+#include <numeric>
+#include <mutex>
+#include <span>
+#include <sstream>
+#include <stdexcept>
+#include <thread>
+#include <tuple>
+#include <fcntl.h>
+#include <unistd.h>
 #include "btree_test_class.h"
 
 using namespace bt;
@@ -19,6 +43,16 @@ using namespace bt;
 // auto getkey(auto const & e) -> decltype(auto) { return (*e).first; };
 auto getkey = [](auto const &e)->decltype(auto){return e.first;};
 
+template<typename Btree>
+concept has_stats = requires(Btree const &tree) { tree.stats(); };
+
+// whether Order is the biggest order whose node takes at most Cache_lines cache lines
+template<template<typename> typename Node_type, typename Key, typename Value, typename Index, std::size_t Cache_lines,
+    std::size_t Order>
+constexpr bool fills_cache_lines =
+    cache_line_aligned_size<Node_type<traits_type<Key, Value, Index, Order, Order>>>() <= Cache_lines * CACHE_LINE_SIZE &&
+    cache_line_aligned_size<Node_type<traits_type<Key, Value, Index, Order + 1, Order + 1>>>() > Cache_lines * CACHE_LINE_SIZE;
+
 #define TREE_CHECK(name, tree, expected, action) \
     DOCTEST_SUBCASE(name) {\
         auto __tree = tree;\
@@ -350,4 +384,1629 @@ TEST_SUITE("btree") {
         }
         MESSAGE("max_depth = ", max_depth, " insert_cnt = ", insert_cnt, " erase_cnt = ", erase_cnt);
     }
-}
\ No newline at end of file
+
+    TEST_CASE_FIXTURE(btree_test_class, "split policy bstar_split") {
+        using bstar_btree_type = btree<int, int, unsigned, 4, 4, bstar_split>;
+        auto proj = [](auto const & e) -> decltype(auto) { return e.first; };
+
+        SUBCASE("random inserts") {
+            std::multimap<int, int> map;
+            bstar_btree_type tree;
+            btree_type midpoint_tree;
+            auto rnd = std::mt19937{4711};
+            auto dist = std::uniform_int_distribution<int>(1, 10'000);
+            for (unsigned i = 0; i < 5'000; ++i) {
+                auto key = dist(rnd);
+                map.insert(std::make_pair(key, key));
+                tree.insert(key, key);
+                midpoint_tree.insert(key, key);
+                if (i % 250 == 0)
+                    check_sane(tree);
+            }
+            check_sane(tree);
+            check_equal(tree, map, getkey, proj);
+            check_find_each(tree, map.begin(), map.end(), proj);
+            CHECK_LT(tree.node_count(), midpoint_tree.node_count());
+        }
+
+        SUBCASE("sequential inserts") {
+            std::vector<int> expected;
+            bstar_btree_type tree;
+            btree_type midpoint_tree;
+            for (int i = 0; i < 2'000; ++i) {
+                expected.push_back(i);
+                tree.insert(i, i);
+                midpoint_tree.insert(i, i);
+            }
+            check_sane(tree);
+            check_equal(tree, expected, getkey, std::identity{});
+            check_find_each(tree, expected.begin(), expected.end());
+            CHECK_LE(tree.node_count(), midpoint_tree.node_count());
+        }
+    }
+
+    TEST_CASE_FIXTURE(btree_test_class, "rebalance policy") {
+        auto proj = [](auto const & e) -> decltype(auto) { return e.first; };
+        auto insert_erase = [&proj]<typename Btree_type>(Btree_type & tree) {
+            std::map<int, int> map;
+            auto rnd = std::mt19937{4711};
+            auto dist = std::uniform_int_distribution<int>(1, 100'000);
+            for (unsigned i = 0; i < 3'000; ++i) {
+                auto key = dist(rnd);
+                if (map.insert(std::make_pair(key, key)).second)
+                    tree.insert(key, key);
+            }
+            check_sane(tree);
+            for (unsigned i = 0; i < 6'000 && !map.empty(); ++i) {
+                auto map_it = map.begin();
+                std::advance(map_it, std::uniform_int_distribution<std::size_t>(0, map.size() - 1)(rnd));
+                auto tree_it = tree.find(map_it->first);
+                REQUIRE(tree_it != tree.end());
+                tree.erase(tree_it);
+                map.erase(map_it);
+                if (i % 3 == 0) {
+                    auto key = dist(rnd);
+                    if (map.insert(std::make_pair(key, key)).second)
+                        tree.insert(key, key);
+                }
+                if (i % 100 == 0) {
+                    CAPTURE(i);
+                    check_sane(tree);
+                    check_equal(tree, map, getkey, proj);
+                }
+            }
+            check_sane(tree);
+            check_equal(tree, map, getkey, proj);
+            check_find_each(tree, map.begin(), map.end(), proj);
+        };
+
+        SUBCASE("equalize") {
+            btree<int, int, unsigned, 8, 8, midpoint_split, rebalance_policy<50, 50, true>> tree;
+            insert_erase(tree);
+        }
+
+        SUBCASE("hysteresis") {
+            using hysteresis_btree_type = btree<int, int, unsigned, 8, 8, midpoint_split, rebalance_policy<25, 50, true>>;
+            static_assert(hysteresis_btree_type::traits::min_leaf_order == 2);
+            static_assert(hysteresis_btree_type::traits::merge_leaf_order == 4);
+            hysteresis_btree_type tree;
+            insert_erase(tree);
+        }
+
+        SUBCASE("hysteresis with bstar_split") {
+            btree<int, int, unsigned, 8, 8, bstar_split, rebalance_policy<25, 75>> tree;
+            insert_erase(tree);
+        }
+    }
+
+    TEST_CASE_FIXTURE(btree_test_class, "reorganize") {
+        auto proj = [](auto const & e) -> decltype(auto) { return e.first; };
+        auto check_locality = [](btree_type const & tree) {
+            auto leaf_index = tree.first_leaf_index();
+            auto internal_count = leaf_index;
+            for (btree_type::index_type i = 0; i < internal_count; ++i)
+                CHECK(std::holds_alternative<btree_type::internal_node_type>(tree.nodes_[i]));
+            CHECK_EQ(tree.root_index(), 0);
+            for (; tree.leaf_node(leaf_index).has_next_leaf_index(); ++leaf_index)
+                CHECK_EQ(tree.leaf_node(leaf_index).next_leaf_index(), leaf_index + 1);
+            CHECK_EQ(leaf_index + 1, tree.nodes_.size());
+        };
+        std::multimap<int, int> map;
+        btree_type tree;
+        auto rnd = std::mt19937{4711};
+        auto dist = std::uniform_int_distribution<int>(1, 10'000);
+        for (unsigned i = 0; i < 3'000; ++i) {
+            auto key = dist(rnd);
+            map.insert(std::make_pair(key, key));
+            tree.insert(key, key);
+        }
+        for (unsigned i = 0; i < 1'000; ++i) {
+            auto key = map.begin()->first;
+            tree.erase(tree.find(key));
+            map.erase(map.begin());
+        }
+
+        SUBCASE("reorganize()") {
+            auto node_count = tree.node_count();
+            tree.reorganize();
+            check_sane(tree);
+            check_equal(tree, map, getkey, proj);
+            check_find_each(tree, map.begin(), map.end(), proj);
+            check_locality(tree);
+            CHECK_LT(tree.node_count(), node_count);
+        }
+
+        SUBCASE("reorganize(max_moves) interleaved with inserts") {
+            bool done = false;
+            for (unsigned i = 0; !done; ++i) {
+                REQUIRE_LT(i, 10'000);
+                done = tree.reorganize(5);
+                check_sane(tree);
+                if (i < 100) {
+                    auto key = dist(rnd);
+                    map.insert(std::make_pair(key, key));
+                    tree.insert(key, key);
+                    done = false;
+                }
+            }
+            check_equal(tree, map, getkey, proj);
+            check_find_each(tree, map.begin(), map.end(), proj);
+            check_locality(tree);
+        }
+    }
+
+    TEST_CASE_FIXTURE(btree_test_class, "storage policy aligned_node_storage") {
+        auto proj = [](auto const & e) -> decltype(auto) { return e.first; };
+        auto insert_random = [&proj]<typename Btree_type>(Btree_type & tree, std::size_t alignment) {
+            std::multimap<int, int> map;
+            auto rnd = std::mt19937{4711};
+            auto dist = std::uniform_int_distribution<int>(1, 100'000);
+            for (unsigned i = 0; i < 20'000; ++i) {
+                auto key = dist(rnd);
+                map.insert(std::make_pair(key, key));
+                tree.insert(key, key);
+            }
+            check_sane(tree);
+            check_equal(tree, map, getkey, proj);
+            check_find_each(tree, map.begin(), map.end(), proj);
+            CHECK_EQ(sizeof(typename Btree_type::common_node_type) % alignment, 0);
+            for (auto const & node : tree.nodes_)
+                CHECK_EQ(reinterpret_cast<std::uintptr_t>(&node) % alignment, 0);
+        };
+
+        SUBCASE("cache line") {
+            btree<int, int, unsigned, 8, 8, midpoint_split, rebalance_policy<>, aligned_node_storage<>> tree;
+            insert_random(tree, CACHE_LINE_SIZE);
+        }
+
+        SUBCASE("page with huge pages") {
+            static constexpr auto internal_order = page_storage_order<btree_internal_node, int, int, unsigned, 4096>();
+            static constexpr auto leaf_order = page_storage_order<btree_leaf_node, int, int, unsigned, 4096>();
+            using page_btree_type = btree<int, int, unsigned, internal_order, leaf_order, midpoint_split,
+                rebalance_policy<>, aligned_node_storage<4096, true>>;
+            static_assert(sizeof(page_btree_type::common_node_type) == 4096);
+            page_btree_type tree;
+            insert_random(tree, 4096);
+
+            huge_page_allocator<std::byte> allocator;
+            auto p = allocator.allocate(2 * HUGE_PAGE_SIZE + 1);
+            CHECK_EQ(reinterpret_cast<std::uintptr_t>(p) % HUGE_PAGE_SIZE, 0);
+            std::fill_n(p, 2 * HUGE_PAGE_SIZE + 1, std::byte{0x5a});
+            allocator.deallocate(p, 2 * HUGE_PAGE_SIZE + 1);
+        }
+    }
+
+    TEST_CASE_FIXTURE(btree_test_class, "storage policy cow_storage snapshot") {
+        using cow_btree_type = btree<int, int, unsigned, 8, 8, midpoint_split, rebalance_policy<>, cow_storage<>>;
+        auto proj = [](auto const & e) -> decltype(auto) { return e.first; };
+        cow_btree_type tree;
+        std::map<int, int> map;
+        for (int i = 0; i < 20'000; ++i) {
+            map.emplace(3 * i, i);
+            tree.insert(3 * i, i);
+        }
+
+        auto snapshot = tree.snapshot();
+        auto const snapshot_map = map;
+        std::size_t const node_count = tree.node_count();
+        std::size_t shared = 0;
+        for (std::size_t i = 0; i < node_count; ++i)
+            shared += tree.nodes_.shares_element(snapshot->nodes_, i);
+        CHECK_EQ(shared, node_count);
+
+        // one insert copies the chunks on the path from the root to the leaf
+        tree.insert(1, 1);
+        map.emplace(1, 1);
+        shared = 0;
+        for (std::size_t i = 0; i < node_count; ++i)
+            shared += tree.nodes_.shares_element(snapshot->nodes_, i);
+        CHECK_GE(shared, node_count - 4 * (tree.depth() + 1));
+        CHECK_LT(shared, node_count);
+
+        // reads through a const tree copy nothing
+        auto second = tree.snapshot();
+        for (auto const & [key, value] : std::as_const(tree))
+            CHECK_EQ(value, map.at(key));
+        for (std::size_t i = 0; i < tree.node_count(); ++i)
+            CHECK(tree.nodes_.shares_element(second->nodes_, i));
+
+        auto rnd = std::mt19937{4711};
+        auto dist = std::uniform_int_distribution<int>(0, 60'000);
+        for (int i = 0; i < 20'000; ++i) {
+            auto key = dist(rnd);
+            if (auto it = tree.find(key); it != tree.end()) {
+                tree.erase(it);
+                map.erase(key);
+            } else {
+                tree.insert(key, -key);
+                map.emplace(key, -key);
+            }
+        }
+        check_sane(tree);
+        check_equal(tree, map, getkey, proj);
+        check_sane(*snapshot);
+        check_equal(*snapshot, snapshot_map, getkey, proj);
+        check_find_each(*snapshot, snapshot_map.begin(), snapshot_map.end(), proj);
+    }
+
+    TEST_CASE_FIXTURE(btree_test_class, "stats policy") {
+        static_assert(!has_stats<btree<int, int, unsigned, 4, 4>>, "no_stats counts nothing");
+        SUBCASE("tree_stats") {
+            btree<int, int, unsigned, 4, 4, midpoint_split, rebalance_policy<>, vector_storage, tree_stats> tree;
+            CHECK_EQ(tree.stats(), btree_stats{});
+            for (int key = 0; key < 1'000; ++key)
+                tree.insert(key, key);
+            auto stats = tree.stats();
+            CHECK_EQ(stats[btree_event::descent], 1'000);
+            // every split and every grow adds a node, nothing is deleted yet
+            CHECK_EQ(tree.node_count(), 1 + stats[btree_event::leaf_split] + stats[btree_event::internal_split] +
+                                        stats[btree_event::grow]);
+            CHECK_EQ(stats[btree_event::grow], tree.depth() - 1);
+            CHECK_EQ(stats[btree_event::leaf_merge], 0);
+
+            tree.reset_stats();
+            for (int key = 0; key < 1'000; ++key)
+                CHECK_NE(std::as_const(tree).find(key), tree.cend());
+            stats = tree.stats();
+            CHECK_EQ(stats[btree_event::descent], 1'000);
+            CHECK_EQ(stats.nodes_per_descent(), doctest::Approx(tree.depth()));
+            CHECK_EQ(stats[btree_event::leaf_split], 0);
+
+            // a copy starts from 0
+            auto copy = tree;
+            CHECK_EQ(copy.stats(), btree_stats{});
+
+            tree.reset_stats();
+            for (int key = 0; key < 1'000; ++key)
+                tree.erase(tree.find(key));
+            stats = tree.stats();
+            CHECK_EQ(tree.depth(), 1);
+            CHECK_EQ(stats[btree_event::shrink], copy.depth() - 1);
+            CHECK_GT(stats[btree_event::leaf_merge], 0);
+            CHECK_GT(stats[btree_event::internal_merge], 0);
+            CHECK_GE(stats[btree_event::leaf_rebalance], stats[btree_event::leaf_merge]);
+            CHECK_GE(stats[btree_event::internal_rebalance], stats[btree_event::internal_merge]);
+            CHECK_GT(stats[btree_event::parent_key_adjustment], 0);
+        }
+        SUBCASE("per_thread_stats") {
+            btree<int, int, unsigned, 4, 4, midpoint_split, rebalance_policy<>, vector_storage, per_thread_stats<2>> tree;
+            for (int key = 0; key < 1'000; ++key)
+                tree.insert(key, key);
+            tree.reset_stats();
+            // more readers than stripes
+            std::atomic<int> found{0};
+            std::vector<std::thread> readers;
+            for (int thread = 0; thread < 4; ++thread)
+                readers.emplace_back([&tree, &found] {
+                    for (int key = 0; key < 1'000; ++key)
+                        found += std::as_const(tree).find(key) != tree.cend();
+                });
+            for (auto &reader : readers)
+                reader.join();
+            CHECK_EQ(found, 4'000);
+            auto const stats = tree.stats();
+            CHECK_EQ(stats[btree_event::descent], 4'000);
+            CHECK_EQ(stats[btree_event::descent_node], 4'000 * std::uint64_t(tree.depth()));
+        }
+    }
+
+    TEST_CASE_FIXTURE(btree_test_class, "bulk_load") {
+        auto proj = [](auto const & e) -> decltype(auto) { return e.first; };
+        auto check_bulk_loaded = [&proj]<typename Btree_type>(Btree_type const & tree, std::vector<std::pair<int, int>> entries) {
+            std::ranges::stable_sort(entries, {}, &std::pair<int, int>::first);
+            check_sane(tree);
+            check_equal(tree, entries, getkey, proj);
+            // locality order: internal nodes first, root first, then the leaves one after the other
+            CHECK_EQ(tree.root_index(), 0);
+            auto leaf_index = tree.first_leaf_index();
+            for (typename Btree_type::index_type i = 0; i < leaf_index; ++i)
+                CHECK(std::holds_alternative<typename Btree_type::internal_node_type>(tree.node(i)));
+            for (; tree.leaf_node(leaf_index).has_next_leaf_index(); ++leaf_index)
+                CHECK_EQ(tree.leaf_node(leaf_index).next_leaf_index(), leaf_index + 1);
+            CHECK_EQ(leaf_index + 1, tree.node_count());
+        };
+        auto random_entries = [](std::size_t count, int max_key) {
+            auto rnd = std::mt19937{4711};
+            auto dist = std::uniform_int_distribution<int>(0, max_key);
+            std::vector<std::pair<int, int>> entries;
+            for (std::size_t i = 0; i < count; ++i)
+                entries.emplace_back(dist(rnd), static_cast<int>(i));
+            return entries;
+        };
+        thread_pool pool(4);
+
+        SUBCASE("sizes") {
+            for (std::size_t count : {0UL, 1UL, 4UL, 5UL, 20UL, 21UL, 100UL, 1'000UL}) {
+                CAPTURE(count);
+                auto entries = random_entries(count, 1'000'000);
+                btree_type tree;
+                tree.insert(7, 7);
+                tree.bulk_load(entries);
+                check_bulk_loaded(tree, entries);
+            }
+        }
+
+        SUBCASE("unique keys, find and change afterwards") {
+            std::vector<std::pair<int, int>> entries;
+            for (int i = 0; i < 20'000; ++i)
+                entries.emplace_back(2 * i, i);
+            std::ranges::shuffle(entries, std::mt19937{4711});
+            btree_type tree;
+            tree.bulk_load(entries);
+            check_bulk_loaded(tree, entries);
+            std::map<int, int> map(entries.begin(), entries.end());
+            check_find_each(tree, map.begin(), map.end(), proj);
+            for (int i = 0; i < 2'000; ++i) {
+                tree.insert(2 * i + 1, i);
+                map.emplace(2 * i + 1, i);
+                tree.erase(tree.find(4 * i));
+                map.erase(4 * i);
+            }
+            check_sane(tree);
+            check_equal(tree, map, getkey, proj);
+        }
+
+        SUBCASE("parallel") {
+            for (std::size_t count : {0UL, 3UL, 1'000UL, 200'000UL}) {
+                CAPTURE(count);
+                auto entries = random_entries(count, 1'000);
+                btree_type serial;
+                serial.bulk_load(entries);
+                btree_type parallel;
+                parallel.bulk_load(entries, pool);
+                check_bulk_loaded(parallel, entries);
+                CHECK(parallel == serial);
+            }
+        }
+
+        SUBCASE("other node storage") {
+            auto entries = random_entries(10'000, 100'000);
+            btree<int, int, unsigned, 8, 8, bstar_split, rebalance_policy<>, stable_storage> stable_tree;
+            stable_tree.bulk_load(entries, pool);
+            check_bulk_loaded(stable_tree, entries);
+            btree<int, int, unsigned, 8, 8, midpoint_split, rebalance_policy<>, cow_storage<>> cow_tree;
+            cow_tree.bulk_load(entries, pool);
+            check_bulk_loaded(cow_tree, entries);
+        }
+    }
+
+    TEST_CASE_FIXTURE(btree_test_class, "leaf ranges and parallel_for_each") {
+        auto rnd = std::mt19937{4711};
+        auto dist = std::uniform_int_distribution<int>(0, 5'000);
+        btree_type tree;
+        std::multimap<int, int> map;
+        for (int i = 0; i < 20'000; ++i) {
+            auto key = dist(rnd);
+            tree.insert(key, i);
+            map.emplace(key, i);
+        }
+        check_sane(tree);
+        using entries_type = std::vector<std::pair<int, int>>;
+        auto append_to = [](entries_type &entries) {
+            return [&entries](std::span<int const> keys, std::span<int const> values) {
+                CHECK_EQ(keys.size(), values.size());
+                CHECK_FALSE(keys.empty());
+                for (std::size_t i = 0; i < keys.size(); ++i)
+                    entries.emplace_back(keys[i], values[i]);
+            };
+        };
+        auto expected = [&map](int lo, int hi) {
+            std::vector<int> keys;
+            for (auto it = map.lower_bound(lo); lo < hi && it != map.lower_bound(hi); ++it)
+                keys.push_back(it->first);
+            return keys;
+        };
+        auto keys_of = [](entries_type const &entries) {
+            std::vector<int> keys;
+            for (auto const &[key, value] : entries)
+                keys.push_back(key);
+            return keys;
+        };
+        thread_pool pool(4);
+
+        SUBCASE("for_each in key order") {
+            entries_type all;
+            tree.for_each(append_to(all));
+            CHECK_EQ(keys_of(all), expected(0, 5'001));
+            for (auto [lo, hi] : {std::pair{0, 5'001}, {-10, 3}, {17, 18}, {100, 4'000}, {4'990, 10'000}, {300, 300}, {400, 200}}) {
+                CAPTURE(lo);
+                CAPTURE(hi);
+                entries_type entries;
+                tree.for_each(lo, hi, append_to(entries));
+                CHECK_EQ(keys_of(entries), expected(lo, hi));
+            }
+        }
+
+        SUBCASE("splitting covers every leaf once, in order") {
+            std::function<void(btree_type::leaf_range const &, entries_type &)> split_all =
+                [&split_all, &append_to](btree_type::leaf_range const &range, entries_type &entries) {
+                    if (!range.is_divisible()) {
+                        range.for_each_leaf(append_to(entries));
+                        return;
+                    }
+                    auto [left, right] = range.split();
+                    split_all(left, entries);
+                    split_all(right, entries);
+                };
+            entries_type whole;
+            tree.for_each(append_to(whole));
+            entries_type parts;
+            split_all(tree.leaves(), parts);
+            CHECK_EQ(parts, whole);
+            int lo = 1'234;
+            int hi = 3'456;
+            entries_type bounded_parts;
+            split_all(tree.leaves(lo, hi), bounded_parts);
+            CHECK_EQ(keys_of(bounded_parts), expected(lo, hi));
+        }
+
+        SUBCASE("parallel_for_each") {
+            for (auto [lo, hi] : {std::pair{0, 5'001}, {1'000, 1'001}, {2'500, 4'000}}) {
+                CAPTURE(lo);
+                CAPTURE(hi);
+                std::mutex mutex;
+                entries_type entries;
+                tree.parallel_for_each(lo, hi, [&mutex, &entries](std::span<int const> keys, std::span<int const> values) {
+                    std::lock_guard lock(mutex);
+                    for (std::size_t i = 0; i < keys.size(); ++i)
+                        entries.emplace_back(keys[i], values[i]);
+                }, pool);
+                entries_type serial;
+                tree.for_each(lo, hi, append_to(serial));
+                std::ranges::sort(entries);
+                std::ranges::sort(serial);
+                CHECK_EQ(entries, serial);
+            }
+            std::atomic<std::size_t> count{0};
+            tree.parallel_for_each([&count](std::span<int const> keys, std::span<int const>) {
+                count += keys.size();
+            }, pool);
+            CHECK_EQ(count.load(), map.size());
+        }
+
+        SUBCASE("parallel_for_each rethrows") {
+            CHECK_THROWS_AS(tree.parallel_for_each([](std::span<int const>, std::span<int const>) {
+                throw std::runtime_error("leaf");
+            }, pool), std::runtime_error);
+        }
+    }
+
+    TEST_CASE_FIXTURE(btree_test_class, "buffered_btree") {
+        auto check_random_operations = []<typename Buffered_type>(Buffered_type &tree, int max_key, int erase_percent) {
+            auto rnd = std::mt19937{4711};
+            auto key_dist = std::uniform_int_distribution<int>(0, max_key);
+            auto percent = std::uniform_int_distribution<int>(0, 99);
+            std::map<int, int> map;
+            for (int i = 0; i < 30'000; ++i) {
+                auto key = key_dist(rnd);
+                if (percent(rnd) < erase_percent) {
+                    tree.erase(key);
+                    map.erase(key);
+                } else {
+                    tree.insert(key, i);
+                    map.insert_or_assign(key, i);
+                }
+                if (i % 97 == 0) {
+                    auto probe = key_dist(rnd);
+                    CAPTURE(probe);
+                    auto found = tree.find(probe);
+                    REQUIRE_EQ(found.has_value(), map.contains(probe));
+                    if (found)
+                        CHECK_EQ(*found, map.find(probe)->second);
+                }
+            }
+            CHECK_GT(tree.buffered_size(), 0);
+            tree.flush();
+            CHECK_EQ(tree.buffered_size(), 0);
+            check_sane(tree.unbuffered());
+            check_equal(tree.unbuffered(), map, getkey, [](auto const &e) -> decltype(auto) { return e.first; });
+        };
+
+        SUBCASE("inserts only") {
+            buffered_btree<int, int, unsigned, 4, 4, 8> tree;
+            check_random_operations(tree, 1'000'000, 0);
+        }
+
+        SUBCASE("inserts and erases") {
+            buffered_btree<int, int, unsigned, 4, 4, 8> tree;
+            check_random_operations(tree, 2'000, 40);
+        }
+
+        SUBCASE("bigger buffers, rebalance with hysteresis") {
+            buffered_btree<int, int, unsigned, 8, 8, 64, midpoint_split, rebalance_policy<25, 50, true>> tree;
+            check_random_operations(tree, 5'000, 30);
+        }
+
+        SUBCASE("erase all, the root becomes a leaf again") {
+            buffered_btree<int, int, unsigned, 4, 4, 8> tree;
+            for (int i = 0; i < 1'000; ++i)
+                tree.insert(i, i);
+            for (int i = 0; i < 1'000; ++i)
+                tree.erase(i);
+            CHECK_FALSE(tree.contains(500));
+            tree.flush();
+            check_sane(tree.unbuffered());
+            CHECK(tree.unbuffered().begin() == tree.unbuffered().end());
+        }
+
+        SUBCASE("an insert replaces the value, before and after flushing") {
+            buffered_btree<int, int, unsigned, 4, 4, 8> tree;
+            for (int i = 0; i < 100; ++i)
+                tree.insert(i, i);
+            tree.insert(42, 1);
+            tree.flush();
+            CHECK_EQ(tree.find(42), std::optional(1));
+            tree.insert(42, 2);
+            CHECK_EQ(tree.find(42), std::optional(2));
+            tree.flush();
+            CHECK_EQ(tree.find(42), std::optional(2));
+            // a replaced key within one batch
+            tree.insert(42, 3);
+            tree.insert(42, 4);
+            tree.flush();
+            CHECK_EQ(tree.find(42), std::optional(4));
+            int entries = 0;
+            for ([[maybe_unused]] auto const &entry : tree.unbuffered())
+                ++entries;
+            CHECK_EQ(entries, 100);
+            check_sane(tree.unbuffered());
+        }
+    }
+
+    TEST_CASE_FIXTURE(btree_test_class, "deferred rebalancing and maintain") {
+        auto proj = [](auto const & e) -> decltype(auto) { return e.first; };
+        auto check_deferred = [&proj]<typename Btree_type>(Btree_type &tree) {
+            std::vector<int> keys(5'000);
+            std::iota(keys.begin(), keys.end(), 0);
+            std::ranges::shuffle(keys, std::mt19937{4711});
+            std::map<int, int> map;
+            for (auto key : keys) {
+                tree.insert(key, key);
+                map.emplace(key, key);
+            }
+            // erase most keys: nodes underflow, only the ones becoming empty are rebalanced at once
+            for (std::size_t i = 0; i < keys.size(); ++i) {
+                if (i % 5 == 0)
+                    continue;
+                tree.erase(tree.find(keys[i]));
+                map.erase(keys[i]);
+            }
+            CHECK_GT(tree.deferred_count(), 0);
+            check_equal(tree, map, getkey, proj);
+            check_find_each(tree, map.begin(), map.end(), proj);
+            for (int key = 10'000; key < 10'500; ++key) {
+                tree.insert(key, key);
+                map.emplace(key, key);
+            }
+            // a zero budget does a single step
+            auto deferred = tree.deferred_count();
+            CHECK_FALSE(tree.maintain(std::chrono::nanoseconds(0)));
+            CHECK_LE(tree.deferred_count(), deferred);
+            while (!tree.maintain(std::chrono::microseconds(100))) {}
+            CHECK_EQ(tree.deferred_count(), 0);
+            CHECK(tree.free_node_indices().empty());
+            CHECK_EQ(tree.node_count(), tree.locality_order().size());
+            check_sane(tree);
+            check_equal(tree, map, getkey, proj);
+            check_find_each(tree, map.begin(), map.end(), proj);
+        };
+
+        SUBCASE("midpoint_split") {
+            btree<int, int, unsigned, 4, 4, midpoint_split, rebalance_policy<50, 50, false, true>> tree;
+            check_deferred(tree);
+        }
+
+        SUBCASE("bstar_split, hysteresis, cow_storage") {
+            btree<int, int, unsigned, 8, 8, bstar_split, rebalance_policy<25, 50, true, true>, cow_storage<>> tree;
+            check_deferred(tree);
+        }
+
+        SUBCASE("maintain without deferred rebalancing compacts") {
+            btree_type tree;
+            for (int key = 0; key < 1'000; ++key)
+                tree.insert(key, key);
+            for (int key = 0; key < 1'000; key += 2)
+                tree.erase(tree.find(key));
+            CHECK_EQ(tree.deferred_count(), 0);
+            CHECK_FALSE(tree.free_node_indices().empty());
+            while (!tree.maintain(std::chrono::microseconds(100))) {}
+            CHECK_EQ(tree.node_count(), tree.locality_order().size());
+            check_sane(tree);
+        }
+    }
+
+    TEST_CASE_FIXTURE(btree_test_class, "save and load") {
+        auto proj = [](auto const & e) -> decltype(auto) { return e.first; };
+        auto rnd = std::mt19937{4711};
+        auto dist = std::uniform_int_distribution<int>(0, 1'000'000);
+        btree_type tree;
+        std::map<int, int> map;
+        for (int i = 0; i < 5'000; ++i) {
+            auto key = dist(rnd);
+            if (map.emplace(key, i).second)
+                tree.insert(key, i);
+        }
+        // erased nodes leave free indices behind
+        for (auto it = map.begin(); it != map.end();) {
+            tree.erase(tree.find(it->first));
+            it = map.erase(it);
+            if (it != map.end())
+                ++it;
+        }
+        REQUIRE_FALSE(tree.free_node_indices().empty());
+        std::stringstream stream;
+        tree.save(stream);
+        auto const saved = stream.str();
+
+        SUBCASE("round trip") {
+            btree_type loaded;
+            loaded.insert(7, 7);
+            loaded.load(stream);
+            check_sane(loaded);
+            check_equal(loaded, map, getkey, proj);
+            check_find_each(loaded, map.begin(), map.end(), proj);
+            CHECK_EQ(loaded.node_count(), tree.node_count());
+            CHECK_EQ(loaded.root_index(), tree.root_index());
+            CHECK_EQ(loaded.free_node_indices(), tree.free_node_indices());
+            // the loaded tree can be changed like the saved one
+            for (int i = 0; i < 2'000; ++i) {
+                auto key = dist(rnd);
+                if (map.emplace(key, i).second)
+                    loaded.insert(key, i);
+            }
+            for (int i = 0; i < 1'000; ++i) {
+                auto it = map.begin();
+                loaded.erase(loaded.find(it->first));
+                map.erase(it);
+            }
+            check_sane(loaded);
+            check_equal(loaded, map, getkey, proj);
+        }
+
+        SUBCASE("empty tree") {
+            btree_type empty;
+            std::stringstream empty_stream;
+            empty.save(empty_stream);
+            tree.load(empty_stream);
+            check_sane(tree);
+            CHECK(tree.begin() == tree.end());
+            CHECK_EQ(tree.node_count(), 1);
+        }
+
+        SUBCASE("file descriptor") {
+            auto *file = std::tmpfile();
+            REQUIRE(file != nullptr);
+            tree.save(fileno(file));
+            std::rewind(file);
+            btree_type loaded;
+            loaded.load(fileno(file));
+            std::fclose(file);
+            check_sane(loaded);
+            CHECK(loaded == tree);
+        }
+
+        SUBCASE("corrupt input leaves the tree unchanged") {
+            btree_type loaded;
+            loaded.insert(7, 7);
+            auto check_rejected = [&loaded](std::string const &bytes) {
+                std::stringstream corrupt(bytes);
+                CHECK_THROWS_AS(loaded.load(corrupt), std::runtime_error);
+                check_sane(loaded);
+                CHECK_EQ(loaded.find(7), loaded.begin());
+                CHECK_EQ(loaded.node_count(), 1);
+            };
+            for (auto position : {std::size_t(0), saved.size() / 2, saved.size() - 1}) {
+                CAPTURE(position);
+                auto flipped = saved;
+                flipped[position] = static_cast<char>(flipped[position] ^ 0x10);
+                check_rejected(flipped);
+            }
+            check_rejected(saved.substr(0, saved.size() / 3));
+            check_rejected(saved.substr(0, saved.size() - 1));
+            check_rejected("");
+            // a node count far beyond the input is rejected before the nodes are allocated
+            auto too_many_nodes = saved;
+            auto const node_count = std::uint64_t(btree_type::INVALID_INDEX - 1);
+            // behind the magic, format version, byte order mark and five sizes
+            std::memcpy(too_many_nodes.data() + 56, &node_count, sizeof(node_count));
+            check_rejected(too_many_nodes);
+            // an index beyond the nodes with a matching checksum, in any field of a small tree: every node index is
+            // checked, the other fields are rejected by their sizes or load a tree which can be used
+            btree_type small;
+            for (int key = 0; key < 20; ++key)
+                small.insert(key, key);
+            REQUIRE_LT(small.node_count(), 0x7f);
+            std::stringstream small_stream;
+            small.save(small_stream);
+            auto const small_saved = small_stream.str();
+            auto const bad_index = 0x7fff'ffffU;
+            std::size_t rejected = 0;
+            // behind the node count and the root index, up to the checksum
+            for (auto position = std::size_t(68); position + sizeof(bad_index) + sizeof(std::uint64_t) <= small_saved.size(); ++position) {
+                CAPTURE(position);
+                auto tampered = small_saved;
+                std::memcpy(tampered.data() + position, &bad_index, sizeof(bad_index));
+                checksum sum;
+                sum.update({reinterpret_cast<std::byte const *>(tampered.data()), tampered.size() - sizeof(std::uint64_t)});
+                auto const value = sum.value();
+                std::memcpy(tampered.data() + tampered.size() - sizeof(value), &value, sizeof(value));
+                btree_type tampered_tree;
+                std::stringstream tampered_stream(tampered);
+                try {
+                    tampered_tree.load(tampered_stream);
+                } catch (std::runtime_error const &) {
+                    ++rejected;
+                    continue;
+                }
+                for (int key = -1; key <= 20; ++key)
+                    static_cast<void>(tampered_tree.contains(key));
+                std::size_t steps = 0;
+                for (auto it = tampered_tree.begin(); it != tampered_tree.end() && steps <= 20; ++it)
+                    ++steps;
+            }
+            CHECK_GT(rejected, 0);
+            btree<int, int, unsigned, 8, 8> other_order;
+            std::stringstream other(saved);
+            CHECK_THROWS_AS(other_order.load(other), std::runtime_error);
+        }
+
+        SUBCASE("corrupt string length") {
+            // a stream which cannot tell how many bytes are left
+            struct unseekable_buffer : std::stringbuf {
+                using std::stringbuf::stringbuf;
+                auto seekoff(off_type, std::ios_base::seekdir, std::ios_base::openmode) -> pos_type override { return pos_type(-1); }
+                auto seekpos(pos_type, std::ios_base::openmode) -> pos_type override { return pos_type(-1); }
+            };
+            btree<int, std::string, unsigned, 8, 8> strings;
+            strings.insert(1, "abc");
+            std::stringstream string_stream;
+            strings.save(string_stream);
+            auto bytes = string_stream.str();
+            auto const length = std::uint64_t(3);
+            auto const position = bytes.find(std::string(reinterpret_cast<char const *>(&length), sizeof(length)) + "abc");
+            REQUIRE_NE(position, std::string::npos);
+            auto const huge = std::uint64_t(1) << 40;
+            std::memcpy(bytes.data() + position, &huge, sizeof(huge));
+
+            std::stringstream corrupt(bytes);
+            CHECK_THROWS_AS(strings.load(corrupt), std::runtime_error);
+            unseekable_buffer buffer(bytes);
+            std::istream unseekable(&buffer);
+            CHECK_THROWS_AS(strings.load(unseekable), std::runtime_error);
+            auto *file = std::tmpfile();
+            REQUIRE(file != nullptr);
+            REQUIRE_EQ(std::fwrite(bytes.data(), 1, bytes.size(), file), bytes.size());
+            std::fflush(file);
+            std::rewind(file);
+            CHECK_THROWS_AS(strings.load(fileno(file)), std::runtime_error);
+            std::fclose(file);
+            CHECK_EQ((*strings.find(1)).second, "abc");
+        }
+
+        SUBCASE("other node storage and strings") {
+            std::vector<std::pair<int, std::string>> entries;
+            for (int i = 0; i < 3'000; ++i)
+                entries.emplace_back(i, std::string(static_cast<std::size_t>(i % 50), static_cast<char>('a' + i % 26)));
+            btree<int, std::string, unsigned, 8, 8, midpoint_split, rebalance_policy<>, cow_storage<>> cow_tree;
+            cow_tree.bulk_load(entries);
+            std::stringstream cow_stream;
+            cow_tree.save(cow_stream);
+            btree<int, std::string, unsigned, 8, 8, bstar_split, rebalance_policy<>, aligned_node_storage<>> aligned_tree;
+            aligned_tree.load(cow_stream);
+            check_sane(aligned_tree);
+            check_equal(aligned_tree, entries, getkey, proj);
+            auto second = [](auto const & e) -> decltype(auto) { return e.second; };
+            check_equal(aligned_tree, entries, second, second);
+        }
+    }
+
+    TEST_CASE_FIXTURE(btree_test_class, "lower_bound and mapped_btree") {
+        auto proj = [](auto const & e) -> decltype(auto) { return e.first; };
+        auto second = [](auto const & e) -> decltype(auto) { return e.second; };
+        auto rnd = std::mt19937{4711};
+        auto dist = std::uniform_int_distribution<int>(0, 20'000);
+        btree_type tree;
+        std::multimap<int, int> map;
+        for (int i = 0; i < 5'000; ++i) {
+            auto key = dist(rnd);
+            tree.insert(key, i);
+            map.emplace(key, i);
+        }
+        // erase unique keys only, erasing duplicates across leaves is not supported
+        for (int key = 0; key < 20'000; key += 3) {
+            if (map.count(key) == 1) {
+                tree.erase(tree.find(key));
+                map.erase(key);
+            }
+        }
+        auto const path = std::filesystem::temp_directory_path() / "bt_test2_mapped.btree";
+        auto save_image = [&path](auto const &t) {
+            std::ofstream out(path, std::ios::binary | std::ios::trunc);
+            t.save_image(out);
+        };
+
+        SUBCASE("lower_bound") {
+            for (int key = -1; key <= 20'001; key += 7) {
+                CAPTURE(key);
+                auto expected = map.lower_bound(key);
+                auto it = std::as_const(tree).lower_bound(key);
+                REQUIRE_EQ(it == tree.cend(), expected == map.end());
+                if (expected != map.end())
+                    CHECK_EQ((*it).first, expected->first);
+                CHECK(tree.lower_bound(key) == tree.find(key) || !tree.contains(key));
+            }
+        }
+
+        SUBCASE("find, lower_bound and iteration on the mapped image") {
+            save_image(tree);
+            mapped_btree<btree_type> mapped(path);
+            CHECK(mapped.verify());
+            CHECK_EQ(mapped.size(), map.size());
+            CHECK_EQ(mapped.node_count(), tree.node_count());
+            check_equal(mapped, map, getkey, proj);
+            check_equal(mapped, map, second, second);
+            for (int key = -1; key <= 20'001; key += 7) {
+                CAPTURE(key);
+                auto expected = map.lower_bound(key);
+                auto it = mapped.lower_bound(key);
+                REQUIRE_EQ(it == mapped.end(), expected == map.end());
+                if (expected != map.end())
+                    CHECK_EQ((*it).first, expected->first);
+                CHECK_EQ(mapped.contains(key), map.contains(key));
+                // with duplicates the same entry as btree::find
+                if (map.contains(key))
+                    CHECK_EQ((*mapped.find(key)).second, (*tree.find(key)).second);
+            }
+            // the mapping outlives moves of the mapped_btree
+            auto moved = std::move(mapped);
+            CHECK_EQ(moved.size(), map.size());
+        }
+
+        SUBCASE("empty tree, other node storage") {
+            save_image(btree_type{});
+            mapped_btree<btree_type> empty(path);
+            CHECK(empty.empty());
+            CHECK(empty.begin() == empty.end());
+            CHECK(empty.lower_bound(0) == empty.end());
+
+            using aligned_type = btree<int, int, unsigned, 8, 8, midpoint_split, rebalance_policy<>, aligned_node_storage<256>>;
+            aligned_type aligned;
+            std::vector<std::pair<int, int>> entries(map.begin(), map.end());
+            aligned.bulk_load(entries);
+            save_image(aligned);
+            mapped_btree<aligned_type> mapped(path);
+            check_equal(mapped, map, getkey, proj);
+        }
+
+        SUBCASE("images of equal trees are equal byte by byte") {
+            // the leaves of tree keep erased entries behind their size, the ones of the copy do not
+            btree_type copy = tree;
+            std::ostringstream image;
+            tree.save_image(image);
+            std::ostringstream copy_image;
+            copy.save_image(copy_image);
+            CHECK(image.str() == copy_image.str());
+        }
+
+        SUBCASE("invalid images are rejected") {
+            using other_order_type = btree<int, int, unsigned, 8, 8>;
+            CHECK_THROWS_AS(mapped_btree<btree_type>{path.string() + ".missing"}, std::system_error);
+            save_image(tree);
+            CHECK_THROWS_AS(mapped_btree<other_order_type>{path}, std::runtime_error);
+            std::filesystem::resize_file(path, std::filesystem::file_size(path) / 2);
+            CHECK_THROWS_AS(mapped_btree<btree_type>{path}, std::runtime_error);
+            save_image(tree);
+            {
+                std::fstream file(path, std::ios::binary | std::ios::in | std::ios::out);
+                file.seekp(static_cast<std::streamoff>(std::filesystem::file_size(path) / 2));
+                file.put('\x7f');
+            }
+            mapped_btree<btree_type> corrupt(path);
+            CHECK_FALSE(corrupt.verify());
+        }
+
+        SUBCASE("corrupt node counts and nodes throw") {
+            std::ostringstream out;
+            tree.save_image(out);
+            auto const image = out.str();
+            auto write_image = [&path](std::string const &bytes) {
+                std::ofstream(path, std::ios::binary | std::ios::trunc) << bytes;
+            };
+            // node_count * node size overflows to a small number
+            auto bytes = image;
+            std::uint64_t const huge = (std::uint64_t(1) << 63) / sizeof(btree_type::common_node_type) * 2;
+            std::memcpy(bytes.data() + offsetof(btree_image_header, node_count), &huge, sizeof(huge));
+            write_image(bytes);
+            CHECK_THROWS_AS(mapped_btree<btree_type>{path}, std::runtime_error);
+
+            // an out of bounds index in every word of the root and of the first leaf: lookups and iteration either
+            // work or throw, they never read outside of the image
+            std::uint64_t root = 0;
+            std::uint64_t first_leaf = 0;
+            std::memcpy(&root, image.data() + offsetof(btree_image_header, root_index), sizeof(root));
+            std::memcpy(&first_leaf, image.data() + offsetof(btree_image_header, first_leaf_index), sizeof(first_leaf));
+            unsigned const bad_index = 0x7fff'ffff;
+            std::size_t thrown = 0;
+            for (auto node : {root, first_leaf}) {
+                auto const node_offset = btree_image_header::IMAGE_ALIGNMENT + node * sizeof(btree_type::common_node_type);
+                for (std::size_t word = 0; word + sizeof(bad_index) <= sizeof(btree_type::common_node_type); word += sizeof(bad_index)) {
+                    CAPTURE(node);
+                    CAPTURE(word);
+                    bytes = image;
+                    std::memcpy(bytes.data() + node_offset + word, &bad_index, sizeof(bad_index));
+                    write_image(bytes);
+                    mapped_btree<btree_type> corrupt(path);
+                    try {
+                        for (int key = -1; key <= 20'001; key += 97)
+                            static_cast<void>(corrupt.contains(key));
+                        std::size_t steps = 0;
+                        for (auto it = corrupt.begin(); it != corrupt.end() && steps <= map.size(); ++it)
+                            ++steps;
+                    } catch (std::runtime_error const &) {
+                        ++thrown;
+                    }
+                }
+            }
+            CHECK_GT(thrown, 0);
+        }
+        std::filesystem::remove(path);
+    }
+
+    TEST_CASE_FIXTURE(btree_test_class, "storage policy paged_storage") {
+        auto proj = [](auto const & e) -> decltype(auto) { return e.first; };
+        auto second = [](auto const & e) -> decltype(auto) { return e.second; };
+
+        SUBCASE("more nodes than frames") {
+            using paged_btree_type = btree<int, int, unsigned, 8, 8, midpoint_split, rebalance_policy<>, paged_storage<32>>;
+            paged_btree_type tree;
+            std::map<int, int> map;
+            auto rnd = std::mt19937{4711};
+            auto dist = std::uniform_int_distribution<int>(0, 60'000);
+            for (int i = 0; i < 40'000; ++i) {
+                auto key = dist(rnd);
+                if (auto it = tree.find(key); it != tree.end()) {
+                    tree.erase(it);
+                    map.erase(key);
+                } else {
+                    tree.insert(key, -key);
+                    map.emplace(key, -key);
+                }
+            }
+            auto const &pool_stats = tree.node_storage().stats();
+            CHECK_GT(tree.node_count(), 1000);
+            CHECK_LE(tree.node_storage().resident_count(), 32);
+            CHECK_GT(pool_stats.evictions, 0);
+            CHECK_GT(pool_stats.writes, 0);
+            check_equal(tree, map, getkey, proj);
+            check_equal(tree, map, second, second);
+            check_find_each(tree, map.begin(), map.end(), proj);
+
+            // reading through a const tree writes no pages
+            tree.node_storage().flush();
+            tree.node_storage().reset_stats();
+            check_equal(std::as_const(tree), map, getkey, proj);
+            CHECK_EQ(pool_stats.writes, 0);
+            CHECK_GT(pool_stats.misses, 0);
+
+            tree.reorganize();
+            check_equal(tree, map, getkey, proj);
+            long long sum = 0;
+            tree.for_each([&sum](std::span<int const> keys, std::span<int const>) {
+                sum += std::accumulate(keys.begin(), keys.end(), 0LL);
+            });
+            CHECK_EQ(sum, std::accumulate(map.begin(), map.end(), 0LL, [](long long s, auto const &e) { return s + e.first; }));
+
+            // runs on the calling thread, the buffer pool is not thread safe
+            thread_pool pool(4);
+            std::vector<std::pair<int, int>> entries(map.begin(), map.end());
+            std::ranges::shuffle(entries, rnd);
+            tree.bulk_load(entries, pool);
+            check_equal(tree, map, getkey, proj);
+            std::size_t count = 0;
+            tree.parallel_for_each([&count](std::span<int const> keys, std::span<int const>) { count += keys.size(); }, pool);
+            CHECK_EQ(count, map.size());
+        }
+
+        SUBCASE("one node per page") {
+            static constexpr auto internal_order = page_storage_order<btree_internal_node, int, int, unsigned, 4096>();
+            static constexpr auto leaf_order = page_storage_order<btree_leaf_node, int, int, unsigned, 4096>();
+            using paged_btree_type = btree<int, int, unsigned, internal_order, leaf_order, midpoint_split,
+                rebalance_policy<>, paged_storage<1024>>;
+            static_assert(paged_btree_type::nodes_type::PAGE_BYTES == 4096);
+            paged_btree_type tree;
+            std::multimap<int, int> map;
+            auto rnd = std::mt19937{4711};
+            auto dist = std::uniform_int_distribution<int>(1, 100'000);
+            for (unsigned i = 0; i < 100'000; ++i) {
+                auto key = dist(rnd);
+                map.insert(std::make_pair(key, key));
+                tree.insert(key, key);
+            }
+            // all nodes fit into the pool, so check_sane may hold references to all of them
+            REQUIRE_LT(tree.node_count(), 1024);
+            check_sane(tree);
+            check_equal(tree, map, getkey, proj);
+            check_find_each(tree, map.begin(), map.end(), proj);
+            CHECK_EQ(tree.node_storage().stats().evictions, 0);
+        }
+
+        SUBCASE("the fewest frames allowed") {
+            // splits, merges and rebalancing hold nodes by reference while reading others, which evicts pages
+            auto check_random_operations = [&](auto &tree, auto &copy) {
+                std::map<int, int> map;
+                auto rnd = std::mt19937{4711};
+                auto dist = std::uniform_int_distribution<int>(0, 3'000);
+                for (int i = 0; i < 20'000; ++i) {
+                    auto key = dist(rnd);
+                    if (auto it = tree.find(key); it != tree.end()) {
+                        tree.erase(it);
+                        map.erase(key);
+                    } else {
+                        tree.insert(key, -key);
+                        map.emplace(key, -key);
+                    }
+                }
+                // erase most keys: merges up to the root
+                std::vector<int> keys;
+                for (auto const &[key, value] : map)
+                    keys.push_back(key);
+                std::ranges::shuffle(keys, rnd);
+                keys.resize(keys.size() - 20);
+                for (auto key : keys) {
+                    tree.erase(tree.find(key));
+                    map.erase(key);
+                }
+                CHECK_GT(tree.node_storage().stats().evictions, 0);
+                check_equal(tree, map, getkey, proj);
+                check_equal(tree, map, second, second);
+                // check_sane holds references to all nodes: check a copy in memory
+                std::stringstream stream;
+                tree.save(stream);
+                copy.load(stream);
+                CHECK(check_sane(copy));
+                check_equal(copy, map, getkey, proj);
+            };
+            btree<int, int, unsigned, 4, 4, midpoint_split, rebalance_policy<>, paged_storage<16>> midpoint_tree;
+            btree<int, int, unsigned, 4, 4, midpoint_split> midpoint_copy;
+            check_random_operations(midpoint_tree, midpoint_copy);
+            btree<int, int, unsigned, 4, 4, bstar_split, rebalance_policy<25, 50, true>, paged_storage<16>> bstar_tree;
+            btree<int, int, unsigned, 4, 4, bstar_split, rebalance_policy<25, 50, true>> bstar_copy;
+            check_random_operations(bstar_tree, bstar_copy);
+        }
+    }
+
+    TEST_CASE_FIXTURE(btree_test_class, "find_batch and read-ahead") {
+        auto proj = [](auto const & e) -> decltype(auto) { return e.first; };
+        auto rnd = std::mt19937{4711};
+        auto dist = std::uniform_int_distribution<int>(0, 100'000);
+        std::multimap<int, int> map;
+        for (int i = 0; i < 30'000; ++i) {
+            auto key = dist(rnd);
+            map.emplace(key, i);
+        }
+        std::vector<int> keys;
+        for (int i = 0; i < 10'000; ++i)
+            keys.push_back(dist(rnd));
+        auto check_batch = [&keys](auto const &tree) {
+            auto const found = tree.find_batch(keys);
+            REQUIRE_EQ(found.size(), keys.size());
+            for (std::size_t i = 0; i < keys.size(); ++i) {
+                CAPTURE(keys[i]);
+                CHECK(found[i] == tree.find(keys[i]));
+            }
+        };
+
+        SUBCASE("in memory") {
+            btree_type tree;
+            for (auto const &[key, value] : map)
+                tree.insert(key, value);
+            check_batch(tree);
+            CHECK(tree.find_batch({}).empty());
+            CHECK(btree_type{}.find_batch(keys).size() == keys.size());
+        }
+
+        SUBCASE("paged_storage") {
+            using paged_btree_type = btree<int, int, unsigned, 8, 8, midpoint_split, rebalance_policy<>, paged_storage<64, 4096, 4>>;
+            paged_btree_type tree;
+            for (auto const &[key, value] : map)
+                tree.insert(key, value);
+            auto const &pool_stats = tree.node_storage().stats();
+            tree.node_storage().reset_stats();
+            check_batch(tree);
+            CHECK_GT(pool_stats.prefetches, 0);
+
+            // iterators and for_each read the next leaves ahead
+            tree.node_storage().reset_stats();
+            check_equal(tree, map, getkey, proj);
+            CHECK_GT(pool_stats.prefetches, 0);
+            CHECK_GT(pool_stats.hit_rate(), 0.5);
+            tree.node_storage().reset_stats();
+            std::size_t count = 0;
+            tree.for_each([&count](std::span<int const> leaf_keys, std::span<int const>) { count += leaf_keys.size(); });
+            CHECK_EQ(count, map.size());
+            CHECK_GT(pool_stats.prefetches, 0);
+        }
+    }
+
+    TEST_CASE_FIXTURE(btree_test_class, "write-ahead log and durable_btree") {
+        using durable_type = durable_btree<btree_type>;
+        auto proj = [](auto const & e) -> decltype(auto) { return e.first; };
+        auto const directory = std::filesystem::temp_directory_path() / "bt_test2_durable";
+        std::filesystem::remove_all(directory);
+        auto rnd = std::mt19937{4711};
+        std::vector<int> keys(3'000);
+        std::iota(keys.begin(), keys.end(), 0);
+        std::ranges::shuffle(keys, rnd);
+        std::map<int, int> map;
+        auto change = [&map](durable_type &tree, std::span<int const> range) {
+            for (auto key : range) {
+                CHECK(tree.insert(key, -key));
+                map.emplace(key, -key);
+            }
+            for (std::size_t i = 0; i < range.size(); i += 3) {
+                CHECK_EQ(tree.erase(range[i]), 1);
+                map.erase(range[i]);
+            }
+            CHECK_EQ(tree.erase(-1), 0);
+        };
+
+        SUBCASE("reopen, checkpoint and torn tail") {
+            {
+                durable_type tree(directory);
+                change(tree, std::span(keys).first(1'000));
+                CHECK_EQ(tree.log().durable_lsn(), tree.log().last_lsn());
+                CHECK_EQ(tree.find(keys[1]), std::optional<int>(-keys[1]));
+                CHECK_FALSE(tree.contains(keys[0]));
+            }
+            {
+                // the log is replayed
+                durable_type tree(directory);
+                check_sane(tree.unsynchronized());
+                check_equal(tree.unsynchronized(), map, getkey, proj);
+                auto const lsn = tree.log().last_lsn();
+                CHECK_EQ(lsn, 1'000 + 334);
+                tree.checkpoint();
+                CHECK_EQ(tree.snapshot_lsn(), lsn);
+                CHECK_EQ(tree.log().size(), 0);
+                change(tree, std::span(keys).subspan(1'000, 1'000));
+                CHECK_EQ(tree.log().last_lsn(), lsn + 1'334);
+            }
+            {
+                // a torn frame at the end of the log is dropped
+                std::ofstream log(directory / "log", std::ios::binary | std::ios::app);
+                log << "a frame cut short by a crash";
+            }
+            {
+                // snapshot and the log after it
+                durable_type tree(directory, durable_type::commit_mode::deferred);
+                check_sane(tree.unsynchronized());
+                check_equal(tree.unsynchronized(), map, getkey, proj);
+                auto const size = tree.log().size();
+                change(tree, std::span(keys).subspan(2'000));
+                CHECK_EQ(tree.log().size(), size);
+                tree.sync();
+                CHECK_GT(tree.log().size(), size);
+            }
+            durable_type tree(directory);
+            check_equal(tree.unsynchronized(), map, getkey, proj);
+        }
+
+        SUBCASE("write_ahead_log") {
+            std::filesystem::create_directories(directory);
+            using log_type = write_ahead_log<int, double>;
+            std::vector<std::tuple<log_type::operation, std::uint64_t, int, double>> records;
+            auto collect = [&records](log_type::operation op, std::uint64_t lsn, int key, double value) {
+                records.emplace_back(op, lsn, key, value);
+            };
+            {
+                log_type log(directory / "wal");
+                CHECK_EQ(log.last_lsn(), 0);
+                CHECK_EQ(log.append(log_type::operation::insert, 1, 0.5), 1);
+                CHECK_EQ(log.append(log_type::operation::erase, 1), 2);
+                CHECK_EQ(log.durable_lsn(), 0);
+                log.commit(1);
+                CHECK_EQ(log.durable_lsn(), 2);
+                CHECK_EQ(log.sync_count(), 1);
+                // nothing left to write
+                log.sync();
+                CHECK_EQ(log.sync_count(), 1);
+                log.append(log_type::operation::insert, 2, 1.5);
+                CHECK_THROWS_AS(log.truncate(2), std::logic_error);
+            }
+            {
+                // records not committed are lost
+                log_type log(directory / "wal");
+                CHECK_EQ(log.last_lsn(), 2);
+                log.replay(0, collect);
+                REQUIRE_EQ(records.size(), 2);
+                CHECK(records[0] == std::tuple(log_type::operation::insert, 1, 1, 0.5));
+                CHECK(records[1] == std::tuple(log_type::operation::erase, 2, 1, 0.0));
+                records.clear();
+                log.replay(1, collect);
+                CHECK_EQ(records.size(), 1);
+                log.truncate(2);
+                CHECK_EQ(log.size(), 0);
+                CHECK_EQ(log.append(log_type::operation::insert, 3, 2.5), 3);
+                log.sync();
+            }
+            log_type log(directory / "wal", 2);
+            CHECK_EQ(log.last_lsn(), 3);
+            records.clear();
+            log.replay(2, collect);
+            REQUIRE_EQ(records.size(), 1);
+            CHECK(records[0] == std::tuple(log_type::operation::insert, 3, 3, 2.5));
+        }
+        std::filesystem::remove_all(directory);
+    }
+
+    TEST_CASE_FIXTURE(btree_test_class, "incremental checkpoint") {
+        auto proj = [](auto const & e) -> decltype(auto) { return e.first; };
+        auto const path = std::filesystem::temp_directory_path() / "bt_test2_checkpoint.btree";
+        auto const full_path = std::filesystem::temp_directory_path() / "bt_test2_full.btree";
+        auto read_file = [](std::filesystem::path const &p) {
+            std::ifstream in(p, std::ios::binary);
+            return std::string(std::istreambuf_iterator<char>(in), {});
+        };
+        // after a checkpoint the file holds the same image as save_image()
+        auto check_image = [&](btree_type const &t, std::map<int, int> const &expected) {
+            {
+                std::ofstream out(full_path, std::ios::binary | std::ios::trunc);
+                t.save_image(out);
+            }
+            CHECK(read_file(path) == read_file(full_path));
+            mapped_btree<btree_type> mapped(path);
+            CHECK(mapped.verify());
+            CHECK_EQ(mapped.size(), expected.size());
+            check_equal(mapped, expected, getkey, proj);
+        };
+        btree_type tree;
+        std::map<int, int> map;
+        std::vector<int> keys(20'000);
+        std::iota(keys.begin(), keys.end(), 0);
+        std::ranges::shuffle(keys, std::mt19937{4711});
+        for (auto key : std::span(keys).first(10'000)) {
+            tree.insert(key, -key);
+            map.emplace(key, -key);
+        }
+        auto const fd = ::open(path.c_str(), O_RDWR | O_CREAT | O_TRUNC, 0644);
+        REQUIRE_GE(fd, 0);
+
+        // the first checkpoint writes all nodes
+        CHECK_EQ(tree.checkpoint(fd), tree.node_count());
+        check_image(tree, map);
+        CHECK_EQ(tree.checkpoint(fd), 0);
+        // reads mark no node
+        for (auto key : std::span(keys).first(100))
+            CHECK(std::as_const(tree).find(key) != tree.cend());
+        check_equal(std::as_const(tree), map, getkey, proj);
+        CHECK_EQ(tree.checkpoint(fd), 0);
+
+        // a few inserts write a few nodes
+        for (auto key : std::span(keys).subspan(10'000, 10)) {
+            tree.insert(key, -key);
+            map.emplace(key, -key);
+        }
+        auto const written = tree.checkpoint(fd);
+        CHECK_GT(written, 0);
+        CHECK_LE(written, 10 * 4);
+        check_image(tree, map);
+
+        // erases merge nodes and delete them, new nodes reuse their indices
+        for (auto key : std::span(keys).first(8'000)) {
+            tree.erase(tree.find(key));
+            map.erase(key);
+        }
+        tree.checkpoint(fd);
+        check_image(tree, map);
+        for (auto key : std::span(keys).subspan(10'010, 5'000)) {
+            tree.insert(key, -key);
+            map.emplace(key, -key);
+        }
+        tree.checkpoint(fd);
+        check_image(tree, map);
+        (*tree.find(keys[9'000])).second = 1;
+        map[keys[9'000]] = 1;
+        CHECK_EQ(tree.checkpoint(fd), 1);
+        check_image(tree, map);
+
+        // reorganize() and assignment change all nodes, the image shrinks or grows with the tree
+        tree.reorganize();
+        CHECK_EQ(tree.checkpoint(fd), tree.node_count());
+        check_image(tree, map);
+        btree_type other;
+        other.insert(1, 2);
+        tree = other;
+        CHECK_EQ(tree.checkpoint(fd), 1);
+        check_image(tree, {{1, 2}});
+        ::close(fd);
+        std::filesystem::remove(path);
+        std::filesystem::remove(full_path);
+    }
+
+    TEST_CASE("best_cache_line_order") {
+        static_assert(best_cache_line_order<btree_leaf_node, int, int, unsigned, 1>() == 5);
+        static_assert(best_cache_line_order<btree_internal_node, int, int, unsigned, 1>() == 5);
+        static_assert(best_cache_line_order<btree_leaf_node, int, int, unsigned, 4>() == 29);
+        static_assert(best_cache_line_order<btree_internal_node, int, int, unsigned, 4>() == 29);
+        static_assert(best_cache_line_order<btree_leaf_node, std::uint64_t, std::uint64_t, std::uint16_t, 2>() == 6);
+        static_assert(best_cache_line_order<btree_internal_node, std::uint64_t, std::uint64_t, std::uint16_t, 2>() == 10);
+        static_assert(best_cache_line_order<btree_leaf_node, std::uint64_t, std::uint64_t, std::uint32_t, 4>() == 14);
+        static_assert(best_cache_line_order<btree_internal_node, std::uint64_t, std::uint64_t, std::uint32_t, 4>() == 19);
+
+        static_assert(fills_cache_lines<btree_leaf_node, int, int, unsigned, 1,
+                                        best_cache_line_order<btree_leaf_node, int, int, unsigned, 1>()>);
+        static_assert(fills_cache_lines<btree_internal_node, int, int, unsigned, 4,
+                                        best_cache_line_order<btree_internal_node, int, int, unsigned, 4>()>);
+        static_assert(fills_cache_lines<btree_leaf_node, std::uint64_t, std::uint64_t, std::uint16_t, 2,
+                                        best_cache_line_order<btree_leaf_node, std::uint64_t, std::uint64_t, std::uint16_t, 2>()>);
+        static_assert(fills_cache_lines<btree_internal_node, std::uint64_t, std::uint64_t, std::uint32_t, 4,
+                                        best_cache_line_order<btree_internal_node, std::uint64_t, std::uint64_t, std::uint32_t, 4>()>);
+    }
+
+    TEST_CASE("bloom_filter") {
+        bloom_filter<int> filter(10'000);
+        CHECK_EQ(filter.bit_count(), 100'352);
+        CHECK_EQ(filter.hash_count(), 7);
+        for (int key = 0; key < 10'000; ++key)
+            filter.insert(key * 2);
+        int false_positives = 0;
+        for (int key = 0; key < 10'000; ++key) {
+            CHECK(filter.may_contain(key * 2));
+            false_positives += filter.may_contain(key * 2 + 1);
+        }
+        // about 1% with 10 bits per key
+        CHECK_LT(false_positives, 300);
+        CHECK_FALSE(bloom_filter<int>().may_contain(1));
+    }
+
+    TEST_CASE("latency_histogram") {
+        latency_histogram<> histogram;
+        CHECK_EQ(histogram.percentile(50), 0);
+        for (std::uint64_t value = 1; value <= 100'000; ++value)
+            histogram.record(value);
+        CHECK_EQ(histogram.count(), 100'000);
+        CHECK_EQ(histogram.min(), 1);
+        CHECK_EQ(histogram.max(), 100'000);
+        CHECK_EQ(histogram.mean(), doctest::Approx(50'000.5));
+        // exact below 256, within 1/128 above
+        CHECK_EQ(histogram.percentile(0.1), 100);
+        for (double percent: {50.0, 99.0, 99.9}) {
+            auto const exact = static_cast<double>(percent * 1'000);
+            CHECK_GE(static_cast<double>(histogram.percentile(percent)), exact);
+            CHECK_LE(static_cast<double>(histogram.percentile(percent)), exact * (1 + 1.0 / 128));
+        }
+        CHECK_EQ(histogram.percentile(100), 100'000);
+
+        latency_histogram<> other;
+        other.record(std::numeric_limits<std::uint64_t>::max());
+        other.record(0);
+        histogram.merge(other);
+        CHECK_EQ(histogram.count(), 100'002);
+        CHECK_EQ(histogram.min(), 0);
+        CHECK_EQ(histogram.percentile(100), std::numeric_limits<std::uint64_t>::max());
+        histogram.reset();
+        CHECK_EQ(histogram.count(), 0);
+        CHECK_EQ(histogram.max(), 0);
+    }
+
+    TEST_CASE_FIXTURE(btree_test_class, "lsm_btree") {
+        using lsm_type = lsm_btree<int, int, unsigned, 4, 4>;
+        auto const directory = std::filesystem::temp_directory_path() / "bt_test2_lsm";
+        std::filesystem::remove_all(directory);
+        std::filesystem::create_directories(directory);
+        auto check_entries = [](lsm_type const &tree, std::map<int, int> const &expected, int from) {
+            std::vector<std::pair<int, int>> actual;
+            for (auto [key, value] : tree.entries(from))
+                actual.emplace_back(key, value);
+            CHECK_EQ(actual, std::vector<std::pair<int, int>>(expected.lower_bound(from), expected.end()));
+        };
+        auto check_all = [&check_entries](lsm_type const &tree, std::map<int, int> const &expected) {
+            for (int key = -1; key <= 3'001; ++key) {
+                auto it = expected.find(key);
+                CHECK_EQ(tree.find(key), it == expected.end() ? std::nullopt : std::optional<int>(it->second));
+            }
+            check_entries(tree, expected, std::numeric_limits<int>::min());
+            check_entries(tree, expected, 1'500);
+            check_entries(tree, expected, 3'001);
+        };
+        auto rnd = std::mt19937{4711};
+        std::vector<int> keys(3'000);
+        std::iota(keys.begin(), keys.end(), 0);
+        std::ranges::shuffle(keys, rnd);
+        std::map<int, int> map;
+        lsm_type tree(100, 4, directory);
+        CHECK(tree.entries().begin() == std::default_sentinel);
+        for (auto key : keys) {
+            tree.insert(key, -key);
+            map.emplace(key, -key);
+        }
+        // newer values and tombstones hide the entries in older runs
+        for (std::size_t i = 0; i < keys.size(); i += 3) {
+            tree.erase(keys[i]);
+            map.erase(keys[i]);
+            tree.insert(keys[i + 1], 1);
+            map[keys[i + 1]] = 1;
+        }
+        check_all(tree, map);
+        tree.flush();
+        CHECK_EQ(tree.memtable_size(), 0);
+        CHECK_GT(tree.run_count(), 1);
+        check_all(tree, map);
+        auto const sizes = tree.run_sizes();
+        CHECK_GE(std::accumulate(sizes.begin(), sizes.end(), std::size_t(0)), map.size());
+        auto const stats = tree.stats();
+        CHECK_GE(stats.runs_written, 30);
+        // Bloom filters spare most lookups of missing keys in runs
+        for (int key = 3'000; key < 4'000; ++key)
+            CHECK_FALSE(tree.contains(key));
+        CHECK_GT(tree.stats().filtered_lookups - stats.filtered_lookups, tree.stats().run_lookups - stats.run_lookups);
+
+        // a full compaction leaves one run without tombstones
+        tree.compact();
+        CHECK_EQ(tree.run_sizes(), std::vector<std::size_t>{map.size()});
+        CHECK_GT(tree.stats().compactions, 0);
+        check_all(tree, map);
+        tree.erase(keys[1]);
+        map.erase(keys[1]);
+        tree.insert(-1, 7);
+        map.emplace(-1, 7);
+        check_all(tree, map);
+        for (auto const &[key, value] : map)
+            tree.erase(key);
+        tree.compact();
+        CHECK_EQ(tree.run_count(), 0);
+        CHECK(tree.entries().begin() == std::default_sentinel);
+        CHECK(std::filesystem::is_empty(directory));
+        std::filesystem::remove_all(directory);
+    }
+
+    TEST_CASE_FIXTURE(btree_test_class, "lsm_btree, failing background thread") {
+        using lsm_type = lsm_btree<int, int, unsigned, 4, 4>;
+        // no run can be created below a regular file, not even by root
+        auto const file = std::filesystem::temp_directory_path() / "bt_test2_lsm_file";
+        std::filesystem::remove_all(file);
+        std::ofstream(file).put('x');
+        lsm_type tree(10, 4, file / "runs");
+        for (int key = 0; key < 10; ++key)
+            tree.insert(key, -key);
+        CHECK_THROWS_AS(tree.flush(), std::system_error);
+        // the frozen memtable stays readable, writes fail
+        CHECK_EQ(tree.find(3), std::optional<int>(-3));
+        CHECK_EQ(tree.run_count(), 0);
+        CHECK_THROWS_AS(tree.insert(10, -10), std::system_error);
+        CHECK_THROWS_AS(tree.erase(3), std::system_error);
+        CHECK_THROWS_AS(tree.compact(), std::system_error);
+        CHECK_THROWS_AS(tree.flush(), std::system_error);
+        CHECK_EQ(tree.find(3), std::optional<int>(-3));
+        CHECK_FALSE(tree.contains(10));
+        std::filesystem::remove(file);
+    }
+
+    TEST_CASE_FIXTURE(btree_test_class, "value_log and separated_btree") {
+        using separated_type = separated_btree<btree<int, value_handle, unsigned, 4, 4>>;
+        auto const directory = std::filesystem::temp_directory_path() / "bt_test2_separated";
+        std::filesystem::remove_all(directory);
+        auto blob = [](int key, int version) {
+            // 1 to 1999 bytes
+            std::vector<std::byte> value(static_cast<std::size_t>((key * 37 + version) % 1999 + 1));
+            for (std::size_t i = 0; i < value.size(); ++i)
+                value[i] = static_cast<std::byte>(std::size_t(key + version) + i);
+            return value;
+        };
+        std::map<int, std::vector<std::byte>> map;
+        auto check_tree = [&map](separated_type const &tree) {
+            check_sane(tree.unsynchronized());
+            auto it = map.begin();
+            for (auto const &[key, handle] : tree.unsynchronized()) {
+                REQUIRE(it != map.end());
+                CHECK_EQ(key, it->first);
+                CHECK(tree.read(handle) == it->second);
+                ++it;
+            }
+            CHECK(it == map.end());
+            CHECK_FALSE(tree.contains(-1));
+        };
+        std::vector<int> keys(1'000);
+        std::iota(keys.begin(), keys.end(), 0);
+        std::ranges::shuffle(keys, std::mt19937{4711});
+        // segments of 64 KB hold a few dozen values
+        std::size_t const segment_size = 64 << 10;
+
+        SUBCASE("insert, replace, erase, collect and reopen") {
+            {
+                separated_type tree(directory, segment_size);
+                for (auto key : keys) {
+                    tree.insert(key, blob(key, 0));
+                    map[key] = blob(key, 0);
+                }
+                CHECK_EQ(tree.find(keys[0]), std::optional(blob(keys[0], 0)));
+                CHECK_EQ(tree.find(-1), std::nullopt);
+                auto const handle = tree.find_handle(keys[1]);
+                REQUIRE(handle.has_value());
+                CHECK_EQ(handle->length, blob(keys[1], 0).size());
+                CHECK_EQ(tree.log().live_size(), tree.log().size());
+                for (std::size_t i = 0; i < keys.size(); i += 2) {
+                    tree.insert(keys[i], blob(keys[i], 1));
+                    map[keys[i]] = blob(keys[i], 1);
+                    CHECK_EQ(tree.erase(keys[i + 1]), 1);
+                    map.erase(keys[i + 1]);
+                }
+                CHECK_EQ(tree.erase(keys[1]), 0);
+                check_tree(tree);
+                CHECK_LT(tree.log().live_size(), tree.log().size() / 2);
+            }
+            {
+                // the log is replayed
+                separated_type tree(directory, segment_size);
+                check_tree(tree);
+                auto const size = tree.log().size();
+                auto const segments = tree.log().segment_count();
+                auto const live = tree.log().live_size();
+                auto const freed = tree.collect_garbage();
+                CHECK_GT(freed, 0);
+                CHECK_EQ(tree.log().size(), size - freed);
+                CHECK_LT(tree.log().segment_count(), segments);
+                CHECK_EQ(tree.log().live_size(), live);
+                CHECK_LT(tree.log().oldest_garbage_ratio(), 0.5);
+                check_tree(tree);
+                // the garbage of all segments but the newest
+                tree.collect_garbage(0);
+                CHECK_EQ(tree.log().live_size(), live);
+                CHECK_LE(tree.log().size() - live, segment_size);
+                check_tree(tree);
+                // handles into collected segments are invalid
+                CHECK_THROWS_AS(tree.read(value_handle{0, 1}), std::runtime_error);
+                for (std::size_t i = 2; i < keys.size(); i += 4) {
+                    tree.insert(keys[i], blob(keys[i], 2));
+                    map[keys[i]] = blob(keys[i], 2);
+                }
+                tree.sync();
+            }
+            separated_type tree(directory, segment_size);
+            check_tree(tree);
+        }
+
+        SUBCASE("value_log, torn and corrupt records") {
+            std::filesystem::remove_all(directory);
+            using log_type = value_log<int>;
+            std::vector<std::pair<int, std::optional<value_handle>>> records;
+            auto collect = [&records](int key, std::optional<value_handle> handle) { records.emplace_back(key, handle); };
+            std::uint64_t size;
+            {
+                log_type log(directory, segment_size);
+                CHECK_EQ(log.segment_count(), 1);
+                auto const handle = log.append(1, blob(1, 0));
+                CHECK_EQ(handle.offset, 0);
+                log.append_erase(1);
+                CHECK_EQ(log.append(2, {}).length, 0);
+                CHECK(log.read(handle) == blob(1, 0));
+                CHECK_THROWS_AS(log.read(value_handle{handle.offset + 1, handle.length}), std::runtime_error);
+                CHECK_THROWS_AS(log.read(value_handle{handle.offset, handle.length - 1}), std::runtime_error);
+                log.release(handle);
+                CHECK_EQ(log.live_size(), sizeof(log_type::record_header));
+                size = log.size();
+                log.sync();
+            }
+            {
+                // a record cut short by a crash
+                std::ofstream segment(directory / "0.vlog", std::ios::binary | std::ios::app);
+                segment << "a record cut short by a crash";
+            }
+            log_type log(directory, segment_size);
+            CHECK_EQ(log.size(), size);
+            log.replay(collect);
+            REQUIRE_EQ(records.size(), 3);
+            CHECK_EQ(records[0].first, 1);
+            CHECK(records[0].second.has_value());
+            CHECK_EQ(records[1].first, 1);
+            CHECK_FALSE(records[1].second.has_value());
+            CHECK_EQ(records[2].second->length, 0);
+            // a value longer than a segment gets one of its own
+            log.append(3, std::vector<std::byte>(segment_size + 1));
+            CHECK_EQ(log.segment_count(), 2);
+            log.append(4, blob(4, 0));
+            CHECK_EQ(log.segment_count(), 3);
+        }
+        std::filesystem::remove_all(directory);
+    }
+}
@@ -18,7 +18,8 @@ namespace bt {
     public:
         using btree_type = btree<int, int, unsigned, 4, 4>;
 
-        static void check_find_each(btree_type const & tree, auto first, auto last) {
+        template<typename Btree_type>
+        static void check_find_each(Btree_type const & tree, auto first, auto last) {
             for (auto it = first; it != last; ++it) {
                 auto res = tree.find(*it);
                 CHECK_NE(res, tree.end());
@@ -27,7 +28,8 @@ namespace bt {
             }
         }
 
-        static void check_find_each(btree_type const & tree, auto first, auto last, auto&& proj) {
+        template<typename Btree_type>
+        static void check_find_each(Btree_type const & tree, auto first, auto last, auto&& proj) {
             auto p1 = std::forward<decltype(proj)>(proj);
             for (auto it = first; it != last; ++it) {
                 auto res = tree.find(p1(*it));
@@ -82,8 +84,8 @@ namespace bt {
             CHECK_LE(node.index(), tree.nodes_.size());
             CHECK_EQ(static_cast<void const *>(&node), static_cast<void const *>(&tree.nodes_[node.index()]));
             if (!tree.is_root(node.index())) {
-                CHECK_GE(node.size(), btree_type::traits::get_min_order<std::is_same_v<btree_type::leaf_node_type, typename Node_type::base_type>>());
-                CHECK_GE(node.keys().size(), btree_type::traits::get_min_order<std::is_same_v<btree_type::leaf_node_type, typename Node_type::base_type>>());
+                CHECK_GE(node.size(), Btree_type::traits::template get_min_order<Node_type::is_leaf()>());
+                CHECK_GE(node.keys().size(), Btree_type::traits::template get_min_order<Node_type::is_leaf()>());
             }
             CHECK_EQ(node.parent_index() == btree_type::INVALID_INDEX, tree.is_root(node.index()));
             CHECK_EQ(!node.has_parent(), tree.is_root(node.index()));
@@ -0,0 +1,479 @@
+//
+// Created by arnoldm on 19.10.26.
+//
+#define DOCTEST_CONFIG_IMPLEMENT_WITH_MAIN
+#include <doctest/doctest.h>
+#ifndef BTREE_TESTING
+#define BTREE_TESTING
+#endif
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <filesystem>
+#include <latch>
+#include <numeric>
+#include <random>
+#include <thread>
+#include <vector>
+#include "concurrent_btree.h"
+#include "durable_btree.h"
+#include "lsm_btree.h"
+#include "olc_btree.h"
+#include "separated_btree.h"
+#include "sharded_btree.h"
+#include "btree_test_class.h"
+
+using namespace bt;
+
+TEST_SUITE("concurrent_btree") {
+    static constexpr int THREADS = 4;
+    static constexpr int KEYS_PER_THREAD = 20'000;
+
+    // every thread owns the keys k with k % THREADS == thread, in random order
+    auto keys_of_thread(int thread) {
+        std::vector<int> keys;
+        for (int i = 0; i < KEYS_PER_THREAD; ++i)
+            keys.push_back(i * THREADS + thread);
+        std::ranges::shuffle(keys, std::mt19937{static_cast<unsigned>(thread)});
+        return keys;
+    }
+
+    template<typename Btree_type>
+    void insert_erase_concurrently(Btree_type &tree) {
+        std::atomic<int> failures = 0;
+        std::vector<std::thread> threads;
+        for (int t = 0; t < THREADS; ++t) {
+            threads.emplace_back([&tree, &failures, t] {
+                auto keys = keys_of_thread(t);
+                for (auto key : keys) {
+                    tree.insert(key, -key);
+                    if (tree.find(key) != std::optional<int>(-key))
+                        ++failures;
+                }
+                // erase every second key of this thread, the others have to stay visible
+                for (std::size_t i = 0; i < keys.size(); i += 2) {
+                    if (tree.erase(keys[i]) != 1)
+                        ++failures;
+                    if (tree.contains(keys[i]) || !tree.contains(keys[i + 1]))
+                        ++failures;
+                }
+            });
+        }
+        for (auto &thread : threads)
+            thread.join();
+        CHECK_EQ(failures.load(), 0);
+        if constexpr (requires { tree.stop_maintenance(); })
+            tree.stop_maintenance();
+        if constexpr (requires { tree.maintain(std::chrono::milliseconds(1)); }) {
+            // rebalance what deferred erases left, the tree must be sane afterwards
+            while (!tree.maintain(std::chrono::milliseconds(1))) {}
+            CHECK_EQ(tree.unsynchronized().deferred_count(), 0);
+        }
+
+        std::vector<int> expected;
+        for (int t = 0; t < THREADS; ++t) {
+            auto keys = keys_of_thread(t);
+            for (std::size_t i = 1; i < keys.size(); i += 2)
+                expected.push_back(keys[i]);
+        }
+        std::ranges::sort(expected);
+        auto const &unsynchronized = tree.unsynchronized();
+        btree_test_class::check_sane(unsynchronized);
+        std::vector<int> actual;
+        for (auto const &[key, value] : unsynchronized) {
+            actual.push_back(key);
+            CHECK_EQ(value, -key);
+        }
+        CHECK_EQ(actual, expected);
+    }
+
+    TEST_CASE("insert, find and erase from several threads") {
+        SUBCASE("small nodes") {
+            concurrent_btree<int, int, unsigned, 4, 4> tree;
+            insert_erase_concurrently(tree);
+        }
+        SUBCASE("bigger nodes, bstar_split, hysteresis") {
+            concurrent_btree<int, int, unsigned, 16, 32, bstar_split, rebalance_policy<25, 50, true>> tree;
+            insert_erase_concurrently(tree);
+        }
+        SUBCASE("deferred rebalancing, maintenance thread") {
+            concurrent_btree<int, int, unsigned, 4, 4, midpoint_split, rebalance_policy<50, 50, false, true>> tree;
+            tree.start_maintenance(std::chrono::microseconds(200), std::chrono::microseconds(50));
+            insert_erase_concurrently(tree);
+        }
+        SUBCASE("olc_btree, small nodes") {
+            olc_btree<int, int, unsigned, 4, 4> tree;
+            insert_erase_concurrently(tree);
+        }
+        SUBCASE("olc_btree, bigger nodes, bstar_split, hysteresis") {
+            olc_btree<int, int, unsigned, 16, 32, bstar_split, rebalance_policy<25, 50, true>> tree;
+            insert_erase_concurrently(tree);
+        }
+        SUBCASE("olc_btree, deferred rebalancing") {
+            olc_btree<int, int, unsigned, 4, 4, midpoint_split, rebalance_policy<50, 50, false, true>> tree;
+            insert_erase_concurrently(tree);
+        }
+    }
+
+    template<typename Btree_type>
+    void read_during_splits_and_merges(Btree_type &tree) {
+        // even keys stay, writers insert and erase odd keys and thereby split, merge and reuse nodes
+        for (int i = 0; i < 2 * KEYS_PER_THREAD; i += 2)
+            tree.insert(i, -i);
+        std::atomic<bool> done = false;
+        std::atomic<int> failures = 0;
+        std::vector<std::thread> threads;
+        for (int t = 0; t < THREADS / 2; ++t) {
+            threads.emplace_back([&tree, t] {
+                for (int round = 0; round < 3; ++round) {
+                    for (int key = 2 * t + 1; key < 2 * KEYS_PER_THREAD; key += THREADS)
+                        tree.insert(key, -key);
+                    for (int key = 2 * t + 1; key < 2 * KEYS_PER_THREAD; key += THREADS)
+                        tree.erase(key);
+                }
+            });
+        }
+        for (int t = 0; t < THREADS / 2; ++t) {
+            threads.emplace_back([&tree, &done, &failures, t] {
+                std::mt19937 rng{static_cast<unsigned>(t)};
+                while (!done) {
+                    auto key = 2 * static_cast<int>(rng() % KEYS_PER_THREAD);
+                    if (tree.find(key) != std::optional<int>(-key))
+                        ++failures;
+                }
+            });
+        }
+        for (int t = 0; t < THREADS / 2; ++t)
+            threads[static_cast<std::size_t>(t)].join();
+        done = true;
+        for (std::size_t t = THREADS / 2; t < threads.size(); ++t)
+            threads[t].join();
+        CHECK_EQ(failures.load(), 0);
+        btree_test_class::check_sane(tree.unsynchronized());
+        int count = 0;
+        for (auto const &[key, value] : tree.unsynchronized())
+            count += key % 2 == 0 && value == -key;
+        CHECK_EQ(count, KEYS_PER_THREAD);
+    }
+
+    TEST_CASE("readers during splits and merges") {
+        SUBCASE("concurrent_btree") {
+            concurrent_btree<int, int, unsigned, 4, 4> tree;
+            read_during_splits_and_merges(tree);
+        }
+        SUBCASE("concurrent_btree, bstar_split") {
+            concurrent_btree<int, int, unsigned, 8, 8, bstar_split> tree;
+            read_during_splits_and_merges(tree);
+        }
+        SUBCASE("olc_btree") {
+            olc_btree<int, int, unsigned, 4, 4> tree;
+            read_during_splits_and_merges(tree);
+        }
+    }
+
+    TEST_CASE("olc_btree readers beyond the thread slots") {
+        olc_btree<int, int, unsigned, 4, 4> tree;
+        for (int i = 0; i < 2 * KEYS_PER_THREAD; i += 2)
+            tree.insert(i, -i);
+        // all readers take their slot before any of them goes on: the last ones find none left
+        static constexpr auto READERS = thread_slot::MAX_THREADS + 8;
+        std::latch started(READERS);
+        std::atomic<int> failures = 0;
+        std::atomic<int> without_slot = 0;
+        std::vector<std::thread> threads;
+        for (std::size_t t = 0; t < READERS; ++t) {
+            threads.emplace_back([&tree, &started, &failures, &without_slot, t] {
+                if (!thread_slot::id())
+                    ++without_slot;
+                started.arrive_and_wait();
+                for (int i = 0; i < 100; ++i) {
+                    auto key = 2 * static_cast<int>((t * 100 + std::size_t(i)) % KEYS_PER_THREAD);
+                    if (tree.find(key) != std::optional<int>(-key))
+                        ++failures;
+                }
+            });
+        }
+        // merges and splits, whose deleted nodes are reused while readers without a slot run
+        for (int round = 0; round < 3; ++round) {
+            for (int key = 1; key < 2 * KEYS_PER_THREAD; key += 2)
+                tree.insert(key, -key);
+            for (int key = 1; key < 2 * KEYS_PER_THREAD; key += 2)
+                tree.erase(key);
+        }
+        for (auto &thread : threads)
+            thread.join();
+        CHECK_EQ(failures.load(), 0);
+        CHECK_GE(without_slot.load(), 8);
+        btree_test_class::check_sane(tree.unsynchronized());
+    }
+
+    TEST_CASE("storage policies") {
+        static_assert(concurrent_storage<vector_storage>);
+        static_assert(concurrent_storage<stable_storage>);
+        static_assert(concurrent_storage<aligned_node_storage<>>);
+        static_assert(concurrent_storage<aligned_node_storage<4096, true>>);
+        static_assert(!concurrent_storage<cow_storage<>>);
+        static_assert(!concurrent_storage<paged_storage<>>);
+
+        concurrent_btree<int, int, unsigned, 8, 8, midpoint_split, rebalance_policy<>, aligned_node_storage<>> tree;
+        for (int i = 0; i < 1'000; ++i)
+            CHECK(tree.insert(i, i));
+        CHECK_EQ(tree.find(500), 500);
+        btree_test_class::check_sane(tree.unsynchronized());
+    }
+
+    TEST_CASE("erase of missing keys") {
+        concurrent_btree<int, int, unsigned, 4, 4> tree;
+        CHECK_EQ(tree.erase(1), 0);
+        for (int i = 0; i < 100; i += 2)
+            tree.insert(i, i);
+        CHECK_EQ(tree.erase(1), 0);
+        CHECK_EQ(tree.erase(2), 1);
+        CHECK_EQ(tree.erase(2), 0);
+        CHECK_FALSE(tree.contains(2));
+        CHECK_EQ(tree.find(4), std::optional<int>(4));
+
+        olc_btree<int, int, unsigned, 4, 4> olc_tree;
+        CHECK_EQ(olc_tree.erase(1), 0);
+        CHECK_FALSE(olc_tree.contains(1));
+        olc_tree.insert(1, 1);
+        CHECK_EQ(olc_tree.erase(1), 1);
+        CHECK_EQ(olc_tree.erase(1), 0);
+    }
+
+    TEST_CASE("sharded_btree") {
+        SUBCASE("insert, find and erase from several threads") {
+            sharded_btree<int, int, unsigned, 4, 4> tree(std::vector<int>{KEYS_PER_THREAD, 2 * KEYS_PER_THREAD, 3 * KEYS_PER_THREAD});
+            std::atomic<int> failures = 0;
+            std::vector<std::thread> threads;
+            for (int t = 0; t < THREADS; ++t) {
+                threads.emplace_back([&tree, &failures, t] {
+                    auto keys = keys_of_thread(t);
+                    for (auto key : keys) {
+                        tree.insert(key, -key);
+                        if (tree.find(key) != std::optional<int>(-key))
+                            ++failures;
+                    }
+                    for (std::size_t i = 0; i < keys.size(); i += 2) {
+                        if (tree.erase(keys[i]) != 1)
+                            ++failures;
+                        if (tree.contains(keys[i]) || !tree.contains(keys[i + 1]))
+                            ++failures;
+                    }
+                });
+            }
+            for (auto &thread : threads)
+                thread.join();
+            CHECK_EQ(failures.load(), 0);
+
+            std::vector<int> expected;
+            for (int t = 0; t < THREADS; ++t) {
+                auto keys = keys_of_thread(t);
+                for (std::size_t i = 1; i < keys.size(); i += 2)
+                    expected.push_back(keys[i]);
+            }
+            std::ranges::sort(expected);
+            std::vector<int> actual;
+            for (auto const &[key, value] : tree) {
+                actual.push_back(key);
+                CHECK_EQ(value, -key);
+            }
+            CHECK_EQ(actual, expected);
+            CHECK_EQ(tree.size(), expected.size());
+            for (std::size_t i = 0; i < tree.shard_count(); ++i)
+                btree_test_class::check_sane(tree.shard(i));
+        }
+
+        SUBCASE("skewed keys move the boundaries") {
+            // all keys fall into one of the four equal ranges of int
+            sharded_btree<int, int, unsigned, 8, 8> tree(4);
+            std::vector<int> keys(100'000);
+            std::iota(keys.begin(), keys.end(), 0);
+            std::ranges::shuffle(keys, std::mt19937{4711});
+            for (auto key : keys)
+                tree.insert(key, key);
+            auto boundaries = tree.boundaries();
+            CHECK(std::ranges::is_sorted(boundaries));
+            CHECK_GT(boundaries.front(), 0);
+            CHECK_LT(boundaries[1], 100'000);
+            for (std::size_t i = 0; i < tree.shard_count(); ++i) {
+                CHECK_LE(tree.shard_size(i), 2 * keys.size() / tree.shard_count() + 1024);
+                btree_test_class::check_sane(tree.shard(i));
+            }
+            CHECK_EQ(tree.size(), keys.size());
+            int expected = 0;
+            for (auto const &[key, value] : tree)
+                CHECK_EQ(key, expected++);
+            CHECK_EQ(expected, 100'000);
+            for (int key = 0; key < 100'000; key += 7)
+                CHECK_EQ(tree.find(key), std::optional<int>(key));
+        }
+
+        SUBCASE("empty shards") {
+            sharded_btree<int, int, unsigned, 4, 4> tree(std::vector<int>{10, 20, 30});
+            CHECK(tree.begin() == tree.end());
+            tree.insert(25, 1);
+            CHECK(tree.begin() != tree.end());
+            CHECK_EQ((*tree.begin()).first, 25);
+            CHECK_THROWS_AS((sharded_btree<int, int, unsigned, 4, 4>(std::vector<int>{2, 1})), std::invalid_argument);
+        }
+    }
+
+    TEST_CASE("durable_btree") {
+        using durable_type = durable_btree<btree<int, int, unsigned, 4, 4>>;
+        auto const directory = std::filesystem::temp_directory_path() / "concurrent_test_durable";
+        std::filesystem::remove_all(directory);
+
+        SUBCASE("deferred commits, replayed after reopening") {
+            {
+                durable_type tree(directory, durable_type::commit_mode::deferred);
+                insert_erase_concurrently(tree);
+                CHECK_EQ(tree.log().sync_count(), 0);
+            }
+            durable_type tree(directory);
+            std::vector<int> expected;
+            for (int t = 0; t < THREADS; ++t) {
+                auto keys = keys_of_thread(t);
+                for (std::size_t i = 1; i < keys.size(); i += 2)
+                    expected.push_back(keys[i]);
+            }
+            std::ranges::sort(expected);
+            std::vector<int> actual;
+            for (auto const &[key, value] : tree.unsynchronized())
+                actual.push_back(key);
+            CHECK_EQ(actual, expected);
+            CHECK_EQ(tree.log().last_lsn(), THREADS * KEYS_PER_THREAD * 3 / 2);
+        }
+
+        SUBCASE("group commit") {
+            static constexpr int COMMITS_PER_THREAD = 500;
+            {
+                durable_type tree(directory);
+                std::vector<std::thread> threads;
+                for (int t = 0; t < THREADS; ++t) {
+                    threads.emplace_back([&tree, t] {
+                        for (int i = 0; i < COMMITS_PER_THREAD; ++i)
+                            tree.insert(i * THREADS + t, t);
+                    });
+                }
+                for (auto &thread : threads)
+                    thread.join();
+                CHECK_EQ(tree.log().durable_lsn(), THREADS * COMMITS_PER_THREAD);
+                // writers waiting for a sync share the next one
+                CHECK_LT(tree.log().sync_count(), THREADS * COMMITS_PER_THREAD);
+            }
+            durable_type tree(directory);
+            int count = 0;
+            for (auto const &[key, value] : tree.unsynchronized())
+                count += key % THREADS == value;
+            CHECK_EQ(count, THREADS * COMMITS_PER_THREAD);
+        }
+        std::filesystem::remove_all(directory);
+    }
+
+    TEST_CASE("lsm_btree") {
+        using lsm_type = lsm_btree<int, int, unsigned, 4, 4>;
+        // small memtables, so that runs are written and merged while the threads work
+        lsm_type tree(500, 3);
+        std::atomic<int> failures = 0;
+        std::atomic<bool> done = false;
+        std::vector<std::thread> threads;
+        for (int t = 0; t < THREADS; ++t) {
+            threads.emplace_back([&tree, &failures, t] {
+                auto keys = keys_of_thread(t);
+                for (auto key : keys) {
+                    tree.insert(key, -key);
+                    if (tree.find(key) != std::optional<int>(-key))
+                        ++failures;
+                }
+                for (std::size_t i = 0; i < keys.size(); i += 2) {
+                    tree.erase(keys[i]);
+                    if (tree.contains(keys[i]) || !tree.contains(keys[i + 1]))
+                        ++failures;
+                }
+            });
+        }
+        // a reader of the merged entries, which are in key order and unique
+        std::thread reader([&tree, &failures, &done] {
+            while (!done) {
+                int previous = -1;
+                for (auto [key, value] : tree.entries(KEYS_PER_THREAD)) {
+                    if (key <= previous || value != -key)
+                        ++failures;
+                    previous = key;
+                }
+            }
+        });
+        for (auto &thread : threads)
+            thread.join();
+        done = true;
+        reader.join();
+        CHECK_EQ(failures.load(), 0);
+        CHECK_GT(tree.stats().compactions, 0);
+
+        std::vector<int> expected;
+        for (int t = 0; t < THREADS; ++t) {
+            auto keys = keys_of_thread(t);
+            for (std::size_t i = 1; i < keys.size(); i += 2)
+                expected.push_back(keys[i]);
+        }
+        std::ranges::sort(expected);
+        tree.compact();
+        CHECK_EQ(tree.run_sizes(), std::vector<std::size_t>{expected.size()});
+        std::vector<int> actual;
+        for (auto [key, value] : tree.entries())
+            actual.push_back(key);
+        CHECK_EQ(actual, expected);
+    }
+
+    TEST_CASE("separated_btree") {
+        using separated_type = separated_btree<btree<int, value_handle, unsigned, 4, 4>>;
+        static constexpr int KEYS = 2'000;
+        auto const directory = std::filesystem::temp_directory_path() / "concurrent_test_separated";
+        std::filesystem::remove_all(directory);
+        // the value of a key in a version: its bytes repeat key + version
+        auto value_of = [](int key, int version) {
+            return std::vector<std::byte>(static_cast<std::size_t>(key % 100 + 1), static_cast<std::byte>(key + version));
+        };
+        {
+            separated_type tree(directory, 16 << 10);
+            std::atomic<int> failures = 0;
+            std::atomic<bool> done = false;
+            std::vector<std::thread> threads;
+            for (int t = 0; t < THREADS; ++t) {
+                threads.emplace_back([&tree, &failures, &value_of, t] {
+                    for (int version = 0; version < 3; ++version)
+                        for (int key = t; key < KEYS; key += THREADS) {
+                            tree.insert(key, value_of(key, version));
+                            if (tree.find(key) != value_of(key, version))
+                                ++failures;
+                        }
+                    for (int key = t; key < KEYS; key += 2 * THREADS)
+                        if (tree.erase(key) != 1 || tree.contains(key))
+                            ++failures;
+                });
+            }
+            // garbage collection moves the values the writers read
+            std::thread collector([&tree, &done] {
+                while (!done)
+                    tree.collect_garbage(0.3);
+            });
+            for (auto &thread : threads)
+                thread.join();
+            done = true;
+            collector.join();
+            CHECK_EQ(failures.load(), 0);
+            tree.sync();
+        }
+        separated_type tree(directory, 16 << 10);
+        int count = 0;
+        for (auto const &[key, handle] : tree.unsynchronized()) {
+            // every second key of each thread is erased
+            CHECK_GE(key % (2 * THREADS), THREADS);
+            CHECK(tree.read(handle) == value_of(key, 2));
+            ++count;
+        }
+        CHECK_EQ(count, KEYS / 2);
+        std::filesystem::remove_all(directory);
+    }
+}
@@ -0,0 +1,237 @@
+//
+// Created by arnoldm on 19.10.26.
+//
+#define DOCTEST_CONFIG_IMPLEMENT_WITH_MAIN
+#include <doctest/doctest.h>
+#include <algorithm>
+#include <array>
+#include <cerrno>
+#include <cstdint>
+#include <cstdlib>
+#include <filesystem>
+#include <numeric>
+#include <string>
+#include <system_error>
+#include <utility>
+#include <vector>
+#include <unistd.h>
+#include "async_io.h"
+#include "paged_vector.h"
+
+TEST_SUITE("paged_vector") {
+    using namespace bt;
+
+    TEST_CASE("push_back, pop_back and eviction") {
+        paged_vector<int, 16> pv;
+        CHECK(pv.empty());
+        CHECK_THROWS_AS([[maybe_unused]] auto ignore = pv.at(0), std::out_of_range);
+        for (int i = 0; i < 1000; ++i) {
+            pv.push_back(i);
+            CHECK_LE(pv.resident_count(), 16);
+        }
+        CHECK_EQ(pv.size(), 1000);
+        CHECK_GT(pv.stats().evictions, 0);
+        // the evicted elements are read back from the page file
+        for (int i = 0; i < 1000; ++i)
+            CHECK_EQ(std::as_const(pv)[std::size_t(i)], i);
+        for (int i = 0; i < 1000; ++i)
+            pv[std::size_t(i)] *= 2;
+        for (int i = 999; i >= 0; --i)
+            CHECK_EQ(std::as_const(pv)[std::size_t(i)], 2 * i);
+        pv.pop_back();
+        CHECK_EQ(pv.back(), 2 * 998);
+        pv.erase(pv.begin() + 500, pv.end());
+        CHECK_EQ(pv.size(), 500);
+        // a page left by an erased element is reused
+        pv.emplace_back(-1);
+        CHECK_EQ(std::as_const(pv)[500], -1);
+        CHECK_THROWS_AS(pv.erase(pv.begin(), pv.begin() + 1), std::invalid_argument);
+    }
+
+    TEST_CASE("const access writes no pages") {
+        paged_vector<std::array<int, 2000>, 16> pv;
+        for (int i = 0; i < 100; ++i)
+            pv.push_back({i, -i});
+        CHECK_EQ(pv.PAGE_BYTES, 8192);
+        pv.flush();
+        pv.reset_stats();
+        for (std::size_t i = 0; i < 100; ++i)
+            CHECK_EQ(std::as_const(pv)[i][0], int(i));
+        CHECK_EQ(pv.stats().writes, 0);
+        CHECK_GT(pv.stats().misses, 0);
+        CHECK_LT(pv.stats().hit_rate(), 1.0);
+        // a dirty page is written once when it is evicted
+        pv[0][1] = 42;
+        for (std::size_t i = 1; i < 100; ++i)
+            CHECK_EQ(std::as_const(pv)[i][1], -int(i));
+        CHECK_EQ(pv.stats().writes, 1);
+        CHECK_EQ(std::as_const(pv)[0][1], 42);
+    }
+
+    TEST_CASE("pin and unpin") {
+        paged_vector<int, 16> pv;
+        for (int i = 0; i < 100; ++i)
+            pv.push_back(i);
+        auto const &first = pv.pin(0);
+        for (int round = 0; round < 3; ++round)
+            for (std::size_t i = 1; i < 100; ++i)
+                CHECK_EQ(std::as_const(pv)[i], int(i));
+        CHECK_EQ(&first, &std::as_const(pv)[0]);
+        CHECK_EQ(first, 0);
+        pv.unpin(0);
+        for (std::size_t i = 0; i < 16; ++i)
+            [[maybe_unused]] auto const &ignore = pv.pin(i);
+        CHECK_THROWS_AS([[maybe_unused]] auto const &ignore = pv.pin(50), std::runtime_error);
+        for (std::size_t i = 0; i < 16; ++i)
+            pv.unpin(i);
+        CHECK_EQ(std::as_const(pv)[50], 50);
+    }
+
+    TEST_CASE("failed reads keep the frames") {
+        paged_vector<int, 16> pv;
+        for (int i = 0; i < 100; ++i)
+            pv.push_back(i);
+        // the failed reads below take the frames freed here
+        pv.erase(pv.begin() + 90, pv.end());
+        pv.flush();
+        auto const resident = pv.resident_count();
+        REQUIRE_LT(resident, 16);
+        // truncate the page file, found among the open files, so that reading an evicted page fails
+        auto truncated = false;
+        for (auto const &entry : std::filesystem::directory_iterator("/proc/self/fd")) {
+            std::error_code error;
+            auto const target = std::filesystem::read_symlink(entry.path(), error).string();
+            if (!error && target.find("bt_paged_vector") != std::string::npos)
+                truncated = ::ftruncate(std::stoi(entry.path().filename().string()), 0) == 0;
+        }
+        REQUIRE(truncated);
+        for (std::size_t i = 0; i < 40; ++i) {
+            CHECK_THROWS_AS([[maybe_unused]] auto ignore = std::as_const(pv)[i], std::system_error);
+            CHECK_EQ(pv.resident_count(), resident);
+        }
+        // the resident pages are still there, the free frames take new elements
+        CHECK_EQ(std::as_const(pv)[89], 89);
+        for (int i = 90; i < 100; ++i)
+            pv.push_back(i);
+        CHECK_EQ(pv.resident_count(), 16);
+        CHECK_EQ(std::as_const(pv)[99], 99);
+    }
+
+    TEST_CASE("copy, move and iterators") {
+        paged_vector<int, 16> pv;
+        for (int i = 0; i < 1000; ++i)
+            pv.push_back(i);
+        auto copy = pv;
+        CHECK(std::ranges::equal(copy, pv));
+        auto moved = std::move(copy);
+        CHECK(copy.empty());
+        CHECK(std::ranges::equal(moved, pv));
+        CHECK_EQ(std::accumulate(pv.cbegin(), pv.cend(), 0), 999 * 1000 / 2);
+        std::ranges::reverse(moved);
+        CHECK_EQ(moved.front(), 999);
+        CHECK_EQ(moved.back(), 0);
+        CHECK_EQ(*std::ranges::find(pv, 500), 500);
+        moved = pv;
+        CHECK(std::ranges::equal(moved, pv));
+        moved.clear();
+        CHECK(moved.empty());
+        CHECK_EQ(moved.resident_count(), 0);
+    }
+
+    TEST_CASE("async_reader") {
+        auto path = (std::filesystem::temp_directory_path() / "pv_test.XXXXXX").string();
+        auto const fd = ::mkstemp(path.data());
+        REQUIRE_GE(fd, 0);
+        ::unlink(path.c_str());
+        static constexpr std::size_t PAGES = 100;
+        static constexpr std::size_t PAGE = 512;
+        std::vector<std::uint32_t> content(PAGES * PAGE / sizeof(std::uint32_t));
+        std::iota(content.begin(), content.end(), 0U);
+        REQUIRE_EQ(::pwrite(fd, content.data(), PAGES * PAGE, 0), ssize_t(PAGES * PAGE));
+
+        for (auto backend : {io_backend::io_uring, io_backend::threads}) {
+            CAPTURE(int(backend));
+            async_reader reader(8, backend);
+            if (backend == io_backend::threads)
+                CHECK_EQ(reader.backend(), io_backend::threads);
+            std::vector<std::uint32_t> buffer(content.size(), 0);
+            std::vector<read_completion> completions;
+            for (std::size_t page = 0; page < PAGES; ++page) {
+                if (reader.in_flight() == reader.queue_depth())
+                    reader.reap(completions);
+                // backwards, every page into its place
+                auto const reverse = PAGES - 1 - page;
+                reader.read(fd, buffer.data() + reverse * PAGE / sizeof(std::uint32_t), PAGE, reverse * PAGE, reverse);
+            }
+            reader.reap(completions, reader.in_flight());
+            CHECK_EQ(reader.in_flight(), 0);
+            REQUIRE_EQ(completions.size(), PAGES);
+            std::vector<bool> seen(PAGES);
+            for (auto const &completion : completions) {
+                CHECK_EQ(completion.result, std::int64_t(PAGE));
+                seen[completion.tag] = true;
+            }
+            CHECK(std::ranges::all_of(seen, std::identity{}));
+            CHECK(std::ranges::equal(buffer, content));
+
+            completions.clear();
+            std::vector<std::uint32_t> scratch(PAGE * reader.queue_depth() / sizeof(std::uint32_t));
+            for (unsigned i = 0; i < reader.queue_depth(); ++i)
+                reader.read(fd, scratch.data() + i * PAGE / sizeof(std::uint32_t), PAGE, 0, i);
+            CHECK_THROWS_AS(reader.read(fd, buffer.data(), PAGE, 0, 0), std::length_error);
+            reader.reap(completions, reader.in_flight());
+            CHECK_EQ(completions.size(), reader.queue_depth());
+
+            // a read at the end of the file reads nothing, one of an invalid descriptor fails
+            completions.clear();
+            reader.read(fd, buffer.data(), PAGE, PAGES * PAGE, 1);
+            reader.read(-1, buffer.data(), PAGE, 0, 2);
+            reader.reap(completions, 2);
+            REQUIRE_EQ(completions.size(), 2);
+            std::ranges::sort(completions, {}, &read_completion::tag);
+            CHECK_EQ(completions[0].result, 0);
+            CHECK_EQ(completions[1].result, -EBADF);
+        }
+        ::close(fd);
+    }
+
+    TEST_CASE("prefetch") {
+        paged_vector<std::array<int, 100>, 16> pv;
+        // nothing to read while all pages are in memory
+        pv.prefetch(std::vector<std::size_t>{0, 1});
+        CHECK_EQ(pv.stats().prefetches, 0);
+        for (int i = 0; i < 200; ++i)
+            pv.push_back({i});
+        pv.reset_stats();
+        std::vector<std::size_t> indices{10, 11, 12, 11, 13, 14, 15, 16, 17, 1000};
+        pv.prefetch(indices);
+        // duplicates and indices out of range are skipped
+        CHECK_EQ(pv.stats().prefetches, 8);
+        CHECK_EQ(pv.stats().misses, 0);
+        for (std::size_t i = 10; i < 18; ++i)
+            CHECK_EQ(std::as_const(pv)[i][0], int(i));
+        CHECK_EQ(pv.stats().misses, 0);
+        CHECK_EQ(pv.stats().hits, 8);
+        // at most Frames / 2 pages per call
+        std::vector<std::size_t> all(200);
+        std::iota(all.begin(), all.end(), std::size_t(0));
+        pv.reset_stats();
+        pv.prefetch(all);
+        CHECK_LE(pv.stats().prefetches, 8);
+        CHECK_LE(pv.resident_count(), 16);
+        for (std::size_t i = 0; i < 200; ++i)
+            CHECK_EQ(std::as_const(pv)[i][0], int(i));
+    }
+
+    TEST_CASE("direct I/O") {
+        paged_vector<std::array<int, 1024>, 16, 4096, true> pv;
+        for (int i = 0; i < 100; ++i)
+            pv.push_back({i, -i});
+        pv.prefetch(std::vector<std::size_t>{0, 1, 2, 3});
+        for (std::size_t i = 0; i < 100; ++i) {
+            CHECK_EQ(std::as_const(pv)[i][0], int(i));
+            CHECK_EQ(std::as_const(pv)[i][1], -int(i));
+        }
+        CHECK_GT(pv.stats().writes, 0);
+    }
+}
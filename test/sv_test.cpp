@@ -0,0 +1,82 @@
+//
+// Created by arnoldm on 19.10.26.
+//
+#define DOCTEST_CONFIG_IMPLEMENT_WITH_MAIN
+#include <doctest/doctest.h>
+#include <algorithm>
+#include <numeric>
+#include <thread>
+#include <vector>
+#include "test_class.h"
+#include "stable_vector.h"
+
+TEST_SUITE("stable_vector") {
+    using namespace bt;
+
+    TEST_CASE("push_back, pop_back and element addresses") {
+        unsigned saved_counter = TestClass::ctor_counter_; {
+            stable_vector<TestClass, 4> sv;
+            CHECK(sv.empty());
+            CHECK_THROWS_AS([[maybe_unused]] auto ignore = sv.at(0), std::out_of_range);
+            std::vector<TestClass const *> addresses;
+            for (unsigned i = 0; i < 100; ++i) {
+                sv.push_back(TestClass(i));
+                addresses.push_back(&sv.back());
+                CHECK_EQ(sv.size(), i + 1);
+            }
+            CHECK_EQ(TestClass::ctor_counter_, saved_counter + 100);
+            for (unsigned i = 0; i < 100; ++i) {
+                CHECK_EQ(sv[i], TestClass(i));
+                CHECK_EQ(&sv[i], addresses[i]);
+            }
+            CHECK_EQ(std::distance(sv.begin(), sv.end()), 100);
+            CHECK_EQ(sv.front(), TestClass(0));
+            sv.pop_back();
+            CHECK_EQ(sv.back(), TestClass(98));
+            sv.erase(sv.begin() + 50, sv.end());
+            CHECK_EQ(sv.size(), 50);
+            CHECK_EQ(TestClass::ctor_counter_, saved_counter + 50);
+            // the chunks stay, new elements go where the erased ones were
+            sv.emplace_back(50U);
+            CHECK_EQ(&sv.back(), addresses[50]);
+            CHECK_THROWS_AS(sv.erase(sv.begin(), sv.begin() + 1), std::invalid_argument);
+        }
+        CHECK_EQ(TestClass::ctor_counter_, saved_counter);
+    }
+
+    TEST_CASE("copy, move and iterators") {
+        stable_vector<int, 8> sv;
+        for (int i = 0; i < 1000; ++i)
+            sv.push_back(i);
+        auto copy = sv;
+        CHECK(std::ranges::equal(copy, sv));
+        auto moved = std::move(copy);
+        CHECK(copy.empty());
+        CHECK(std::ranges::equal(moved, sv));
+        CHECK_EQ(std::accumulate(sv.cbegin(), sv.cend(), 0), 999 * 1000 / 2);
+        std::ranges::reverse(moved);
+        CHECK_EQ(moved.front(), 999);
+        CHECK_EQ(*std::ranges::find(sv, 500), 500);
+        moved = sv;
+        CHECK(std::ranges::equal(moved, sv));
+        moved.clear();
+        CHECK(moved.empty());
+    }
+
+    TEST_CASE("read while another thread appends") {
+        stable_vector<int, 1> sv;
+        sv.push_back(0);
+        int const *p_first = &sv[0];
+        std::thread writer([&sv] {
+            for (int i = 1; i < 100'000; ++i)
+                sv.push_back(i);
+        });
+        bool ok = true;
+        while (sv.size() < 100'000) {
+            auto size = sv.size();
+            ok = ok && sv[size - 1] == int(size - 1) && &sv[0] == p_first;
+        }
+        writer.join();
+        CHECK(ok);
+    }
+}